@@ -0,0 +1,146 @@
+/**
+ * bt_transport.c - DualShock 4 and DualSense reports over Bluetooth
+ *
+ * Implementation of the CRC trailer checks and of the input report
+ * rewrite. Every full input report is checked, so the CRC runs at the
+ * report rate of each controller; crc32_update() folds eight bytes per
+ * step to keep that cheap.
+ */
+
+#include "bt_transport.h"
+#include "controller_info.h"
+#include "hid_io.h"
+#include "mac_utils.h"
+#include "crc32.h"
+#include <string.h>
+
+/* Report ID of the USB input report */
+#define USB_INPUT_REPORT_ID 0x01
+
+/**
+ * Computes the CRC-32 of a Bluetooth report
+ */
+uint32_t bt_report_crc(unsigned char seed, const unsigned char *report, size_t length)
+{
+    return crc32_update(crc32(&seed, 1), report, length);
+}
+
+/**
+ * Checks the CRC trailer of a Bluetooth report
+ */
+int bt_report_valid(unsigned char seed, const unsigned char *report, size_t length)
+{
+    const unsigned char *trailer;
+    uint32_t stored;
+
+    if (length <= BT_CRC_LENGTH)
+        return 0;
+    trailer = report + length - BT_CRC_LENGTH;
+    stored = (uint32_t)trailer[0] | ((uint32_t)trailer[1] << 8) | ((uint32_t)trailer[2] << 16) |
+             ((uint32_t)trailer[3] << 24);
+    return bt_report_crc(seed, report, length - BT_CRC_LENGTH) == stored;
+}
+
+/**
+ * Writes the CRC trailer of a Bluetooth report
+ */
+void bt_report_seal(unsigned char seed, unsigned char *report, size_t length)
+{
+    uint32_t crc = bt_report_crc(seed, report, length - BT_CRC_LENGTH);
+    unsigned char *trailer = report + length - BT_CRC_LENGTH;
+
+    trailer[0] = (unsigned char)crc;
+    trailer[1] = (unsigned char)(crc >> 8);
+    trailer[2] = (unsigned char)(crc >> 16);
+    trailer[3] = (unsigned char)(crc >> 24);
+}
+
+/**
+ * Reads a feature report from a controller on Bluetooth and checks its CRC
+ */
+int bt_get_feature_report(hid_device *dev, unsigned char *report, size_t length)
+{
+    int ret = hid_io_get_feature_report(dev, report, length);
+
+    if (ret < (int)length || !bt_report_valid(BT_SEED_FEATURE, report, length))
+        return -1;
+    return ret;
+}
+
+/**
+ * Turns a full Bluetooth input report into the controller's USB layout
+ */
+int bt_normalize_input(unsigned short product_id, input_report_t *report)
+{
+    size_t header;
+
+    if (report->length == 0)
+        return 1;
+    if (product_id == PRODUCT_DS4 && report->data[0] == DS4_BT_INPUT_REPORT_ID)
+        header = 2;
+    else if ((product_id == PRODUCT_DUALSENSE || product_id == PRODUCT_DUALSENSE_EDGE) &&
+             report->data[0] == DUALSENSE_BT_INPUT_REPORT_ID)
+        header = 1;
+    else
+        return 1;
+
+    if (report->length < BT_INPUT_LENGTH || !bt_report_valid(BT_SEED_INPUT, report->data, BT_INPUT_LENGTH))
+        return 0;
+
+    memmove(report->data + 1, report->data + 1 + header, BT_INPUT_LENGTH - BT_CRC_LENGTH - 1 - header);
+    report->data[0] = USB_INPUT_REPORT_ID;
+    report->length = (uint32_t)(BT_INPUT_LENGTH - BT_CRC_LENGTH - header);
+    return 1;
+}
+
+/**
+ * Wraps a USB output report for a controller on Bluetooth
+ */
+size_t bt_wrap_output(unsigned short product_id, const unsigned char *usb, size_t length, unsigned char *bt)
+{
+    size_t body = BT_OUTPUT_LENGTH - BT_CRC_LENGTH - 3;
+
+    memset(bt, 0, BT_OUTPUT_LENGTH);
+    if (product_id == PRODUCT_DS4 && usb[0] == DS4_OUTPUT_REPORT_ID)
+    {
+        /* HID and CRC flags, no audio */
+        bt[0] = DS4_BT_OUTPUT_REPORT_ID;
+        bt[1] = 0xc0;
+    }
+    else if ((product_id == PRODUCT_DUALSENSE || product_id == PRODUCT_DUALSENSE_EDGE) &&
+             usb[0] == DUALSENSE_OUTPUT_REPORT_ID)
+    {
+        /* Sequence number 0, then the output tag */
+        bt[0] = DUALSENSE_BT_OUTPUT_REPORT_ID;
+        bt[2] = 0x10;
+    }
+    else
+        return 0;
+
+    memcpy(bt + 3, usb + 1, length - 1 < body ? length - 1 : body);
+    bt_report_seal(BT_SEED_OUTPUT, bt, BT_OUTPUT_LENGTH);
+    return BT_OUTPUT_LENGTH;
+}
+
+/**
+ * Gets the address of a controller on Bluetooth
+ */
+int bt_device_address(hid_device *dev, unsigned char *mac)
+{
+    struct hid_device_info *info = hid_io_get_device_info(dev);
+    char serial[18];
+    size_t length = 0;
+
+    if (!info || !info->serial_number)
+        return 0;
+    while (length < sizeof(serial) - 1 && info->serial_number[length])
+    {
+        if (info->serial_number[length] > 0x7f)
+            return 0;
+        serial[length] = (char)info->serial_number[length];
+        length++;
+    }
+    serial[length] = '\0';
+
+    return (length == 12 || length == 17) && mac_to_bytes(serial, length, mac, 6);
+}
@@ -0,0 +1,130 @@
+/**
+ * bt_transport.h - DualShock 4 and DualSense reports over Bluetooth
+ *
+ * Over Bluetooth a DualShock 4 or DualSense ends its feature, output and
+ * full input reports with a CRC-32 of the report, seeded with the byte of
+ * the HID transaction header it travels in (0xA1 input, 0xA2 output, 0xA3
+ * feature), stored little-endian in the last 4 bytes. The full input
+ * reports also carry a different report ID and extra header bytes in front
+ * of the USB layout:
+ *
+ *   DualShock 4  0x11, 78 bytes: ID, 2 header bytes, USB report from byte 1
+ *   DualSense    0x31, 78 bytes: ID, 1 header byte, USB report from byte 1
+ *
+ * Output reports are 0x11 (DualShock 4) and 0x31 (DualSense), 78 bytes:
+ * ID, 2 header bytes, the USB output report from byte 1, zero padding.
+ *
+ * Feature reports keep their USB layout with the CRC appended, except for
+ * the DualShock 4 calibration, which is report 0x05 instead of 0x02 and
+ * orders its gyro references differently.
+ */
+
+#ifndef BT_TRANSPORT_H
+#define BT_TRANSPORT_H
+
+#include "platform_compat.h"
+#include "report_ring.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Seeds: the HID transaction header byte the report travels in */
+#define BT_SEED_INPUT 0xa1
+#define BT_SEED_OUTPUT 0xa2
+#define BT_SEED_FEATURE 0xa3
+
+/* Length of the CRC trailer */
+#define BT_CRC_LENGTH 4
+
+/* Full input reports */
+#define DS4_BT_INPUT_REPORT_ID 0x11
+#define DUALSENSE_BT_INPUT_REPORT_ID 0x31
+#define BT_INPUT_LENGTH 78
+
+/* Output reports */
+#define DS4_BT_OUTPUT_REPORT_ID 0x11
+#define DUALSENSE_BT_OUTPUT_REPORT_ID 0x31
+#define BT_OUTPUT_LENGTH 78
+
+/* DualShock 4 calibration over Bluetooth, CRC included */
+#define DS4_BT_CALIBRATION_REPORT_ID 0x05
+#define DS4_BT_CALIBRATION_LENGTH 41
+
+/**
+ * Computes the CRC-32 of a Bluetooth report
+ *
+ * @param seed Transaction header byte (BT_SEED_*)
+ * @param report The report including its ID
+ * @param length Length of the report before the CRC trailer
+ * @return The CRC
+ */
+uint32_t bt_report_crc(unsigned char seed, const unsigned char *report, size_t length);
+
+/**
+ * Checks the CRC trailer of a Bluetooth report
+ *
+ * @param seed Transaction header byte (BT_SEED_*)
+ * @param report The report including its ID and trailer
+ * @param length Length of the report including the trailer
+ * @return 1 if the trailer matches, 0 otherwise or if the report is too short
+ */
+int bt_report_valid(unsigned char seed, const unsigned char *report, size_t length);
+
+/**
+ * Writes the CRC trailer of a Bluetooth report
+ *
+ * @param seed Transaction header byte (BT_SEED_*)
+ * @param report The report; its last BT_CRC_LENGTH bytes receive the CRC
+ * @param length Length of the report including the trailer
+ */
+void bt_report_seal(unsigned char seed, unsigned char *report, size_t length);
+
+/**
+ * Reads a feature report from a controller on Bluetooth and checks its CRC
+ *
+ * @param dev Handle to the HID device
+ * @param report Buffer with the report ID in its first byte
+ * @param length Length of the report including the trailer
+ * @return Number of bytes read, or -1 on failure or a CRC mismatch
+ */
+int bt_get_feature_report(hid_device *dev, unsigned char *report, size_t length);
+
+/**
+ * Turns a full Bluetooth input report into the controller's USB layout
+ *
+ * DualShock 4 report 0x11 and DualSense report 0x31 are checked and
+ * rewritten in place as report 0x01; every other report is left as it is.
+ *
+ * @param product_id Product ID of the controller
+ * @param report The report as read
+ * @return 1 if the report can be decoded, 0 if its CRC does not match
+ */
+int bt_normalize_input(unsigned short product_id, input_report_t *report);
+
+/**
+ * Wraps a USB output report for a controller on Bluetooth
+ *
+ * DualShock 4 report 0x05 becomes report 0x11 and DualSense report 0x02
+ * becomes report 0x31, with the header bytes in front, zero padding and
+ * the CRC trailer.
+ *
+ * @param product_id Product ID of the controller
+ * @param usb The USB output report including its ID
+ * @param length Length of the USB report
+ * @param bt Receives BT_OUTPUT_LENGTH bytes
+ * @return BT_OUTPUT_LENGTH, or 0 if the report has no Bluetooth form
+ */
+size_t bt_wrap_output(unsigned short product_id, const unsigned char *usb, size_t length, unsigned char *bt);
+
+/**
+ * Gets the address of a controller on Bluetooth
+ *
+ * The host's HID stack reports the controller's address as its serial
+ * number.
+ *
+ * @param dev Handle to the HID device
+ * @param mac Receives the address, most significant byte first
+ * @return 1 on success, 0 if the serial number is not an address
+ */
+int bt_device_address(hid_device *dev, unsigned char *mac);
+
+#endif /* BT_TRANSPORT_H */
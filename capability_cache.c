@@ -0,0 +1,527 @@
+/**
+ * capability_cache.c - Persistent matrix of the feature reports devices answer
+ *
+ * Implementation of the mapped capability file and of device bindings. The
+ * entries form an open-addressing hash table of FNV-1a hashed keys with
+ * linear probing; a free entry is claimed by a compare-and-swap on its key,
+ * so threads and processes sharing the file never claim one twice. State
+ * bytes are plain stores: two writers racing on one report lose a failure
+ * count at worst. Bindings tie an open device handle to its entry the way
+ * the flight recorder ties it to a ring, and hold the session's failures
+ * until the device is released.
+ */
+
+#include "capability_cache.h"
+#include "controller_info.h"
+#include "hid_io.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifdef PLATFORM_WINDOWS
+    #include <windows.h>
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+/* File identification */
+#define CAPABILITY_MAGIC 0x43505853u    /* "SXPC" */
+#define CAPABILITY_VERSION 1
+
+/* Report states; values in between count failed sessions */
+#define STATE_UNKNOWN 0x00
+#define STATE_WORKS 0xff
+#define STATE_MAX_FAILURES 0xfe
+
+/**
+ * One report of an entry
+ */
+typedef struct {
+    uint16_t size;
+    uint8_t get;
+    uint8_t set;
+} report_state_t;
+
+/**
+ * One kind of device
+ */
+typedef struct {
+    _Atomic uint64_t key;
+    uint64_t reserved;
+    report_state_t reports[256];
+} capability_entry_t;
+
+/**
+ * File header
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t entry_size;
+    uint64_t reserved;
+} capability_header_t;
+
+/* Size of the mapped file */
+#define CAPABILITY_FILE_SIZE (sizeof(capability_header_t) + CAPABILITY_MAX_ENTRIES * sizeof(capability_entry_t))
+
+/**
+ * An open device and the session it is in
+ */
+typedef struct {
+    _Atomic(hid_device *) owner;
+    uint64_t key;
+    uint16_t firmware;
+    int answered;                       /* Some request succeeded this session */
+    uint8_t failed[2][32];              /* Failed requests, by op, one bit per report ID */
+} binding_t;
+
+int capability_cache_enabled = 1;
+
+static char file_path[512];
+static atomic_flag map_lock = ATOMIC_FLAG_INIT;
+static _Atomic(capability_entry_t *) entries = NULL;
+static capability_header_t *header = NULL;
+static int map_failed = 0;
+static binding_t bindings[CAPABILITY_MAX_DEVICES];
+
+#ifdef PLATFORM_WINDOWS
+static HANDLE file_handle = INVALID_HANDLE_VALUE;
+static HANDLE mapping = NULL;
+#endif
+
+/**
+ * Sets the capability file
+ */
+void capability_cache_set_file(const char *path)
+{
+    if (!path || !*path)
+    {
+        file_path[0] = '\0';
+        return;
+    }
+    strncpy(file_path, path, sizeof(file_path) - 1);
+    file_path[sizeof(file_path) - 1] = '\0';
+}
+
+/**
+ * Fills in the per-user default file path if none was set
+ */
+static void resolve_file_path(void)
+{
+    const char *base;
+
+    if (file_path[0])
+        return;
+
+#ifdef PLATFORM_WINDOWS
+    base = getenv("LOCALAPPDATA");
+    snprintf(file_path, sizeof(file_path), "%s%ssixaxispairer-capabilities.bin", base ? base : ".", PATH_SEPARATOR);
+#else
+    base = getenv("XDG_CACHE_HOME");
+    if (base && *base)
+        snprintf(file_path, sizeof(file_path), "%s/sixaxispairer-capabilities.bin", base);
+    else if ((base = getenv("HOME")) != NULL && *base)
+        snprintf(file_path, sizeof(file_path), "%s/.cache/sixaxispairer-capabilities.bin", base);
+    else
+        snprintf(file_path, sizeof(file_path), "sixaxispairer-capabilities.bin");
+#endif
+}
+
+#ifdef PLATFORM_WINDOWS
+
+/**
+ * Maps the file, growing it to size; sets *fresh if it had another size
+ */
+static void* map_file(const char *path, size_t size, int *fresh)
+{
+    LARGE_INTEGER length;
+    void *base = NULL;
+
+    file_handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE)
+        return NULL;
+    *fresh = !GetFileSizeEx(file_handle, &length) || (size_t)length.QuadPart != size;
+    mapping = CreateFileMappingA(file_handle, NULL, PAGE_READWRITE, 0, (DWORD)size, NULL);
+    if (mapping)
+        base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!base)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file_handle);
+        mapping = NULL;
+        file_handle = INVALID_HANDLE_VALUE;
+    }
+    return base;
+}
+
+/**
+ * Unmaps the file
+ */
+static void unmap_file(void *base, size_t size)
+{
+    (void)size;
+    FlushViewOfFile(base, 0);
+    UnmapViewOfFile(base);
+    CloseHandle(mapping);
+    CloseHandle(file_handle);
+    mapping = NULL;
+    file_handle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+/**
+ * Maps the file, growing it to size; sets *fresh if it had another size
+ */
+static void* map_file(const char *path, size_t size, int *fresh)
+{
+    struct stat st;
+    void *base;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0)
+        return NULL;
+    *fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != size;
+    /* A file of another size is zero-filled again */
+    if (*fresh && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0))
+    {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return base == MAP_FAILED ? NULL : base;
+}
+
+/**
+ * Unmaps the file
+ */
+static void unmap_file(void *base, size_t size)
+{
+    msync(base, size, MS_ASYNC);
+    munmap(base, size);
+}
+
+#endif /* PLATFORM_WINDOWS */
+
+/**
+ * Maps the capability file on first use
+ *
+ * @return The entries, or NULL if the cache is off or unavailable
+ */
+static capability_entry_t* table(void)
+{
+    capability_entry_t *mapped = atomic_load_explicit(&entries, memory_order_acquire);
+    int fresh = 0;
+
+    if (mapped || !capability_cache_enabled || map_failed)
+        return mapped;
+
+    while (atomic_flag_test_and_set_explicit(&map_lock, memory_order_acquire))
+        sleep_ms(1);
+    mapped = atomic_load_explicit(&entries, memory_order_relaxed);
+    if (!mapped && !map_failed)
+    {
+        resolve_file_path();
+        header = (capability_header_t*)map_file(file_path, CAPABILITY_FILE_SIZE, &fresh);
+        if (!header)
+        {
+            map_failed = 1;
+            fprintf(stderr, "%s[INFO]%s Capability cache %s unavailable; feature reports are not cached\n",
+                    COLOR_BLUE, COLOR_RESET, file_path);
+        }
+        else
+        {
+            /* A file of another format is started over */
+            if (fresh || header->magic != CAPABILITY_MAGIC || header->version != CAPABILITY_VERSION ||
+                header->entry_count != CAPABILITY_MAX_ENTRIES || header->entry_size != sizeof(capability_entry_t))
+            {
+                memset(header, 0, CAPABILITY_FILE_SIZE);
+                header->version = CAPABILITY_VERSION;
+                header->entry_count = CAPABILITY_MAX_ENTRIES;
+                header->entry_size = sizeof(capability_entry_t);
+                atomic_thread_fence(memory_order_release);
+                header->magic = CAPABILITY_MAGIC;
+            }
+            mapped = (capability_entry_t*)(header + 1);
+            atomic_store_explicit(&entries, mapped, memory_order_release);
+        }
+    }
+    atomic_flag_clear_explicit(&map_lock, memory_order_release);
+    return mapped;
+}
+
+/**
+ * Unmaps the capability file; the next use maps it again
+ */
+void capability_cache_close(void)
+{
+    while (atomic_flag_test_and_set_explicit(&map_lock, memory_order_acquire))
+        sleep_ms(1);
+    if (header)
+        unmap_file(header, CAPABILITY_FILE_SIZE);
+    header = NULL;
+    map_failed = 0;
+    atomic_store_explicit(&entries, NULL, memory_order_release);
+    atomic_flag_clear_explicit(&map_lock, memory_order_release);
+}
+
+/**
+ * Builds the key of a kind of device
+ */
+uint64_t capability_key(unsigned short vendor_id, unsigned short product_id, uint16_t firmware, int bluetooth)
+{
+    return ((uint64_t)vendor_id << 48) | ((uint64_t)product_id << 32) | ((uint64_t)firmware << 16) |
+           ((uint64_t)(bluetooth ? 2 : 1) << 8) | 1u;
+}
+
+/**
+ * Finds the entry of a key, claiming a free one if asked
+ *
+ * @return The entry, or NULL if absent (or the table is full)
+ */
+static capability_entry_t* find_entry(uint64_t key, int claim)
+{
+    capability_entry_t *base = table();
+    uint32_t hash = 2166136261u;
+
+    if (!base)
+        return NULL;
+    for (int i = 0; i < 8; i++)
+        hash = (hash ^ (uint8_t)(key >> (8 * i))) * 16777619u;
+
+    for (uint32_t probe = 0; probe < CAPABILITY_MAX_ENTRIES; probe++)
+    {
+        capability_entry_t *entry = &base[(hash + probe) & (CAPABILITY_MAX_ENTRIES - 1)];
+        uint64_t current = atomic_load_explicit(&entry->key, memory_order_acquire);
+
+        if (current == key)
+            return entry;
+        if (current != 0)
+            continue;
+        if (!claim)
+            return NULL;
+        if (atomic_compare_exchange_strong(&entry->key, &current, key) || current == key)
+            return entry;
+    }
+    return NULL;
+}
+
+/**
+ * Records the outcome of one request for a kind of device
+ */
+void capability_cache_record(uint64_t key, capability_op_t op, unsigned char report_id, int result)
+{
+    capability_entry_t *entry = find_entry(key, 1);
+    report_state_t *report;
+    uint8_t *state;
+
+    if (!entry)
+        return;
+    report = &entry->reports[report_id];
+    state = op == CAPABILITY_GET ? &report->get : &report->set;
+    if (result >= 0)
+    {
+        *state = STATE_WORKS;
+        if (op == CAPABILITY_GET)
+            report->size = (uint16_t)result;
+    }
+    else if (*state == STATE_WORKS || *state == STATE_UNKNOWN)
+        *state = 1;
+    else if (*state < STATE_MAX_FAILURES)
+        (*state)++;
+}
+
+/**
+ * Checks whether a request is known to fail for a kind of device
+ */
+int capability_cache_failing(uint64_t key, capability_op_t op, unsigned char report_id)
+{
+    capability_entry_t *entry = find_entry(key, 0);
+    uint8_t state;
+
+    if (!entry)
+        return 0;
+    state = op == CAPABILITY_GET ? entry->reports[report_id].get : entry->reports[report_id].set;
+    return state != STATE_WORKS && state >= CAPABILITY_FAIL_LIMIT;
+}
+
+/**
+ * Lists the feature reports known to be readable on a device model and firmware
+ */
+int capability_cache_reports(unsigned short vendor_id, unsigned short product_id, uint16_t firmware,
+                             capability_report_t *reports, size_t max_reports)
+{
+    capability_entry_t *usb = find_entry(capability_key(vendor_id, product_id, firmware, 0), 0);
+    capability_entry_t *bt = find_entry(capability_key(vendor_id, product_id, firmware, 1), 0);
+    size_t count = 0;
+
+    for (int id = 0; id < 256 && count < max_reports; id++)
+    {
+        uint8_t transports = 0;
+
+        if (usb && usb->reports[id].get == STATE_WORKS)
+            transports |= CAPABILITY_USB;
+        if (bt && bt->reports[id].get == STATE_WORKS)
+            transports |= CAPABILITY_BLUETOOTH;
+        if (!transports)
+            continue;
+        reports[count].report_id = (uint8_t)id;
+        reports[count].size = (transports & CAPABILITY_USB) ? usb->reports[id].size : bt->reports[id].size;
+        reports[count].transports = transports;
+        count++;
+    }
+    return (int)count;
+}
+
+/**
+ * Gets the preferred table position for a device handle
+ */
+static unsigned int home_slot(hid_device *dev)
+{
+    uintptr_t key = (uintptr_t)dev;
+    key ^= key >> 17;
+    key *= 0x9E3779B1u;
+    return (unsigned int)(key >> 8) & (CAPABILITY_MAX_DEVICES - 1);
+}
+
+/**
+ * Finds the binding of a device
+ */
+static binding_t* find_binding(hid_device *dev)
+{
+    unsigned int slot = home_slot(dev);
+
+    for (int probe = 0; probe < CAPABILITY_MAX_DEVICES; probe++)
+    {
+        binding_t *binding = &bindings[(slot + probe) & (CAPABILITY_MAX_DEVICES - 1)];
+        if (atomic_load_explicit(&binding->owner, memory_order_acquire) == dev)
+            return binding;
+    }
+    return NULL;
+}
+
+/**
+ * Binds an open device to its entry, reading its firmware version once
+ */
+void capability_cache_bind(hid_device *dev, int (*read_feature)(hid_device*, unsigned char*, size_t))
+{
+    struct hid_device_info *info;
+    unsigned char report[CAPABILITY_FIRMWARE_LENGTH];
+    unsigned int slot;
+    uint64_t unknown_key;
+    uint16_t firmware = CAPABILITY_FIRMWARE_UNKNOWN;
+    int bluetooth, result = -1, tried = 0;
+
+    if (!dev || !table() || find_binding(dev))
+        return;
+    info = hid_io_get_device_info(dev);
+    if (!info)
+        return;
+    bluetooth = is_bluetooth_device(dev);
+
+    /* The model-wide entry remembers whether report 0xF2 is worth asking for */
+    unknown_key = capability_key(info->vendor_id, info->product_id, CAPABILITY_FIRMWARE_UNKNOWN, bluetooth);
+    if (!capability_cache_failing(unknown_key, CAPABILITY_GET, CAPABILITY_FIRMWARE_REPORT_ID))
+    {
+        memset(report, 0, sizeof(report));
+        report[0] = CAPABILITY_FIRMWARE_REPORT_ID;
+        result = read_feature(dev, report, sizeof(report));
+        tried = 1;
+        if (result >= 3)
+            firmware = (uint16_t)((report[1] << 8) | report[2]);
+        else
+            result = -1;
+    }
+
+    slot = home_slot(dev);
+    for (int probe = 0; probe < CAPABILITY_MAX_DEVICES; probe++)
+    {
+        binding_t *binding = &bindings[(slot + probe) & (CAPABILITY_MAX_DEVICES - 1)];
+        hid_device *expected = NULL;
+
+        if (!atomic_compare_exchange_strong(&binding->owner, &expected, dev))
+            continue;
+        binding->key = capability_key(info->vendor_id, info->product_id, firmware, bluetooth);
+        binding->firmware = firmware;
+        binding->answered = result >= 0;
+        memset(binding->failed, 0, sizeof(binding->failed));
+        if (result >= 0)
+        {
+            capability_cache_record(unknown_key, CAPABILITY_GET, CAPABILITY_FIRMWARE_REPORT_ID, result);
+            capability_cache_record(binding->key, CAPABILITY_GET, CAPABILITY_FIRMWARE_REPORT_ID, result);
+        }
+        else if (tried)
+            binding->failed[CAPABILITY_GET][CAPABILITY_FIRMWARE_REPORT_ID / 8] |=
+                (uint8_t)(1u << (CAPABILITY_FIRMWARE_REPORT_ID % 8));
+        return;
+    }
+}
+
+/**
+ * Checks whether a request to a bound device is known to fail
+ */
+int capability_cache_skip(hid_device *dev, capability_op_t op, unsigned char report_id)
+{
+    binding_t *binding = find_binding(dev);
+
+    return binding ? capability_cache_failing(binding->key, op, report_id) : 0;
+}
+
+/**
+ * Notes the outcome of a request to a bound device
+ */
+void capability_cache_note(hid_device *dev, capability_op_t op, unsigned char report_id, int result)
+{
+    binding_t *binding = find_binding(dev);
+
+    if (!binding)
+        return;
+    if (result >= 0)
+    {
+        binding->answered = 1;
+        binding->failed[op][report_id / 8] &= (uint8_t)~(1u << (report_id % 8));
+        capability_cache_record(binding->key, op, report_id, result);
+    }
+    else
+        binding->failed[op][report_id / 8] |= (uint8_t)(1u << (report_id % 8));
+}
+
+/**
+ * Gets the firmware version a device was bound with
+ */
+uint16_t capability_cache_firmware(hid_device *dev)
+{
+    binding_t *binding = find_binding(dev);
+
+    return binding ? binding->firmware : CAPABILITY_FIRMWARE_UNKNOWN;
+}
+
+/**
+ * Releases a device's binding, recording the failures of its session
+ */
+void capability_cache_release(hid_device *dev)
+{
+    binding_t *binding = dev ? find_binding(dev) : NULL;
+
+    if (!binding)
+        return;
+    for (int op = CAPABILITY_GET; binding->answered && op <= CAPABILITY_SET; op++)
+    {
+        for (int id = 0; id < 256; id++)
+        {
+            if (binding->failed[op][id / 8] & (1u << (id % 8)))
+                capability_cache_record(binding->key, (capability_op_t)op, (unsigned char)id, -1);
+        }
+    }
+    atomic_store_explicit(&binding->owner, NULL, memory_order_release);
+}
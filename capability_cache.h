@@ -0,0 +1,175 @@
+/**
+ * capability_cache.h - Persistent matrix of the feature reports devices answer
+ *
+ * Remembers, across runs, which feature reports each kind of device answers
+ * and which it rejects, keyed by vendor and product ID, firmware version
+ * (from report 0xF2) and transport. The hid_io feature report wrappers
+ * consult it before every request, so a report known to fail is not sent
+ * again, and record every outcome in it. The matrix is a fixed-size file
+ * mapped into memory and updated in place:
+ *
+ *   Header (24 bytes): magic, format version, entry count, entry size, 0
+ *   Entries: 64-bit key (0 if free), then for each report ID 0-255 the
+ *            length last read, and the get and set state
+ *
+ * A state is unknown, working, or a count of the sessions in which the
+ * request failed. Failures of a session are only counted when the device
+ * answered some other feature request in it, so an unplugged controller
+ * teaches nothing, and a request is only skipped once it failed in
+ * CAPABILITY_FAIL_LIMIT sessions in a row. Delete the file to relearn.
+ */
+
+#ifndef CAPABILITY_CACHE_H
+#define CAPABILITY_CACHE_H
+
+#include "platform_compat.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Feature report holding the firmware version in bytes 1 and 2 */
+#define CAPABILITY_FIRMWARE_REPORT_ID 0xf2
+#define CAPABILITY_FIRMWARE_LENGTH 64
+
+/* Firmware of devices that do not answer report 0xF2 */
+#define CAPABILITY_FIRMWARE_UNKNOWN 0xffff
+
+/* Device kinds the file holds; a power of two */
+#define CAPABILITY_MAX_ENTRIES 64
+
+/* Devices bound at once; a power of two */
+#define CAPABILITY_MAX_DEVICES 64
+
+/* Sessions a request must fail in before it is skipped */
+#define CAPABILITY_FAIL_LIMIT 3
+
+/* Transports, as bits */
+#define CAPABILITY_USB 0x01
+#define CAPABILITY_BLUETOOTH 0x02
+
+/**
+ * Feature report requests
+ */
+typedef enum {
+    CAPABILITY_GET = 0,
+    CAPABILITY_SET
+} capability_op_t;
+
+/**
+ * A feature report known to work
+ */
+typedef struct {
+    uint8_t report_id;
+    uint16_t size;              /* Length last read, report ID included */
+    uint8_t transports;         /* CAPABILITY_USB and CAPABILITY_BLUETOOTH */
+} capability_report_t;
+
+/* Nonzero while the cache is consulted, cleared by --no-capability-cache and --replay */
+extern int capability_cache_enabled;
+
+/**
+ * Sets the capability file
+ *
+ * @param path File path, or NULL for the per-user default
+ */
+void capability_cache_set_file(const char *path);
+
+/**
+ * Unmaps the capability file; the next use maps it again
+ */
+void capability_cache_close(void);
+
+/**
+ * Builds the key of a kind of device
+ *
+ * @param vendor_id Vendor ID
+ * @param product_id Product ID
+ * @param firmware Firmware version, or CAPABILITY_FIRMWARE_UNKNOWN
+ * @param bluetooth Nonzero for the Bluetooth transport
+ * @return The key, never 0
+ */
+uint64_t capability_key(unsigned short vendor_id, unsigned short product_id, uint16_t firmware, int bluetooth);
+
+/**
+ * Records the outcome of one request for a kind of device
+ *
+ * @param key Key from capability_key()
+ * @param op The request
+ * @param report_id The report
+ * @param result Bytes read or sent, or -1 if the request failed
+ */
+void capability_cache_record(uint64_t key, capability_op_t op, unsigned char report_id, int result);
+
+/**
+ * Checks whether a request is known to fail for a kind of device
+ *
+ * @param key Key from capability_key()
+ * @param op The request
+ * @param report_id The report
+ * @return 1 if the request should not be sent, 0 otherwise
+ */
+int capability_cache_failing(uint64_t key, capability_op_t op, unsigned char report_id);
+
+/**
+ * Lists the feature reports known to be readable on a device model and firmware
+ *
+ * @param vendor_id Vendor ID
+ * @param product_id Product ID
+ * @param firmware Firmware version, or CAPABILITY_FIRMWARE_UNKNOWN
+ * @param reports Receives the reports in report ID order
+ * @param max_reports Size of the reports array
+ * @return Number of reports
+ */
+int capability_cache_reports(unsigned short vendor_id, unsigned short product_id, uint16_t firmware,
+                             capability_report_t *reports, size_t max_reports);
+
+/**
+ * Binds an open device to its entry, reading its firmware version once
+ *
+ * Called by the hid_io wrappers before a device's first feature request.
+ * Report 0xF2 is read with read_feature unless the model is known not to
+ * answer it.
+ *
+ * @param dev Handle to the HID device
+ * @param read_feature Uninstrumented feature report read
+ */
+void capability_cache_bind(hid_device *dev, int (*read_feature)(hid_device*, unsigned char*, size_t));
+
+/**
+ * Checks whether a request to a bound device is known to fail
+ *
+ * @param dev Handle to the HID device
+ * @param op The request
+ * @param report_id The report
+ * @return 1 if the request should not be sent, 0 otherwise
+ */
+int capability_cache_skip(hid_device *dev, capability_op_t op, unsigned char report_id);
+
+/**
+ * Notes the outcome of a request to a bound device
+ *
+ * Successes are recorded at once; failures when the device is released,
+ * if it answered some other request.
+ *
+ * @param dev Handle to the HID device
+ * @param op The request
+ * @param report_id The report
+ * @param result Bytes read or sent, or -1 if the request failed
+ */
+void capability_cache_note(hid_device *dev, capability_op_t op, unsigned char report_id, int result);
+
+/**
+ * Gets the firmware version a device was bound with
+ *
+ * @param dev Handle to the HID device
+ * @return The version, or CAPABILITY_FIRMWARE_UNKNOWN
+ */
+uint16_t capability_cache_firmware(hid_device *dev);
+
+/**
+ * Releases a device's binding, recording the failures of its session
+ *
+ * @param dev Handle to the HID device
+ */
+void capability_cache_release(hid_device *dev);
+
+#endif /* CAPABILITY_CACHE_H */
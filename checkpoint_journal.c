@@ -0,0 +1,394 @@
+/**
+ * checkpoint_journal.c - Crash-safe journal of completed batch work
+ *
+ * Implementation of the checkpoint journal. Workers append their record to
+ * a shared buffer under the lock; the first worker to find no write in
+ * progress becomes the leader, takes the whole buffer, and writes and
+ * fsyncs it with the lock released while the others wait for their record
+ * to be covered. Records appended during a write are taken by the next
+ * leader, so a burst of completions costs one or two fsyncs.
+ */
+
+#include "checkpoint_journal.h"
+#include "crc32.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PLATFORM_WINDOWS
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+/* First word of the header */
+#define CHECKPOINT_MAGIC "sixaxispairer-journal"
+
+/* Journal format version */
+#define CHECKPOINT_VERSION 1
+
+/* Initial index size */
+#define CHECKPOINT_INITIAL_SLOTS 64
+
+/* Longest line: key, tab, CRC and newline */
+#define CHECKPOINT_MAX_LINE (CHECKPOINT_MAX_KEY + 16)
+
+/**
+ * Computes the fingerprint of a job's input
+ */
+uint32_t checkpoint_fingerprint(const void *data, size_t length, uint32_t seed)
+{
+    return crc32_update(seed, data, length);
+}
+
+/**
+ * Computes the fingerprint of a file's contents, leaving it rewound
+ */
+int checkpoint_fingerprint_file(FILE *file, uint32_t *fingerprint)
+{
+    unsigned char buffer[4096];
+    uint32_t crc = 0;
+    size_t length;
+
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        crc = crc32_update(crc, buffer, length);
+    if (ferror(file))
+        return 0;
+    rewind(file);
+    *fingerprint = crc;
+    return 1;
+}
+
+/**
+ * Writes buffered data through to the disk
+ */
+static int sync_file(FILE *file)
+{
+    if (fflush(file) != 0)
+        return 0;
+#ifdef PLATFORM_WINDOWS
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+/**
+ * Cuts a file off at an offset
+ */
+static int truncate_file(FILE *file, long offset)
+{
+    if (fflush(file) != 0)
+        return 0;
+#ifdef PLATFORM_WINDOWS
+    return _chsize(_fileno(file), offset) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)offset) == 0;
+#endif
+}
+
+/**
+ * Hashes a key (FNV-1a)
+ */
+static uint32_t hash_key(const char *key)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *key; key++)
+        hash = (hash ^ (unsigned char)*key) * 16777619u;
+    return hash;
+}
+
+/**
+ * Finds the slot of a key, or the empty slot where it belongs
+ */
+static size_t find_slot(const checkpoint_t *checkpoint, const char *key)
+{
+    size_t mask = checkpoint->slot_count - 1;
+    size_t slot = hash_key(key) & mask;
+
+    while (checkpoint->slots[slot] && strcmp(checkpoint->keys[checkpoint->slots[slot] - 1], key) != 0)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+/**
+ * Adds a key loaded from the journal to the index
+ */
+static int add_key(checkpoint_t *checkpoint, const char *key)
+{
+    size_t slot;
+    char *copy;
+
+    if ((checkpoint->key_count + 1) * 2 > checkpoint->slot_count)
+    {
+        size_t slot_count = checkpoint->slot_count ? checkpoint->slot_count * 2 : CHECKPOINT_INITIAL_SLOTS;
+        uint32_t *slots = (uint32_t*)calloc(slot_count, sizeof(uint32_t));
+
+        if (!slots)
+            return 0;
+        free(checkpoint->slots);
+        checkpoint->slots = slots;
+        checkpoint->slot_count = slot_count;
+        for (size_t i = 0; i < checkpoint->key_count; i++)
+            checkpoint->slots[find_slot(checkpoint, checkpoint->keys[i])] = (uint32_t)(i + 1);
+    }
+
+    slot = find_slot(checkpoint, key);
+    if (checkpoint->slots[slot])
+        return 1;
+    if (checkpoint->key_count == checkpoint->key_capacity)
+    {
+        size_t capacity = checkpoint->key_capacity ? checkpoint->key_capacity * 2 : CHECKPOINT_INITIAL_SLOTS;
+        char **keys = (char**)realloc(checkpoint->keys, capacity * sizeof(char*));
+
+        if (!keys)
+            return 0;
+        checkpoint->keys = keys;
+        checkpoint->key_capacity = capacity;
+    }
+    copy = (char*)malloc(strlen(key) + 1);
+    if (!copy)
+        return 0;
+    strcpy(copy, key);
+    checkpoint->keys[checkpoint->key_count] = copy;
+    checkpoint->slots[slot] = (uint32_t)(++checkpoint->key_count);
+    return 1;
+}
+
+/**
+ * Parses a record line in place
+ *
+ * @return The key, or NULL if the line is torn or its CRC does not match
+ */
+static char* parse_record(char *line)
+{
+    size_t length = strlen(line);
+    char *tab, *end;
+    unsigned long crc;
+
+    if (!length || line[length - 1] != '\n')
+        return NULL;
+    line[--length] = '\0';
+    tab = strrchr(line, '\t');
+    if (!tab || tab == line || strlen(tab + 1) != 8)
+        return NULL;
+    *tab = '\0';
+    crc = strtoul(tab + 1, &end, 16);
+    if (*end || (uint32_t)crc != crc32(line, (size_t)(tab - line)))
+        return NULL;
+    return line;
+}
+
+/**
+ * Loads the records of an existing journal and cuts off a torn tail
+ */
+static int load_journal(checkpoint_t *checkpoint, char *error, size_t error_len)
+{
+    char line[CHECKPOINT_MAX_LINE];
+    unsigned int version, fingerprint;
+    size_t length, magic_length = strlen(CHECKPOINT_MAGIC);
+    long good_end;
+
+    if (!fgets(line, sizeof(line), checkpoint->file))
+        line[0] = '\0';
+    length = strlen(line);
+    if (!strchr(line, '\n') && strncmp(line, CHECKPOINT_MAGIC, length < magic_length ? length : magic_length) == 0)
+    {
+        /* Crashed before the header was on disk */
+        return truncate_file(checkpoint->file, 0) && fseek(checkpoint->file, 0, SEEK_SET) == 0;
+    }
+    if (sscanf(line, CHECKPOINT_MAGIC " %u %8x", &version, &fingerprint) != 2 || version != CHECKPOINT_VERSION ||
+        !strchr(line, '\n'))
+    {
+        snprintf(error, error_len, "not a journal");
+        return 0;
+    }
+    if ((uint32_t)fingerprint != checkpoint->fingerprint)
+    {
+        snprintf(error, error_len, "the journal is of another job (input changed?)");
+        return 0;
+    }
+
+    good_end = ftell(checkpoint->file);
+    while (fgets(line, sizeof(line), checkpoint->file))
+    {
+        const char *key = parse_record(line);
+
+        if (!key)
+            break;
+        if (!add_key(checkpoint, key))
+        {
+            snprintf(error, error_len, "out of memory");
+            return 0;
+        }
+        good_end = ftell(checkpoint->file);
+    }
+    if (good_end < 0 || fseek(checkpoint->file, 0, SEEK_END) != 0)
+        return 0;
+    if (ftell(checkpoint->file) != good_end && !truncate_file(checkpoint->file, good_end))
+        return 0;
+    return fseek(checkpoint->file, good_end, SEEK_SET) == 0;
+}
+
+/**
+ * Opens a journal
+ */
+int checkpoint_open(checkpoint_t *checkpoint, const char *path, uint32_t fingerprint, int resume, char *error,
+                    size_t error_len)
+{
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    checkpoint->fingerprint = fingerprint;
+    mutex_init(&checkpoint->lock);
+    cond_init(&checkpoint->committed);
+    snprintf(error, error_len, "cannot write the journal");
+
+    if (resume)
+        checkpoint->file = fopen(path, "r+b");
+    if (checkpoint->file)
+    {
+        if (!load_journal(checkpoint, error, error_len))
+        {
+            checkpoint_close(checkpoint);
+            return 0;
+        }
+    }
+    else
+        checkpoint->file = fopen(path, "w+b");
+    if (!checkpoint->file)
+    {
+        checkpoint_close(checkpoint);
+        return 0;
+    }
+
+    if (ftell(checkpoint->file) == 0 &&
+        (fprintf(checkpoint->file, "%s %d %08x\n", CHECKPOINT_MAGIC, CHECKPOINT_VERSION, fingerprint) < 0 ||
+         !sync_file(checkpoint->file)))
+    {
+        checkpoint_close(checkpoint);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Checks whether an earlier run recorded a key
+ */
+int checkpoint_done(const checkpoint_t *checkpoint, const char *key)
+{
+    return checkpoint && checkpoint->key_count && checkpoint->slots[find_slot(checkpoint, key)] != 0;
+}
+
+/**
+ * Appends a record to the pending buffer
+ */
+static int append_record(checkpoint_t *checkpoint, const char *key)
+{
+    char record[CHECKPOINT_MAX_LINE];
+    size_t length = 0;
+
+    for (; key[length] && length < CHECKPOINT_MAX_KEY - 1; length++)
+        record[length] = (key[length] == '\t' || key[length] == '\n' || key[length] == '\r') ? '_' : key[length];
+    length += (size_t)snprintf(record + length, sizeof(record) - length, "\t%08x\n", crc32(record, length));
+
+    if (checkpoint->pending_length + length > checkpoint->pending_capacity)
+    {
+        size_t capacity = checkpoint->pending_capacity ? checkpoint->pending_capacity * 2 : 4096;
+        char *pending;
+
+        while (capacity < checkpoint->pending_length + length)
+            capacity *= 2;
+        pending = (char*)realloc(checkpoint->pending, capacity);
+        if (!pending)
+            return 0;
+        checkpoint->pending = pending;
+        checkpoint->pending_capacity = capacity;
+    }
+    memcpy(checkpoint->pending + checkpoint->pending_length, record, length);
+    checkpoint->pending_length += length;
+    return 1;
+}
+
+/**
+ * Records a completed key and waits until it is on disk
+ */
+int checkpoint_record(checkpoint_t *checkpoint, const char *key)
+{
+    uint64_t sequence;
+    int ok;
+
+    mutex_lock(&checkpoint->lock);
+    if (checkpoint->failed || !append_record(checkpoint, key))
+    {
+        mutex_unlock(&checkpoint->lock);
+        return 0;
+    }
+    sequence = ++checkpoint->appended;
+
+    while (checkpoint->durable < sequence && !checkpoint->failed)
+    {
+        if (checkpoint->flushing)
+        {
+            cond_timedwait(&checkpoint->committed, &checkpoint->lock, 100);
+            continue;
+        }
+
+        /* Lead a commit of everything appended so far */
+        {
+            char *batch = checkpoint->pending;
+            size_t length = checkpoint->pending_length;
+            uint64_t covered = checkpoint->appended;
+
+            checkpoint->pending = NULL;
+            checkpoint->pending_length = checkpoint->pending_capacity = 0;
+            checkpoint->flushing = 1;
+            mutex_unlock(&checkpoint->lock);
+
+            ok = fwrite(batch, 1, length, checkpoint->file) == length && sync_file(checkpoint->file);
+            free(batch);
+
+            mutex_lock(&checkpoint->lock);
+            checkpoint->flushing = 0;
+            checkpoint->commit_count++;
+            if (ok)
+                checkpoint->durable = covered;
+            else
+                checkpoint->failed = 1;
+            cond_broadcast(&checkpoint->committed);
+        }
+    }
+    ok = checkpoint->durable >= sequence;
+    mutex_unlock(&checkpoint->lock);
+    return ok;
+}
+
+/**
+ * Gets the number of keys recorded by earlier runs
+ */
+size_t checkpoint_resumed_count(const checkpoint_t *checkpoint)
+{
+    return checkpoint->key_count;
+}
+
+/**
+ * Closes a journal
+ */
+int checkpoint_close(checkpoint_t *checkpoint)
+{
+    int ok = !checkpoint->failed;
+
+    if (checkpoint->file && fclose(checkpoint->file) != 0)
+        ok = 0;
+    for (size_t i = 0; i < checkpoint->key_count; i++)
+        free(checkpoint->keys[i]);
+    free(checkpoint->keys);
+    free(checkpoint->slots);
+    free(checkpoint->pending);
+    checkpoint->file = NULL;
+    checkpoint->keys = NULL;
+    checkpoint->slots = NULL;
+    checkpoint->pending = NULL;
+    checkpoint->key_count = 0;
+    cond_destroy(&checkpoint->committed);
+    mutex_destroy(&checkpoint->lock);
+    return ok;
+}
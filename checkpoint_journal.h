@@ -0,0 +1,135 @@
+/**
+ * checkpoint_journal.h - Crash-safe journal of completed batch work
+ *
+ * Batch commands record each controller they finish in an append-only
+ * journal so that a run cut short by a crash or power loss can be resumed
+ * without redoing the controllers already done. The journal starts with a
+ * header naming the job by a fingerprint of its input, followed by one line
+ * per completed controller:
+ *
+ *   sixaxispairer-journal 1 1c291ca3
+ *   serial:0123456789ab	5d3c1b0e
+ *
+ * Each record ends with the CRC-32 of its key, so a record torn by a crash
+ * is detected and dropped on resume. A record is on disk when
+ * checkpoint_record() returns: records from workers finishing at the same
+ * time are written and fsync'd together (group commit), so the journal
+ * costs one fsync per burst rather than one per controller.
+ */
+
+#ifndef CHECKPOINT_JOURNAL_H
+#define CHECKPOINT_JOURNAL_H
+
+#include "thread_compat.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Longest key of a record */
+#define CHECKPOINT_MAX_KEY 256
+
+/**
+ * An open journal
+ */
+typedef struct {
+    FILE *file;
+    uint32_t fingerprint;
+
+    /* Keys recorded by earlier runs, with their hash index */
+    char **keys;
+    size_t key_count;
+    size_t key_capacity;
+    uint32_t *slots;                /* Key index plus one, 0 for an empty slot */
+    size_t slot_count;
+
+    /* Group commit */
+    mutex_t lock;
+    cond_t committed;
+    char *pending;                  /* Records not yet written */
+    size_t pending_length;
+    size_t pending_capacity;
+    uint64_t appended;              /* Records appended to pending */
+    uint64_t durable;               /* Records written and fsync'd */
+    int flushing;                   /* A worker is writing */
+    int failed;                     /* A write or fsync failed */
+    size_t commit_count;            /* fsyncs of records */
+} checkpoint_t;
+
+/**
+ * Computes the fingerprint of a job's input
+ *
+ * @param data The input, such as a recipe or manifest
+ * @param length Number of bytes
+ * @param seed Fingerprint of any earlier input, 0 to start
+ * @return The fingerprint
+ */
+uint32_t checkpoint_fingerprint(const void *data, size_t length, uint32_t seed);
+
+/**
+ * Computes the fingerprint of a file's contents, leaving it rewound
+ *
+ * @param file The open file
+ * @param fingerprint Receives the fingerprint
+ * @return 1 on success, 0 on a read error
+ */
+int checkpoint_fingerprint_file(FILE *file, uint32_t *fingerprint);
+
+/**
+ * Opens a journal
+ *
+ * Without resume the journal is started afresh. With resume the records
+ * of an existing journal are loaded, a torn last record is cut off and new
+ * records are appended; a missing journal is started afresh.
+ *
+ * @param checkpoint The journal
+ * @param path Journal file
+ * @param fingerprint Fingerprint of the job
+ * @param resume Nonzero to continue an existing journal
+ * @param error Receives a message on failure
+ * @param error_len Size of the error buffer
+ * @return 1 on success, 0 if the file cannot be opened, is not a journal
+ *         or belongs to a job with another fingerprint
+ */
+int checkpoint_open(checkpoint_t *checkpoint, const char *path, uint32_t fingerprint, int resume, char *error,
+                    size_t error_len);
+
+/**
+ * Checks whether an earlier run recorded a key
+ *
+ * Safe to call from several threads at once.
+ *
+ * @param checkpoint The journal, or NULL
+ * @param key The key
+ * @return 1 if the key was recorded by an earlier run, 0 otherwise
+ */
+int checkpoint_done(const checkpoint_t *checkpoint, const char *key);
+
+/**
+ * Records a completed key and waits until it is on disk
+ *
+ * Safe to call from several threads at once; concurrent records share one
+ * write and fsync. Tabs and line breaks in the key are replaced.
+ *
+ * @param checkpoint The journal
+ * @param key The key, at most CHECKPOINT_MAX_KEY - 1 characters
+ * @return 1 once the record is durable, 0 if it could not be written
+ */
+int checkpoint_record(checkpoint_t *checkpoint, const char *key);
+
+/**
+ * Gets the number of keys recorded by earlier runs
+ *
+ * @param checkpoint The journal
+ * @return Number of keys loaded when the journal was opened
+ */
+size_t checkpoint_resumed_count(const checkpoint_t *checkpoint);
+
+/**
+ * Closes a journal
+ *
+ * @param checkpoint The journal
+ * @return 1 if every record was written, 0 otherwise
+ */
+int checkpoint_close(checkpoint_t *checkpoint);
+
+#endif /* CHECKPOINT_JOURNAL_H */
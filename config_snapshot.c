@@ -0,0 +1,732 @@
+/**
+ * config_snapshot.c - Feature report snapshots and parallel restore
+ *
+ * Implementation of the snapshot file format and of snapshot and restore
+ * modes. Snapshot parses the controller's report descriptor and reads each
+ * feature report it declares. Restore reads the restored reports of every
+ * matching controller in parallel and compares their hash with the
+ * snapshot's, so a controller already configured costs only the reads;
+ * the others get just the reports that differ.
+ */
+
+#include "config_snapshot.h"
+#include "hid_descriptor.h"
+#include "capability_cache.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "link_key_pairing.h"
+#include "imu_calibration.h"
+#include "hid_io.h"
+#include "flight_recorder.h"
+#include "latency_stats.h"
+#include "thread_compat.h"
+#include "crc32.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Firmware and calibration reports that belong to one unit */
+#define DS4_FIRMWARE_REPORT_ID 0xa3
+#define DS4_ADDRESS_REPORT_ID 0x81
+#define DUALSENSE_CALIBRATION_REPORT_ID 0x05
+#define DUALSENSE_FIRMWARE_REPORT_ID 0x20
+#define MOVE_CALIBRATION_REPORT_ID 0x10
+#define SIXAXIS_ADDRESS_REPORT_ID 0xf2
+
+/**
+ * Checks whether a feature report may be written back to other controllers
+ */
+int snapshot_restorable(unsigned short product_id, unsigned char report_id)
+{
+    const link_key_layout_t *layout = link_key_layout(product_id);
+
+    if (layout && (report_id == layout->pairing_report_id || report_id == layout->link_key_report_id ||
+                   (layout->address_report_id && report_id == layout->address_report_id)))
+        return 0;
+    /* Address reports, whatever the model */
+    if (report_id == MAC_REPORT_ID || report_id == SIXAXIS_ADDRESS_REPORT_ID)
+        return 0;
+
+    switch (product_id)
+    {
+    case PRODUCT_SIXAXIS:
+    case PRODUCT_MOVE:
+        return report_id != SIXAXIS_ENABLE_REPORT_ID &&
+               !(product_id == PRODUCT_MOVE && report_id == MOVE_CALIBRATION_REPORT_ID);
+    case PRODUCT_DS4:
+        return report_id != DS4_CALIBRATION_REPORT_ID && report_id != DS4_FIRMWARE_REPORT_ID &&
+               report_id != DS4_ADDRESS_REPORT_ID;
+    case PRODUCT_DUALSENSE:
+    case PRODUCT_DUALSENSE_EDGE:
+        return report_id != DUALSENSE_CALIBRATION_REPORT_ID && report_id != DUALSENSE_FIRMWARE_REPORT_ID;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * Adds one report to a running CRC
+ */
+static uint32_t hash_report(uint32_t crc, const snapshot_report_t *report)
+{
+    unsigned char header[3];
+
+    header[0] = report->report_id;
+    header[1] = (unsigned char)(report->length & 0xff);
+    header[2] = (unsigned char)(report->length >> 8);
+    crc = crc32_update(crc, header, sizeof(header));
+    return crc32_update(crc, report->data, report->length);
+}
+
+/**
+ * Computes the content hash of the reports that are restored
+ */
+uint32_t snapshot_hash(const snapshot_t *snapshot)
+{
+    uint32_t crc = 0;
+
+    for (uint16_t i = 0; i < snapshot->count; i++)
+    {
+        if (snapshot->reports[i].flags & SNAPSHOT_FLAG_RESTORE)
+            crc = hash_report(crc, &snapshot->reports[i]);
+    }
+    return crc;
+}
+
+/**
+ * Stores a little-endian 16-bit value
+ */
+static void put_u16(unsigned char *out, uint16_t value)
+{
+    out[0] = (unsigned char)(value & 0xff);
+    out[1] = (unsigned char)(value >> 8);
+}
+
+/**
+ * Loads a little-endian 16-bit value
+ */
+static uint16_t get_u16(const unsigned char *in)
+{
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+/**
+ * Encodes a snapshot as a file image
+ */
+size_t snapshot_encode(const snapshot_t *snapshot, unsigned char *out, size_t out_len)
+{
+    size_t used = SNAPSHOT_HEADER_SIZE;
+
+    if (out_len < SNAPSHOT_HEADER_SIZE || snapshot->count > SNAPSHOT_MAX_REPORTS)
+        return 0;
+
+    memcpy(out, SNAPSHOT_MAGIC, 6);
+    put_u16(out + 6, SNAPSHOT_VERSION);
+    put_u16(out + 8, snapshot->vendor_id);
+    put_u16(out + 10, snapshot->product_id);
+    put_u16(out + 12, snapshot->count);
+    put_u16(out + 14, 0);
+    put_u16(out + 16, (uint16_t)(snapshot->hash & 0xffff));
+    put_u16(out + 18, (uint16_t)(snapshot->hash >> 16));
+
+    for (uint16_t i = 0; i < snapshot->count; i++)
+    {
+        const snapshot_report_t *report = &snapshot->reports[i];
+
+        if (report->length > SNAPSHOT_MAX_LENGTH || used + SNAPSHOT_REPORT_HEADER_SIZE + report->length > out_len)
+            return 0;
+        out[used] = report->report_id;
+        out[used + 1] = report->flags;
+        put_u16(out + used + 2, report->length);
+        memcpy(out + used + SNAPSHOT_REPORT_HEADER_SIZE, report->data, report->length);
+        used += SNAPSHOT_REPORT_HEADER_SIZE + report->length;
+    }
+    return used;
+}
+
+/**
+ * Decodes a file image, checking its bounds and content hash
+ */
+int snapshot_decode(const unsigned char *data, size_t length, snapshot_t *snapshot, char *error, size_t error_len)
+{
+    size_t used = SNAPSHOT_HEADER_SIZE;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    if (length < SNAPSHOT_HEADER_SIZE || memcmp(data, SNAPSHOT_MAGIC, 6) != 0)
+    {
+        snprintf(error, error_len, "not a snapshot file");
+        return 0;
+    }
+    if (get_u16(data + 6) != SNAPSHOT_VERSION)
+    {
+        snprintf(error, error_len, "unsupported snapshot version %u", get_u16(data + 6));
+        return 0;
+    }
+    snapshot->vendor_id = get_u16(data + 8);
+    snapshot->product_id = get_u16(data + 10);
+    snapshot->count = get_u16(data + 12);
+    snapshot->hash = (uint32_t)get_u16(data + 16) | ((uint32_t)get_u16(data + 18) << 16);
+    if (snapshot->count > SNAPSHOT_MAX_REPORTS)
+    {
+        snprintf(error, error_len, "too many reports (%u)", snapshot->count);
+        return 0;
+    }
+
+    for (uint16_t i = 0; i < snapshot->count; i++)
+    {
+        snapshot_report_t *report = &snapshot->reports[i];
+
+        if (used + SNAPSHOT_REPORT_HEADER_SIZE > length)
+        {
+            snprintf(error, error_len, "truncated at report %u", i + 1);
+            return 0;
+        }
+        report->report_id = data[used];
+        report->flags = data[used + 1];
+        report->length = get_u16(data + used + 2);
+        used += SNAPSHOT_REPORT_HEADER_SIZE;
+        if (report->length == 0 || report->length > SNAPSHOT_MAX_LENGTH || used + report->length > length)
+        {
+            snprintf(error, error_len, "bad length in report %u", i + 1);
+            return 0;
+        }
+        memcpy(report->data, data + used, report->length);
+        used += report->length;
+        if (report->data[0] != report->report_id || (report->flags & ~SNAPSHOT_FLAG_RESTORE))
+        {
+            snprintf(error, error_len, "report %u is corrupt", i + 1);
+            return 0;
+        }
+    }
+
+    if (used != length)
+    {
+        snprintf(error, error_len, "%zu trailing bytes", length - used);
+        return 0;
+    }
+    if (snapshot_hash(snapshot) != snapshot->hash)
+    {
+        snprintf(error, error_len, "content hash mismatch");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Reads one feature report into a snapshot entry
+ *
+ * @return 1 on success, 0 on failure
+ */
+static int read_report(hid_device *dev, unsigned char report_id, size_t length, snapshot_report_t *report)
+{
+    int result;
+
+    memset(report->data, 0, sizeof(report->data));
+    report->data[0] = report_id;
+    result = hid_io_get_feature_report(dev, report->data, length);
+    if (result <= 0)
+        return 0;
+    report->report_id = report_id;
+    report->length = (uint16_t)result;
+    return 1;
+}
+
+/**
+ * Finds the controller a snapshot is taken from
+ *
+ * @return Index into controllers, or -1 with an error printed
+ */
+static int pick_controller(controller_info_t *controllers[], int controller_count, const char *path)
+{
+    int found = -1;
+
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (path && strcmp(controllers[i]->path, path) != 0)
+            continue;
+        if (found >= 0)
+        {
+            printf("%s[ERROR]%s %d controllers are connected; choose one with --path\n", COLOR_RED, COLOR_RESET,
+                   controller_count);
+            return -1;
+        }
+        found = i;
+    }
+    if (found < 0)
+        printf("%s[ERROR]%s No controller at %s\n", COLOR_RED, COLOR_RESET, path ? path : "any path");
+    return found;
+}
+
+/**
+ * Lists the feature reports the capability cache knows a controller's model
+ * and firmware answer over USB
+ *
+ * @return Number of reports
+ */
+static int known_reports(hid_device *dev, const controller_info_t *controller, hid_feature_report_t *declared)
+{
+    capability_report_t known[HID_DESCRIPTOR_MAX_REPORTS];
+    snapshot_report_t firmware;
+    int known_count, count = 0;
+
+    /* Any feature request binds the device to the cache, reading its firmware version */
+    read_report(dev, CAPABILITY_FIRMWARE_REPORT_ID, CAPABILITY_FIRMWARE_LENGTH, &firmware);
+    known_count = capability_cache_reports(controller->vendor_id, controller->product_id,
+                                           capability_cache_firmware(dev), known, HID_DESCRIPTOR_MAX_REPORTS);
+    for (int i = 0; i < known_count; i++)
+    {
+        if (!(known[i].transports & CAPABILITY_USB) || known[i].size == 0)
+            continue;
+        declared[count].report_id = known[i].report_id;
+        declared[count].size = (uint16_t)(known[i].size - 1);
+        declared[count].has_data = 1;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Reads every feature report a controller declares into a snapshot
+ *
+ * @return 1 on success, 0 with an error printed
+ */
+static int take_snapshot(hid_device *dev, const controller_info_t *controller, snapshot_t *snapshot)
+{
+    unsigned char descriptor[HID_DESCRIPTOR_MAX];
+    hid_feature_report_t declared[HID_DESCRIPTOR_MAX_REPORTS];
+    int descriptor_length, declared_count, unreadable = 0;
+
+    descriptor_length = hid_io_get_report_descriptor(dev, descriptor, sizeof(descriptor));
+    declared_count = descriptor_length > 0
+                         ? hid_descriptor_feature_reports(descriptor, (size_t)descriptor_length, declared,
+                                                          HID_DESCRIPTOR_MAX_REPORTS)
+                         : -1;
+    if (declared_count < 0)
+    {
+        /* Without a descriptor, the reports earlier runs saw this model and firmware answer */
+        declared_count = known_reports(dev, controller, declared);
+        if (declared_count <= 0)
+        {
+            printf("%s[ERROR]%s Could not read a report descriptor%s\n", COLOR_RED, COLOR_RESET,
+                   descriptor_length > 0 ? " that parses" : "");
+            return 0;
+        }
+        printf("%s[INFO]%s No usable report descriptor; using the %d report(s) the capability cache knows\n",
+               COLOR_BLUE, COLOR_RESET, declared_count);
+    }
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->vendor_id = controller->vendor_id;
+    snapshot->product_id = controller->product_id;
+    printf("\n%s%s=== Snapshot ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
+    printf("%s  %-26s %s, %d feature report(s) declared%s\n", COLOR_WHITE, get_controller_name(controller->product_id),
+           controller->path, declared_count, COLOR_RESET);
+
+    for (int i = 0; i < declared_count; i++)
+    {
+        const hid_feature_report_t *entry = &declared[i];
+        snapshot_report_t *report = &snapshot->reports[snapshot->count];
+        size_t length = (size_t)entry->size + 1;
+
+        if (length > SNAPSHOT_MAX_LENGTH || snapshot->count == SNAPSHOT_MAX_REPORTS)
+        {
+            printf("  0x%02x %4zu bytes  %sskipped, too long%s\n", entry->report_id, length, COLOR_YELLOW, COLOR_RESET);
+            continue;
+        }
+        if (!read_report(dev, entry->report_id, length, report))
+        {
+            unreadable++;
+            continue;
+        }
+        if (entry->has_data && snapshot_restorable(controller->product_id, entry->report_id))
+            report->flags = SNAPSHOT_FLAG_RESTORE;
+        printf("  0x%02x %4u bytes  %s\n", report->report_id, report->length,
+               report->flags & SNAPSHOT_FLAG_RESTORE ? "restored" : !entry->has_data ? "constant, kept" : "kept");
+        snapshot->count++;
+    }
+
+    snapshot->hash = snapshot_hash(snapshot);
+    if (unreadable)
+        printf("%s[INFO]%s %d declared report(s) could not be read and are left out\n", COLOR_BLUE, COLOR_RESET,
+               unreadable);
+    return 1;
+}
+
+/**
+ * Saves the feature reports of one controller to a snapshot file
+ */
+int snapshot_command(int argc, char **argv)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    const char *path = NULL;
+    snapshot_t *snapshot;
+    unsigned char *image;
+    hid_device *dev;
+    FILE *file;
+    size_t image_length = 0;
+    int controller_count, picked, restored = 0;
+
+    if (argc < 1 || argv[0][0] == '-')
+    {
+        fprintf(stderr, "%s[ERROR]%s snapshot requires a file\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--path") == 0)
+            path = argv[++i];
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown snapshot option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+
+    controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+    if (controller_count == 0)
+    {
+        printf("%s[ERROR]%s No supported PlayStation controllers found\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    picked = pick_controller(controllers, controller_count, path);
+    if (picked >= 0 && is_bluetooth_controller(controllers[picked]))
+    {
+        printf("%s[ERROR]%s Snapshots are taken over USB; connect the controller with a cable\n", COLOR_RED,
+               COLOR_RESET);
+        picked = -1;
+    }
+
+    snapshot = (snapshot_t*)malloc(sizeof(snapshot_t));
+    image = (unsigned char*)malloc(SNAPSHOT_MAX_FILE);
+    dev = picked >= 0 && snapshot && image ? connect_to_controller(controllers[picked]) : NULL;
+    if (dev && take_snapshot(dev, controllers[picked], snapshot))
+        image_length = snapshot_encode(snapshot, image, SNAPSHOT_MAX_FILE);
+    hid_io_close(dev);
+
+    if (image_length)
+    {
+        file = fopen(argv[0], "wb");
+        if (!file || fwrite(image, 1, image_length, file) != image_length || fclose(file) != 0)
+        {
+            printf("%s[ERROR]%s Could not write %s\n", COLOR_RED, COLOR_RESET, argv[0]);
+            image_length = 0;
+        }
+        else
+        {
+            for (uint16_t i = 0; i < snapshot->count; i++)
+                restored += (snapshot->reports[i].flags & SNAPSHOT_FLAG_RESTORE) != 0;
+            printf("%s[SUCCESS]%s Saved %u report(s), %d restorable, to %s (%zu bytes, hash %08x)\n", COLOR_GREEN,
+                   COLOR_RESET, snapshot->count, restored, argv[0], image_length, (unsigned)snapshot->hash);
+        }
+    }
+    else if (picked >= 0 && !dev)
+        printf("%s[ERROR]%s Could not open the controller\n", COLOR_RED, COLOR_RESET);
+
+    for (int i = 0; i < controller_count; i++)
+        free_controller_info(controllers[i]);
+    free(snapshot);
+    free(image);
+    return image_length ? 0 : 1;
+}
+
+/**
+ * Outcome of restoring one controller
+ */
+typedef enum {
+    RESTORE_UNCHANGED = 0,      /* Already held the snapshot */
+    RESTORE_DIFFERS,            /* Dry run: reports differ */
+    RESTORE_RESTORED,           /* Written and read back */
+    RESTORE_MISMATCH,           /* Written, but reads back different */
+    RESTORE_READ_FAILED,        /* A restored report could not be read */
+    RESTORE_WRITE_FAILED,       /* The controller rejected a report */
+    RESTORE_OPEN_FAILED,
+    RESTORE_BLUETOOTH           /* Restores go over USB only */
+} restore_outcome_t;
+
+/**
+ * One controller and how it was restored
+ */
+typedef struct {
+    const snapshot_t *snapshot;
+    int dry_run;
+    controller_info_t *controller;
+    restore_outcome_t outcome;
+    int differing;                      /* Reports that differed */
+    unsigned char failed_report;        /* Report that could not be read or written */
+    uint64_t elapsed_us;
+    thread_t thread;
+    int running;
+} restore_worker_t;
+
+/**
+ * Reads a controller's copy of every restored report and hashes them
+ *
+ * @param current Receives the reports, with the snapshot's flags
+ * @return 1 on success, 0 with worker->failed_report set
+ */
+static int read_current(hid_device *dev, restore_worker_t *worker, snapshot_t *current)
+{
+    const snapshot_t *snapshot = worker->snapshot;
+
+    current->count = snapshot->count;
+    for (uint16_t i = 0; i < snapshot->count; i++)
+    {
+        const snapshot_report_t *wanted = &snapshot->reports[i];
+
+        current->reports[i].flags = wanted->flags;
+        current->reports[i].length = 0;
+        if (!(wanted->flags & SNAPSHOT_FLAG_RESTORE))
+            continue;
+        if (!read_report(dev, wanted->report_id, wanted->length, &current->reports[i]))
+        {
+            worker->failed_report = wanted->report_id;
+            return 0;
+        }
+    }
+    current->hash = snapshot_hash(current);
+    return 1;
+}
+
+/**
+ * Checks whether a controller's report differs from the snapshot's
+ */
+static int report_differs(const snapshot_report_t *wanted, const snapshot_report_t *current)
+{
+    return current->length != wanted->length || memcmp(current->data, wanted->data, wanted->length) != 0;
+}
+
+/**
+ * Worker thread: compares one controller with the snapshot and writes what differs
+ */
+static void restore_main(void *arg)
+{
+    restore_worker_t *worker = (restore_worker_t*)arg;
+    const snapshot_t *snapshot = worker->snapshot;
+    uint64_t start = latency_now_ns();
+    snapshot_t *current = (snapshot_t*)malloc(sizeof(snapshot_t));
+    hid_device *dev = NULL;
+
+    worker->outcome = RESTORE_OPEN_FAILED;
+    if (is_bluetooth_controller(worker->controller))
+        worker->outcome = RESTORE_BLUETOOTH;
+    else if (current)
+        dev = connect_to_controller(worker->controller);
+    if (!dev)
+    {
+        free(current);
+        return;
+    }
+
+    if (!read_current(dev, worker, current))
+        worker->outcome = RESTORE_READ_FAILED;
+    else if (current->hash == snapshot->hash)
+        worker->outcome = RESTORE_UNCHANGED;
+    else
+    {
+        for (uint16_t i = 0; i < snapshot->count; i++)
+        {
+            if ((snapshot->reports[i].flags & SNAPSHOT_FLAG_RESTORE) &&
+                report_differs(&snapshot->reports[i], &current->reports[i]))
+                worker->differing++;
+        }
+        worker->outcome = worker->dry_run ? RESTORE_DIFFERS : RESTORE_RESTORED;
+    }
+
+    for (uint16_t i = 0; worker->outcome == RESTORE_RESTORED && i < snapshot->count; i++)
+    {
+        const snapshot_report_t *wanted = &snapshot->reports[i];
+
+        if (!(wanted->flags & SNAPSHOT_FLAG_RESTORE) || !report_differs(wanted, &current->reports[i]))
+            continue;
+        if (hid_io_send_feature_report(dev, wanted->data, wanted->length) < 0)
+        {
+            worker->outcome = RESTORE_WRITE_FAILED;
+            worker->failed_report = wanted->report_id;
+        }
+        else if (!read_report(dev, wanted->report_id, wanted->length, &current->reports[i]))
+        {
+            worker->outcome = RESTORE_READ_FAILED;
+            worker->failed_report = wanted->report_id;
+        }
+        else if (report_differs(wanted, &current->reports[i]))
+        {
+            worker->outcome = RESTORE_MISMATCH;
+            worker->failed_report = wanted->report_id;
+        }
+    }
+    if (worker->outcome >= RESTORE_MISMATCH)
+        flight_recorder_dump(dev, "snapshot restore failed");
+
+    hid_io_close(dev);
+    free(current);
+    worker->elapsed_us = (latency_now_ns() - start) / 1000ull;
+}
+
+/**
+ * Prints how one controller was restored
+ */
+static void print_restore(const restore_worker_t *worker)
+{
+    printf("%s  %-26s %-14s ", COLOR_WHITE, get_controller_name(worker->controller->product_id),
+           worker->controller->path);
+    switch (worker->outcome)
+    {
+    case RESTORE_UNCHANGED:
+        printf("%sunchanged, hash matches%s", COLOR_GREEN, COLOR_RESET);
+        break;
+    case RESTORE_DIFFERS:
+        printf("%s%d report(s) differ%s", COLOR_YELLOW, worker->differing, COLOR_RESET);
+        break;
+    case RESTORE_RESTORED:
+        printf("%srestored %d report(s)%s", COLOR_GREEN, worker->differing, COLOR_RESET);
+        break;
+    case RESTORE_MISMATCH:
+        printf("%sreport 0x%02x reads back different%s", COLOR_RED, worker->failed_report, COLOR_RESET);
+        break;
+    case RESTORE_READ_FAILED:
+        printf("%scould not read report 0x%02x%s", COLOR_RED, worker->failed_report, COLOR_RESET);
+        break;
+    case RESTORE_WRITE_FAILED:
+        printf("%sreport 0x%02x was rejected%s", COLOR_RED, worker->failed_report, COLOR_RESET);
+        break;
+    case RESTORE_OPEN_FAILED:
+        printf("%scould not open the controller%s\n", COLOR_RED, COLOR_RESET);
+        return;
+    case RESTORE_BLUETOOTH:
+        printf("%sBluetooth, connect with a cable%s\n", COLOR_YELLOW, COLOR_RESET);
+        return;
+    }
+    printf(" %.1fms\n", worker->elapsed_us / 1000.0);
+}
+
+/**
+ * Reads and decodes a snapshot file
+ *
+ * @return 1 on success, 0 with an error printed
+ */
+static int load_snapshot(const char *path, snapshot_t *snapshot)
+{
+    unsigned char *image = (unsigned char*)malloc(SNAPSHOT_MAX_FILE + 1);
+    FILE *file = fopen(path, "rb");
+    char error[96] = "could not read the file";
+    size_t length;
+    int ok = 0;
+
+    if (file && image)
+    {
+        length = fread(image, 1, SNAPSHOT_MAX_FILE + 1, file);
+        if (!ferror(file) && length <= SNAPSHOT_MAX_FILE)
+            ok = snapshot_decode(image, length, snapshot, error, sizeof(error));
+        else if (length > SNAPSHOT_MAX_FILE)
+            snprintf(error, sizeof(error), "file too large");
+    }
+    if (file)
+        fclose(file);
+    free(image);
+    if (!ok)
+        printf("%s[ERROR]%s %s: %s\n", COLOR_RED, COLOR_RESET, path, error);
+    return ok;
+}
+
+/**
+ * Writes a snapshot to every matching controller, in parallel
+ */
+int restore_command(int argc, char **argv)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    restore_worker_t *workers;
+    snapshot_t *snapshot;
+    uint64_t start;
+    int controller_count, worker_count = 0, dry_run = 0, failed = 0, restored = 0, unchanged = 0;
+
+    if (argc < 1 || argv[0][0] == '-')
+    {
+        fprintf(stderr, "%s[ERROR]%s restore requires a snapshot file\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--dry-run") == 0)
+            dry_run = 1;
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown restore option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+
+    snapshot = (snapshot_t*)malloc(sizeof(snapshot_t));
+    if (!snapshot || !load_snapshot(argv[0], snapshot))
+    {
+        free(snapshot);
+        return 1;
+    }
+    /* A hand-made file cannot restore a unit's own reports */
+    for (uint16_t i = 0; i < snapshot->count; i++)
+    {
+        if (!snapshot_restorable(snapshot->product_id, snapshot->reports[i].report_id))
+            snapshot->reports[i].flags &= (uint8_t)~SNAPSHOT_FLAG_RESTORE;
+    }
+    snapshot->hash = snapshot_hash(snapshot);
+
+    controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+    workers = (restore_worker_t*)calloc(controller_count > 0 ? (size_t)controller_count : 1, sizeof(restore_worker_t));
+    if (!workers)
+    {
+        for (int i = 0; i < controller_count; i++)
+            free_controller_info(controllers[i]);
+        free(snapshot);
+        return 1;
+    }
+
+    start = latency_now_ns();
+    for (int i = 0; i < controller_count; i++)
+    {
+        restore_worker_t *worker = &workers[worker_count];
+
+        if (controllers[i]->vendor_id != snapshot->vendor_id || controllers[i]->product_id != snapshot->product_id)
+        {
+            free_controller_info(controllers[i]);
+            continue;
+        }
+        worker->snapshot = snapshot;
+        worker->dry_run = dry_run;
+        worker->controller = controllers[i];
+        worker->running = thread_create(&worker->thread, restore_main, worker);
+        if (!worker->running)
+            restore_main(worker);
+        worker_count++;
+    }
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (workers[i].running)
+            thread_join(workers[i].thread);
+    }
+
+    if (worker_count == 0)
+    {
+        printf("%s[ERROR]%s No connected %s to restore\n", COLOR_RED, COLOR_RESET,
+               get_controller_name(snapshot->product_id));
+        free(workers);
+        free(snapshot);
+        return 1;
+    }
+
+    printf("\n%s%s=== Restore%s ===%s\n", COLOR_BOLD, COLOR_YELLOW, dry_run ? " (dry run)" : "", COLOR_RESET);
+    for (int i = 0; i < worker_count; i++)
+    {
+        unchanged += workers[i].outcome == RESTORE_UNCHANGED;
+        restored += workers[i].outcome == RESTORE_RESTORED;
+        failed += workers[i].outcome != RESTORE_UNCHANGED && workers[i].outcome != RESTORE_RESTORED;
+        print_restore(&workers[i]);
+        free_controller_info(workers[i].controller);
+    }
+    printf("%s[INFO]%s %d restored, %d unchanged, %d %s of %d controller(s) in %.1fms\n", COLOR_BLUE, COLOR_RESET,
+           restored, unchanged, failed, dry_run ? "differing or failed" : "failed", worker_count,
+           (latency_now_ns() - start) / 1e6);
+
+    free(workers);
+    free(snapshot);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * config_snapshot.h - Feature report snapshots and parallel restore
+ *
+ * A snapshot holds every feature report a controller declares in its
+ * report descriptor and answers, so that the configuration of a golden unit
+ * can be cloned onto others. Snapshot files are compact binary blobs (all
+ * integers little-endian):
+ *
+ *   Header (20 bytes)
+ *     0  char[6]  magic "SXPSNP"
+ *     6  u16      format version (SNAPSHOT_VERSION)
+ *     8  u16      vendor ID
+ *    10  u16      product ID
+ *    12  u16      number of reports
+ *    14  u16      reserved, 0
+ *    16  u32      content hash
+ *
+ *   Report, repeated
+ *     0  u8       report ID
+ *     1  u8       flags (SNAPSHOT_FLAG_RESTORE)
+ *     2  u16      length of the report as read, report ID byte included
+ *     4  bytes    the report
+ *
+ * The content hash is the CRC-32 of the reports that are restored, so a
+ * controller already holding them is recognised by reading them back and
+ * hashing, without writing anything.
+ */
+
+#ifndef CONFIG_SNAPSHOT_H
+#define CONFIG_SNAPSHOT_H
+
+#include "platform_compat.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* File format */
+#define SNAPSHOT_MAGIC "SXPSNP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 20
+#define SNAPSHOT_REPORT_HEADER_SIZE 4
+
+/* Most reports in a snapshot */
+#define SNAPSHOT_MAX_REPORTS 64
+
+/* Longest report kept, report ID byte included */
+#define SNAPSHOT_MAX_LENGTH 256
+
+/* Largest snapshot file */
+#define SNAPSHOT_MAX_FILE \
+    (SNAPSHOT_HEADER_SIZE + SNAPSHOT_MAX_REPORTS * (SNAPSHOT_REPORT_HEADER_SIZE + SNAPSHOT_MAX_LENGTH))
+
+/* The report is written back by restore */
+#define SNAPSHOT_FLAG_RESTORE 0x01
+
+/**
+ * One feature report as read
+ */
+typedef struct {
+    uint8_t report_id;
+    uint8_t flags;
+    uint16_t length;
+    unsigned char data[SNAPSHOT_MAX_LENGTH];
+} snapshot_report_t;
+
+/**
+ * A controller's feature reports
+ */
+typedef struct {
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint16_t count;
+    uint32_t hash;
+    snapshot_report_t reports[SNAPSHOT_MAX_REPORTS];
+} snapshot_t;
+
+/**
+ * Checks whether a feature report may be written back to other controllers
+ *
+ * Reports that belong to one unit (its address, firmware, IMU calibration
+ * and pairing, with the link key) and command reports are never restored.
+ *
+ * @param product_id Product ID of the controller
+ * @param report_id The report
+ * @return 1 if the report may be restored, 0 otherwise
+ */
+int snapshot_restorable(unsigned short product_id, unsigned char report_id);
+
+/**
+ * Computes the content hash of the reports that are restored
+ *
+ * @param snapshot The snapshot
+ * @return CRC-32 over the ID, length and bytes of each restored report
+ */
+uint32_t snapshot_hash(const snapshot_t *snapshot);
+
+/**
+ * Encodes a snapshot as a file image
+ *
+ * @param snapshot The snapshot, with its hash set
+ * @param out Output buffer
+ * @param out_len Size of the output buffer
+ * @return Number of bytes written, or 0 if the buffer is too small
+ */
+size_t snapshot_encode(const snapshot_t *snapshot, unsigned char *out, size_t out_len);
+
+/**
+ * Decodes a file image, checking its bounds and content hash
+ *
+ * @param data The file image
+ * @param length Length of the image
+ * @param snapshot Receives the snapshot
+ * @param error Receives a message on failure
+ * @param error_len Size of the error buffer
+ * @return 1 on success, 0 on failure
+ */
+int snapshot_decode(const unsigned char *data, size_t length, snapshot_t *snapshot, char *error, size_t error_len);
+
+/**
+ * Saves the feature reports of one controller to a snapshot file
+ *
+ * Usage: snapshot <file> [--path <device path>]
+ *
+ * The controller's report descriptor lists its feature reports; each one
+ * it answers is saved. With several controllers connected, --path picks one.
+ *
+ * @param argc Number of arguments after the "snapshot" command
+ * @param argv Arguments after the "snapshot" command
+ * @return 0 on success, 1 on failure
+ */
+int snapshot_command(int argc, char **argv);
+
+/**
+ * Writes a snapshot to every matching controller, in parallel
+ *
+ * Usage: restore <file> [--dry-run]
+ *
+ * Every USB controller of the snapshot's model reads back the restored
+ * reports; a controller whose hash already matches is skipped, the others
+ * get only the reports that differ, which are then read back to verify.
+ * --dry-run only compares.
+ *
+ * @param argc Number of arguments after the "restore" command
+ * @param argv Arguments after the "restore" command
+ * @return 0 if every matching controller holds the snapshot, 1 otherwise
+ */
+int restore_command(int argc, char **argv);
+
+#endif /* CONFIG_SNAPSHOT_H */
@@ -6,6 +6,15 @@
 
 #include "controller_connection.h"
 #include "mac_utils.h"
+#include "hid_io.h"
+#include "trace_events.h"
+#include "flight_recorder.h"
+#include "imu_calibration.h"
+#include "link_key_pairing.h"
+#include "bt_transport.h"
+#include "led_identify.h"
+#include "report_decoder.h"
+#include "capability_cache.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -20,6 +29,22 @@
 #define COLOR_WHITE "\x1b[37m"
 #define COLOR_BOLD "\x1b[1m"
 
+/* Input reads tried for a battery level, and how long each waits */
+#define BATTERY_READ_ATTEMPTS 8
+#define BATTERY_READ_TIMEOUT_MS 100
+
+/* Battery status byte of a DualSense input report in the USB layout */
+#define DUALSENSE_BATTERY_OFFSET 53
+
+/**
+ * Gets the platform path of an open device for trace events
+ */
+static const char* device_path(hid_device *dev)
+{
+    struct hid_device_info *device_info = hid_io_get_device_info(dev);
+    return device_info ? device_info->path : NULL;
+}
+
 /**
  * Attempts to connect to a controller using the most appropriate method
  */
@@ -27,19 +52,24 @@ hid_device* connect_to_controller(controller_info_t *controller)
 {
     hid_device *dev = NULL;
     const char* device_name = get_controller_name(controller->product_id);
+    uint64_t stage_start = trace_events_begin();
+    uint64_t fallback_start;
     
     printf("%s[INFO]%s Connecting to %s (Interface: %d)...\n", 
            COLOR_BLUE, COLOR_RESET, device_name, controller->interface_number);
     
     /* Try to open by path first (more reliable) */
-    dev = hid_open_path(controller->path);
+    dev = hid_io_open_path(controller->path);
     
     /* If that fails, try standard method */
     if (dev == NULL)
     {
         printf("%s[INFO]%s Path method failed, trying standard connection...\n", 
                COLOR_BLUE, COLOR_RESET);
-        dev = hid_open(controller->vendor_id, controller->product_id, NULL);
+        fallback_start = trace_events_begin();
+        dev = hid_io_open(controller->vendor_id, controller->product_id, NULL);
+        trace_events_record("standard connection", TRACE_CAT_FALLBACK, fallback_start,
+                            controller->path, -1, dev ? 0 : -1);
     }
     
     /* If standard methods failed, try alternative methods based on controller type */
@@ -56,7 +86,10 @@ hid_device* connect_to_controller(controller_info_t *controller)
             printf("%s[INFO]%s Standard methods failed, trying direct connection...\n", 
                    COLOR_BLUE, COLOR_RESET);
             
-            dev = hid_open(controller->vendor_id, controller->product_id, NULL);
+            fallback_start = trace_events_begin();
+            dev = hid_io_open(controller->vendor_id, controller->product_id, NULL);
+            trace_events_record("direct connection", TRACE_CAT_FALLBACK, fallback_start,
+                                controller->path, -1, dev ? 0 : -1);
             if (dev != NULL)
             {
                 printf("%s[SUCCESS]%s Connected to %s%s%s using direct connection\n",
@@ -70,6 +103,8 @@ hid_device* connect_to_controller(controller_info_t *controller)
                COLOR_GREEN, COLOR_RESET, COLOR_YELLOW, device_name, COLOR_RESET);
     }
     
+    trace_events_record("connect_to_controller", TRACE_CAT_STAGE, stage_start,
+                        controller->path, -1, dev ? 0 : -1);
     return dev;
 }
 
@@ -79,6 +114,7 @@ hid_device* connect_to_controller(controller_info_t *controller)
 hid_device* connect_to_dualshock4_raw(controller_info_t *controller)
 {
     hid_device *dev = NULL;
+    uint64_t fallback_start = trace_events_begin();
     
     printf("%s[INFO]%s Standard methods failed for DualShock 4, trying raw device access...\n", 
            COLOR_BLUE, COLOR_RESET);
@@ -104,7 +140,7 @@ hid_device* connect_to_dualshock4_raw(controller_info_t *controller)
                    COLOR_BLUE, COLOR_RESET, path);
                    
             /* Try to open the raw device directly */
-            dev = hid_open_path(path);
+            dev = hid_io_open_path(path);
             if (dev != NULL)
             {
                 printf("%s[SUCCESS]%s Connected to DualShock 4 using raw device path\n", 
@@ -114,6 +150,8 @@ hid_device* connect_to_dualshock4_raw(controller_info_t *controller)
         pclose(fp);
     }
     
+    trace_events_record("raw device access", TRACE_CAT_FALLBACK, fallback_start,
+                        controller->path, -1, dev ? 0 : -1);
     return dev;
 }
 
@@ -123,9 +161,11 @@ hid_device* connect_to_dualshock4_raw(controller_info_t *controller)
  */
 void dump_device_info(hid_device *dev)
 {
-    struct hid_device_info *device_info = hid_get_device_info(dev);
+    struct hid_device_info *device_info = hid_io_get_device_info(dev);
     unsigned char report_buf[256];
-    int ret;
+    capability_report_t known[64];
+    int ret, known_count = 0;
+    uint64_t stage_start = trace_events_begin();
     
     printf("\n%s%s=== Detailed Device Information ===%s\n", COLOR_BOLD, COLOR_GREEN, COLOR_RESET);
     
@@ -153,11 +193,46 @@ void dump_device_info(hid_device *dev)
     
     /* Try to get controller-specific information using known report IDs */
     printf("%s%s┌─ Controller-Specific Information ──────────────%s\n", COLOR_BOLD, COLOR_MAGENTA, COLOR_RESET);
+
+    /* Transport, address and battery are read the same way over USB and Bluetooth */
+    if (device_info)
+    {
+        unsigned char address[6];
+        int battery;
+
+        printf("%s│  Transport:        %s%s\n", COLOR_MAGENTA,
+               is_bluetooth_device(dev) ? "Bluetooth (reports checked with CRC-32)" : "USB", COLOR_RESET);
+        if (read_device_address(dev, device_info->product_id, address))
+        {
+            printf("%s│  Device Address:   %02x:%02x:%02x:%02x:%02x:%02x%s\n", COLOR_MAGENTA,
+                   address[0], address[1], address[2], address[3], address[4], address[5], COLOR_RESET);
+        }
+        battery = read_battery(dev, device_info->product_id);
+        if (battery == BATTERY_CHARGING)
+            printf("%s│  Battery:          charging%s\n", COLOR_MAGENTA, COLOR_RESET);
+        else if (battery >= 0)
+            printf("%s│  Battery:          %d%%%s\n", COLOR_MAGENTA, battery, COLOR_RESET);
+
+        /* What earlier runs learned about this model and firmware; requests known to fail are not sent */
+        if (capability_cache_enabled)
+        {
+            uint16_t firmware = capability_cache_firmware(dev);
+
+            known_count = capability_cache_reports(device_info->vendor_id, device_info->product_id, firmware,
+                                                   known, sizeof(known) / sizeof(known[0]));
+            if (firmware == CAPABILITY_FIRMWARE_UNKNOWN)
+                printf("%s│  Capabilities:     firmware unknown, %d report(s) known to answer%s\n", COLOR_MAGENTA,
+                       known_count, COLOR_RESET);
+            else
+                printf("%s│  Capabilities:     firmware %d.%d, %d report(s) known to answer%s\n", COLOR_MAGENTA,
+                       firmware >> 8, firmware & 0xff, known_count, COLOR_RESET);
+        }
+    }
     
     /* Report 0xF2 - Controller information (firmware version, Bluetooth MAC) */
     memset(report_buf, 0, sizeof(report_buf));
     report_buf[0] = 0xF2;
-    ret = hid_get_feature_report(dev, report_buf, sizeof(report_buf));
+    ret = hid_io_get_feature_report(dev, report_buf, sizeof(report_buf));
     if (ret > 0)
     {
         printf("%s│  [Report 0xF2] Controller Information:%s\n", COLOR_MAGENTA, COLOR_RESET);
@@ -171,7 +246,7 @@ void dump_device_info(hid_device *dev)
     /* Report 0xF5 - Current MAC address pairing */
     memset(report_buf, 0, sizeof(report_buf));
     report_buf[0] = MAC_REPORT_ID; /* 0xF5 */
-    ret = hid_get_feature_report(dev, report_buf, sizeof(report_buf));
+    ret = hid_io_get_feature_report(dev, report_buf, sizeof(report_buf));
     if (ret > 0)
     {
         printf("%s│  [Report 0xF5] Current MAC Pairing:%s\n", COLOR_MAGENTA, COLOR_RESET);
@@ -185,7 +260,7 @@ void dump_device_info(hid_device *dev)
     /* Report 0xA3 - PS3 Controller status */
     memset(report_buf, 0, sizeof(report_buf));
     report_buf[0] = 0xA3;
-    ret = hid_get_feature_report(dev, report_buf, sizeof(report_buf));
+    ret = hid_io_get_feature_report(dev, report_buf, sizeof(report_buf));
     if (ret > 0)
     {
         printf("%s│  [Report 0xA3] Controller Status:%s\n", COLOR_MAGENTA, COLOR_RESET);
@@ -200,7 +275,7 @@ void dump_device_info(hid_device *dev)
     /* Report 0x01 - Controller capabilities/features */
     memset(report_buf, 0, sizeof(report_buf));
     report_buf[0] = 0x01;
-    ret = hid_get_feature_report(dev, report_buf, sizeof(report_buf));
+    ret = hid_io_get_feature_report(dev, report_buf, sizeof(report_buf));
     if (ret > 0)
     {
         printf("%s│  [Report 0x01] Controller Capabilities:%s\n", COLOR_MAGENTA, COLOR_RESET);
@@ -212,23 +287,71 @@ void dump_device_info(hid_device *dev)
         printf("...%s\n", COLOR_RESET);
     }
     
+    /* Report 0x02 (0x05 over Bluetooth) - DualShock 4 IMU calibration; read
+       directly so that -d neither uses nor updates the calibration cache */
+    int calibration_shown = 0;
+    if (is_dualshock4(dev))
+    {
+        imu_calibration_t cal;
+        unsigned char usb_layout[DS4_CALIBRATION_LENGTH];
+        int bluetooth = is_bluetooth_device(dev);
+        static const char *AXES[IMU_AXES] = { "Accel X", "Accel Y", "Accel Z", "Gyro X", "Gyro Y", "Gyro Z" };
+
+        memset(report_buf, 0, sizeof(report_buf));
+        if (bluetooth)
+        {
+            report_buf[0] = DS4_BT_CALIBRATION_REPORT_ID;
+            ret = bt_get_feature_report(dev, report_buf, DS4_BT_CALIBRATION_LENGTH);
+            if (ret < 0 || !imu_calibration_ds4_from_bt(report_buf, (size_t)ret, usb_layout))
+                ret = -1;
+        }
+        else
+        {
+            report_buf[0] = DS4_CALIBRATION_REPORT_ID;
+            ret = hid_io_get_feature_report(dev, report_buf, DS4_CALIBRATION_LENGTH);
+            memcpy(usb_layout, report_buf, sizeof(usb_layout));
+        }
+        if (ret >= DS4_CALIBRATION_LENGTH && imu_calibration_parse_ds4(usb_layout, sizeof(usb_layout), &cal))
+        {
+            calibration_shown = 1;
+            printf("%s│  [Report 0x%02x] IMU Calibration:%s\n", COLOR_MAGENTA, report_buf[0], COLOR_RESET);
+            for (int axis = 0; axis < IMU_AXES; axis++)
+            {
+                printf("%s│    %-8s bias %8.1f counts, %.6f %s/count%s\n", COLOR_MAGENTA, AXES[axis],
+                       -cal.offset[axis] / cal.scale[axis], cal.scale[axis],
+                       axis < IMU_GYRO_X ? "g" : "deg/s", COLOR_RESET);
+            }
+        }
+    }
+
     /* Try to discover other report IDs by scanning */
     printf("%s│  [Report Discovery] Scanning for additional report IDs:%s\n", COLOR_MAGENTA, COLOR_RESET);
     int found_reports = 0;
     
-    /* Only scan a subset of possible report IDs to avoid taking too long */
-    unsigned char report_ids[] = {0x00, 0x02, 0x10, 0x12, 0x81, 0xA0, 0xF0, 0xF1, 0xF3, 0xF4, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA};
+    /* Only scan a subset of possible report IDs to avoid taking too long, plus those known to answer */
+    unsigned char report_ids[15 + sizeof(known) / sizeof(known[0])] = {
+        0x00, 0x02, 0x10, 0x12, 0x81, 0xA0, 0xF0, 0xF1, 0xF3, 0xF4, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA
+    };
+    size_t report_id_count = 15;
+
+    for (int k = 0; k < known_count; k++)
+    {
+        int transport = is_bluetooth_device(dev) ? CAPABILITY_BLUETOOTH : CAPABILITY_USB;
+
+        if ((known[k].transports & transport) && !memchr(report_ids, known[k].report_id, report_id_count))
+            report_ids[report_id_count++] = known[k].report_id;
+    }
     
-    for (size_t i = 0; i < sizeof(report_ids); i++)
+    for (size_t i = 0; i < report_id_count; i++)
     {
-        /* Skip report IDs we've already tried */
-        if (report_ids[i] == 0x01 || report_ids[i] == 0xA3 || 
+        /* Skip report IDs we've already tried; 0x02 is only shown raw when it was not decoded above */
+        if (report_ids[i] == 0x01 || (report_ids[i] == 0x02 && calibration_shown) || report_ids[i] == 0xA3 || 
             report_ids[i] == 0xF2 || report_ids[i] == MAC_REPORT_ID)
             continue;
             
         memset(report_buf, 0, sizeof(report_buf));
         report_buf[0] = report_ids[i];
-        ret = hid_get_feature_report(dev, report_buf, sizeof(report_buf));
+        ret = hid_io_get_feature_report(dev, report_buf, sizeof(report_buf));
         
         if (ret > 0)
         {
@@ -248,83 +371,364 @@ void dump_device_info(hid_device *dev)
     }
     
     printf("%s└───────────────────────────────────────────────%s\n", COLOR_MAGENTA, COLOR_RESET);
+    
+    trace_events_record("dump_device_info", TRACE_CAT_STAGE, stage_start,
+                        device_info ? device_info->path : NULL, -1, found_reports);
 }
 
 /**
- * Pairs a PlayStation controller with the specified MAC address
+ * Starts input reports on a SixAxis controller
  */
-void pair_device(hid_device *dev, const char *mac, size_t mac_len)
+int enable_sixaxis_reports(hid_device *dev)
+{
+    unsigned char buf[5] = { SIXAXIS_ENABLE_REPORT_ID, 0x42, 0x0c, 0x00, 0x00 };
+
+    return hid_io_send_feature_report(dev, buf, sizeof(buf)) >= 0;
+}
+
+/**
+ * Reads the controller's own Bluetooth address
+ */
+int read_device_address(hid_device *dev, unsigned short product_id, unsigned char *mac)
+{
+    const link_key_layout_t *layout = link_key_layout(product_id);
+    unsigned char buf[17], host[6];
+    int ret;
+
+    /* On Bluetooth the host's HID stack knows the address already */
+    if (is_bluetooth_device(dev))
+        return bt_device_address(dev, mac);
+
+    /* DualShock 4 and DualSense: one get of the family's pairing report */
+    if (layout)
+        return link_key_read_pairing(dev, layout, mac, host);
+
+    memset(buf, 0, sizeof(buf));
+    if (product_id == PRODUCT_SIXAXIS)
+    {
+        buf[0] = 0xF2;
+        ret = hid_io_get_feature_report(dev, buf, sizeof(buf));
+        if (ret < 10)
+            return 0;
+        memcpy(mac, buf + 4, 6);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Writes a host MAC address to the controller's pairing report
+ */
+int write_pairing(hid_device *dev, const unsigned char *mac)
 {
     unsigned char buf[8]; /* Buffer for the feature report */
     int ret;              /* Return value from HID operations */
-    int is_ds4 = is_dualshock4(dev);
+    uint64_t fallback_start;
+    const link_key_layout_t *layout = link_key_device_layout(dev);
 
-    /* Print controller type information */
-    if (is_ds4) {
-        printf("%s[INFO]%s Device identified as DualShock 4 controller\n", 
+    /* A DualSense has no report for the host address alone */
+    if (layout && !layout->address_report_id)
+        return 0;
+
+    /* Initialize the feature report buffer */
+    memset(buf, 0, sizeof(buf));
+    buf[0] = MAC_REPORT_ID; /* Set the report ID for MAC address */
+    buf[1] = 0x0;           /* Reserved byte, must be zero */
+    memcpy(buf + 2, mac, 6);
+
+    /* First try the standard method */
+    ret = hid_io_send_feature_report(dev, buf, sizeof(buf));
+
+    /* For DualShock 4, we might need to try different approaches */
+    if (ret == -1 && is_dualshock4(dev)) {
+        printf("%s[INFO]%s Standard method failed for DualShock 4, trying alternatives...\n", 
                COLOR_BLUE, COLOR_RESET);
+        fallback_start = trace_events_begin();
+               
+        /* Try with Bluetooth report ID 0x12 which is used by some DualShock 4 models */
+        buf[0] = 0x12;
+        ret = hid_io_send_feature_report(dev, buf, sizeof(buf));
+        
+        if (ret == -1) {
+            /* Try with report ID 0x81 */
+            buf[0] = 0x81;
+            ret = hid_io_send_feature_report(dev, buf, sizeof(buf));
+        }
+        trace_events_record("alternative report IDs", TRACE_CAT_FALLBACK, fallback_start,
+                            device_path(dev), buf[0], ret);
     }
 
+    return ret != -1;
+}
+
+/**
+ * Pairs a controller with a host as pair_device() does, without reporting
+ */
+int write_host_pairing(hid_device *dev, const unsigned char *host_mac)
+{
+    const link_key_layout_t *layout = link_key_device_layout(dev);
+
+    if (is_bluetooth_device(dev))
+        return 0;
+    if (layout && (link_key_available() || !layout->address_report_id))
+    {
+        link_key_pair_result_t result = link_key_pair(dev, layout, host_mac, NULL);
+
+        if (result == LINK_KEY_PAIR_OK || (result == LINK_KEY_PAIR_STORE_FAILED && !link_key_available()))
+            return 1;
+        if (!layout->address_report_id ||
+            (result != LINK_KEY_PAIR_KEY_FAILED && result != LINK_KEY_PAIR_WRITE_FAILED))
+            return 0;
+    }
+    return write_pairing(dev, host_mac);
+}
+
+/**
+ * Reads the host MAC address the controller is currently paired with
+ */
+int read_pairing(hid_device *dev, unsigned char *mac)
+{
+    unsigned char buf[8]; /* Buffer for the feature report */
+    int ret;              /* Return value from HID operations */
+    uint64_t fallback_start;
+    const link_key_layout_t *layout = link_key_device_layout(dev);
+
+    /* A DualSense, and any controller on Bluetooth, is read in one get of
+       its pairing report, without trials */
+    if (layout && (!layout->address_report_id || is_bluetooth_device(dev)))
+        return link_key_read_pairing(dev, layout, buf, mac);
+
     /* Initialize the feature report buffer */
     memset(buf, 0, sizeof(buf));
     buf[0] = MAC_REPORT_ID; /* Set the report ID for MAC address */
     buf[1] = 0x0;           /* Reserved byte, must be zero */
 
+    /* First try the standard method */
+    ret = hid_io_get_feature_report(dev, buf, sizeof(buf));
+    
+    /* For DualShock 4, we might need to try different approaches */
+    if (ret < 8 && is_dualshock4(dev)) {
+        printf("%s[INFO]%s Standard method failed for DualShock 4, trying alternatives...\n", 
+               COLOR_BLUE, COLOR_RESET);
+        fallback_start = trace_events_begin();
+               
+        /* Report 0x12 holds the controller's own address in bytes 1-6 and the
+           paired host in bytes 10-15, both little-endian */
+        unsigned char pairing[16];
+        memset(pairing, 0, sizeof(pairing));
+        pairing[0] = 0x12;
+        ret = hid_io_get_feature_report(dev, pairing, sizeof(pairing));
+        trace_events_record("alternative report IDs", TRACE_CAT_FALLBACK, fallback_start,
+                            device_path(dev), pairing[0], ret);
+        if (ret < 16)
+            return 0;
+        for (int i = 0; i < 6; i++)
+            mac[i] = pairing[15 - i];
+        return 1;
+    }
+
+    if (ret < 8)
+        return 0;
+
+    memcpy(mac, buf + 2, 6);
+    return 1;
+}
+
+/**
+ * Reads the battery level from the controller's input reports
+ */
+int read_battery(hid_device *dev, unsigned short product_id)
+{
+    report_family_t family = report_family(product_id);
+    int dualsense = product_id == PRODUCT_DUALSENSE || product_id == PRODUCT_DUALSENSE_EDGE;
+    decoded_reports_t batch;
+    input_report_t report;
+    int battery = -1;
+
+    if (family == REPORT_FAMILY_UNKNOWN && !dualsense)
+        return -1;
+    if (!dualsense && !decoded_reports_init(&batch, 1))
+        return -1;
+
+    /* A SixAxis sends nothing until enabled; a DualShock 4 on Bluetooth sends
+       reduced reports without the battery until its calibration is read */
+    if (product_id == PRODUCT_SIXAXIS)
+        enable_sixaxis_reports(dev);
+    if (product_id == PRODUCT_DS4 && is_bluetooth_device(dev))
+    {
+        unsigned char calibration[DS4_BT_CALIBRATION_LENGTH] = { DS4_BT_CALIBRATION_REPORT_ID };
+        bt_get_feature_report(dev, calibration, sizeof(calibration));
+    }
+
+    for (int attempt = 0; attempt < BATTERY_READ_ATTEMPTS && battery < 0; attempt++)
+    {
+        int ret = hid_io_read_timeout(dev, report.data, INPUT_REPORT_MAX, BATTERY_READ_TIMEOUT_MS);
+
+        if (ret < 0)
+            break;
+        report.length = (uint32_t)ret;
+        if (ret == 0 || !bt_normalize_input(product_id, &report) || report.data[0] != 0x01)
+            continue;
+
+        if (dualsense)
+        {
+            /* Level in tenths in the low nibble, 1 in the high nibble while charging */
+            if (report.length > DUALSENSE_BATTERY_OFFSET)
+            {
+                int status = report.data[DUALSENSE_BATTERY_OFFSET], level = status & 0x0f;
+                battery = (status >> 4) == 1 ? BATTERY_CHARGING : (level >= 10 ? 100 : level * 10 + 5);
+            }
+        }
+        else if (report.length >= report_min_length(family))
+        {
+            batch.count = 0;
+            decode_reports(family, &report, 1, &batch);
+            battery = batch.battery[0];
+        }
+    }
+
+    if (!dualsense)
+        decoded_reports_free(&batch);
+    return battery;
+}
+
+/**
+ * Sets the lightbar of a DualShock 4 or DualSense, or the sphere of a Move
+ */
+int set_lightbar(hid_device *dev, unsigned short product_id, unsigned char red, unsigned char green,
+                 unsigned char blue)
+{
+    led_state_t state = { red, green, blue, -1, -1 };
+    led_report_t report;
+
+    /* The SixAxis has player LEDs only */
+    if (product_id == PRODUCT_SIXAXIS || !led_report_template(&report, product_id, is_bluetooth_device(dev)))
+        return -1;
+    led_report_apply(&report, &state);
+    return hid_io_write(dev, report.data, report.length) >= 0;
+}
+
+/**
+ * Pairs a DualShock 4 or DualSense with a link key that BlueZ learns as well
+ *
+ * @return 1 on success, 0 on failure, -1 to fall back to writing the host address only
+ */
+static int pair_with_link_key(hid_device *dev, const link_key_layout_t *layout, const unsigned char *host_mac)
+{
+    unsigned char device_mac[6];
+    link_key_pair_result_t result = link_key_pair(dev, layout, host_mac, device_mac);
+
+    switch (result)
+    {
+    case LINK_KEY_PAIR_OK:
+        printf("%s[SUCCESS]%s Paired %02x:%02x:%02x:%02x:%02x:%02x with a link key stored in %s\n", COLOR_GREEN,
+               COLOR_RESET, device_mac[0], device_mac[1], device_mac[2], device_mac[3], device_mac[4], device_mac[5],
+               link_key_storage());
+        printf("%s[INFO]%s Restart bluetoothd to load the key; the controller then connects without pairing\n",
+               COLOR_BLUE, COLOR_RESET);
+        return 1;
+    case LINK_KEY_PAIR_STORE_FAILED:
+        if (!link_key_available())
+            printf("%s[SUCCESS]%s Set MAC address; pair the controller over Bluetooth once to bond it\n",
+                   COLOR_GREEN, COLOR_RESET);
+        else
+            printf("%s[ERROR]%s Paired, but could not store the link key in %s (run as root?); the controller "
+                   "will need Bluetooth pairing\n", COLOR_RED, COLOR_RESET, link_key_storage());
+        return 1;
+    case LINK_KEY_PAIR_UNVERIFIED:
+    case LINK_KEY_PAIR_MISMATCH:
+        printf("%s[ERROR]%s Wrote the link key, but the controller %s\n", COLOR_RED, COLOR_RESET,
+               result == LINK_KEY_PAIR_MISMATCH ? "reports another host" : "could not be read back");
+        flight_recorder_dump(dev, "link_key_pair failed");
+        return 0;
+    default:
+        if (!layout->address_report_id)
+        {
+            printf("%s[ERROR]%s Failed to write the link key. Error: %ls\n", COLOR_RED, COLOR_RESET,
+                   hid_io_error(dev));
+            flight_recorder_dump(dev, "link_key_pair failed");
+            return 0;
+        }
+        printf("%s[INFO]%s Could not pair with a link key, writing the host address only\n", COLOR_BLUE,
+               COLOR_RESET);
+        return -1;
+    }
+}
+
+/**
+ * Pairs a PlayStation controller with the specified MAC address
+ */
+int pair_device(hid_device *dev, const char *mac, size_t mac_len)
+{
+    unsigned char host_mac[6]; /* Parsed MAC address */
+    int ok;                    /* Result of the pairing write */
+    const link_key_layout_t *layout = link_key_device_layout(dev);
+    uint64_t stage_start = trace_events_begin();
+
+    /* Print controller type information */
+    if (is_dualshock4(dev)) {
+        printf("%s[INFO]%s Device identified as DualShock 4 controller\n", 
+               COLOR_BLUE, COLOR_RESET);
+    } else if (is_dualsense(dev)) {
+        printf("%s[INFO]%s Device identified as DualSense controller\n", 
+               COLOR_BLUE, COLOR_RESET);
+    }
+
+    /* The pairing reports are only written over the cable */
+    if (is_bluetooth_device(dev))
+    {
+        printf("%s[ERROR]%s The controller is connected over Bluetooth; connect it with a USB cable to pair it\n",
+               COLOR_RED, COLOR_RESET);
+        return 0;
+    }
+
     /* Validate MAC address format and convert to bytes */
-    if ((mac_len != 12 && mac_len != 17) || !mac_to_bytes(mac, mac_len, buf + 2, sizeof(buf) - 2))
+    if ((mac_len != 12 && mac_len != 17) || !mac_to_bytes(mac, mac_len, host_mac, sizeof(host_mac)))
     {
         printf("%s[ERROR]%s Invalid MAC address format: %s\n", COLOR_RED, COLOR_RESET, mac);
         printf("        MAC address must be in format '%sAABBCCDDEEFF%s' or '%sAA:BB:CC:DD:EE:FF%s'\n",
                COLOR_CYAN, COLOR_RESET, COLOR_CYAN, COLOR_RESET);
-        return;
+        return 0;
     }
 
     /* Send the feature report to the controller */
     printf("%s[INFO]%s Attempting to set MAC address to %s%02x:%02x:%02x:%02x:%02x:%02x%s...\n",
            COLOR_BLUE, COLOR_RESET, COLOR_CYAN,
-           buf[2], buf[3], buf[4], buf[5], buf[6], buf[7], COLOR_RESET);
+           host_mac[0], host_mac[1], host_mac[2], host_mac[3], host_mac[4], host_mac[5], COLOR_RESET);
            
-    /* For DualShock 4, we might need to try different approaches */
-    if (is_ds4) {
-        /* First try the standard method */
-        ret = hid_send_feature_report(dev, buf, sizeof(buf));
-        
-        /* If that fails, try alternative methods for DualShock 4 */
-        if (ret == -1) {
-            printf("%s[INFO]%s Standard method failed for DualShock 4, trying alternatives...\n", 
-                   COLOR_BLUE, COLOR_RESET);
-                   
-            /* Try with Bluetooth report ID 0x12 which is used by some DualShock 4 models */
-            unsigned char alt_buf[8];
-            memcpy(alt_buf, buf, sizeof(alt_buf));
-            alt_buf[0] = 0x12;
-            ret = hid_send_feature_report(dev, alt_buf, sizeof(alt_buf));
-            
-            if (ret == -1) {
-                /* Try with report ID 0x81 */
-                alt_buf[0] = 0x81;
-                ret = hid_send_feature_report(dev, alt_buf, sizeof(alt_buf));
-            }
+    /* A DualShock 4 also takes a link key, which skips Bluetooth pairing later;
+       a DualSense only takes the host address together with a link key */
+    if (layout && (link_key_available() || !layout->address_report_id))
+    {
+        ok = pair_with_link_key(dev, layout, host_mac);
+        if (ok >= 0)
+        {
+            trace_events_record("pair_device", TRACE_CAT_STAGE, stage_start, device_path(dev),
+                                layout->link_key_report_id, ok ? 0 : -1);
+            if (ok)
+                dump_device_info(dev);
+            return ok;
         }
-    } else {
-        /* Standard method for other controllers */
-        ret = hid_send_feature_report(dev, buf, sizeof(buf));
     }
+
+    ok = write_pairing(dev, host_mac);
+    trace_events_record("pair_device", TRACE_CAT_STAGE, stage_start, device_path(dev), MAC_REPORT_ID, ok ? 0 : -1);
     
-    if (ret == -1)
+    if (!ok)
     {
         printf("%s[ERROR]%s Failed to set MAC address. Error: %ls\n",
-               COLOR_RED, COLOR_RESET, hid_error(dev));
-    }
-    else
-    {
-        printf("%s[SUCCESS]%s Set MAC address to %s%02x:%02x:%02x:%02x:%02x:%02x%s\n",
-               COLOR_GREEN, COLOR_RESET, COLOR_CYAN,
-               buf[2], buf[3], buf[4], buf[5], buf[6], buf[7], COLOR_RESET);
-        
-        /* Get detailed device information when pairing is successful */
-        dump_device_info(dev);
+               COLOR_RED, COLOR_RESET, hid_io_error(dev));
+        flight_recorder_dump(dev, "pair_device failed");
+        return 0;
     }
+
+    printf("%s[SUCCESS]%s Set MAC address to %s%02x:%02x:%02x:%02x:%02x:%02x%s\n",
+           COLOR_GREEN, COLOR_RESET, COLOR_CYAN,
+           host_mac[0], host_mac[1], host_mac[2], host_mac[3], host_mac[4], host_mac[5], COLOR_RESET);
+    
+    /* Get detailed device information when pairing is successful */
+    dump_device_info(dev);
+    return 1;
 }
 
 /**
@@ -332,62 +736,36 @@ void pair_device(hid_device *dev, const char *mac, size_t mac_len)
  */
 void show_pairing(hid_device *dev)
 {
-    unsigned char buf[8]; /* Buffer for the feature report */
-    int ret;              /* Return value from HID operations */
-    int is_ds4 = is_dualshock4(dev);
+    unsigned char mac[6]; /* Currently paired MAC address */
+    int ok;               /* Result of the pairing read */
+    uint64_t stage_start = trace_events_begin();
 
     /* Print controller type information */
-    if (is_ds4) {
+    if (is_dualshock4(dev)) {
         printf("%s[INFO]%s Device identified as DualShock 4 controller\n", 
                COLOR_BLUE, COLOR_RESET);
+    } else if (is_dualsense(dev)) {
+        printf("%s[INFO]%s Device identified as DualSense controller\n", 
+               COLOR_BLUE, COLOR_RESET);
     }
 
-    /* Initialize the feature report buffer */
-    memset(buf, 0, sizeof(buf));
-    buf[0] = MAC_REPORT_ID; /* Set the report ID for MAC address */
-    buf[1] = 0x0;           /* Reserved byte, must be zero */
-
     /* Get the current MAC address from the controller */
     printf("%s[INFO]%s Retrieving current MAC address from controller...\n", COLOR_BLUE, COLOR_RESET);
     
-    /* For DualShock 4, we might need to try different approaches */
-    if (is_ds4) {
-        /* First try the standard method */
-        ret = hid_get_feature_report(dev, buf, sizeof(buf));
-        
-        /* If that fails, try alternative methods for DualShock 4 */
-        if (ret < 8) {
-            printf("%s[INFO]%s Standard method failed for DualShock 4, trying alternatives...\n", 
-                   COLOR_BLUE, COLOR_RESET);
-                   
-            /* Try with Bluetooth report ID 0x12 which is used by some DualShock 4 models */
-            memset(buf, 0, sizeof(buf));
-            buf[0] = 0x12;
-            ret = hid_get_feature_report(dev, buf, sizeof(buf));
-            
-            if (ret < 8) {
-                /* Try with report ID 0x81 */
-                memset(buf, 0, sizeof(buf));
-                buf[0] = 0x81;
-                ret = hid_get_feature_report(dev, buf, sizeof(buf));
-            }
-        }
-    } else {
-        /* Standard method for other controllers */
-        ret = hid_get_feature_report(dev, buf, sizeof(buf));
-    }
+    ok = read_pairing(dev, mac);
+    trace_events_record("show_pairing", TRACE_CAT_STAGE, stage_start, device_path(dev), MAC_REPORT_ID, ok ? 0 : -1);
     
-    if (ret < 8)
+    if (!ok)
     {
         printf("%s[ERROR]%s Failed to read MAC address. Error: %ls\n",
-               COLOR_RED, COLOR_RESET, hid_error(dev));
+               COLOR_RED, COLOR_RESET, hid_io_error(dev));
         return;
     }
 
     /* Print the MAC address in standard format XX:XX:XX:XX:XX:XX */
     printf("%s[INFO]%s Current controller MAC address: %s%02x:%02x:%02x:%02x:%02x:%02x%s\n",
            COLOR_BLUE, COLOR_RESET, COLOR_CYAN,
-           buf[2], buf[3], buf[4], buf[5], buf[6], buf[7], COLOR_RESET);
+           mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], COLOR_RESET);
            
     /* Ask if user wants to see detailed device information */
     char response[10];
@@ -34,14 +34,98 @@ hid_device* connect_to_dualshock4_raw(controller_info_t *controller);
  */
 void dump_device_info(hid_device *dev);
 
+/**
+ * Starts input reports on a SixAxis controller, which stays silent over USB
+ * until it receives the 0xF4 enable command
+ *
+ * @param dev Handle to the HID device
+ * @return 1 on success, 0 on failure
+ */
+int enable_sixaxis_reports(hid_device *dev);
+
+/**
+ * Reads the controller's own Bluetooth address
+ * (the pairing report of link_key_layout() on a DualShock 4 or DualSense,
+ * report 0xF2 on a SixAxis, the serial number of any controller on Bluetooth)
+ *
+ * @param dev Handle to the HID device
+ * @param product_id Product ID of the controller
+ * @param mac Output buffer for the 6-byte device address
+ * @return 1 on success, 0 on failure or for other controllers
+ */
+int read_device_address(hid_device *dev, unsigned short product_id, unsigned char *mac);
+
+/**
+ * Writes a host MAC address to the controller's pairing report
+ * (tries the DualShock 4 alternative report IDs if the standard one fails;
+ * always fails on a DualSense, which pair_device() pairs with a link key)
+ *
+ * @param dev Handle to the HID device
+ * @param mac The 6-byte host MAC address
+ * @return 1 on success, 0 on failure
+ */
+int write_pairing(hid_device *dev, const unsigned char *mac);
+
+/**
+ * Pairs a controller with a host as pair_device() does, without reporting:
+ * with a link key where the controller takes one, otherwise (or when a
+ * DualShock 4 rejects the key) with the host address only. The result is
+ * not read back.
+ *
+ * @param dev Handle to the HID device
+ * @param host_mac The 6-byte host MAC address
+ * @return 1 on success, 0 on failure or for a controller on Bluetooth
+ */
+int write_host_pairing(hid_device *dev, const unsigned char *host_mac);
+
+/**
+ * Reads the host MAC address the controller is currently paired with
+ * (tries the DualShock 4 alternative report IDs if the standard one fails;
+ * a single get of the pairing report on a DualSense, and on a DualShock 4
+ * over Bluetooth)
+ *
+ * @param dev Handle to the HID device
+ * @param mac Output buffer for the 6-byte host MAC address
+ * @return 1 on success, 0 on failure
+ */
+int read_pairing(hid_device *dev, unsigned char *mac);
+
+/**
+ * Reads the battery level from the controller's input reports
+ * (full Bluetooth input reports are checked and rewritten in the USB layout)
+ *
+ * @param dev Handle to the HID device
+ * @param product_id Product ID of the controller
+ * @return Percent, BATTERY_CHARGING while on the cable, or -1 if unknown
+ */
+int read_battery(hid_device *dev, unsigned short product_id);
+
+/**
+ * Sets the lightbar of a DualShock 4 or DualSense, or the sphere of a Move,
+ * with one output report (wrapped with its CRC on Bluetooth)
+ *
+ * A Move turns its sphere off again after a few seconds without a new report.
+ *
+ * @param dev Handle to the HID device
+ * @param product_id Product ID of the controller
+ * @param red Red level
+ * @param green Green level
+ * @param blue Blue level
+ * @return 1 on success, 0 on failure, -1 if the controller has no lightbar
+ */
+int set_lightbar(hid_device *dev, unsigned short product_id, unsigned char red, unsigned char green,
+                 unsigned char blue);
+
 /**
  * Pairs a PlayStation controller with the specified MAC address
+ * (USB only; a controller on Bluetooth is refused)
  *
  * @param dev Handle to the HID device
  * @param mac MAC address string to pair with
  * @param mac_len Length of the MAC address string
+ * @return 1 on success, 0 on failure
  */
-void pair_device(hid_device *dev, const char *mac, size_t mac_len);
+int pair_device(hid_device *dev, const char *mac, size_t mac_len);
 
 /**
  * Displays the currently paired MAC address of the controller
@@ -5,6 +5,8 @@
  */
 
 #include "controller_info.h"
+#include "hid_io.h"
+#include "trace_events.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -12,7 +14,9 @@
 static const unsigned short SUPPORTED_PRODUCTS[] = {
     PRODUCT_SIXAXIS,  /* PlayStation 3 SixAxis controller */
     PRODUCT_MOVE,     /* PlayStation Move Motion controller */
-    PRODUCT_DS4       /* Sony Corp. DualShock 4 [CUH-ZCT2x] */
+    PRODUCT_DS4,      /* Sony Corp. DualShock 4 [CUH-ZCT2x] */
+    PRODUCT_DUALSENSE,      /* PlayStation 5 DualSense [CFI-ZCT1] */
+    PRODUCT_DUALSENSE_EDGE  /* PlayStation 5 DualSense Edge [CFI-ZCP1] */
 };
 
 /**
@@ -26,6 +30,10 @@ const char* get_controller_name(unsigned short product_id)
         return "Move Motion Controller";
     else if (product_id == PRODUCT_DS4)
         return "DualShock 4 [CUH-ZCT2x]";
+    else if (product_id == PRODUCT_DUALSENSE)
+        return "DualSense [CFI-ZCT1]";
+    else if (product_id == PRODUCT_DUALSENSE_EDGE)
+        return "DualSense Edge [CFI-ZCP1]";
     else
         return "Compatible Device";
 }
@@ -35,7 +43,7 @@ const char* get_controller_name(unsigned short product_id)
  */
 int is_dualshock4(hid_device *dev)
 {
-    struct hid_device_info *device_info = hid_get_device_info(dev);
+    struct hid_device_info *device_info = hid_io_get_device_info(dev);
     if (device_info && device_info->vendor_id == VENDOR_SONY && device_info->product_id == PRODUCT_DS4)
     {
         return 1;
@@ -43,6 +51,41 @@ int is_dualshock4(hid_device *dev)
     return 0;
 }
 
+/**
+ * Determines if the device is a DualSense or DualSense Edge controller
+ */
+int is_dualsense(hid_device *dev)
+{
+    struct hid_device_info *device_info = hid_io_get_device_info(dev);
+    if (device_info && device_info->vendor_id == VENDOR_SONY &&
+        (device_info->product_id == PRODUCT_DUALSENSE || device_info->product_id == PRODUCT_DUALSENSE_EDGE))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Determines if an open device is connected over Bluetooth rather than USB
+ */
+int is_bluetooth_device(hid_device *dev)
+{
+    struct hid_device_info *device_info = hid_io_get_device_info(dev);
+    return device_info && device_info->interface_number < 0;
+}
+
+/**
+ * Checks if a USB interface is the HID interface of a controller with several interfaces
+ */
+int is_preferred_interface(unsigned short product_id, int interface_number)
+{
+    if (product_id == PRODUCT_DS4)
+        return interface_number == DS4_HID_INTERFACE;
+    if (product_id == PRODUCT_DUALSENSE || product_id == PRODUCT_DUALSENSE_EDGE)
+        return interface_number == DUALSENSE_HID_INTERFACE;
+    return 0;
+}
+
 /**
  * Creates a deep copy of controller information
  */
@@ -87,12 +130,8 @@ controller_info_t* create_controller_info(struct hid_device_info *device_info)
         }
     }
     
-    /* For DualShock 4, prefer interface 3 */
-    if (device_info->product_id == PRODUCT_DS4 && device_info->interface_number == DS4_HID_INTERFACE) {
-        info->is_preferred = 1;
-    } else {
-        info->is_preferred = 0;
-    }
+    /* For DualShock 4 and DualSense, prefer the HID interface 3 */
+    info->is_preferred = is_preferred_interface(device_info->product_id, device_info->interface_number);
     
     return info;
 }
@@ -120,13 +159,40 @@ int is_supported_controller(unsigned short vendor_id, unsigned short product_id)
     if (vendor_id != VENDOR_SONY)
         return 0;
         
+    return get_product_index(product_id) >= 0;
+}
+
+/**
+ * Gets the position of a product ID in the supported product table
+ */
+int get_product_index(unsigned short product_id)
+{
     for (size_t i = 0; i < sizeof(SUPPORTED_PRODUCTS) / sizeof(*SUPPORTED_PRODUCTS); i++)
     {
         if (product_id == SUPPORTED_PRODUCTS[i])
-            return 1;
+            return (int)i;
     }
     
-    return 0;
+    return -1;
+}
+
+/**
+ * Gets the product ID stored at a position in the supported product table
+ */
+unsigned short get_supported_product(int index)
+{
+    if (index < 0 || (size_t)index >= sizeof(SUPPORTED_PRODUCTS) / sizeof(*SUPPORTED_PRODUCTS))
+        return 0;
+        
+    return SUPPORTED_PRODUCTS[index];
+}
+
+/**
+ * Checks if a controller is connected over Bluetooth rather than USB
+ */
+int is_bluetooth_controller(const controller_info_t *controller)
+{
+    return controller->interface_number < 0;
 }
 
 /**
@@ -136,9 +202,10 @@ int find_controllers(controller_info_t *controllers[], int max_controllers)
 {
     struct hid_device_info *devs, *cur_dev;
     int controller_count = 0;
+    uint64_t stage_start = trace_events_begin();
     
     /* Enumerate all Sony devices */
-    devs = hid_enumerate(VENDOR_SONY, 0);
+    devs = hid_io_enumerate(VENDOR_SONY, 0);
     cur_dev = devs;
     
     /* First pass: identify all supported devices */
@@ -173,7 +240,9 @@ int find_controllers(controller_info_t *controllers[], int max_controllers)
     }
     
     /* Free the enumeration */
-    hid_free_enumeration(devs);
+    hid_io_free_enumeration(devs);
+    
+    trace_events_record("find_controllers", TRACE_CAT_STAGE, stage_start, NULL, -1, controller_count);
     
     return controller_count;
 }
\ No newline at end of file
@@ -17,16 +17,35 @@
 #define PRODUCT_SIXAXIS 0x0268  /* PlayStation 3 SixAxis controller */
 #define PRODUCT_MOVE    0x042f  /* PlayStation Move Motion controller */
 #define PRODUCT_DS4     0x09cc  /* Sony Corp. DualShock 4 [CUH-ZCT2x] */
+#define PRODUCT_DUALSENSE      0x0ce6  /* PlayStation 5 DualSense [CFI-ZCT1] */
+#define PRODUCT_DUALSENSE_EDGE 0x0df2  /* PlayStation 5 DualSense Edge [CFI-ZCP1] */
 
 /* DualShock 4 specific constants */
 #define DS4_HID_INTERFACE 3     /* Interface number for HID on DualShock 4 */
 
+/* DualSense specific constants; interfaces 0-2 are audio */
+#define DUALSENSE_HID_INTERFACE 3
+
 /* Maximum number of controllers to handle */
-#define MAX_CONTROLLERS 10
+#define MAX_CONTROLLERS 64
 
 /* MAC address report ID for controller pairing */
 #define MAC_REPORT_ID 0xf5
 
+/* Feature report that starts input reports on a SixAxis controller */
+#define SIXAXIS_ENABLE_REPORT_ID 0xf4
+
+/* Output reports over USB: DualShock 4 and DualSense rumble and lightbar,
+   Move sphere and rumble, SixAxis rumble and player LEDs */
+#define DS4_OUTPUT_REPORT_ID 0x05
+#define DS4_OUTPUT_LENGTH 32
+#define DUALSENSE_OUTPUT_REPORT_ID 0x02
+#define DUALSENSE_OUTPUT_LENGTH 63
+#define MOVE_OUTPUT_REPORT_ID 0x06
+#define MOVE_OUTPUT_LENGTH 49
+#define SIXAXIS_OUTPUT_REPORT_ID 0x01
+#define SIXAXIS_OUTPUT_LENGTH 49
+
 /**
  * Structure to store controller information
  */
@@ -39,7 +58,7 @@ typedef struct {
     wchar_t *manufacturer_string;         /* Manufacturer string (copied from device_info) */
     wchar_t *product_string;              /* Product string (copied from device_info) */
     wchar_t *serial_number;               /* Serial number (copied from device_info) */
-    int is_preferred;                     /* Flag for preferred devices (e.g., DS4 with interface 3) */
+    int is_preferred;                     /* Flag for preferred devices (e.g., DS4 or DualSense with interface 3) */
 } controller_info_t;
 
 /**
@@ -58,6 +77,31 @@ const char* get_controller_name(unsigned short product_id);
  */
 int is_dualshock4(hid_device *dev);
 
+/**
+ * Determines if the device is a DualSense or DualSense Edge controller
+ *
+ * @param dev Handle to the HID device
+ * @return 1 if the device is a DualSense, 0 otherwise
+ */
+int is_dualsense(hid_device *dev);
+
+/**
+ * Determines if an open device is connected over Bluetooth rather than USB
+ *
+ * @param dev Handle to the HID device
+ * @return 1 if the device is connected over Bluetooth, 0 otherwise
+ */
+int is_bluetooth_device(hid_device *dev);
+
+/**
+ * Checks if a USB interface is the HID interface of a controller with several interfaces
+ *
+ * @param product_id The product ID of the controller
+ * @param interface_number The interface number
+ * @return 1 for the HID interface of a DualShock 4 or DualSense, 0 otherwise
+ */
+int is_preferred_interface(unsigned short product_id, int interface_number);
+
 /**
  * Creates a deep copy of controller information
  * 
@@ -82,6 +126,32 @@ void free_controller_info(controller_info_t *info);
  */
 int is_supported_controller(unsigned short vendor_id, unsigned short product_id);
 
+/**
+ * Gets the position of a product ID in the supported product table
+ * 
+ * @param product_id The product ID of the device
+ * @return Index into the supported product table, or -1 if not supported
+ */
+int get_product_index(unsigned short product_id);
+
+/**
+ * Gets the product ID stored at a position in the supported product table
+ * 
+ * @param index Index into the supported product table
+ * @return The product ID, or 0 if the index is out of range
+ */
+unsigned short get_supported_product(int index);
+
+/**
+ * Checks if a controller is connected over Bluetooth rather than USB
+ * 
+ * HIDAPI reports no interface number for Bluetooth HID devices.
+ * 
+ * @param controller The controller information
+ * @return 1 if the controller is connected over Bluetooth, 0 otherwise
+ */
+int is_bluetooth_controller(const controller_info_t *controller);
+
 /**
  * Finds all supported controllers and returns their information
  * 
@@ -0,0 +1,641 @@
+/**
+ * controller_qa.c - Controller health checks for refurbishment
+ *
+ * Implementation of qa mode. Every controller gets a reader thread that
+ * reads reports into a small batch, decodes and calibrates the batch and
+ * folds it into the controller's running statistics, so no report is kept
+ * past its batch and the controllers are measured independently of each
+ * other. The main thread only waits for the window to end and reports.
+ */
+
+#include "controller_qa.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "bt_transport.h"
+#include "mac_utils.h"
+#include "hid_io.h"
+#include "latency_stats.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <math.h>
+
+/* Read timeout; bounds how late a reader notices the end of the window */
+#define QA_READ_TIMEOUT_MS 20
+
+/* Histogram ranges: raw 0-255 sticks and triggers, g, degrees per second */
+#define QA_STICK_LO 0.0
+#define QA_STICK_HI 256.0
+#define QA_ACCEL_RANGE_G 2.0
+#define QA_GYRO_RANGE_DPS 64.0
+
+static const char *CHANNEL_NAMES[QA_CHANNELS] = {
+    "left_x", "left_y", "right_x", "right_y", "l2", "r2",
+    "accel_x", "accel_y", "accel_z", "gyro_x", "gyro_y", "gyro_z"
+};
+
+static const char *FAILURE_NAMES[QA_FAIL_CHECKS] = {
+    "no_reports", "report_rate", "stick_drift", "stick_noise", "trigger_drift",
+    "accel_noise", "gyro_noise", "gyro_bias", "button_bounce", "battery"
+};
+
+/**
+ * Empties a channel
+ */
+void qa_channel_init(qa_channel_t *channel, double lo, double hi)
+{
+    memset(channel, 0, sizeof(*channel));
+    channel->lo = lo;
+    channel->hi = hi;
+}
+
+/**
+ * Adds one value to a channel (Welford's update)
+ */
+void qa_channel_add(qa_channel_t *channel, double value)
+{
+    double delta = value - channel->mean;
+    int bin;
+
+    channel->count++;
+    channel->mean += delta / (double)channel->count;
+    channel->m2 += delta * (value - channel->mean);
+
+    if (channel->count == 1 || value < channel->min)
+        channel->min = value;
+    if (channel->count == 1 || value > channel->max)
+        channel->max = value;
+
+    bin = (int)floor((value - channel->lo) / (channel->hi - channel->lo) * QA_HISTOGRAM_BINS);
+    if (bin < 0)
+        bin = 0;
+    if (bin >= QA_HISTOGRAM_BINS)
+        bin = QA_HISTOGRAM_BINS - 1;
+    channel->bins[bin]++;
+}
+
+/**
+ * Gets the sample standard deviation of a channel
+ */
+double qa_channel_stddev(const qa_channel_t *channel)
+{
+    if (channel->count < 2)
+        return 0.0;
+    return sqrt(channel->m2 / (double)(channel->count - 1));
+}
+
+/**
+ * Estimates a percentile by interpolating inside the bin that holds it
+ */
+double qa_channel_percentile(const qa_channel_t *channel, double fraction)
+{
+    double width = (channel->hi - channel->lo) / QA_HISTOGRAM_BINS;
+    double target = fraction * (double)channel->count;
+    double below = 0.0, value = channel->max;
+
+    if (channel->count == 0)
+        return 0.0;
+
+    for (int i = 0; i < QA_HISTOGRAM_BINS; i++)
+    {
+        if (channel->bins[i] == 0)
+            continue;
+        if (below + channel->bins[i] >= target)
+        {
+            value = channel->lo + width * (i + (target - below) / channel->bins[i]);
+            break;
+        }
+        below += channel->bins[i];
+    }
+
+    if (value < channel->min)
+        value = channel->min;
+    if (value > channel->max)
+        value = channel->max;
+    return value;
+}
+
+/**
+ * Gets the default thresholds
+ */
+void qa_thresholds_default(qa_thresholds_t *thresholds)
+{
+    thresholds->min_rate_hz = 50.0;
+    thresholds->stick_drift = 6.0;
+    thresholds->stick_noise = 2.0;
+    thresholds->trigger_drift = 8.0;
+    thresholds->accel_noise_g = 0.02;
+    thresholds->gyro_noise_dps = 1.0;
+    thresholds->gyro_bias_dps = 3.0;
+    thresholds->bounce_ms = 10.0;
+    thresholds->max_bounces = 0;
+    thresholds->min_battery = 20;
+}
+
+/**
+ * Empties a unit with the histogram range of every channel
+ */
+void qa_unit_init(qa_unit_t *unit)
+{
+    memset(unit, 0, sizeof(*unit));
+    for (int i = QA_LEFT_X; i <= QA_R2; i++)
+        qa_channel_init(&unit->channels[i], QA_STICK_LO, QA_STICK_HI);
+    for (int i = QA_ACCEL_X; i <= QA_ACCEL_Z; i++)
+        qa_channel_init(&unit->channels[i], -QA_ACCEL_RANGE_G, QA_ACCEL_RANGE_G);
+    for (int i = QA_GYRO_X; i <= QA_GYRO_Z; i++)
+        qa_channel_init(&unit->channels[i], -QA_GYRO_RANGE_DPS, QA_GYRO_RANGE_DPS);
+    unit->battery_min = -1;
+}
+
+/**
+ * Counts presses and bounces of one report's buttons
+ */
+static void add_buttons(qa_unit_t *unit, uint32_t buttons, uint64_t timestamp_ns, double bounce_ms)
+{
+    uint32_t changed = buttons ^ unit->buttons;
+    uint64_t window_ns = (uint64_t)(bounce_ms * 1e6);
+
+    for (int b = 0; changed; b++, changed >>= 1)
+    {
+        uint32_t bit = 1u << b;
+
+        if (!(changed & 1u))
+            continue;
+        if (buttons & bit)
+        {
+            unit->presses++;
+            unit->buttons_seen |= bit;
+            if (unit->released_ns[b] && timestamp_ns - unit->released_ns[b] < window_ns)
+                unit->bounces++;
+        }
+        else
+        {
+            unit->released_ns[b] = timestamp_ns;
+        }
+    }
+    unit->buttons = buttons;
+}
+
+/**
+ * Adds a batch of reports to a unit
+ */
+void qa_unit_add(qa_unit_t *unit, const decoded_reports_t *decoded, const imu_samples_t *samples,
+                 double bounce_ms)
+{
+    qa_channel_t *c = unit->channels;
+
+    for (size_t i = 0; i < decoded->count; i++)
+    {
+        if (unit->reports == 0)
+            unit->first_ns = decoded->timestamp_ns[i];
+        unit->last_ns = decoded->timestamp_ns[i];
+        unit->reports++;
+
+        qa_channel_add(&c[QA_LEFT_X], decoded->left_x[i]);
+        qa_channel_add(&c[QA_LEFT_Y], decoded->left_y[i]);
+        qa_channel_add(&c[QA_RIGHT_X], decoded->right_x[i]);
+        qa_channel_add(&c[QA_RIGHT_Y], decoded->right_y[i]);
+        qa_channel_add(&c[QA_L2], decoded->l2[i]);
+        qa_channel_add(&c[QA_R2], decoded->r2[i]);
+        qa_channel_add(&c[QA_ACCEL_X], samples->accel_x[i]);
+        qa_channel_add(&c[QA_ACCEL_Y], samples->accel_y[i]);
+        qa_channel_add(&c[QA_ACCEL_Z], samples->accel_z[i]);
+        qa_channel_add(&c[QA_GYRO_X], samples->gyro_x[i]);
+        qa_channel_add(&c[QA_GYRO_Y], samples->gyro_y[i]);
+        qa_channel_add(&c[QA_GYRO_Z], samples->gyro_z[i]);
+
+        add_buttons(unit, decoded->buttons[i], decoded->timestamp_ns[i], bounce_ms);
+
+        if (decoded->battery[i] == BATTERY_CHARGING)
+            unit->charging = 1;
+        else if (unit->battery_min < 0 || decoded->battery[i] < unit->battery_min)
+            unit->battery_min = decoded->battery[i];
+    }
+}
+
+/**
+ * Checks a unit against thresholds
+ */
+uint32_t qa_unit_evaluate(const qa_unit_t *unit, const qa_thresholds_t *thresholds)
+{
+    const qa_channel_t *c = unit->channels;
+    uint32_t failures = 0;
+
+    if (unit->reports == 0)
+        return QA_FAIL_NO_REPORTS;
+
+    if (unit->reports < 2 || unit->last_ns == unit->first_ns ||
+        (double)(unit->reports - 1) * 1e9 / (double)(unit->last_ns - unit->first_ns) < thresholds->min_rate_hz)
+        failures |= QA_FAIL_REPORT_RATE;
+
+    for (int i = QA_LEFT_X; i <= QA_RIGHT_Y; i++)
+    {
+        if (fabs(c[i].mean - 128.0) > thresholds->stick_drift)
+            failures |= QA_FAIL_STICK_DRIFT;
+        if (qa_channel_stddev(&c[i]) > thresholds->stick_noise)
+            failures |= QA_FAIL_STICK_NOISE;
+    }
+    for (int i = QA_L2; i <= QA_R2; i++)
+    {
+        if (c[i].mean > thresholds->trigger_drift)
+            failures |= QA_FAIL_TRIGGER_DRIFT;
+    }
+    for (int i = QA_ACCEL_X; i <= QA_ACCEL_Z; i++)
+    {
+        if (qa_channel_stddev(&c[i]) > thresholds->accel_noise_g)
+            failures |= QA_FAIL_ACCEL_NOISE;
+    }
+    for (int i = QA_GYRO_X; i <= QA_GYRO_Z; i++)
+    {
+        if (qa_channel_stddev(&c[i]) > thresholds->gyro_noise_dps)
+            failures |= QA_FAIL_GYRO_NOISE;
+        if (fabs(c[i].mean) > thresholds->gyro_bias_dps)
+            failures |= QA_FAIL_GYRO_BIAS;
+    }
+
+    if (unit->bounces > thresholds->max_bounces)
+        failures |= QA_FAIL_BUTTON_BOUNCE;
+    if (unit->battery_min >= 0 && unit->battery_min < thresholds->min_battery)
+        failures |= QA_FAIL_BATTERY;
+
+    return failures;
+}
+
+/**
+ * Gets the name of a failed check
+ */
+const char* qa_failure_name(uint32_t failure)
+{
+    for (int i = 0; i < QA_FAIL_CHECKS; i++)
+    {
+        if (failure == (1u << i))
+            return FAILURE_NAMES[i];
+    }
+    return "unknown";
+}
+
+/**
+ * Gets the name of a channel
+ */
+const char* qa_channel_name(qa_channel_id_t channel)
+{
+    return (channel >= 0 && channel < QA_CHANNELS) ? CHANNEL_NAMES[channel] : "unknown";
+}
+
+/**
+ * Reader thread state for one controller
+ */
+typedef struct {
+    controller_info_t *controller;
+    report_family_t family;
+    imu_calibration_t calibration;
+    hid_device *dev;
+    char address[18];               /* Bluetooth address, empty if unknown */
+    const qa_thresholds_t *thresholds;
+    qa_unit_t unit;                 /* Written by the reader, read after join */
+    thread_t thread;
+    uint64_t crc_errors;            /* Bluetooth reports dropped for a bad CRC */
+    int running;
+    int error;
+} qa_reader_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+static _Atomic int stopping = 0;
+
+/**
+ * Signal handler requesting an early end of the window
+ */
+static void handle_stop_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/**
+ * Reader thread: folds batches of reports into the unit until the window ends
+ */
+static void reader_main(void *arg)
+{
+    qa_reader_t *reader = (qa_reader_t*)arg;
+    input_report_t reports[QA_BATCH];
+    decoded_reports_t decoded;
+    imu_samples_t samples;
+    size_t pending = 0;
+
+    if (!decoded_reports_init(&decoded, QA_BATCH) || !imu_samples_init(&samples, QA_BATCH))
+    {
+        decoded_reports_free(&decoded);
+        reader->error = 1;
+        return;
+    }
+
+    for (;;)
+    {
+        int stop = atomic_load_explicit(&stopping, memory_order_relaxed);
+        int ret = 0;
+
+        if (!stop)
+        {
+            ret = hid_io_read_timeout(reader->dev, reports[pending].data, INPUT_REPORT_MAX, QA_READ_TIMEOUT_MS);
+            if (ret < 0)
+            {
+                reader->error = 1;
+                stop = 1;
+            }
+            else if (ret > 0)
+            {
+                reports[pending].timestamp_ns = latency_now_ns();
+                reports[pending].length = (uint32_t)ret;
+                if (bt_normalize_input(reader->controller->product_id, &reports[pending]))
+                    pending++;
+                else
+                    reader->crc_errors++;
+            }
+        }
+
+        /* Fold a full batch, or whatever is left once reports stop coming */
+        if (pending == QA_BATCH || (pending > 0 && (ret == 0 || stop)))
+        {
+            decoded.count = 0;
+            samples.count = 0;
+            decode_reports(reader->family, reports, pending, &decoded);
+            imu_calibration_apply(&reader->calibration, &decoded, &samples);
+            qa_unit_add(&reader->unit, &decoded, &samples, reader->thresholds->bounce_ms);
+            pending = 0;
+        }
+        if (stop)
+            break;
+    }
+
+    decoded_reports_free(&decoded);
+    imu_samples_free(&samples);
+}
+
+/**
+ * Writes a string as a JSON string literal
+ */
+static void write_json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            fputc('\\', out);
+        if ((unsigned char)*text >= 0x20)
+            fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * Writes the summary record of one unit as a line of JSON
+ */
+static void write_record(FILE *out, const qa_reader_t *reader, uint32_t failures)
+{
+    const qa_unit_t *unit = &reader->unit;
+    double span_s = (double)(unit->last_ns - unit->first_ns) / 1e9;
+    int first = 1;
+
+    fprintf(out, "{\"path\":");
+    write_json_string(out, reader->controller->path);
+    fprintf(out, ",\"product\":");
+    write_json_string(out, get_controller_name(reader->controller->product_id));
+    fprintf(out, ",\"product_id\":%u,\"address\":", reader->controller->product_id);
+    write_json_string(out, reader->address);
+    fprintf(out, ",\"result\":\"%s\",\"failures\":[", failures || reader->error ? "fail" : "pass");
+    for (int i = 0; i < QA_FAIL_CHECKS; i++)
+    {
+        if (!(failures & (1u << i)))
+            continue;
+        fprintf(out, "%s\"%s\"", first ? "" : ",", qa_failure_name(1u << i));
+        first = 0;
+    }
+    fprintf(out, "],\"reports\":%llu,\"rate_hz\":%.1f,\"read_error\":%s,\"presses\":%u,\"bounces\":%u,"
+            "\"buttons_seen\":%u,\"battery_min\":%d,\"charging\":%s,\"channels\":{",
+            (unsigned long long)unit->reports, span_s > 0 ? (double)(unit->reports - 1) / span_s : 0.0,
+            reader->error ? "true" : "false", unit->presses, unit->bounces, unit->buttons_seen, unit->battery_min,
+            unit->charging ? "true" : "false");
+
+    for (int i = 0; i < QA_CHANNELS; i++)
+    {
+        const qa_channel_t *c = &unit->channels[i];
+
+        fprintf(out, "%s\"%s\":{\"mean\":%.6g,\"stddev\":%.6g,\"min\":%.6g,\"max\":%.6g,\"p1\":%.6g,"
+                "\"p50\":%.6g,\"p99\":%.6g,\"lo\":%g,\"hi\":%g,\"histogram\":[",
+                i ? "," : "", qa_channel_name((qa_channel_id_t)i), c->mean, qa_channel_stddev(c), c->min, c->max,
+                qa_channel_percentile(c, 0.01), qa_channel_percentile(c, 0.5), qa_channel_percentile(c, 0.99),
+                c->lo, c->hi);
+        for (int b = 0; b < QA_HISTOGRAM_BINS; b++)
+            fprintf(out, "%s%u", b ? "," : "", c->bins[b]);
+        fprintf(out, "]}");
+    }
+    fprintf(out, "}}\n");
+}
+
+/**
+ * Prints the summary of one unit
+ */
+static void print_summary(int index, const qa_reader_t *reader, uint32_t failures)
+{
+    const qa_unit_t *unit = &reader->unit;
+    const qa_channel_t *c = unit->channels;
+    double span_s = (double)(unit->last_ns - unit->first_ns) / 1e9;
+    double drift = 0, stick_noise = 0, accel_noise = 0, gyro_noise = 0, gyro_bias = 0;
+    int failed = failures || reader->error;
+
+    for (int i = QA_LEFT_X; i <= QA_RIGHT_Y; i++)
+    {
+        drift = fmax(drift, fabs(c[i].mean - 128.0));
+        stick_noise = fmax(stick_noise, qa_channel_stddev(&c[i]));
+    }
+    for (int i = QA_ACCEL_X; i <= QA_ACCEL_Z; i++)
+        accel_noise = fmax(accel_noise, qa_channel_stddev(&c[i]));
+    for (int i = QA_GYRO_X; i <= QA_GYRO_Z; i++)
+    {
+        gyro_noise = fmax(gyro_noise, qa_channel_stddev(&c[i]));
+        gyro_bias = fmax(gyro_bias, fabs(c[i].mean));
+    }
+
+    printf("%s  [%d] %-26s %-17s %s%s%s\n", COLOR_WHITE, index, get_controller_name(reader->controller->product_id),
+           reader->address[0] ? reader->address : "(no address)", failed ? COLOR_RED : COLOR_GREEN,
+           failed ? "FAIL" : "PASS", COLOR_RESET);
+    printf("      %llu reports %.1f Hz, stick drift %.1f noise %.2f, accel noise %.4f g, "
+           "gyro bias %.2f noise %.3f dps\n", (unsigned long long)unit->reports,
+           span_s > 0 ? (double)(unit->reports - 1) / span_s : 0.0, drift, stick_noise, accel_noise, gyro_bias,
+           gyro_noise);
+    if (unit->charging && unit->battery_min < 0)
+        printf("      %u presses, %u bounces, battery charging\n", unit->presses, unit->bounces);
+    else
+        printf("      %u presses, %u bounces, battery %d%%%s\n", unit->presses, unit->bounces, unit->battery_min,
+               unit->charging ? " (charging)" : "");
+    if (reader->error)
+        printf("      %sread error during the window%s\n", COLOR_RED, COLOR_RESET);
+    if (reader->crc_errors)
+        printf("      %llu Bluetooth reports dropped for a bad CRC\n", (unsigned long long)reader->crc_errors);
+
+    for (int i = 0; i < QA_FAIL_CHECKS; i++)
+    {
+        if (failures & (1u << i))
+            printf("      %sfailed: %s%s\n", COLOR_RED, qa_failure_name(1u << i), COLOR_RESET);
+    }
+}
+
+/**
+ * Checks every connected controller in parallel and prints one summary per unit
+ */
+int qa_command(int argc, char **argv)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    qa_reader_t *readers;
+    qa_thresholds_t thresholds;
+    const char *output_path = NULL;
+    double duration_s = QA_DEFAULT_DURATION_S;
+    FILE *out = NULL;
+    int controller_count, started = 0, failed = 0;
+    uint64_t origin_ns;
+
+    qa_thresholds_default(&thresholds);
+    for (int i = 0; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--duration") == 0)
+            duration_s = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--output") == 0)
+            output_path = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--min-rate") == 0)
+            thresholds.min_rate_hz = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--stick-drift") == 0)
+            thresholds.stick_drift = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--stick-noise") == 0)
+            thresholds.stick_noise = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--trigger-drift") == 0)
+            thresholds.trigger_drift = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--accel-noise") == 0)
+            thresholds.accel_noise_g = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--gyro-noise") == 0)
+            thresholds.gyro_noise_dps = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--gyro-bias") == 0)
+            thresholds.gyro_bias_dps = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--bounce-ms") == 0)
+            thresholds.bounce_ms = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--max-bounces") == 0)
+            thresholds.max_bounces = (uint32_t)atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--min-battery") == 0)
+            thresholds.min_battery = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown qa option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+    if (duration_s <= 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s --duration must be positive\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+    if (controller_count == 0)
+    {
+        printf("%s[ERROR]%s No supported PlayStation controllers found\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    readers = (qa_reader_t*)calloc((size_t)controller_count, sizeof(qa_reader_t));
+    if (readers && output_path)
+    {
+        out = fopen(output_path, "a");
+        if (!out)
+            fprintf(stderr, "%s[ERROR]%s Failed to open %s\n", COLOR_RED, COLOR_RESET, output_path);
+    }
+    if (!readers || (output_path && !out))
+    {
+        for (int i = 0; i < controller_count; i++)
+            free_controller_info(controllers[i]);
+        free(readers);
+        return 1;
+    }
+
+    /* Connect and calibrate every unit before the window opens */
+    for (int i = 0; i < controller_count; i++)
+    {
+        qa_reader_t *reader = &readers[started];
+        unsigned char mac[6];
+
+        reader->controller = controllers[i];
+        reader->family = report_family(controllers[i]->product_id);
+        reader->thresholds = &thresholds;
+        reader->dev = connect_to_controller(controllers[i]);
+        if (!reader->dev)
+        {
+            printf("%s[ERROR]%s Failed to open %s, not checking it\n", COLOR_RED, COLOR_RESET,
+                   controllers[i]->path);
+            free_controller_info(controllers[i]);
+            memset(reader, 0, sizeof(*reader));
+            failed++;
+            continue;
+        }
+
+        qa_unit_init(&reader->unit);
+        imu_calibration_load(reader->dev, controllers[i]->product_id, &reader->calibration);
+        if (read_device_address(reader->dev, controllers[i]->product_id, mac))
+            bytes_to_mac_string(mac, reader->address, sizeof(reader->address), 1);
+
+        if (controllers[i]->product_id == PRODUCT_SIXAXIS && !enable_sixaxis_reports(reader->dev))
+        {
+            printf("%s[INFO]%s Could not send the SixAxis enable command to %s, reading anyway\n",
+                   COLOR_BLUE, COLOR_RESET, controllers[i]->path);
+        }
+        started++;
+    }
+
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+
+    for (int i = 0; i < started; i++)
+    {
+        readers[i].running = thread_create(&readers[i].thread, reader_main, &readers[i]);
+        if (!readers[i].running)
+            readers[i].error = 1;
+    }
+
+    printf("%s[INFO]%s Checking %d controller(s) for %.1f s, keep them still and press each button once\n",
+           COLOR_BLUE, COLOR_RESET, started, duration_s);
+
+    origin_ns = latency_now_ns();
+    while (!stop_requested && latency_now_ns() - origin_ns < (uint64_t)(duration_s * 1e9))
+        sleep_ms(10);
+    atomic_store(&stopping, 1);
+
+    for (int i = 0; i < started; i++)
+    {
+        if (readers[i].running)
+            thread_join(readers[i].thread);
+    }
+
+    printf("\n%s%s=== QA Summary ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
+    for (int i = 0; i < started; i++)
+    {
+        qa_reader_t *reader = &readers[i];
+        uint32_t failures = qa_unit_evaluate(&reader->unit, &thresholds);
+
+        if (failures || reader->error)
+            failed++;
+        print_summary(i, reader, failures);
+        if (out)
+            write_record(out, reader, failures);
+
+        hid_io_close(reader->dev);
+        free_controller_info(reader->controller);
+    }
+    printf("%s[INFO]%s %d of %d controller(s) passed\n", COLOR_BLUE, COLOR_RESET, controller_count - failed,
+           controller_count);
+
+    if (out)
+        fclose(out);
+    free(readers);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+/**
+ * controller_qa.h - Controller health checks for refurbishment
+ *
+ * Streams the input reports of every connected controller for a fixed
+ * window and keeps running statistics of each channel in a single pass:
+ * Welford mean and variance, minimum, maximum and a fixed-range histogram,
+ * in constant memory however long the window is. The statistics are then
+ * checked against thresholds for stick and trigger drift, stick and IMU
+ * noise, gyro bias, button bounce, battery level and report rate.
+ *
+ * The controller is expected to rest on the bench during the window, with
+ * the operator free to press each button once; any stick, trigger or IMU
+ * movement counts as drift or noise.
+ */
+
+#ifndef CONTROLLER_QA_H
+#define CONTROLLER_QA_H
+
+#include "report_decoder.h"
+#include "imu_calibration.h"
+#include <stdint.h>
+
+/* Histogram bins per channel; values outside the range land in the end bins */
+#define QA_HISTOGRAM_BINS 32
+
+/* Reports decoded per batch by each QA reader */
+#define QA_BATCH 64
+
+/* Default measuring window */
+#define QA_DEFAULT_DURATION_S 10.0
+
+/**
+ * Channels measured on every controller
+ */
+typedef enum {
+    QA_LEFT_X = 0,
+    QA_LEFT_Y,
+    QA_RIGHT_X,
+    QA_RIGHT_Y,
+    QA_L2,
+    QA_R2,
+    QA_ACCEL_X,     /* g */
+    QA_ACCEL_Y,
+    QA_ACCEL_Z,
+    QA_GYRO_X,      /* Degrees per second */
+    QA_GYRO_Y,
+    QA_GYRO_Z,
+    QA_CHANNELS
+} qa_channel_id_t;
+
+/**
+ * Failed checks, as bits of qa_unit_evaluate()'s result
+ */
+#define QA_FAIL_NO_REPORTS     (1u << 0)   /* Nothing was read in the window */
+#define QA_FAIL_REPORT_RATE    (1u << 1)   /* Fewer reports per second than min_rate_hz */
+#define QA_FAIL_STICK_DRIFT    (1u << 2)   /* A resting stick axis is off center */
+#define QA_FAIL_STICK_NOISE    (1u << 3)   /* A resting stick axis jitters */
+#define QA_FAIL_TRIGGER_DRIFT  (1u << 4)   /* A released trigger reads as pressed */
+#define QA_FAIL_ACCEL_NOISE    (1u << 5)   /* Accelerometer noise */
+#define QA_FAIL_GYRO_NOISE     (1u << 6)   /* Gyro noise */
+#define QA_FAIL_GYRO_BIAS      (1u << 7)   /* A resting gyro axis reads as turning */
+#define QA_FAIL_BUTTON_BOUNCE  (1u << 8)   /* A button re-pressed within the bounce window */
+#define QA_FAIL_BATTERY        (1u << 9)   /* Battery below min_battery while not charging */
+#define QA_FAIL_CHECKS         10
+
+/**
+ * Running statistics of one channel
+ */
+typedef struct {
+    uint64_t count;
+    double mean;
+    double m2;                          /* Sum of squared differences from the mean */
+    double min, max;
+    double lo, hi;                      /* Histogram range */
+    uint32_t bins[QA_HISTOGRAM_BINS];
+} qa_channel_t;
+
+/**
+ * Pass/fail limits; all deviations are absolute
+ */
+typedef struct {
+    double min_rate_hz;
+    double stick_drift;         /* Mean distance of a stick axis from 128 */
+    double stick_noise;         /* Standard deviation of a stick axis */
+    double trigger_drift;       /* Mean of a trigger */
+    double accel_noise_g;       /* Standard deviation of an accelerometer axis */
+    double gyro_noise_dps;      /* Standard deviation of a gyro axis */
+    double gyro_bias_dps;       /* Mean of a gyro axis */
+    double bounce_ms;           /* Re-presses sooner than this after a release are bounces */
+    uint32_t max_bounces;
+    int min_battery;            /* Percent */
+} qa_thresholds_t;
+
+/**
+ * Statistics of one controller
+ */
+typedef struct {
+    qa_channel_t channels[QA_CHANNELS];
+    uint64_t reports;
+    uint64_t first_ns, last_ns;
+    uint32_t buttons;                   /* Buttons held in the last report */
+    uint32_t buttons_seen;              /* Every button pressed at least once */
+    uint64_t released_ns[32];           /* When each button was last released, 0 if never */
+    uint32_t presses;
+    uint32_t bounces;
+    int battery_min;                    /* -1 until a report arrives without charging */
+    int charging;                       /* Charging in any report */
+} qa_unit_t;
+
+/**
+ * Empties a channel
+ *
+ * @param channel The channel
+ * @param lo Lower end of the histogram range
+ * @param hi Upper end of the histogram range
+ */
+void qa_channel_init(qa_channel_t *channel, double lo, double hi);
+
+/**
+ * Adds one value to a channel
+ *
+ * @param channel The channel
+ * @param value The value
+ */
+void qa_channel_add(qa_channel_t *channel, double value);
+
+/**
+ * Gets the sample standard deviation of a channel
+ *
+ * @param channel The channel
+ * @return Standard deviation, 0 with fewer than two values
+ */
+double qa_channel_stddev(const qa_channel_t *channel);
+
+/**
+ * Estimates a percentile of a channel from its histogram
+ *
+ * @param channel The channel
+ * @param fraction Percentile as a fraction (0.5 for the median)
+ * @return Estimate, clamped to the channel's minimum and maximum
+ */
+double qa_channel_percentile(const qa_channel_t *channel, double fraction);
+
+/**
+ * Gets the default thresholds
+ *
+ * @param thresholds Receives the defaults
+ */
+void qa_thresholds_default(qa_thresholds_t *thresholds);
+
+/**
+ * Empties a unit with the histogram range of every channel
+ *
+ * @param unit The unit
+ */
+void qa_unit_init(qa_unit_t *unit);
+
+/**
+ * Adds a batch of reports to a unit
+ *
+ * @param unit The unit
+ * @param decoded Decoded reports in timestamp order
+ * @param samples Their calibrated IMU samples, one per report
+ * @param bounce_ms Bounce window
+ */
+void qa_unit_add(qa_unit_t *unit, const decoded_reports_t *decoded, const imu_samples_t *samples,
+                 double bounce_ms);
+
+/**
+ * Checks a unit against thresholds
+ *
+ * @param unit The unit
+ * @param thresholds The limits
+ * @return Bitmask of QA_FAIL_* checks, 0 if the unit passes
+ */
+uint32_t qa_unit_evaluate(const qa_unit_t *unit, const qa_thresholds_t *thresholds);
+
+/**
+ * Gets the name of a failed check
+ *
+ * @param failure One QA_FAIL_* bit
+ * @return Short name such as "stick_drift"
+ */
+const char* qa_failure_name(uint32_t failure);
+
+/**
+ * Gets the name of a channel
+ *
+ * @param channel The channel
+ * @return Short name such as "left_x"
+ */
+const char* qa_channel_name(qa_channel_id_t channel);
+
+/**
+ * Checks every connected controller in parallel and prints one summary per unit
+ *
+ * Usage: qa [--duration <seconds>] [--output <file>] [--min-rate <hz>] [--stick-drift <n>]
+ *           [--stick-noise <n>] [--trigger-drift <n>] [--accel-noise <g>] [--gyro-noise <dps>]
+ *           [--gyro-bias <dps>] [--bounce-ms <ms>] [--max-bounces <n>] [--min-battery <percent>]
+ *
+ * Each controller is read on its own thread and decoded QA_BATCH reports at
+ * a time. --output appends one JSON object per unit and line with its
+ * address, verdict, failed checks and every channel's statistics and
+ * histogram.
+ *
+ * @param argc Number of arguments after the "qa" command
+ * @param argv Arguments after the "qa" command
+ * @return 0 if every unit passed, 1 otherwise
+ */
+int qa_command(int argc, char **argv);
+
+#endif /* CONTROLLER_QA_H */
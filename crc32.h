@@ -0,0 +1,33 @@
+/**
+ * crc32.h - CRC-32 checksums
+ *
+ * The reflected IEEE 802.3 CRC-32 (polynomial 0xEDB88320, as used by zlib),
+ * which is the checksum of DSU packets
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Continues a CRC-32 over more data
+ *
+ * @param crc CRC of the data so far (0 to start)
+ * @param data Next bytes
+ * @param length Number of bytes
+ * @return CRC of all data so far
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
+
+/**
+ * Computes the CRC-32 of a buffer
+ *
+ * @param data The bytes
+ * @param length Number of bytes
+ * @return The CRC
+ */
+uint32_t crc32(const void *data, size_t length);
+
+#endif /* CRC32_H */
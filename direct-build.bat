@@ -16,7 +16,7 @@ cd build-direct
 
 REM Compile source files
 echo Compiling source files...
-cl.exe /c /EHsc /I..\hidapi-win\include ..\main.c ..\mac_utils.c ..\controller_info.c ..\controller_connection.c ..\ui.c
+cl.exe /c /EHsc /std:c11 /experimental:c11atomics /I..\hidapi-win\include ..\main.c ..\mac_utils.c ..\controller_info.c ..\controller_connection.c ..\ui.c ..\hid_io.c ..\latency_stats.c ..\trace_events.c ..\flight_recorder.c ..\hid_capture.c ..\hid_replay.c ..\metrics.c ..\pairing_daemon.c ..\report_ring.c ..\input_stream.c ..\report_decoder.c ..\imu_calibration.c ..\orientation_filter.c ..\crc32.c ..\dsu_server.c ..\uinput_bridge.c ..\uring_reader.c ..\state_shm.c ..\recording.c ..\controller_qa.c ..\link_key_pairing.c ..\bt_transport.c ..\provision_recipe.c ..\manifest_apply.c ..\checkpoint_journal.c ..\led_identify.c ..\hid_descriptor.c ..\config_snapshot.c ..\capability_cache.c ..\feature_survey.c
 
 if %ERRORLEVEL% neq 0 (
     echo Compilation failed!
@@ -25,7 +25,7 @@ if %ERRORLEVEL% neq 0 (
 
 REM Link executable
 echo Linking executable...
-link.exe /OUT:sixaxispairer.exe main.obj mac_utils.obj controller_info.obj controller_connection.obj ui.obj ..\hidapi-win\x64\hidapi.lib
+link.exe /OUT:sixaxispairer.exe main.obj mac_utils.obj controller_info.obj controller_connection.obj ui.obj hid_io.obj latency_stats.obj trace_events.obj flight_recorder.obj hid_capture.obj hid_replay.obj metrics.obj pairing_daemon.obj report_ring.obj input_stream.obj report_decoder.obj imu_calibration.obj orientation_filter.obj crc32.obj dsu_server.obj uinput_bridge.obj uring_reader.obj state_shm.obj recording.obj controller_qa.obj link_key_pairing.obj bt_transport.obj provision_recipe.obj manifest_apply.obj checkpoint_journal.obj led_identify.obj hid_descriptor.obj config_snapshot.obj capability_cache.obj feature_survey.obj ..\hidapi-win\x64\hidapi.lib
 
 if %ERRORLEVEL% neq 0 (
     echo Linking failed!
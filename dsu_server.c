@@ -0,0 +1,647 @@
+/**
+ * dsu_server.c - DSU (cemuhook) motion server
+ *
+ * Implementation of the DSU server. All packet buffers, iovecs and message
+ * headers are static; a tick fills data packets as reports are merged and
+ * dsu_server_flush() hands them to the kernel with a single sendmmsg()
+ * (one sendmsg() per packet where sendmmsg() is not available). Requests
+ * are answered from the same thread between ticks, so nothing is locked.
+ */
+
+/* sendmmsg() is a GNU extension on Linux */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "dsu_server.h"
+#include "controller_info.h"
+#include "latency_stats.h"
+#include "crc32.h"
+#include "ui.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef PLATFORM_WINDOWS
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <errno.h>
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+#endif
+
+#define DSU_PROTOCOL_VERSION 1001
+#define DSU_HEADER_SIZE 16
+
+/* Message types */
+#define DSU_MSG_VERSION 0x100000u
+#define DSU_MSG_INFO    0x100001u
+#define DSU_MSG_DATA    0x100002u
+
+/* Packet sizes including the header */
+#define DSU_VERSION_PACKET_SIZE 22
+#define DSU_INFO_PACKET_SIZE 32
+#define DSU_DATA_PACKET_SIZE 100
+
+/* Slot states, device models and connection types */
+#define DSU_SLOT_CONNECTED 2
+#define DSU_MODEL_NONE 0
+#define DSU_MODEL_PARTIAL_GYRO 1
+#define DSU_MODEL_FULL_GYRO 2
+#define DSU_CONNECTION_USB 1
+#define DSU_CONNECTION_BLUETOOTH 2
+
+/* Motion a slot sends in physical units; other axes are sent as zero */
+#define DSU_MOTION_ACCEL 0x01
+#define DSU_MOTION_GYRO 0x02
+
+/* Battery states */
+#define DSU_BATTERY_NONE 0x00
+#define DSU_BATTERY_DYING 0x01
+#define DSU_BATTERY_LOW 0x02
+#define DSU_BATTERY_MEDIUM 0x03
+#define DSU_BATTERY_HIGH 0x04
+#define DSU_BATTERY_FULL 0x05
+#define DSU_BATTERY_CHARGING 0xEE
+
+/* Data request registration flags */
+#define DSU_REGISTER_SLOT 0x01
+#define DSU_REGISTER_MAC 0x02
+
+#ifndef PLATFORM_WINDOWS
+
+/**
+ * One subscribed client
+ */
+typedef struct {
+    struct sockaddr_in addr;
+    uint64_t last_request_ns;
+    uint8_t slot_mask;          /* 0 for a free entry */
+} dsu_client_t;
+
+/**
+ * Controller assigned to a slot
+ */
+typedef struct {
+    int connected;
+    uint8_t model;
+    uint8_t connection;
+    uint8_t motion;             /* DSU_MOTION_* flags */
+    int mac_known;
+    uint8_t mac[6];
+    uint8_t battery;
+    uint32_t packet_number;
+} dsu_slot_t;
+
+static int server_fd = -1;
+static uint32_t server_id;
+static dsu_client_t clients[DSU_MAX_CLIENTS];
+static dsu_slot_t slots[DSU_SLOTS];
+static uint64_t packets_sent = 0;
+
+/* Preallocated tick buffers: one packet per queued report, one message per packet and client */
+static unsigned char packets[DSU_QUEUE_PACKETS][DSU_DATA_PACKET_SIZE];
+static uint8_t packet_slots[DSU_QUEUE_PACKETS];
+static int queued = 0;
+static struct iovec iovecs[DSU_QUEUE_PACKETS * DSU_MAX_CLIENTS];
+#ifdef PLATFORM_LINUX
+static struct mmsghdr messages[DSU_QUEUE_PACKETS * DSU_MAX_CLIENTS];
+#else
+static struct msghdr messages[DSU_QUEUE_PACKETS * DSU_MAX_CLIENTS];
+#endif
+
+/**
+ * Little-endian field writers
+ */
+static void put_u16(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    put_u16(p, v & 0xffff);
+    put_u16(p + 2, v >> 16);
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static void put_float(unsigned char *p, float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    put_u32(p, bits);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * Writes the header and message type of a server packet
+ */
+static void begin_packet(unsigned char *p, size_t size, uint32_t type)
+{
+    memcpy(p, "DSUS", 4);
+    put_u16(p + 4, DSU_PROTOCOL_VERSION);
+    put_u16(p + 6, (uint32_t)(size - DSU_HEADER_SIZE));
+    put_u32(p + 8, 0);
+    put_u32(p + 12, server_id);
+    put_u32(p + 16, type);
+}
+
+/**
+ * Fills in the CRC of a finished packet
+ */
+static void finish_packet(unsigned char *p, size_t size)
+{
+    put_u32(p + 8, crc32(p, size));
+}
+
+/**
+ * Writes the 11-byte slot description shared by info and data packets
+ */
+static void put_slot(unsigned char *p, int slot)
+{
+    const dsu_slot_t *s = &slots[slot];
+
+    memset(p, 0, 11);
+    p[0] = (unsigned char)slot;
+    if (!s->connected)
+        return;
+    p[1] = DSU_SLOT_CONNECTED;
+    p[2] = s->model;
+    p[3] = s->connection;
+    memcpy(p + 4, s->mac, 6);
+    p[10] = s->battery;
+}
+
+/**
+ * Sends one packet outside the tick batch
+ */
+static void send_reply(const unsigned char *p, size_t size, const struct sockaddr_in *to)
+{
+    if (sendto(server_fd, p, size, 0, (const struct sockaddr*)to, sizeof(*to)) == (ssize_t)size)
+        packets_sent++;
+}
+
+/**
+ * Opens the UDP socket and preallocates all packet buffers
+ */
+int dsu_server_start(const char *address, int port)
+{
+    struct sockaddr_in addr;
+
+    if (!address)
+        address = DSU_DEFAULT_ADDRESS;
+    if (port <= 0)
+        port = DSU_DEFAULT_PORT;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (port > 65535 || inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "%s[ERROR]%s Invalid DSU address %s:%d\n", COLOR_RED, COLOR_RESET, address, port);
+        return 0;
+    }
+
+    server_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (server_fd < 0)
+    {
+        perror("socket");
+        return 0;
+    }
+    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to bind the DSU server to %s:%d\n", COLOR_RED, COLOR_RESET,
+                address, port);
+        close(server_fd);
+        server_fd = -1;
+        return 0;
+    }
+
+    memset(clients, 0, sizeof(clients));
+    memset(slots, 0, sizeof(slots));
+    server_id = (uint32_t)(latency_now_ns() ^ ((uint64_t)getpid() << 16));
+    queued = 0;
+    packets_sent = 0;
+
+    printf("%s[INFO]%s Serving DSU motion on udp:%s:%d\n", COLOR_BLUE, COLOR_RESET, address, port);
+    return 1;
+}
+
+/**
+ * Assigns a controller to a slot
+ */
+void dsu_server_set_slot(int slot, unsigned short product_id, const unsigned char *mac, int bluetooth)
+{
+    dsu_slot_t *s;
+
+    if (slot < 0 || slot >= DSU_SLOTS)
+        return;
+
+    s = &slots[slot];
+    memset(s, 0, sizeof(*s));
+    s->connected = 1;
+    s->connection = bluetooth ? DSU_CONNECTION_BLUETOOTH : DSU_CONNECTION_USB;
+
+    /* Only the DS4 has calibrated gyros; the SixAxis accelerometer has a
+       nominal scale in g, the Move only reports raw counts */
+    switch (report_family(product_id))
+    {
+    case REPORT_FAMILY_DS4:
+        s->model = DSU_MODEL_FULL_GYRO;
+        s->motion = DSU_MOTION_ACCEL | DSU_MOTION_GYRO;
+        break;
+    case REPORT_FAMILY_SIXAXIS:
+        s->model = DSU_MODEL_PARTIAL_GYRO;
+        s->motion = DSU_MOTION_ACCEL;
+        break;
+    default:
+        s->model = DSU_MODEL_NONE;
+        s->motion = 0;
+        break;
+    }
+    if (mac)
+    {
+        memcpy(s->mac, mac, 6);
+        s->mac_known = 1;
+    }
+}
+
+/**
+ * Finds the entry of a client, reusing a free or expired one for a new client
+ */
+static dsu_client_t* find_client(const struct sockaddr_in *from, uint64_t now)
+{
+    dsu_client_t *spare = NULL;
+
+    for (int i = 0; i < DSU_MAX_CLIENTS; i++)
+    {
+        dsu_client_t *c = &clients[i];
+
+        if (c->slot_mask && c->addr.sin_addr.s_addr == from->sin_addr.s_addr &&
+            c->addr.sin_port == from->sin_port)
+            return c;
+        if (!spare && (!c->slot_mask || now - c->last_request_ns > DSU_CLIENT_TIMEOUT_MS * 1000000ull))
+            spare = c;
+    }
+    return spare;
+}
+
+/**
+ * Handles one request datagram
+ */
+static void handle_request(unsigned char *p, size_t len, const struct sockaddr_in *from)
+{
+    unsigned char reply[DSU_INFO_PACKET_SIZE];
+    uint32_t crc, type;
+
+    if (len < DSU_HEADER_SIZE + 4 || memcmp(p, "DSUC", 4) != 0 ||
+        (size_t)(p[6] | p[7] << 8) + DSU_HEADER_SIZE > len)
+        return;
+
+    crc = get_u32(p + 8);
+    put_u32(p + 8, 0);
+    if (crc32(p, len) != crc)
+        return;
+
+    type = get_u32(p + 16);
+    if (type == DSU_MSG_VERSION)
+    {
+        begin_packet(reply, DSU_VERSION_PACKET_SIZE, DSU_MSG_VERSION);
+        put_u16(reply + 20, DSU_PROTOCOL_VERSION);
+        finish_packet(reply, DSU_VERSION_PACKET_SIZE);
+        send_reply(reply, DSU_VERSION_PACKET_SIZE, from);
+    }
+    else if (type == DSU_MSG_INFO && len >= 24)
+    {
+        uint32_t count = get_u32(p + 20);
+
+        for (uint32_t i = 0; i < count && i < DSU_SLOTS && 24 + i < len; i++)
+        {
+            if (p[24 + i] >= DSU_SLOTS)
+                continue;
+            begin_packet(reply, DSU_INFO_PACKET_SIZE, DSU_MSG_INFO);
+            put_slot(reply + 20, p[24 + i]);
+            reply[31] = 0;
+            finish_packet(reply, DSU_INFO_PACKET_SIZE);
+            send_reply(reply, DSU_INFO_PACKET_SIZE, from);
+        }
+    }
+    else if (type == DSU_MSG_DATA && len >= 28)
+    {
+        uint64_t now = latency_now_ns();
+        dsu_client_t *client = find_client(from, now);
+        uint8_t mask = 0;
+
+        if (!client)
+            return;
+
+        if (p[20] == 0)
+            mask = (1u << DSU_SLOTS) - 1;
+        if ((p[20] & DSU_REGISTER_SLOT) && p[21] < DSU_SLOTS)
+            mask |= (uint8_t)(1u << p[21]);
+        if (p[20] & DSU_REGISTER_MAC)
+        {
+            for (int slot = 0; slot < DSU_SLOTS; slot++)
+            {
+                if (slots[slot].connected && slots[slot].mac_known && memcmp(slots[slot].mac, p + 22, 6) == 0)
+                    mask |= (uint8_t)(1u << slot);
+            }
+        }
+
+        if (client->addr.sin_addr.s_addr != from->sin_addr.s_addr || client->addr.sin_port != from->sin_port ||
+            now - client->last_request_ns > DSU_CLIENT_TIMEOUT_MS * 1000000ull)
+        {
+            client->slot_mask = 0;
+            client->addr = *from;
+        }
+        client->slot_mask |= mask;
+        client->last_request_ns = now;
+    }
+}
+
+/**
+ * Answers pending version, info and subscription requests without blocking
+ */
+void dsu_server_poll(void)
+{
+    unsigned char request[128];
+    struct sockaddr_in from;
+
+    if (server_fd < 0)
+        return;
+
+    for (;;)
+    {
+        socklen_t from_len = sizeof(from);
+        ssize_t got = recvfrom(server_fd, request, sizeof(request), 0, (struct sockaddr*)&from, &from_len);
+
+        if (got < 0)
+            break;
+        if (from_len == sizeof(from) && from.sin_family == AF_INET)
+            handle_request(request, (size_t)got, &from);
+    }
+}
+
+/**
+ * Checks whether a client currently receives a slot
+ */
+static int client_wants(const dsu_client_t *client, int slot, uint64_t now)
+{
+    return (client->slot_mask & (1u << slot)) &&
+           now - client->last_request_ns <= DSU_CLIENT_TIMEOUT_MS * 1000000ull;
+}
+
+/**
+ * Converts a decoded battery level to the DSU battery state
+ */
+static uint8_t battery_state(uint8_t battery)
+{
+    if (battery == BATTERY_CHARGING)
+        return DSU_BATTERY_CHARGING;
+    if (battery >= 95)
+        return DSU_BATTERY_FULL;
+    if (battery >= 70)
+        return DSU_BATTERY_HIGH;
+    if (battery >= 40)
+        return DSU_BATTERY_MEDIUM;
+    if (battery >= 10)
+        return DSU_BATTERY_LOW;
+    return battery > 0 ? DSU_BATTERY_DYING : DSU_BATTERY_NONE;
+}
+
+/**
+ * Builds the data packet of one report for every client subscribed to its slot
+ */
+void dsu_server_queue(int slot, const decoded_reports_t *decoded, const imu_samples_t *samples, size_t index)
+{
+    uint64_t now = latency_now_ns();
+    unsigned char *p;
+    uint32_t b;
+    int wanted = 0;
+
+    if (server_fd < 0 || slot < 0 || slot >= DSU_SLOTS || !slots[slot].connected)
+        return;
+
+    /* Keep the battery current for info replies even without subscribers */
+    slots[slot].battery = battery_state(decoded->battery[index]);
+    for (int i = 0; i < DSU_MAX_CLIENTS && !wanted; i++)
+        wanted = client_wants(&clients[i], slot, now);
+    if (!wanted)
+        return;
+
+    if (queued == DSU_QUEUE_PACKETS)
+        dsu_server_flush();
+
+    p = packets[queued];
+    packet_slots[queued] = (uint8_t)slot;
+    queued++;
+
+    b = decoded->buttons[index];
+
+    begin_packet(p, DSU_DATA_PACKET_SIZE, DSU_MSG_DATA);
+    put_slot(p + 20, slot);
+    p[31] = 1;
+    put_u32(p + 32, slots[slot].packet_number++);
+
+    p[36] = (unsigned char)(((b & BUTTON_LEFT) ? 0x80 : 0) | ((b & BUTTON_DOWN) ? 0x40 : 0) |
+                            ((b & BUTTON_RIGHT) ? 0x20 : 0) | ((b & BUTTON_UP) ? 0x10 : 0) |
+                            ((b & BUTTON_START) ? 0x08 : 0) | ((b & BUTTON_R3) ? 0x04 : 0) |
+                            ((b & BUTTON_L3) ? 0x02 : 0) | ((b & BUTTON_SELECT) ? 0x01 : 0));
+    p[37] = (unsigned char)(((b & BUTTON_TRIANGLE) ? 0x80 : 0) | ((b & BUTTON_CIRCLE) ? 0x40 : 0) |
+                            ((b & BUTTON_CROSS) ? 0x20 : 0) | ((b & BUTTON_SQUARE) ? 0x10 : 0) |
+                            ((b & BUTTON_R1) ? 0x08 : 0) | ((b & BUTTON_L1) ? 0x04 : 0) |
+                            ((b & BUTTON_R2) ? 0x02 : 0) | ((b & BUTTON_L2) ? 0x01 : 0));
+    p[38] = (b & BUTTON_PS) ? 1 : 0;
+    p[39] = (b & BUTTON_TOUCHPAD) ? 1 : 0;
+
+    /* DSU sticks are positive upwards, PlayStation sticks downwards */
+    p[40] = decoded->left_x[index];
+    p[41] = (unsigned char)(255 - decoded->left_y[index]);
+    p[42] = decoded->right_x[index];
+    p[43] = (unsigned char)(255 - decoded->right_y[index]);
+
+    /* Analog d-pad, face and shoulder buttons; only triggers are really analog */
+    p[44] = (b & BUTTON_LEFT) ? 255 : 0;
+    p[45] = (b & BUTTON_DOWN) ? 255 : 0;
+    p[46] = (b & BUTTON_RIGHT) ? 255 : 0;
+    p[47] = (b & BUTTON_UP) ? 255 : 0;
+    p[48] = (b & BUTTON_TRIANGLE) ? 255 : 0;
+    p[49] = (b & BUTTON_CIRCLE) ? 255 : 0;
+    p[50] = (b & BUTTON_CROSS) ? 255 : 0;
+    p[51] = (b & BUTTON_SQUARE) ? 255 : 0;
+    p[52] = (b & BUTTON_R1) ? 255 : 0;
+    p[53] = (b & BUTTON_L1) ? 255 : 0;
+    p[54] = decoded->r2[index];
+    p[55] = decoded->l2[index];
+
+    /* First touch point; the second one is not decoded */
+    p[56] = decoded->touch_active[index];
+    p[57] = 0;
+    put_u16(p + 58, decoded->touch_x[index]);
+    put_u16(p + 60, decoded->touch_y[index]);
+    memset(p + 62, 0, 6);
+
+    put_u64(p + 68, decoded->timestamp_ns[index] / 1000u);
+    memset(p + 76, 0, 24);
+    if (slots[slot].motion & DSU_MOTION_ACCEL)
+    {
+        put_float(p + 76, samples->accel_x[index]);
+        put_float(p + 80, samples->accel_y[index]);
+        put_float(p + 84, samples->accel_z[index]);
+    }
+    if (slots[slot].motion & DSU_MOTION_GYRO)
+    {
+        put_float(p + 88, samples->gyro_x[index]);
+        put_float(p + 92, samples->gyro_y[index]);
+        put_float(p + 96, samples->gyro_z[index]);
+    }
+
+    finish_packet(p, DSU_DATA_PACKET_SIZE);
+}
+
+/**
+ * Sends every queued packet in one batch
+ */
+void dsu_server_flush(void)
+{
+    uint64_t now = latency_now_ns();
+    unsigned int count = 0;
+
+    if (queued == 0)
+        return;
+
+    for (int i = 0; i < queued; i++)
+    {
+        for (int c = 0; c < DSU_MAX_CLIENTS; c++)
+        {
+            struct msghdr *hdr;
+
+            if (!client_wants(&clients[c], packet_slots[i], now))
+                continue;
+
+            iovecs[count].iov_base = packets[i];
+            iovecs[count].iov_len = DSU_DATA_PACKET_SIZE;
+#ifdef PLATFORM_LINUX
+            hdr = &messages[count].msg_hdr;
+#else
+            hdr = &messages[count];
+#endif
+            memset(hdr, 0, sizeof(*hdr));
+            hdr->msg_name = &clients[c].addr;
+            hdr->msg_namelen = sizeof(clients[c].addr);
+            hdr->msg_iov = &iovecs[count];
+            hdr->msg_iovlen = 1;
+            count++;
+        }
+    }
+    queued = 0;
+
+#ifdef PLATFORM_LINUX
+    for (unsigned int sent = 0; sent < count; )
+    {
+        int ret = sendmmsg(server_fd, messages + sent, count - sent, 0);
+        if (ret <= 0)
+            break;  /* Datagrams are best effort; drop the rest of the tick */
+        sent += (unsigned int)ret;
+        packets_sent += (uint64_t)ret;
+    }
+#else
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (sendmsg(server_fd, &messages[i], 0) >= 0)
+            packets_sent++;
+    }
+#endif
+}
+
+/**
+ * Closes the socket and prints the packet count
+ */
+void dsu_server_stop(void)
+{
+    int subscribed = 0;
+
+    if (server_fd < 0)
+        return;
+
+    for (int i = 0; i < DSU_MAX_CLIENTS; i++)
+    {
+        if (clients[i].slot_mask)
+            subscribed++;
+    }
+    close(server_fd);
+    server_fd = -1;
+
+    printf("%s[INFO]%s DSU server sent %llu packets to %d client(s)\n", COLOR_BLUE, COLOR_RESET,
+           (unsigned long long)packets_sent, subscribed);
+}
+
+#else /* PLATFORM_WINDOWS */
+
+/**
+ * Opens the UDP socket and preallocates all packet buffers
+ */
+int dsu_server_start(const char *address, int port)
+{
+    (void)address;
+    (void)port;
+    fprintf(stderr, "%s[ERROR]%s The DSU server is not supported on this platform\n", COLOR_RED, COLOR_RESET);
+    return 0;
+}
+
+/**
+ * Assigns a controller to a slot
+ */
+void dsu_server_set_slot(int slot, unsigned short product_id, const unsigned char *mac, int bluetooth)
+{
+    (void)slot;
+    (void)product_id;
+    (void)mac;
+    (void)bluetooth;
+}
+
+/**
+ * Answers pending version, info and subscription requests without blocking
+ */
+void dsu_server_poll(void)
+{
+}
+
+/**
+ * Builds the data packet of one report for every client subscribed to its slot
+ */
+void dsu_server_queue(int slot, const decoded_reports_t *decoded, const imu_samples_t *samples, size_t index)
+{
+    (void)slot;
+    (void)decoded;
+    (void)samples;
+    (void)index;
+}
+
+/**
+ * Sends every queued packet in one batch
+ */
+void dsu_server_flush(void)
+{
+}
+
+/**
+ * Closes the socket and prints the packet count
+ */
+void dsu_server_stop(void)
+{
+}
+
+#endif /* PLATFORM_WINDOWS */
@@ -0,0 +1,80 @@
+/**
+ * dsu_server.h - DSU (cemuhook) motion server
+ *
+ * Serves controller state and calibrated motion over the DSU UDP protocol
+ * used by emulators and motion tools. Packets are built in preallocated
+ * buffers as reports are merged and sent to every subscribed client in one
+ * batch per stream tick.
+ */
+
+#ifndef DSU_SERVER_H
+#define DSU_SERVER_H
+
+#include "report_decoder.h"
+#include "imu_calibration.h"
+
+/* Default address and port of DSU servers */
+#define DSU_DEFAULT_ADDRESS "127.0.0.1"
+#define DSU_DEFAULT_PORT 26760
+
+/* The protocol addresses controllers as slots 0-3 */
+#define DSU_SLOTS 4
+
+/* Clients that can be subscribed at the same time */
+#define DSU_MAX_CLIENTS 16
+
+/* Data packets buffered per tick before they are sent early */
+#define DSU_QUEUE_PACKETS 64
+
+/* A client that sends no data request for this long is dropped */
+#define DSU_CLIENT_TIMEOUT_MS 5000
+
+/**
+ * Opens the UDP socket and preallocates all packet buffers
+ *
+ * @param address IPv4 address to bind, or NULL for DSU_DEFAULT_ADDRESS
+ * @param port UDP port, or 0 for DSU_DEFAULT_PORT
+ * @return 1 on success, 0 on failure
+ */
+int dsu_server_start(const char *address, int port);
+
+/**
+ * Assigns a controller to a slot
+ *
+ * The device model follows the motion the controller's calibrated samples
+ * carry in physical units: full for the DS4, accelerometer only for the
+ * SixAxis and none for the Move, whose axes are sent as zero.
+ *
+ * @param slot Slot number (0 to DSU_SLOTS - 1)
+ * @param product_id Product ID of the controller, used for the device model
+ * @param mac Controller Bluetooth address, or NULL if unknown
+ * @param bluetooth 1 if the controller is connected over Bluetooth, 0 for USB
+ */
+void dsu_server_set_slot(int slot, unsigned short product_id, const unsigned char *mac, int bluetooth);
+
+/**
+ * Answers pending version, info and subscription requests without blocking
+ */
+void dsu_server_poll(void);
+
+/**
+ * Builds the data packet of one report for every client subscribed to its slot
+ *
+ * @param slot Slot of the controller
+ * @param decoded Decoded reports
+ * @param samples Calibrated IMU samples matching decoded
+ * @param index Index of the report in both batches
+ */
+void dsu_server_queue(int slot, const decoded_reports_t *decoded, const imu_samples_t *samples, size_t index);
+
+/**
+ * Sends every queued packet in one batch
+ */
+void dsu_server_flush(void);
+
+/**
+ * Closes the socket and prints the packet count
+ */
+void dsu_server_stop(void);
+
+#endif /* DSU_SERVER_H */
@@ -0,0 +1,616 @@
+/**
+ * feature_survey.c - Probing of every feature report ID
+ *
+ * Implementation of survey mode. Controllers of one model and transport
+ * form a group that shares a report ID counter, so each ID is probed once
+ * by whichever controller is free, and a timeout estimate. Every controller
+ * has a worker thread, which hands each probe to a prober thread owning an
+ * open handle and waits for it until the timeout. A prober that does not
+ * answer in time is abandoned: the worker opens a fresh handle with a new
+ * prober and goes on, and the stalled one is joined once its call returns.
+ */
+
+#include "feature_survey.h"
+#include "capability_cache.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "hid_io.h"
+#include "flight_recorder.h"
+#include "latency_stats.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of report IDs */
+#define SURVEY_REPORT_IDS 256
+
+/* Leading payload bytes shown in the table */
+#define SURVEY_PREVIEW_BYTES 16
+
+/**
+ * Starts a timeout estimate with no samples
+ */
+void survey_timeout_init(survey_timeout_t *timeout)
+{
+    timeout->smoothed_us = 0.0;
+    timeout->variation_us = 0.0;
+    timeout->samples = 0;
+}
+
+/**
+ * Adds the response time of an answered probe
+ */
+void survey_timeout_sample(survey_timeout_t *timeout, uint64_t elapsed_us)
+{
+    double sample = (double)elapsed_us;
+
+    if (timeout->samples == 0)
+    {
+        timeout->smoothed_us = sample;
+        timeout->variation_us = sample / 2.0;
+    }
+    else
+    {
+        timeout->variation_us = 0.75 * timeout->variation_us + 0.25 * fabs(timeout->smoothed_us - sample);
+        timeout->smoothed_us = 0.875 * timeout->smoothed_us + 0.125 * sample;
+    }
+    timeout->samples++;
+}
+
+/**
+ * Gets the current probe timeout
+ */
+int survey_timeout_ms(const survey_timeout_t *timeout)
+{
+    double ms;
+
+    if (timeout->samples == 0)
+        return SURVEY_INITIAL_TIMEOUT_MS;
+    ms = ceil((timeout->smoothed_us + 4.0 * timeout->variation_us) / 1000.0);
+    if (ms < SURVEY_MIN_TIMEOUT_MS)
+        return SURVEY_MIN_TIMEOUT_MS;
+    if (ms > SURVEY_MAX_TIMEOUT_MS)
+        return SURVEY_MAX_TIMEOUT_MS;
+    return (int)ms;
+}
+
+/**
+ * What probing one report ID found
+ */
+typedef enum {
+    SURVEY_UNPROBED = 0,
+    SURVEY_ANSWERED,
+    SURVEY_REJECTED,            /* The controller failed the request */
+    SURVEY_KNOWN_FAILING,       /* Skipped, the capability cache knows it fails */
+    SURVEY_TIMED_OUT            /* Abandoned after the timeout */
+} survey_status_t;
+
+/**
+ * The outcome of one report ID
+ */
+typedef struct {
+    survey_status_t status;
+    int length;
+    uint64_t elapsed_us;
+    int slot;                           /* Controller that probed it */
+    unsigned char data[SURVEY_MAX_LENGTH];
+} survey_result_t;
+
+/**
+ * Controllers of one model and transport, and their shared work
+ */
+typedef struct {
+    unsigned short vendor_id;
+    unsigned short product_id;
+    int bluetooth;
+    int members;
+    mutex_t lock;
+    int next_id;                        /* Next report ID to hand out */
+    survey_timeout_t timeout;
+    survey_result_t results[SURVEY_REPORT_IDS];
+} survey_group_t;
+
+/**
+ * A thread owning one open handle and running the probes handed to it
+ */
+typedef struct {
+    hid_device *dev;
+    mutex_t lock;
+    cond_t cond;
+    int pending;                        /* A probe is waiting to run */
+    int done;                           /* The probe has returned */
+    int abandoned;                      /* Its worker gave up waiting */
+    int stop;
+    unsigned char data[SURVEY_MAX_LENGTH];
+    int result;
+    int error;
+    uint64_t elapsed_us;
+    thread_t thread;
+    int running;
+} survey_prober_t;
+
+/**
+ * One controller and its share of the survey
+ */
+typedef struct {
+    survey_group_t *group;
+    controller_info_t *controller;
+    int slot;
+    int opened;
+    uint16_t firmware;
+    int probed;
+    int stalls;
+    survey_prober_t *abandoned[SURVEY_MAX_STALLS];
+    thread_t thread;
+    int running;
+} survey_worker_t;
+
+/**
+ * Runs one probe on a prober's handle
+ */
+static void run_probe(survey_prober_t *prober)
+{
+    uint64_t start = latency_now_ns();
+
+    errno = 0;
+    prober->result = hid_io_get_feature_report(prober->dev, prober->data, sizeof(prober->data));
+    prober->error = errno;
+    prober->elapsed_us = (latency_now_ns() - start) / 1000ull;
+}
+
+/**
+ * Prober thread: runs probes until stopped or abandoned
+ */
+static void prober_main(void *arg)
+{
+    survey_prober_t *prober = (survey_prober_t*)arg;
+
+    mutex_lock(&prober->lock);
+    while (!prober->stop)
+    {
+        if (!prober->pending)
+        {
+            cond_timedwait(&prober->cond, &prober->lock, 100);
+            continue;
+        }
+        mutex_unlock(&prober->lock);
+        run_probe(prober);
+        mutex_lock(&prober->lock);
+        prober->pending = 0;
+        prober->done = 1;
+        cond_broadcast(&prober->cond);
+        if (prober->abandoned)
+            break;
+    }
+    mutex_unlock(&prober->lock);
+}
+
+/**
+ * Starts a prober on an open handle; probes run on the caller's thread if no thread can be started
+ *
+ * @return The prober, or NULL with the handle closed
+ */
+static survey_prober_t* prober_start(hid_device *dev)
+{
+    survey_prober_t *prober;
+
+    if (!dev)
+        return NULL;
+    prober = (survey_prober_t*)calloc(1, sizeof(survey_prober_t));
+    if (!prober)
+    {
+        hid_io_close(dev);
+        return NULL;
+    }
+    prober->dev = dev;
+    mutex_init(&prober->lock);
+    cond_init(&prober->cond);
+    prober->running = thread_create(&prober->thread, prober_main, prober);
+    return prober;
+}
+
+/**
+ * Stops a prober once its probe has returned, closes its handle and frees it
+ */
+static void prober_stop(survey_prober_t *prober)
+{
+    if (!prober)
+        return;
+    if (prober->running)
+    {
+        mutex_lock(&prober->lock);
+        prober->stop = 1;
+        cond_broadcast(&prober->cond);
+        mutex_unlock(&prober->lock);
+        thread_join(prober->thread);
+    }
+    hid_io_close(prober->dev);
+    cond_destroy(&prober->cond);
+    mutex_destroy(&prober->lock);
+    free(prober);
+}
+
+/**
+ * Hands a probe to a prober and waits for it until the timeout
+ *
+ * @return 1 if the probe returned, 0 if it was abandoned
+ */
+static int probe(survey_prober_t *prober, unsigned char report_id, int timeout_ms)
+{
+    uint64_t deadline, now;
+
+    memset(prober->data, 0, sizeof(prober->data));
+    prober->data[0] = report_id;
+    if (!prober->running)
+    {
+        run_probe(prober);
+        return 1;
+    }
+
+    mutex_lock(&prober->lock);
+    prober->done = 0;
+    prober->pending = 1;
+    cond_broadcast(&prober->cond);
+    deadline = latency_now_ns() + (uint64_t)timeout_ms * 1000000ull;
+    while (!prober->done && (now = latency_now_ns()) < deadline)
+    {
+        int wait_ms = (int)((deadline - now) / 1000000ull);
+
+        cond_timedwait(&prober->cond, &prober->lock, wait_ms > 0 ? wait_ms : 1);
+    }
+    if (!prober->done)
+        prober->abandoned = 1;
+    mutex_unlock(&prober->lock);
+    return !prober->abandoned;
+}
+
+/**
+ * Stores the outcome of a returned probe in the group
+ */
+static void record_probe(survey_worker_t *worker, const survey_prober_t *prober, unsigned char report_id)
+{
+    survey_group_t *group = worker->group;
+    survey_result_t *result = &group->results[report_id];
+
+    mutex_lock(&group->lock);
+    result->slot = worker->slot;
+    result->elapsed_us = prober->elapsed_us;
+    if (prober->result > 0)
+    {
+        result->status = SURVEY_ANSWERED;
+        result->length = prober->result;
+        memcpy(result->data, prober->data, (size_t)prober->result);
+        survey_timeout_sample(&group->timeout, prober->elapsed_us);
+    }
+    else if (prober->error == EOPNOTSUPP)
+        result->status = SURVEY_KNOWN_FAILING;
+    else
+        result->status = SURVEY_REJECTED;
+    mutex_unlock(&group->lock);
+}
+
+/**
+ * Worker thread: probes report IDs of its group on one controller until none are left
+ */
+static void survey_main(void *arg)
+{
+    survey_worker_t *worker = (survey_worker_t*)arg;
+    survey_group_t *group = worker->group;
+    survey_prober_t *prober = prober_start(connect_to_controller(worker->controller));
+    int report_id, timeout_ms;
+
+    worker->opened = prober != NULL;
+    worker->firmware = CAPABILITY_FIRMWARE_UNKNOWN;
+    while (prober)
+    {
+        mutex_lock(&group->lock);
+        report_id = group->next_id < SURVEY_REPORT_IDS ? group->next_id++ : -1;
+        timeout_ms = survey_timeout_ms(&group->timeout);
+        mutex_unlock(&group->lock);
+        if (report_id < 0)
+            break;
+
+        worker->probed++;
+        if (probe(prober, (unsigned char)report_id, timeout_ms))
+        {
+            record_probe(worker, prober, (unsigned char)report_id);
+            if (worker->firmware == CAPABILITY_FIRMWARE_UNKNOWN)
+                worker->firmware = capability_cache_firmware(prober->dev);
+            continue;
+        }
+
+        mutex_lock(&group->lock);
+        group->results[report_id].status = SURVEY_TIMED_OUT;
+        group->results[report_id].slot = worker->slot;
+        group->results[report_id].elapsed_us = (uint64_t)timeout_ms * 1000ull;
+        mutex_unlock(&group->lock);
+
+        /* The stalled call cannot be cancelled; go on through a fresh handle */
+        flight_recorder_dump(prober->dev, "survey probe timed out");
+        worker->abandoned[worker->stalls++] = prober;
+        prober = NULL;
+        if (worker->stalls < SURVEY_MAX_STALLS)
+            prober = prober_start(hid_io_open_path(worker->controller->path));
+    }
+
+    prober_stop(prober);
+    for (int i = 0; i < worker->stalls; i++)
+        prober_stop(worker->abandoned[i]);
+}
+
+/**
+ * Formats report bytes as hex
+ */
+static void format_payload(const unsigned char *data, int length, char *out, size_t out_len)
+{
+    size_t used = 0;
+
+    out[0] = '\0';
+    for (int i = 0; i < length && used + 3 <= out_len; i++)
+        used += (size_t)snprintf(out + used, out_len - used, "%02x", data[i]);
+}
+
+/**
+ * Gets the name of a result status, as written to the CSV file
+ */
+static const char* status_name(survey_status_t status)
+{
+    switch (status)
+    {
+    case SURVEY_ANSWERED:
+        return "answered";
+    case SURVEY_REJECTED:
+        return "rejected";
+    case SURVEY_KNOWN_FAILING:
+        return "known-failing";
+    case SURVEY_TIMED_OUT:
+        return "timed-out";
+    default:
+        return "unprobed";
+    }
+}
+
+/**
+ * Prints one group's controllers and the report IDs that answered or stalled
+ *
+ * @return 1 if every report ID of the group was probed, 0 otherwise
+ */
+static int print_group(const survey_group_t *group, const survey_worker_t *workers, int worker_count)
+{
+    int counts[SURVEY_TIMED_OUT + 1] = {0};
+    uint16_t firmware = CAPABILITY_FIRMWARE_UNKNOWN;
+    int mixed = 0;
+    char payload[SURVEY_PREVIEW_BYTES * 2 + 1];
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (workers[i].group != group || !workers[i].opened)
+            continue;
+        if (firmware == CAPABILITY_FIRMWARE_UNKNOWN)
+            firmware = workers[i].firmware;
+        else if (workers[i].firmware != CAPABILITY_FIRMWARE_UNKNOWN && workers[i].firmware != firmware)
+            mixed = 1;
+    }
+
+    printf("\n%s%s=== Survey: %s (%s", COLOR_BOLD, COLOR_YELLOW, get_controller_name(group->product_id),
+           group->bluetooth ? "Bluetooth" : "USB");
+    if (mixed)
+        printf(", mixed firmware");
+    else if (firmware != CAPABILITY_FIRMWARE_UNKNOWN)
+        printf(", firmware %x.%02x", firmware >> 8, firmware & 0xff);
+    printf(", %d controller(s)) ===%s\n", group->members, COLOR_RESET);
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (workers[i].group != group)
+            continue;
+        printf("%s  [%d] %-14s %s", COLOR_WHITE, workers[i].slot, workers[i].controller->path, COLOR_RESET);
+        if (!workers[i].opened)
+            printf("%scould not open the controller%s\n", COLOR_RED, COLOR_RESET);
+        else
+            printf("%d probed, %d stalled\n", workers[i].probed, workers[i].stalls);
+    }
+
+    printf("%s  ID    Size  Time       By   Payload%s\n", COLOR_BOLD, COLOR_RESET);
+    for (int id = 0; id < SURVEY_REPORT_IDS; id++)
+    {
+        const survey_result_t *result = &group->results[id];
+
+        counts[result->status]++;
+        if (result->status == SURVEY_ANSWERED)
+        {
+            format_payload(result->data, result->length < SURVEY_PREVIEW_BYTES ? result->length : SURVEY_PREVIEW_BYTES,
+                           payload, sizeof(payload));
+            printf("  %s0x%02x%s  %4d  %7.2fms  [%d]  %s%s\n", COLOR_GREEN, id, COLOR_RESET, result->length,
+                   result->elapsed_us / 1000.0, result->slot, payload,
+                   result->length > SURVEY_PREVIEW_BYTES ? "..." : "");
+        }
+        else if (result->status == SURVEY_TIMED_OUT)
+        {
+            printf("  %s0x%02x%s     -  >%6.0fms  [%d]  %stimed out%s\n", COLOR_YELLOW, id, COLOR_RESET,
+                   result->elapsed_us / 1000.0, result->slot, COLOR_YELLOW, COLOR_RESET);
+        }
+    }
+
+    printf("%s[INFO]%s %d answered, %d rejected, %d known failing, %d timed out, %d not probed; "
+           "timeout settled at %dms\n", COLOR_BLUE, COLOR_RESET, counts[SURVEY_ANSWERED], counts[SURVEY_REJECTED],
+           counts[SURVEY_KNOWN_FAILING], counts[SURVEY_TIMED_OUT], counts[SURVEY_UNPROBED],
+           survey_timeout_ms(&group->timeout));
+    return counts[SURVEY_UNPROBED] == 0;
+}
+
+/**
+ * Writes every report ID of every group to a CSV file
+ *
+ * @return 1 on success, 0 with an error printed
+ */
+static int write_csv(const char *path, survey_group_t *groups[], int group_count,
+                     const survey_worker_t *workers, int worker_count)
+{
+    FILE *file = fopen(path, "w");
+    char payload[SURVEY_MAX_LENGTH * 2 + 1];
+    int ok;
+
+    if (!file)
+    {
+        printf("%s[ERROR]%s Could not write %s\n", COLOR_RED, COLOR_RESET, path);
+        return 0;
+    }
+    fprintf(file, "product_id,transport,report_id,status,length,elapsed_us,controller,payload\n");
+    for (int g = 0; g < group_count; g++)
+    {
+        for (int id = 0; id < SURVEY_REPORT_IDS; id++)
+        {
+            const survey_result_t *result = &groups[g]->results[id];
+            const char *controller = "";
+
+            for (int i = 0; i < worker_count && result->status != SURVEY_UNPROBED; i++)
+            {
+                if (workers[i].group == groups[g] && workers[i].slot == result->slot)
+                    controller = workers[i].controller->path;
+            }
+            format_payload(result->data, result->status == SURVEY_ANSWERED ? result->length : 0, payload,
+                           sizeof(payload));
+            fprintf(file, "0x%04x,%s,0x%02x,%s,%d,%llu,%s,%s\n", groups[g]->product_id,
+                    groups[g]->bluetooth ? "bluetooth" : "usb", id, status_name(result->status), result->length,
+                    (unsigned long long)result->elapsed_us, controller, payload);
+        }
+    }
+    ok = !ferror(file);
+    if (fclose(file) != 0)
+        ok = 0;
+    if (!ok)
+        printf("%s[ERROR]%s Could not write %s\n", COLOR_RED, COLOR_RESET, path);
+    else
+        printf("%s[SUCCESS]%s Survey written to %s\n", COLOR_GREEN, COLOR_RESET, path);
+    return ok;
+}
+
+/**
+ * Finds the group of a controller, creating it if needed
+ *
+ * @return The group, or NULL if out of memory
+ */
+static survey_group_t* group_for(survey_group_t *groups[], int *group_count, const controller_info_t *controller)
+{
+    int bluetooth = is_bluetooth_controller(controller);
+    survey_group_t *group;
+
+    for (int g = 0; g < *group_count; g++)
+    {
+        if (groups[g]->vendor_id == controller->vendor_id && groups[g]->product_id == controller->product_id &&
+            groups[g]->bluetooth == bluetooth)
+            return groups[g];
+    }
+    group = (survey_group_t*)calloc(1, sizeof(survey_group_t));
+    if (!group)
+        return NULL;
+    group->vendor_id = controller->vendor_id;
+    group->product_id = controller->product_id;
+    group->bluetooth = bluetooth;
+    mutex_init(&group->lock);
+    survey_timeout_init(&group->timeout);
+    groups[(*group_count)++] = group;
+    return group;
+}
+
+/**
+ * Probes every feature report ID on every connected controller
+ */
+int survey_command(int argc, char **argv)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    survey_group_t *groups[MAX_CONTROLLERS];
+    survey_worker_t *workers;
+    const char *output = NULL;
+    char *end;
+    long product = -1;
+    uint64_t start;
+    int controller_count, worker_count = 0, group_count = 0, complete = 1;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--product") == 0)
+        {
+            product = strtol(argv[++i], &end, 0);
+            if (*end != '\0' || product < 0 || product > 0xffff)
+            {
+                fprintf(stderr, "%s[ERROR]%s Invalid product ID: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+                return 1;
+            }
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--output") == 0)
+            output = argv[++i];
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown survey option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+
+    controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+    workers = (survey_worker_t*)calloc(controller_count > 0 ? (size_t)controller_count : 1, sizeof(survey_worker_t));
+    if (!workers)
+    {
+        for (int i = 0; i < controller_count; i++)
+            free_controller_info(controllers[i]);
+        return 1;
+    }
+
+    for (int i = 0; i < controller_count; i++)
+    {
+        survey_group_t *group = NULL;
+
+        if (product < 0 || controllers[i]->product_id == (unsigned short)product)
+            group = group_for(groups, &group_count, controllers[i]);
+        if (!group)
+        {
+            free_controller_info(controllers[i]);
+            continue;
+        }
+        workers[worker_count].group = group;
+        workers[worker_count].controller = controllers[i];
+        workers[worker_count].slot = ++group->members;
+        worker_count++;
+    }
+    if (worker_count == 0)
+    {
+        printf("%s[ERROR]%s No connected controller to survey\n", COLOR_RED, COLOR_RESET);
+        free(workers);
+        return 1;
+    }
+
+    printf("%s[INFO]%s Probing report IDs 0x00-0xff on %d controller(s)...\n", COLOR_BLUE, COLOR_RESET, worker_count);
+    start = latency_now_ns();
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i].running = thread_create(&workers[i].thread, survey_main, &workers[i]);
+        if (!workers[i].running)
+            survey_main(&workers[i]);
+    }
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (workers[i].running)
+            thread_join(workers[i].thread);
+    }
+
+    for (int g = 0; g < group_count; g++)
+        complete &= print_group(groups[g], workers, worker_count);
+    printf("%s[INFO]%s Survey took %.1fms\n", COLOR_BLUE, COLOR_RESET, (latency_now_ns() - start) / 1e6);
+    if (output && !write_csv(output, groups, group_count, workers, worker_count))
+        complete = 0;
+
+    for (int i = 0; i < worker_count; i++)
+        free_controller_info(workers[i].controller);
+    for (int g = 0; g < group_count; g++)
+    {
+        mutex_destroy(&groups[g]->lock);
+        free(groups[g]);
+    }
+    free(workers);
+    return complete ? 0 : 1;
+}
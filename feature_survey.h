@@ -0,0 +1,80 @@
+/**
+ * feature_survey.h - Probing of every feature report ID
+ *
+ * Survey mode asks connected controllers for each feature report ID from
+ * 0x00 to 0xFF, for reverse-engineering new controller revisions. The IDs
+ * of one model are shared out among all its connected controllers, which
+ * probe in parallel. HIDAPI calls cannot be cancelled, so a probe that
+ * outlives its timeout is abandoned on its own thread and probing goes on
+ * through a fresh handle; the timeout adapts to the response times of the
+ * reports that answered. Outcomes land in the capability cache through
+ * hid_io.
+ */
+
+#ifndef FEATURE_SURVEY_H
+#define FEATURE_SURVEY_H
+
+#include <stdint.h>
+
+/* Probe timeouts: before any answer, and the range they adapt within */
+#define SURVEY_INITIAL_TIMEOUT_MS 500
+#define SURVEY_MIN_TIMEOUT_MS 20
+#define SURVEY_MAX_TIMEOUT_MS 2000
+
+/* Longest report read, report ID included */
+#define SURVEY_MAX_LENGTH 256
+
+/* Abandoned probes after which a controller stops probing */
+#define SURVEY_MAX_STALLS 8
+
+/**
+ * Adaptive probe timeout, estimated like a TCP retransmission timeout
+ * (RFC 6298) from the response times of answered probes
+ */
+typedef struct {
+    double smoothed_us;
+    double variation_us;
+    int samples;
+} survey_timeout_t;
+
+/**
+ * Starts a timeout estimate with no samples
+ *
+ * @param timeout The estimate
+ */
+void survey_timeout_init(survey_timeout_t *timeout);
+
+/**
+ * Adds the response time of an answered probe
+ *
+ * @param timeout The estimate
+ * @param elapsed_us Response time in microseconds
+ */
+void survey_timeout_sample(survey_timeout_t *timeout, uint64_t elapsed_us);
+
+/**
+ * Gets the current probe timeout
+ *
+ * @param timeout The estimate
+ * @return SURVEY_INITIAL_TIMEOUT_MS before any sample, otherwise the
+ *         smoothed time plus four variations, clamped to the range
+ */
+int survey_timeout_ms(const survey_timeout_t *timeout);
+
+/**
+ * Probes every feature report ID on every connected controller
+ *
+ * Usage: survey [--product <id>] [--output <file>]
+ *
+ * Controllers are grouped by model and transport; each group prints a
+ * table of the IDs that answered, with their length, response time and
+ * leading payload bytes. --product limits the survey to one product ID,
+ * --output writes every probed ID to a CSV file.
+ *
+ * @param argc Number of arguments after the "survey" command
+ * @param argv Arguments after the "survey" command
+ * @return 0 if every ID of every group was probed, 1 otherwise
+ */
+int survey_command(int argc, char **argv);
+
+#endif /* FEATURE_SURVEY_H */
@@ -0,0 +1,220 @@
+/**
+ * flight_recorder.c - Always-on recorder of recent HID transactions
+ *
+ * Implementation of the per-device rings. Rings are claimed from a small
+ * open-addressed table keyed by the device handle; recording is a lookup,
+ * a handful of plain stores into the slot and one release store of the
+ * head index, so it can stay enabled at full bench throughput.
+ */
+
+#include "flight_recorder.h"
+#include "hid_io.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/**
+ * One recorded HID transaction (32 bytes)
+ */
+typedef struct {
+    uint64_t timestamp_ns;
+    uint8_t op;
+    uint8_t report_id;
+    uint16_t length;
+    int32_t result;
+    int32_t error;
+    uint8_t data[FLIGHT_DATA_BYTES];
+    uint32_t reserved;
+} flight_entry_t;
+
+/**
+ * Transaction ring bound to one open device
+ */
+typedef struct {
+    _Atomic(hid_device *) owner;
+    _Atomic uint32_t head;
+    char path[128];
+    flight_entry_t entries[FLIGHT_RING_ENTRIES];
+} flight_ring_t;
+
+static flight_ring_t rings[FLIGHT_MAX_DEVICES];
+static char dump_dir[512] = ".";
+
+/**
+ * Gets the preferred table position for a device handle
+ */
+static unsigned int home_slot(hid_device *dev)
+{
+    uintptr_t key = (uintptr_t)dev;
+    key ^= key >> 17;
+    key *= 0x9E3779B1u;
+    return (unsigned int)(key >> 8) & (FLIGHT_MAX_DEVICES - 1);
+}
+
+/**
+ * Finds the ring bound to a device
+ */
+static flight_ring_t* find_ring(hid_device *dev)
+{
+    unsigned int slot = home_slot(dev);
+
+    for (int probe = 0; probe < FLIGHT_MAX_DEVICES; probe++)
+    {
+        flight_ring_t *ring = &rings[(slot + probe) & (FLIGHT_MAX_DEVICES - 1)];
+        if (atomic_load_explicit(&ring->owner, memory_order_acquire) == dev)
+            return ring;
+    }
+
+    return NULL;
+}
+
+/**
+ * Sets the directory flight recorder dumps are written to
+ */
+void flight_recorder_set_dir(const char *dir)
+{
+    if (!dir || !*dir)
+        return;
+
+    strncpy(dump_dir, dir, sizeof(dump_dir) - 1);
+    dump_dir[sizeof(dump_dir) - 1] = '\0';
+}
+
+/**
+ * Attaches a ring to a newly opened device
+ */
+void flight_recorder_attach(hid_device *dev, const char *path)
+{
+    unsigned int slot;
+
+    if (!dev || find_ring(dev))
+        return;
+
+    slot = home_slot(dev);
+    for (int probe = 0; probe < FLIGHT_MAX_DEVICES; probe++)
+    {
+        flight_ring_t *ring = &rings[(slot + probe) & (FLIGHT_MAX_DEVICES - 1)];
+        hid_device *expected = NULL;
+
+        if (atomic_compare_exchange_strong(&ring->owner, &expected, dev))
+        {
+            atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+            strncpy(ring->path, path ? path : "", sizeof(ring->path) - 1);
+            ring->path[sizeof(ring->path) - 1] = '\0';
+            return;
+        }
+    }
+
+    /* Table full: this device simply goes unrecorded */
+}
+
+/**
+ * Releases the ring of a device that is about to be closed
+ */
+void flight_recorder_detach(hid_device *dev)
+{
+    flight_ring_t *ring = dev ? find_ring(dev) : NULL;
+
+    if (ring)
+        atomic_store_explicit(&ring->owner, NULL, memory_order_release);
+}
+
+/**
+ * Records one HID transaction in the device's ring
+ */
+void flight_recorder_record(hid_device *dev, latency_op_t op, int report_id,
+                            const unsigned char *data, size_t length, int result, int error)
+{
+    flight_ring_t *ring = dev ? find_ring(dev) : NULL;
+    flight_entry_t *entry;
+    uint32_t head;
+    size_t copy;
+
+    if (!ring)
+        return;
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    entry = &ring->entries[head & (FLIGHT_RING_ENTRIES - 1)];
+
+    entry->timestamp_ns = latency_now_ns();
+    entry->op = (uint8_t)op;
+    entry->report_id = (uint8_t)report_id;
+    entry->length = (uint16_t)(length > 0xffff ? 0xffff : length);
+    entry->result = result;
+    entry->error = error;
+    copy = (data && length) ? (length < FLIGHT_DATA_BYTES ? length : FLIGHT_DATA_BYTES) : 0;
+    if (copy)
+        memcpy(entry->data, data, copy);
+    memset(entry->data + copy, 0, FLIGHT_DATA_BYTES - copy);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * Writes the device's ring to a file in the dump directory
+ */
+int flight_recorder_dump(hid_device *dev, const char *reason)
+{
+    flight_ring_t *ring = dev ? find_ring(dev) : NULL;
+    char file_name[768];
+    char safe_path[sizeof(ring->path)];
+    uint32_t head, first;
+    uint64_t now_ns = latency_now_ns();
+    FILE *fp;
+
+    if (!ring)
+        return 0;
+
+    /* Turn the device path into something usable as a file name */
+    size_t i;
+    for (i = 0; ring->path[i] && i < sizeof(safe_path) - 1; i++)
+    {
+        char c = ring->path[i];
+        int ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+        safe_path[i] = ok ? c : '_';
+    }
+    safe_path[i] = '\0';
+
+    snprintf(file_name, sizeof(file_name), "%s%sflight-%s-%lld.log", dump_dir, PATH_SEPARATOR,
+             safe_path[0] ? safe_path : "device", (long long)time(NULL));
+
+    fp = fopen(file_name, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to write flight recorder dump %s\n", COLOR_RED, COLOR_RESET, file_name);
+        return 0;
+    }
+
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    first = head > FLIGHT_RING_ENTRIES ? head - FLIGHT_RING_ENTRIES : 0;
+
+    fprintf(fp, "# sixaxispairer flight recorder\n");
+    fprintf(fp, "# device: %s\n", ring->path);
+    fprintf(fp, "# reason: %s\n", reason ? reason : "(none)");
+    fprintf(fp, "# hid_error: %ls\n", hid_io_error(dev) ? hid_io_error(dev) : L"(none)");
+    fprintf(fp, "# transactions: %u recorded, last %u shown\n", head, head - first);
+    fprintf(fp, "#\n# %-10s %-24s %-6s %-6s %-7s %-6s %s\n",
+            "age_us", "operation", "report", "length", "result", "errno", "data");
+
+    for (uint32_t seq = first; seq < head; seq++)
+    {
+        const flight_entry_t *entry = &ring->entries[seq & (FLIGHT_RING_ENTRIES - 1)];
+        int shown = entry->length < FLIGHT_DATA_BYTES ? entry->length : FLIGHT_DATA_BYTES;
+
+        fprintf(fp, "  %-10.1f %-24s 0x%02x   %-6u %-7d %-6d ",
+                (now_ns - entry->timestamp_ns) / 1e3, latency_op_name((latency_op_t)entry->op),
+                entry->report_id, entry->length, entry->result, entry->error);
+        for (int b = 0; b < shown; b++)
+            fprintf(fp, "%02x ", entry->data[b]);
+        fprintf(fp, "\n");
+    }
+
+    fclose(fp);
+
+    printf("%s[INFO]%s Flight recorder dump written to %s\n", COLOR_BLUE, COLOR_RESET, file_name);
+    return 1;
+}
@@ -0,0 +1,71 @@
+/**
+ * flight_recorder.h - Always-on recorder of recent HID transactions
+ *
+ * Keeps the last FLIGHT_RING_ENTRIES HID transactions of every open device
+ * in a fixed-size ring so that a failure can be diagnosed from more than
+ * the final hid_error() text
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "platform_compat.h"
+#include "latency_stats.h"
+
+/* Transactions kept per device (power of two) */
+#define FLIGHT_RING_ENTRIES 64
+
+/* Number of devices that can be tracked at the same time (power of two) */
+#define FLIGHT_MAX_DEVICES 32
+
+/* Leading payload bytes stored per transaction */
+#define FLIGHT_DATA_BYTES 8
+
+/**
+ * Sets the directory flight recorder dumps are written to
+ *
+ * @param dir Directory path (defaults to the current directory)
+ */
+void flight_recorder_set_dir(const char *dir);
+
+/**
+ * Attaches a ring to a newly opened device
+ *
+ * @param dev Handle to the HID device
+ * @param path Device path used to name dumps, or NULL
+ */
+void flight_recorder_attach(hid_device *dev, const char *path);
+
+/**
+ * Releases the ring of a device that is about to be closed
+ *
+ * @param dev Handle to the HID device
+ */
+void flight_recorder_detach(hid_device *dev);
+
+/**
+ * Records one HID transaction in the device's ring
+ *
+ * Only the thread currently using the device may record into its ring.
+ *
+ * @param dev Handle to the HID device
+ * @param op The HID operation
+ * @param report_id Report ID of the transaction
+ * @param data Payload sent or received, or NULL
+ * @param length Payload length in bytes
+ * @param result Return value of the HIDAPI call
+ * @param error errno observed after the call
+ */
+void flight_recorder_record(hid_device *dev, latency_op_t op, int report_id,
+                            const unsigned char *data, size_t length, int result, int error);
+
+/**
+ * Writes the device's ring to a file in the dump directory
+ *
+ * @param dev Handle to the HID device
+ * @param reason Short description of why the dump was taken
+ * @return 1 if a dump was written, 0 otherwise
+ */
+int flight_recorder_dump(hid_device *dev, const char *reason);
+
+#endif /* FLIGHT_RECORDER_H */
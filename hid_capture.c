@@ -0,0 +1,428 @@
+/**
+ * hid_capture.c - HID traffic capture
+ *
+ * Implementation of the capture writer. Each record is encoded into a local
+ * buffer by the calling thread and appended to the file under a mutex, so
+ * captures taken by the multi-threaded daemon stay well formed.
+ */
+
+#include "hid_capture.h"
+#include "hid_io.h"
+#include "latency_stats.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <time.h>
+
+/* Maximum number of devices open at the same time while capturing */
+#define CAPTURE_MAX_OPEN 256
+
+/**
+ * Growable little-endian encoding buffer
+ */
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+    unsigned char inline_data[256];
+} capture_buffer_t;
+
+/**
+ * Capture ID assigned to an open device
+ */
+typedef struct {
+    hid_device *dev;
+    uint16_t id;
+} capture_device_t;
+
+int hid_capture_enabled = 0;
+
+static FILE *capture_file = NULL;
+static uint64_t capture_origin_ns = 0;
+static mutex_t capture_lock;
+static capture_device_t open_devices[CAPTURE_MAX_OPEN];
+static uint16_t next_device_id = 0;
+static int write_failed = 0;      /* A record could not be encoded or written */
+static int devices_untracked = 0; /* Opens that found no free slot in open_devices */
+
+/**
+ * Prepares an empty buffer
+ */
+static void buffer_init(capture_buffer_t *buf)
+{
+    buf->data = buf->inline_data;
+    buf->length = 0;
+    buf->capacity = sizeof(buf->inline_data);
+    buf->failed = 0;
+}
+
+/**
+ * Releases heap storage held by a buffer
+ */
+static void buffer_free(capture_buffer_t *buf)
+{
+    if (buf->data != buf->inline_data)
+        free(buf->data);
+}
+
+/**
+ * Appends raw bytes, growing the buffer as needed
+ */
+static void put_bytes(capture_buffer_t *buf, const void *bytes, size_t count)
+{
+    if (buf->failed || count == 0)
+        return;
+
+    if (buf->length + count > buf->capacity)
+    {
+        size_t capacity = buf->capacity * 2;
+        unsigned char *grown;
+
+        while (capacity < buf->length + count)
+            capacity *= 2;
+        grown = (unsigned char*)malloc(capacity);
+        if (!grown)
+        {
+            buf->failed = 1;
+            return;
+        }
+        memcpy(grown, buf->data, buf->length);
+        buffer_free(buf);
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+
+    memcpy(buf->data + buf->length, bytes, count);
+    buf->length += count;
+}
+
+static void put_u8(capture_buffer_t *buf, uint8_t value)
+{
+    put_bytes(buf, &value, 1);
+}
+
+static void put_u16(capture_buffer_t *buf, uint16_t value)
+{
+    unsigned char bytes[2] = { (unsigned char)value, (unsigned char)(value >> 8) };
+    put_bytes(buf, bytes, sizeof(bytes));
+}
+
+static void put_u32(capture_buffer_t *buf, uint32_t value)
+{
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; i++)
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    put_bytes(buf, bytes, sizeof(bytes));
+}
+
+static void put_u64(capture_buffer_t *buf, uint64_t value)
+{
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++)
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    put_bytes(buf, bytes, sizeof(bytes));
+}
+
+/**
+ * Appends a length-prefixed narrow string
+ */
+static void put_string(capture_buffer_t *buf, const char *str)
+{
+    size_t length = str ? strlen(str) : 0;
+
+    if (!str || length >= CAPTURE_NULL_STRING)
+    {
+        put_u16(buf, CAPTURE_NULL_STRING);
+        return;
+    }
+    put_u16(buf, (uint16_t)length);
+    put_bytes(buf, str, length);
+}
+
+/**
+ * Appends a length-prefixed wide string as 16-bit code units
+ */
+static void put_wstring(capture_buffer_t *buf, const wchar_t *str)
+{
+    size_t length = str ? wcslen(str) : 0;
+
+    if (!str || length >= CAPTURE_NULL_STRING)
+    {
+        put_u16(buf, CAPTURE_NULL_STRING);
+        return;
+    }
+    put_u16(buf, (uint16_t)length);
+    for (size_t i = 0; i < length; i++)
+        put_u16(buf, (uint16_t)str[i]);
+}
+
+/**
+ * Appends one device entry
+ */
+static void put_device_info(capture_buffer_t *buf, const struct hid_device_info *info)
+{
+    put_u16(buf, info->vendor_id);
+    put_u16(buf, info->product_id);
+    put_u16(buf, info->release_number);
+    put_u16(buf, info->usage_page);
+    put_u16(buf, info->usage);
+    put_u32(buf, (uint32_t)info->interface_number);
+    put_string(buf, info->path);
+    put_wstring(buf, info->serial_number);
+    put_wstring(buf, info->manufacturer_string);
+    put_wstring(buf, info->product_string);
+}
+
+/**
+ * Looks up the capture ID of an open device; the lock must be held
+ */
+static uint16_t device_id_locked(hid_device *dev)
+{
+    for (int i = 0; i < CAPTURE_MAX_OPEN; i++)
+    {
+        if (dev && open_devices[i].dev == dev)
+            return open_devices[i].id;
+    }
+    return CAPTURE_NO_DEVICE;
+}
+
+/**
+ * Writes one record; the device ID is resolved under the same lock
+ */
+static void write_record(capture_record_t type, int report_id, hid_device *dev, int result,
+                         uint64_t start_ns, uint64_t end_ns, capture_buffer_t *payload)
+{
+    capture_buffer_t header;
+    uint64_t duration = end_ns > start_ns ? end_ns - start_ns : 0;
+
+    mutex_lock(&capture_lock);
+    if (payload->failed)
+        write_failed = 1;
+    else if (capture_file)
+    {
+        buffer_init(&header);
+        put_u8(&header, (uint8_t)type);
+        put_u8(&header, (uint8_t)report_id);
+        put_u16(&header, device_id_locked(dev));
+        put_u32(&header, (uint32_t)payload->length);
+        put_u32(&header, (uint32_t)result);
+        put_u32(&header, duration > UINT32_MAX ? UINT32_MAX : (uint32_t)duration);
+        put_u64(&header, start_ns - capture_origin_ns);
+
+        if (fwrite(header.data, 1, header.length, capture_file) != header.length ||
+            fwrite(payload->data, 1, payload->length, capture_file) != payload->length)
+            write_failed = 1;
+    }
+    mutex_unlock(&capture_lock);
+}
+
+/**
+ * Starts capturing HID traffic to a file
+ */
+int hid_capture_open(const char *path)
+{
+    capture_buffer_t header;
+
+    if (!path || !*path)
+        return 0;
+
+    capture_file = fopen(path, "wb");
+    if (!capture_file)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to create capture file %s\n", COLOR_RED, COLOR_RESET, path);
+        return 0;
+    }
+
+    buffer_init(&header);
+    put_bytes(&header, HID_CAPTURE_MAGIC, 6);
+    put_u16(&header, HID_CAPTURE_VERSION);
+    put_u64(&header, (uint64_t)time(NULL));
+    if (fwrite(header.data, 1, header.length, capture_file) != header.length)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to write capture file %s\n", COLOR_RED, COLOR_RESET, path);
+        fclose(capture_file);
+        capture_file = NULL;
+        return 0;
+    }
+    write_failed = 0;
+    devices_untracked = 0;
+
+    mutex_init(&capture_lock);
+    capture_origin_ns = latency_now_ns();
+    hid_capture_enabled = 1;
+    return 1;
+}
+
+/**
+ * Records an enumeration and its results
+ */
+void hid_capture_enumerate(uint64_t start_ns, uint64_t end_ns, unsigned short vendor_id,
+                           unsigned short product_id, const struct hid_device_info *devs)
+{
+    capture_buffer_t payload;
+    const struct hid_device_info *cur;
+    uint16_t count = 0;
+
+    for (cur = devs; cur && count < UINT16_MAX; cur = cur->next)
+        count++;
+
+    buffer_init(&payload);
+    put_u16(&payload, vendor_id);
+    put_u16(&payload, product_id);
+    put_u16(&payload, count);
+    cur = devs;
+    for (uint16_t i = 0; i < count; i++, cur = cur->next)
+        put_device_info(&payload, cur);
+
+    write_record(CAPTURE_ENUMERATE, 0, NULL, count, start_ns, end_ns, &payload);
+    buffer_free(&payload);
+}
+
+/**
+ * Records an open and assigns the device its capture ID
+ */
+void hid_capture_open_device(capture_record_t type, uint64_t start_ns, uint64_t end_ns, const char *path,
+                             unsigned short vendor_id, unsigned short product_id,
+                             hid_device *dev, const struct hid_device_info *info)
+{
+    capture_buffer_t payload;
+
+    buffer_init(&payload);
+    if (type == CAPTURE_OPEN_PATH)
+        put_string(&payload, path);
+    else
+    {
+        put_u16(&payload, vendor_id);
+        put_u16(&payload, product_id);
+    }
+    if (dev && info)
+        put_device_info(&payload, info);
+
+    /* Register the device first so the open record already carries its ID */
+    if (dev)
+    {
+        int registered = 0;
+
+        mutex_lock(&capture_lock);
+        for (int i = 0; i < CAPTURE_MAX_OPEN && !registered; i++)
+        {
+            if (!open_devices[i].dev)
+            {
+                open_devices[i].dev = dev;
+                open_devices[i].id = next_device_id++;
+                if (next_device_id == CAPTURE_NO_DEVICE)
+                    next_device_id = 0;
+                registered = 1;
+            }
+        }
+        if (!registered && devices_untracked++ == 0)
+        {
+            fprintf(stderr, "%s[ERROR]%s More than %d devices open while capturing; their records "
+                    "carry no device ID and will not replay\n", COLOR_RED, COLOR_RESET, CAPTURE_MAX_OPEN);
+        }
+        mutex_unlock(&capture_lock);
+    }
+
+    write_record(type, 0, dev, dev ? 0 : -1, start_ns, end_ns, &payload);
+    buffer_free(&payload);
+}
+
+/**
+ * Records a feature report transfer, an output report write or a report
+ * descriptor read
+ */
+void hid_capture_feature(capture_record_t type, uint64_t start_ns, uint64_t end_ns, hid_device *dev,
+                         int report_id, const unsigned char *data, size_t length, int result)
+{
+    capture_buffer_t payload;
+
+    buffer_init(&payload);
+    if (type == CAPTURE_GET_FEATURE || type == CAPTURE_DESCRIPTOR)
+    {
+        put_u32(&payload, (uint32_t)length);
+        if (result > 0)
+            put_bytes(&payload, data, (size_t)result < length ? (size_t)result : length);
+    }
+    else
+    {
+        put_u32(&payload, (uint32_t)length);
+        put_bytes(&payload, data, length);
+    }
+
+    if (result < 0)
+        put_wstring(&payload, hid_io_error(dev));
+
+    write_record(type, report_id, dev, result, start_ns, end_ns, &payload);
+    buffer_free(&payload);
+}
+
+/**
+ * Records an input report read
+ */
+void hid_capture_read(uint64_t start_ns, uint64_t end_ns, hid_device *dev,
+                      const unsigned char *data, size_t length, int timeout_ms, int result)
+{
+    capture_buffer_t payload;
+
+    buffer_init(&payload);
+    put_u32(&payload, (uint32_t)length);
+    put_u32(&payload, (uint32_t)timeout_ms);
+    if (result > 0)
+        put_bytes(&payload, data, (size_t)result < length ? (size_t)result : length);
+
+    write_record(CAPTURE_READ, result > 0 ? data[0] : 0, dev, result, start_ns, end_ns, &payload);
+    buffer_free(&payload);
+}
+
+/**
+ * Records that a device is about to be closed
+ */
+void hid_capture_close_device(hid_device *dev)
+{
+    capture_buffer_t payload;
+    uint64_t now = latency_now_ns();
+
+    buffer_init(&payload);
+    write_record(CAPTURE_CLOSE, 0, dev, 0, now, now, &payload);
+
+    mutex_lock(&capture_lock);
+    for (int i = 0; i < CAPTURE_MAX_OPEN; i++)
+    {
+        if (open_devices[i].dev == dev)
+            open_devices[i].dev = NULL;
+    }
+    mutex_unlock(&capture_lock);
+}
+
+/**
+ * Flushes and closes the capture file, suitable for atexit()
+ */
+void hid_capture_close(void)
+{
+    if (!hid_capture_enabled)
+        return;
+
+    mutex_lock(&capture_lock);
+    hid_capture_enabled = 0;
+    if (capture_file)
+    {
+        if (fclose(capture_file) != 0)
+            write_failed = 1;
+        capture_file = NULL;
+    }
+    if (write_failed)
+    {
+        fprintf(stderr, "%s[ERROR]%s Some capture records could not be written (disk full?); "
+                "the capture is incomplete\n", COLOR_RED, COLOR_RESET);
+    }
+    if (devices_untracked > 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s %d device open(s) were captured without a device ID\n",
+                COLOR_RED, COLOR_RESET, devices_untracked);
+    }
+    mutex_unlock(&capture_lock);
+}
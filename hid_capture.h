@@ -0,0 +1,154 @@
+/**
+ * hid_capture.h - HID traffic capture
+ *
+ * Records everything that crosses the HID boundary during a run into a
+ * compact binary file that the replay backend (hid_replay.h) can serve back.
+ *
+ * File layout (all integers little-endian):
+ *
+ *   File header (16 bytes)
+ *     0  char[6]  magic "SXPCAP"
+ *     6  u16      format version (HID_CAPTURE_VERSION)
+ *     8  u64      wall-clock start time, seconds since the epoch
+ *
+ *   Record header (24 bytes), followed by <length> payload bytes
+ *     0  u8       record type (capture_record_t)
+ *     1  u8       report ID, 0 if not applicable
+ *     2  u16      device ID assigned at open, CAPTURE_NO_DEVICE if none
+ *     4  u32      payload length
+ *     8  i32      return value of the HIDAPI call
+ *    12  u32      call duration in nanoseconds (saturating)
+ *    16  u64      call start in nanoseconds since the capture was opened
+ *
+ * Payloads:
+ *   ENUMERATE     u16 vendor_id, u16 product_id, u16 count, <count> device entries
+ *   OPEN_PATH     str path, then a device entry if the open succeeded
+ *   OPEN          u16 vendor_id, u16 product_id, then a device entry if the open succeeded
+ *   GET_FEATURE   u32 buffer length, then the bytes returned, or wstr hid_error() on failure
+ *   SEND_FEATURE  u32 byte count, the bytes sent, then wstr hid_error() on failure
+ *   READ          u32 buffer length, i32 timeout, then the bytes returned
+ *   CLOSE         empty
+ *   WRITE         as SEND_FEATURE
+ *   DESCRIPTOR    as GET_FEATURE, with report ID 0
+ *
+ *   device entry  u16 vendor_id, u16 product_id, u16 release_number, u16 usage_page,
+ *                 u16 usage, i32 interface_number, str path, wstr serial_number,
+ *                 wstr manufacturer_string, wstr product_string
+ *   str           u16 byte count (0xffff for NULL), bytes
+ *   wstr          u16 code unit count (0xffff for NULL), u16 code units
+ */
+
+#ifndef HID_CAPTURE_H
+#define HID_CAPTURE_H
+
+#include "platform_compat.h"
+#include <stdint.h>
+
+#define HID_CAPTURE_MAGIC "SXPCAP"
+#define HID_CAPTURE_VERSION 1
+#define HID_CAPTURE_FILE_HEADER_SIZE 16
+#define HID_CAPTURE_RECORD_HEADER_SIZE 24
+
+/* Device ID of records that are not tied to an open device */
+#define CAPTURE_NO_DEVICE 0xffff
+
+/* Marker length of a NULL string */
+#define CAPTURE_NULL_STRING 0xffff
+
+/**
+ * Record types
+ */
+typedef enum {
+    CAPTURE_ENUMERATE = 1,
+    CAPTURE_OPEN_PATH,
+    CAPTURE_OPEN,
+    CAPTURE_GET_FEATURE,
+    CAPTURE_SEND_FEATURE,
+    CAPTURE_READ,
+    CAPTURE_CLOSE,
+    CAPTURE_WRITE,
+    CAPTURE_DESCRIPTOR
+} capture_record_t;
+
+/* Non-zero while a capture file is being written */
+extern int hid_capture_enabled;
+
+/**
+ * Starts capturing HID traffic to a file
+ *
+ * @param path Output file path
+ * @return 1 on success, 0 on failure
+ */
+int hid_capture_open(const char *path);
+
+/**
+ * Records an enumeration and its results
+ *
+ * @param start_ns Call start from latency_now_ns()
+ * @param end_ns Call end from latency_now_ns()
+ * @param vendor_id Requested vendor ID
+ * @param product_id Requested product ID
+ * @param devs Enumeration result
+ */
+void hid_capture_enumerate(uint64_t start_ns, uint64_t end_ns, unsigned short vendor_id,
+                           unsigned short product_id, const struct hid_device_info *devs);
+
+/**
+ * Records an open and assigns the device its capture ID
+ *
+ * @param type CAPTURE_OPEN_PATH or CAPTURE_OPEN
+ * @param start_ns Call start from latency_now_ns()
+ * @param end_ns Call end from latency_now_ns()
+ * @param path Requested path (CAPTURE_OPEN_PATH)
+ * @param vendor_id Requested vendor ID (CAPTURE_OPEN)
+ * @param product_id Requested product ID (CAPTURE_OPEN)
+ * @param dev The opened device, or NULL on failure
+ * @param info Device information of the opened device, or NULL
+ */
+void hid_capture_open_device(capture_record_t type, uint64_t start_ns, uint64_t end_ns, const char *path,
+                             unsigned short vendor_id, unsigned short product_id,
+                             hid_device *dev, const struct hid_device_info *info);
+
+/**
+ * Records a feature report transfer, an output report write or a report
+ * descriptor read
+ *
+ * @param type CAPTURE_GET_FEATURE, CAPTURE_SEND_FEATURE, CAPTURE_WRITE or CAPTURE_DESCRIPTOR
+ * @param start_ns Call start from latency_now_ns()
+ * @param end_ns Call end from latency_now_ns()
+ * @param dev Handle to the HID device
+ * @param report_id Requested report ID
+ * @param data Report buffer after the call
+ * @param length Buffer length (get) or number of bytes sent (send)
+ * @param result Return value of the HIDAPI call
+ */
+void hid_capture_feature(capture_record_t type, uint64_t start_ns, uint64_t end_ns, hid_device *dev,
+                         int report_id, const unsigned char *data, size_t length, int result);
+
+/**
+ * Records an input report read
+ *
+ * @param start_ns Call start from latency_now_ns()
+ * @param end_ns Call end from latency_now_ns()
+ * @param dev Handle to the HID device
+ * @param data Buffer after the call
+ * @param length Buffer length
+ * @param timeout_ms Requested timeout
+ * @param result Return value of the HIDAPI call
+ */
+void hid_capture_read(uint64_t start_ns, uint64_t end_ns, hid_device *dev,
+                      const unsigned char *data, size_t length, int timeout_ms, int result);
+
+/**
+ * Records that a device is about to be closed
+ *
+ * @param dev Handle to the HID device
+ */
+void hid_capture_close_device(hid_device *dev);
+
+/**
+ * Flushes and closes the capture file, suitable for atexit()
+ */
+void hid_capture_close(void);
+
+#endif /* HID_CAPTURE_H */
@@ -0,0 +1,146 @@
+/**
+ * hid_descriptor.c - HID report descriptor parsing
+ *
+ * Implementation of the feature report walk. Short items are decoded from
+ * their prefix byte (size, type and tag); long items are skipped. Feature
+ * main items add report size times report count bits to the current report
+ * ID, and the bits are rounded up to bytes at the end.
+ */
+
+#include "hid_descriptor.h"
+#include <string.h>
+
+/* Item types */
+#define ITEM_MAIN 0
+#define ITEM_GLOBAL 1
+
+/* Main item tags */
+#define TAG_FEATURE 0x0b
+
+/* Global item tags */
+#define TAG_REPORT_SIZE 0x07
+#define TAG_REPORT_ID 0x08
+#define TAG_REPORT_COUNT 0x09
+#define TAG_PUSH 0x0a
+#define TAG_POP 0x0b
+
+/* Prefix of a long item */
+#define LONG_ITEM 0xfe
+
+/* Depth of the push/pop stack */
+#define GLOBAL_STACK_DEPTH 8
+
+/* Constant bit of a main item */
+#define MAIN_CONSTANT 0x01
+
+/**
+ * Globals that affect report sizes
+ */
+typedef struct {
+    uint32_t report_size;
+    uint32_t report_count;
+    uint32_t report_id;
+} globals_t;
+
+/**
+ * Lists the feature reports a report descriptor declares
+ */
+int hid_descriptor_feature_reports(const unsigned char *descriptor, size_t length, hid_feature_report_t *reports,
+                                   size_t max_reports)
+{
+    static const unsigned char DATA_SIZES[4] = { 0, 1, 2, 4 };
+    globals_t globals, stack[GLOBAL_STACK_DEPTH];
+    uint32_t bits[HID_DESCRIPTOR_MAX_REPORTS];
+    uint8_t has_data[HID_DESCRIPTOR_MAX_REPORTS];
+    int slot_of[HID_DESCRIPTOR_MAX_REPORTS];
+    uint8_t order[HID_DESCRIPTOR_MAX_REPORTS];
+    int depth = 0, count = 0;
+    size_t i = 0;
+
+    memset(&globals, 0, sizeof(globals));
+    memset(bits, 0, sizeof(bits));
+    memset(has_data, 0, sizeof(has_data));
+    for (int id = 0; id < HID_DESCRIPTOR_MAX_REPORTS; id++)
+        slot_of[id] = -1;
+
+    while (i < length)
+    {
+        unsigned char prefix = descriptor[i];
+        size_t size;
+        uint32_t value = 0;
+        int type, tag;
+
+        if (prefix == LONG_ITEM)
+        {
+            if (i + 2 >= length)
+                return -1;
+            i += 3 + (size_t)descriptor[i + 1];
+            if (i > length)
+                return -1;
+            continue;
+        }
+
+        size = DATA_SIZES[prefix & 0x03];
+        type = (prefix >> 2) & 0x03;
+        tag = prefix >> 4;
+        if (i + 1 + size > length)
+            return -1;
+        for (size_t b = 0; b < size; b++)
+            value |= (uint32_t)descriptor[i + 1 + b] << (8 * b);
+        i += 1 + size;
+
+        if (type == ITEM_GLOBAL)
+        {
+            switch (tag)
+            {
+            case TAG_REPORT_SIZE:
+                globals.report_size = value;
+                break;
+            case TAG_REPORT_ID:
+                if (value == 0 || value >= HID_DESCRIPTOR_MAX_REPORTS)
+                    return -1;
+                globals.report_id = value;
+                break;
+            case TAG_REPORT_COUNT:
+                globals.report_count = value;
+                break;
+            case TAG_PUSH:
+                if (depth == GLOBAL_STACK_DEPTH)
+                    return -1;
+                stack[depth++] = globals;
+                break;
+            case TAG_POP:
+                if (depth == 0)
+                    return -1;
+                globals = stack[--depth];
+                break;
+            default:
+                break;
+            }
+        }
+        else if (type == ITEM_MAIN && tag == TAG_FEATURE)
+        {
+            uint32_t id = globals.report_id;
+            uint64_t total = (uint64_t)bits[id] + (uint64_t)globals.report_size * globals.report_count;
+
+            if (total > UINT16_MAX * 8u)
+                return -1;
+            if (slot_of[id] < 0)
+            {
+                slot_of[id] = count;
+                order[count++] = (uint8_t)id;
+            }
+            bits[id] = (uint32_t)total;
+            if (!(value & MAIN_CONSTANT))
+                has_data[id] = 1;
+        }
+    }
+
+    for (int n = 0; n < count && (size_t)n < max_reports; n++)
+    {
+        reports[n].report_id = order[n];
+        reports[n].size = (uint16_t)((bits[order[n]] + 7) / 8);
+        reports[n].has_data = has_data[order[n]];
+    }
+    return (size_t)count < max_reports ? count : (int)max_reports;
+}
@@ -0,0 +1,43 @@
+/**
+ * hid_descriptor.h - HID report descriptor parsing
+ *
+ * Walks the items of a report descriptor to find the feature reports a
+ * device declares: their IDs, their sizes, and whether any of their fields
+ * is data rather than constant padding. Only the global items that affect
+ * sizes (report ID, size and count, push and pop) are tracked.
+ */
+
+#ifndef HID_DESCRIPTOR_H
+#define HID_DESCRIPTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest report descriptor read */
+#define HID_DESCRIPTOR_MAX 4096
+
+/* Most feature reports one descriptor can declare, one per report ID */
+#define HID_DESCRIPTOR_MAX_REPORTS 256
+
+/**
+ * A feature report declared by a descriptor
+ */
+typedef struct {
+    uint8_t report_id;          /* 0 if the descriptor uses no report IDs */
+    uint16_t size;              /* Payload bytes, not counting the report ID */
+    uint8_t has_data;           /* Some field is data, not constant */
+} hid_feature_report_t;
+
+/**
+ * Lists the feature reports a report descriptor declares
+ *
+ * @param descriptor The report descriptor
+ * @param length Length of the descriptor
+ * @param reports Receives the reports in the order they first appear
+ * @param max_reports Size of the reports array
+ * @return Number of reports, or -1 if the descriptor is malformed
+ */
+int hid_descriptor_feature_reports(const unsigned char *descriptor, size_t length, hid_feature_report_t *reports,
+                                   size_t max_reports);
+
+#endif /* HID_DESCRIPTOR_H */
@@ -0,0 +1,395 @@
+/**
+ * hid_io.c - Instrumented HID I/O
+ *
+ * Implementation of the HIDAPI wrappers. When instrumentation is disabled
+ * each wrapper costs a single branch on top of the HIDAPI call, plus the
+ * always-on flight recorder entry for calls on an open device. With --replay
+ * the calls are served by the replay backend instead of HIDAPI. Feature
+ * report requests the capability cache knows to fail are not sent.
+ */
+
+#include "hid_io.h"
+#include "latency_stats.h"
+#include "trace_events.h"
+#include "flight_recorder.h"
+#include "hid_capture.h"
+#include "hid_replay.h"
+#include "capability_cache.h"
+#include <errno.h>
+
+/**
+ * Checks whether any consumer of call timings is active
+ */
+static int instrumented(void)
+{
+    return latency_stats_enabled || trace_events_enabled || hid_capture_enabled;
+}
+
+/**
+ * Gets the device information of an open device for attributing samples
+ */
+static struct hid_device_info* device_info(hid_device *dev)
+{
+    return dev ? hid_io_get_device_info(dev) : NULL;
+}
+
+/**
+ * Feeds one completed HID call to the latency and trace consumers
+ */
+static void finish_call(latency_op_t op, uint64_t start_ns, uint64_t end_ns, unsigned short product_id,
+                        const char *path, int report_id, int result)
+{
+    if (latency_stats_enabled)
+        latency_stats_record(op, product_id, end_ns - start_ns);
+    if (trace_events_enabled)
+        trace_events_record_span(latency_op_name(op), TRACE_CAT_HID, start_ns, end_ns, path, report_id, result);
+}
+
+static struct hid_device_info* backend_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+    return hid_replay_enabled ? hid_replay_enumerate(vendor_id, product_id) : hid_enumerate(vendor_id, product_id);
+}
+
+static hid_device* backend_open_path(const char *path)
+{
+    return hid_replay_enabled ? hid_replay_open_path(path) : hid_open_path(path);
+}
+
+static hid_device* backend_open(unsigned short vendor_id, unsigned short product_id, const wchar_t *serial_number)
+{
+    return hid_replay_enabled ? hid_replay_open(vendor_id, product_id) : hid_open(vendor_id, product_id, serial_number);
+}
+
+static int backend_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+{
+    return hid_replay_enabled ? hid_replay_get_feature_report(dev, data, length)
+                              : hid_get_feature_report(dev, data, length);
+}
+
+static int backend_send_feature_report(hid_device *dev, const unsigned char *data, size_t length)
+{
+    return hid_replay_enabled ? hid_replay_send_feature_report(dev, data, length)
+                              : hid_send_feature_report(dev, data, length);
+}
+
+static int backend_get_report_descriptor(hid_device *dev, unsigned char *data, size_t length)
+{
+    if (hid_replay_enabled)
+        return hid_replay_get_report_descriptor(dev, data, length);
+#if defined(HID_API_VERSION) && HID_API_VERSION >= HID_API_MAKE_VERSION(0, 14, 0)
+    return hid_get_report_descriptor(dev, data, length);
+#else
+    /* Older HIDAPI cannot read descriptors */
+    (void)dev;
+    (void)data;
+    (void)length;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int backend_write(hid_device *dev, const unsigned char *data, size_t length)
+{
+    return hid_replay_enabled ? hid_replay_write(dev, data, length) : hid_write(dev, data, length);
+}
+
+static int backend_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+    return hid_replay_enabled ? hid_replay_read_timeout(dev, data, length, milliseconds)
+                              : hid_read_timeout(dev, data, length, milliseconds);
+}
+
+/**
+ * Reads a feature report for the capability cache, seen by the flight recorder only
+ */
+static int read_uncached(hid_device *dev, unsigned char *data, size_t length)
+{
+    int report_id = data[0];
+    int ret;
+
+    errno = 0;
+    ret = backend_get_feature_report(dev, data, length);
+    flight_recorder_record(dev, LATENCY_OP_GET_FEATURE, report_id, data, ret > 0 ? (size_t)ret : 0, ret, errno);
+    return ret;
+}
+
+/**
+ * Binds a device to the capability cache and checks whether a request is known to fail
+ *
+ * A skipped request fails with EOPNOTSUPP and is noted by the flight recorder.
+ */
+static int skip_request(hid_device *dev, capability_op_t op, latency_op_t latency_op, const unsigned char *data)
+{
+    if (!capability_cache_enabled)
+        return 0;
+    capability_cache_bind(dev, read_uncached);
+    if (!capability_cache_skip(dev, op, data[0]))
+        return 0;
+    errno = EOPNOTSUPP;
+    flight_recorder_record(dev, latency_op, data[0], data, 0, -1, EOPNOTSUPP);
+    return 1;
+}
+
+/**
+ * Enumerates HID devices, see hid_enumerate()
+ */
+struct hid_device_info* hid_io_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+    struct hid_device_info *devs;
+    uint64_t start, end;
+    int count = 0;
+
+    if (!instrumented())
+        return backend_enumerate(vendor_id, product_id);
+
+    start = latency_now_ns();
+    devs = backend_enumerate(vendor_id, product_id);
+    end = latency_now_ns();
+    for (struct hid_device_info *cur = devs; cur; cur = cur->next)
+        count++;
+    finish_call(LATENCY_OP_ENUMERATE, start, end, product_id, NULL, -1, count);
+    if (hid_capture_enabled)
+        hid_capture_enumerate(start, end, vendor_id, product_id, devs);
+    return devs;
+}
+
+/**
+ * Frees an enumeration returned by hid_io_enumerate(), see hid_free_enumeration()
+ */
+void hid_io_free_enumeration(struct hid_device_info *devs)
+{
+    if (hid_replay_enabled)
+        hid_replay_free_enumeration(devs);
+    else
+        hid_free_enumeration(devs);
+}
+
+/**
+ * Opens a HID device by its platform path, see hid_open_path()
+ */
+hid_device* hid_io_open_path(const char *path)
+{
+    hid_device *dev;
+    struct hid_device_info *info;
+    uint64_t start, end;
+
+    if (!instrumented())
+    {
+        dev = backend_open_path(path);
+        flight_recorder_attach(dev, path);
+        return dev;
+    }
+
+    start = latency_now_ns();
+    dev = backend_open_path(path);
+    end = latency_now_ns();
+    flight_recorder_attach(dev, path);
+    info = device_info(dev);
+    finish_call(LATENCY_OP_OPEN_PATH, start, end, info ? info->product_id : 0, path, -1, dev ? 0 : -1);
+    if (hid_capture_enabled)
+        hid_capture_open_device(CAPTURE_OPEN_PATH, start, end, path, 0, 0, dev, info);
+    return dev;
+}
+
+/**
+ * Opens a HID device by vendor and product ID, see hid_open()
+ */
+hid_device* hid_io_open(unsigned short vendor_id, unsigned short product_id, const wchar_t *serial_number)
+{
+    hid_device *dev;
+    struct hid_device_info *info;
+    uint64_t start, end;
+
+    if (!instrumented())
+    {
+        dev = backend_open(vendor_id, product_id, serial_number);
+        info = device_info(dev);
+        flight_recorder_attach(dev, info ? info->path : NULL);
+        return dev;
+    }
+
+    start = latency_now_ns();
+    dev = backend_open(vendor_id, product_id, serial_number);
+    end = latency_now_ns();
+    info = device_info(dev);
+    flight_recorder_attach(dev, info ? info->path : NULL);
+    finish_call(LATENCY_OP_OPEN, start, end, product_id, info ? info->path : NULL, -1, dev ? 0 : -1);
+    if (hid_capture_enabled)
+        hid_capture_open_device(CAPTURE_OPEN, start, end, NULL, vendor_id, product_id, dev, info);
+    return dev;
+}
+
+/**
+ * Reads a feature report, see hid_get_feature_report()
+ */
+int hid_io_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+{
+    struct hid_device_info *info;
+    uint64_t start, end;
+    int report_id = data[0];
+    int ret, error;
+
+    if (skip_request(dev, CAPABILITY_GET, LATENCY_OP_GET_FEATURE, data))
+        return -1;
+    errno = 0;
+    start = instrumented() ? latency_now_ns() : 0;
+    ret = backend_get_feature_report(dev, data, length);
+    error = errno;
+    flight_recorder_record(dev, LATENCY_OP_GET_FEATURE, report_id, data, ret > 0 ? (size_t)ret : 0, ret, error);
+    if (capability_cache_enabled)
+        capability_cache_note(dev, CAPABILITY_GET, (unsigned char)report_id, ret);
+
+    if (!instrumented())
+        return ret;
+
+    end = latency_now_ns();
+    info = device_info(dev);
+    finish_call(LATENCY_OP_GET_FEATURE, start, end, info ? info->product_id : 0,
+                info ? info->path : NULL, report_id, ret);
+    if (hid_capture_enabled)
+        hid_capture_feature(CAPTURE_GET_FEATURE, start, end, dev, report_id, data, length, ret);
+    return ret;
+}
+
+/**
+ * Sends a feature report, see hid_send_feature_report()
+ */
+int hid_io_send_feature_report(hid_device *dev, const unsigned char *data, size_t length)
+{
+    struct hid_device_info *info;
+    uint64_t start, end;
+    int ret, error;
+
+    if (skip_request(dev, CAPABILITY_SET, LATENCY_OP_SEND_FEATURE, data))
+        return -1;
+    errno = 0;
+    start = instrumented() ? latency_now_ns() : 0;
+    ret = backend_send_feature_report(dev, data, length);
+    error = errno;
+    flight_recorder_record(dev, LATENCY_OP_SEND_FEATURE, data[0], data, length, ret, error);
+    if (capability_cache_enabled)
+        capability_cache_note(dev, CAPABILITY_SET, data[0], ret);
+
+    if (!instrumented())
+        return ret;
+
+    end = latency_now_ns();
+    info = device_info(dev);
+    finish_call(LATENCY_OP_SEND_FEATURE, start, end, info ? info->product_id : 0,
+                info ? info->path : NULL, data[0], ret);
+    if (hid_capture_enabled)
+        hid_capture_feature(CAPTURE_SEND_FEATURE, start, end, dev, data[0], data, length, ret);
+    return ret;
+}
+
+/**
+ * Sends an output report, see hid_write()
+ */
+int hid_io_write(hid_device *dev, const unsigned char *data, size_t length)
+{
+    struct hid_device_info *info;
+    uint64_t start, end;
+    int ret, error;
+
+    errno = 0;
+    start = instrumented() ? latency_now_ns() : 0;
+    ret = backend_write(dev, data, length);
+    error = errno;
+    flight_recorder_record(dev, LATENCY_OP_WRITE, data[0], data, length, ret, error);
+
+    if (!instrumented())
+        return ret;
+
+    end = latency_now_ns();
+    info = device_info(dev);
+    finish_call(LATENCY_OP_WRITE, start, end, info ? info->product_id : 0,
+                info ? info->path : NULL, data[0], ret);
+    if (hid_capture_enabled)
+        hid_capture_feature(CAPTURE_WRITE, start, end, dev, data[0], data, length, ret);
+    return ret;
+}
+
+/**
+ * Reads the report descriptor, see hid_get_report_descriptor()
+ */
+int hid_io_get_report_descriptor(hid_device *dev, unsigned char *data, size_t length)
+{
+    struct hid_device_info *info;
+    uint64_t start, end;
+    int ret, error;
+
+    errno = 0;
+    start = instrumented() ? latency_now_ns() : 0;
+    ret = backend_get_report_descriptor(dev, data, length);
+    error = errno;
+    flight_recorder_record(dev, LATENCY_OP_DESCRIPTOR, 0, data, ret > 0 ? (size_t)ret : 0, ret, error);
+
+    if (!instrumented())
+        return ret;
+
+    end = latency_now_ns();
+    info = device_info(dev);
+    finish_call(LATENCY_OP_DESCRIPTOR, start, end, info ? info->product_id : 0,
+                info ? info->path : NULL, 0, ret);
+    if (hid_capture_enabled)
+        hid_capture_feature(CAPTURE_DESCRIPTOR, start, end, dev, 0, data, length, ret);
+    return ret;
+}
+
+/**
+ * Reads an input report with a timeout, see hid_read_timeout()
+ */
+int hid_io_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+    struct hid_device_info *info;
+    uint64_t start, end;
+    int ret;
+
+    if (!instrumented())
+        return backend_read_timeout(dev, data, length, milliseconds);
+
+    start = latency_now_ns();
+    ret = backend_read_timeout(dev, data, length, milliseconds);
+    end = latency_now_ns();
+    info = device_info(dev);
+    finish_call(LATENCY_OP_READ, start, end, info ? info->product_id : 0,
+                info ? info->path : NULL, ret > 0 ? data[0] : -1, ret);
+    if (hid_capture_enabled)
+        hid_capture_read(start, end, dev, data, length, milliseconds, ret);
+    return ret;
+}
+
+/**
+ * Gets the device information of an open device, see hid_get_device_info()
+ */
+struct hid_device_info* hid_io_get_device_info(hid_device *dev)
+{
+    return hid_replay_enabled ? hid_replay_get_device_info(dev) : hid_get_device_info(dev);
+}
+
+/**
+ * Gets the last error of a device, see hid_error()
+ */
+const wchar_t* hid_io_error(hid_device *dev)
+{
+    return hid_replay_enabled ? hid_replay_error(dev) : hid_error(dev);
+}
+
+/**
+ * Closes a HID device, see hid_close()
+ */
+void hid_io_close(hid_device *dev)
+{
+    if (!dev)
+        return;
+
+    flight_recorder_detach(dev);
+    capability_cache_release(dev);
+    if (hid_capture_enabled)
+        hid_capture_close_device(dev);
+
+    if (hid_replay_enabled)
+        hid_replay_close_device(dev);
+    else
+        hid_close(dev);
+}
@@ -0,0 +1,129 @@
+/**
+ * hid_io.h - Instrumented HID I/O
+ *
+ * Thin wrappers around the HIDAPI calls used on the hot path. Every wrapper
+ * behaves exactly like the HIDAPI function it replaces and additionally feeds
+ * the latency instrumentation when it is enabled. The same wrappers write
+ * --capture files and serve --replay files in place of real hardware.
+ */
+
+#ifndef HID_IO_H
+#define HID_IO_H
+
+#include "platform_compat.h"
+
+/**
+ * Enumerates HID devices, see hid_enumerate()
+ *
+ * @param vendor_id Vendor ID to match, or 0 for any
+ * @param product_id Product ID to match, or 0 for any
+ * @return Linked list of device information, free with hid_io_free_enumeration()
+ */
+struct hid_device_info* hid_io_enumerate(unsigned short vendor_id, unsigned short product_id);
+
+/**
+ * Opens a HID device by its platform path, see hid_open_path()
+ *
+ * @param path The device path
+ * @return Handle to the device, or NULL on failure
+ */
+hid_device* hid_io_open_path(const char *path);
+
+/**
+ * Opens a HID device by vendor and product ID, see hid_open()
+ *
+ * @param vendor_id The vendor ID
+ * @param product_id The product ID
+ * @param serial_number Serial number to match, or NULL for the first device
+ * @return Handle to the device, or NULL on failure
+ */
+hid_device* hid_io_open(unsigned short vendor_id, unsigned short product_id, const wchar_t *serial_number);
+
+/**
+ * Reads a feature report, see hid_get_feature_report()
+ *
+ * A read the capability cache knows to fail is not sent.
+ *
+ * @param dev Handle to the HID device
+ * @param data Buffer whose first byte holds the report ID
+ * @param length Size of the buffer
+ * @return Number of bytes read, or -1 on error (errno EOPNOTSUPP if not sent)
+ */
+int hid_io_get_feature_report(hid_device *dev, unsigned char *data, size_t length);
+
+/**
+ * Sends a feature report, see hid_send_feature_report()
+ *
+ * A report the capability cache knows to be rejected is not sent.
+ *
+ * @param dev Handle to the HID device
+ * @param data Report data, the first byte is the report ID
+ * @param length Number of bytes to send
+ * @return Number of bytes written, or -1 on error (errno EOPNOTSUPP if not sent)
+ */
+int hid_io_send_feature_report(hid_device *dev, const unsigned char *data, size_t length);
+
+/**
+ * Sends an output report, see hid_write()
+ *
+ * @param dev Handle to the HID device
+ * @param data Report data, the first byte is the report ID
+ * @param length Number of bytes to send
+ * @return Number of bytes written, or -1 on error
+ */
+int hid_io_write(hid_device *dev, const unsigned char *data, size_t length);
+
+/**
+ * Reads the report descriptor, see hid_get_report_descriptor()
+ *
+ * Fails with errno ENOSYS when built against a HIDAPI older than 0.14.
+ *
+ * @param dev Handle to the HID device
+ * @param data Buffer for the descriptor
+ * @param length Size of the buffer
+ * @return Length of the descriptor, or -1 on error
+ */
+int hid_io_get_report_descriptor(hid_device *dev, unsigned char *data, size_t length);
+
+/**
+ * Reads an input report with a timeout, see hid_read_timeout()
+ *
+ * @param dev Handle to the HID device
+ * @param data Buffer for the report
+ * @param length Size of the buffer
+ * @param milliseconds Timeout in milliseconds, -1 to block
+ * @return Number of bytes read, 0 on timeout, or -1 on error
+ */
+int hid_io_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds);
+
+/**
+ * Frees an enumeration returned by hid_io_enumerate(), see hid_free_enumeration()
+ *
+ * @param devs The list to free
+ */
+void hid_io_free_enumeration(struct hid_device_info *devs);
+
+/**
+ * Gets the device information of an open device, see hid_get_device_info()
+ *
+ * @param dev Handle to the HID device
+ * @return Device information owned by the handle
+ */
+struct hid_device_info* hid_io_get_device_info(hid_device *dev);
+
+/**
+ * Gets the last error of a device, see hid_error()
+ *
+ * @param dev Handle to the HID device
+ * @return Error text owned by the library
+ */
+const wchar_t* hid_io_error(hid_device *dev);
+
+/**
+ * Closes a HID device, see hid_close()
+ *
+ * @param dev Handle to the HID device (may be NULL)
+ */
+void hid_io_close(hid_device *dev);
+
+#endif /* HID_IO_H */
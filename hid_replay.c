@@ -0,0 +1,813 @@
+/**
+ * hid_replay.c - HID replay backend
+ *
+ * Implementation of the replay backend. The whole capture is loaded and
+ * indexed up front, with every record linked to the next record of the same
+ * type and of the same device, so lookups never rescan the capture from the
+ * start. Replayed handles are heap objects that keep their own cursor into
+ * their device's chain and are handed out as opaque hid_device pointers that
+ * only this module dereferences.
+ */
+
+#include "hid_replay.h"
+#include "hid_capture.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#ifdef PLATFORM_WINDOWS
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+/* Capacity of the per-device error text */
+#define REPLAY_ERROR_CHARS 128
+
+/* Record types are small positive numbers, see capture_record_t */
+#define REPLAY_TYPES 10
+
+/* End of a record chain */
+#define REPLAY_NONE SIZE_MAX
+
+/**
+ * One indexed capture record
+ */
+typedef struct {
+    uint8_t type;
+    uint8_t report_id;
+    uint16_t device;
+    uint32_t length;
+    int32_t result;
+    uint32_t duration_ns;
+    uint64_t timestamp_ns;  /* Start of the call relative to the start of the capture */
+    const unsigned char *payload;
+    int consumed;
+    size_t next_of_type;    /* Next record of the same type */
+    size_t next_of_device;  /* Next record of the same device */
+} replay_record_t;
+
+/**
+ * Bounds-checked little-endian payload reader
+ */
+typedef struct {
+    const unsigned char *data;
+    size_t left;
+    int failed;
+} replay_reader_t;
+
+/**
+ * A replayed device; the public handle points at this
+ */
+typedef struct {
+    uint16_t id;
+    size_t cursor;          /* Next record of this device, or REPLAY_NONE */
+    struct hid_device_info *info;
+    wchar_t error[REPLAY_ERROR_CHARS];
+} replay_device_t;
+
+int hid_replay_enabled = 0;
+int hid_replay_fast = 0;
+
+static unsigned char *capture_data = NULL;
+static replay_record_t *records = NULL;
+static size_t record_count = 0;
+static size_t type_heads[REPLAY_TYPES];
+static size_t divergences = 0;
+static size_t mismatched_writes = 0;
+static mutex_t replay_lock;
+
+static const unsigned char* get_bytes(replay_reader_t *reader, size_t count)
+{
+    const unsigned char *bytes = reader->data;
+
+    if (reader->failed || reader->left < count)
+    {
+        reader->failed = 1;
+        return NULL;
+    }
+    reader->data += count;
+    reader->left -= count;
+    return bytes;
+}
+
+static uint16_t get_u16(replay_reader_t *reader)
+{
+    const unsigned char *b = get_bytes(reader, 2);
+    return b ? (uint16_t)(b[0] | (b[1] << 8)) : 0;
+}
+
+static uint32_t get_u32(replay_reader_t *reader)
+{
+    const unsigned char *b = get_bytes(reader, 4);
+    return b ? (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24) : 0;
+}
+
+static uint64_t get_u64(replay_reader_t *reader)
+{
+    uint64_t low = get_u32(reader);
+    return low | ((uint64_t)get_u32(reader) << 32);
+}
+
+/**
+ * Reads a length-prefixed narrow string into a new heap string
+ */
+static char* get_string(replay_reader_t *reader)
+{
+    uint16_t length = get_u16(reader);
+    const unsigned char *bytes;
+    char *str;
+
+    if (length == CAPTURE_NULL_STRING || !(bytes = get_bytes(reader, length)))
+        return NULL;
+
+    str = (char*)malloc((size_t)length + 1);
+    if (str)
+    {
+        memcpy(str, bytes, length);
+        str[length] = '\0';
+    }
+    return str;
+}
+
+/**
+ * Reads a length-prefixed wide string into a buffer
+ *
+ * @return Number of characters stored, or -1 for a NULL string
+ */
+static int get_wstring_into(replay_reader_t *reader, wchar_t *out, size_t capacity)
+{
+    uint16_t length = get_u16(reader);
+    size_t stored = 0;
+
+    if (length == CAPTURE_NULL_STRING)
+        return -1;
+
+    for (uint16_t i = 0; i < length && !reader->failed; i++)
+    {
+        uint16_t unit = get_u16(reader);
+        if (stored + 1 < capacity)
+            out[stored++] = (wchar_t)unit;
+    }
+    if (capacity)
+        out[stored] = L'\0';
+    return (int)stored;
+}
+
+/**
+ * Reads a length-prefixed wide string into a new heap string
+ */
+static wchar_t* get_wstring(replay_reader_t *reader)
+{
+    replay_reader_t peek = *reader;
+    uint16_t length = get_u16(&peek);
+    wchar_t *str;
+
+    if (length == CAPTURE_NULL_STRING)
+    {
+        get_u16(reader);
+        return NULL;
+    }
+
+    str = (wchar_t*)malloc(((size_t)length + 1) * sizeof(wchar_t));
+    if (!str)
+    {
+        reader->failed = 1;
+        return NULL;
+    }
+    get_wstring_into(reader, str, (size_t)length + 1);
+    return str;
+}
+
+/**
+ * Reads one device entry into a new heap object
+ */
+static struct hid_device_info* get_device_info(replay_reader_t *reader)
+{
+    struct hid_device_info *info = (struct hid_device_info*)calloc(1, sizeof(struct hid_device_info));
+
+    if (!info)
+    {
+        reader->failed = 1;
+        return NULL;
+    }
+
+    info->vendor_id = get_u16(reader);
+    info->product_id = get_u16(reader);
+    info->release_number = get_u16(reader);
+    info->usage_page = get_u16(reader);
+    info->usage = get_u16(reader);
+    info->interface_number = (int)get_u32(reader);
+    info->path = get_string(reader);
+    info->serial_number = get_wstring(reader);
+    info->manufacturer_string = get_wstring(reader);
+    info->product_string = get_wstring(reader);
+    return info;
+}
+
+/**
+ * Opens a reader over a record's payload
+ */
+static replay_reader_t payload_reader(const replay_record_t *record)
+{
+    replay_reader_t reader = { record->payload, record->length, 0 };
+    return reader;
+}
+
+/**
+ * Waits for the recorded duration of a call unless replaying as fast as possible
+ */
+static void replay_delay(const replay_record_t *record)
+{
+    if (hid_replay_fast || record->duration_ns == 0)
+        return;
+
+#ifdef PLATFORM_WINDOWS
+    Sleep((DWORD)((record->duration_ns + 999999u) / 1000000u));
+#else
+    struct timespec ts;
+    ts.tv_sec = record->duration_ns / 1000000000u;
+    ts.tv_nsec = record->duration_ns % 1000000000u;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/**
+ * Links every record to the next record of its type and of its device
+ *
+ * @return 1 on success, 0 if out of memory
+ */
+static int link_records(void)
+{
+    size_t type_tails[REPLAY_TYPES];
+    size_t *device_tails = (size_t*)malloc(((size_t)CAPTURE_NO_DEVICE + 1) * sizeof(size_t));
+
+    if (!device_tails)
+        return 0;
+
+    for (size_t i = 0; i <= CAPTURE_NO_DEVICE; i++)
+        device_tails[i] = REPLAY_NONE;
+    for (int t = 0; t < REPLAY_TYPES; t++)
+        type_heads[t] = type_tails[t] = REPLAY_NONE;
+
+    for (size_t i = 0; i < record_count; i++)
+    {
+        replay_record_t *record = &records[i];
+        int type = record->type < REPLAY_TYPES ? record->type : 0;
+
+        record->next_of_type = REPLAY_NONE;
+        record->next_of_device = REPLAY_NONE;
+
+        if (type_tails[type] == REPLAY_NONE)
+            type_heads[type] = i;
+        else
+            records[type_tails[type]].next_of_type = i;
+        type_tails[type] = i;
+
+        if (device_tails[record->device] != REPLAY_NONE)
+            records[device_tails[record->device]].next_of_device = i;
+        device_tails[record->device] = i;
+    }
+
+    free(device_tails);
+    return 1;
+}
+
+/**
+ * Loads a capture file and switches HID I/O over to it
+ */
+int hid_replay_load(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    replay_reader_t reader;
+    long size;
+
+    if (!fp)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to open capture file %s\n", COLOR_RED, COLOR_RESET, path);
+        return 0;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    capture_data = size > 0 ? (unsigned char*)malloc((size_t)size) : NULL;
+    if (!capture_data || fread(capture_data, 1, (size_t)size, fp) != (size_t)size)
+    {
+        fclose(fp);
+        free(capture_data);
+        capture_data = NULL;
+        fprintf(stderr, "%s[ERROR]%s Failed to read capture file %s\n", COLOR_RED, COLOR_RESET, path);
+        return 0;
+    }
+    fclose(fp);
+
+    reader.data = capture_data;
+    reader.left = (size_t)size;
+    reader.failed = 0;
+
+    const unsigned char *magic = get_bytes(&reader, 6);
+    if (!magic || memcmp(magic, HID_CAPTURE_MAGIC, 6) != 0 || get_u16(&reader) != HID_CAPTURE_VERSION)
+    {
+        free(capture_data);
+        capture_data = NULL;
+        fprintf(stderr, "%s[ERROR]%s %s is not a supported capture file\n", COLOR_RED, COLOR_RESET, path);
+        return 0;
+    }
+    get_u64(&reader);
+
+    /* Index the records; a truncated final record (interrupted capture) is dropped */
+    size_t capacity = 0;
+    while (reader.left >= HID_CAPTURE_RECORD_HEADER_SIZE)
+    {
+        replay_record_t record;
+
+        record.type = *get_bytes(&reader, 1);
+        record.report_id = *get_bytes(&reader, 1);
+        record.device = get_u16(&reader);
+        record.length = get_u32(&reader);
+        record.result = (int32_t)get_u32(&reader);
+        record.duration_ns = get_u32(&reader);
+        record.timestamp_ns = get_u64(&reader);
+        record.payload = get_bytes(&reader, record.length);
+        record.consumed = 0;
+        if (reader.failed)
+            break;
+
+        if (record_count == capacity)
+        {
+            size_t grown_capacity = capacity ? capacity * 2 : 256;
+            replay_record_t *grown = (replay_record_t*)realloc(records, grown_capacity * sizeof(replay_record_t));
+            if (!grown)
+                break;
+            records = grown;
+            capacity = grown_capacity;
+        }
+        records[record_count++] = record;
+    }
+
+    if (!link_records())
+    {
+        free(records);
+        free(capture_data);
+        records = NULL;
+        capture_data = NULL;
+        record_count = 0;
+        fprintf(stderr, "%s[ERROR]%s Out of memory indexing %s\n", COLOR_RED, COLOR_RESET, path);
+        return 0;
+    }
+
+    mutex_init(&replay_lock);
+    hid_replay_enabled = 1;
+
+    printf("%s[INFO]%s Replaying %zu HID records from %s (%s)\n", COLOR_BLUE, COLOR_RESET,
+           record_count, path, hid_replay_fast ? "as fast as possible" : "recorded timing");
+    return 1;
+}
+
+/**
+ * Finds the first unconsumed record of a type that satisfies a predicate;
+ * the lock must be held
+ */
+static replay_record_t* find_unconsumed(uint8_t type, int (*match)(const replay_record_t*, const void*), const void *key)
+{
+    size_t *head;
+
+    if (type >= REPLAY_TYPES)
+        return NULL;
+
+    /* Consumed records at the front of the chain are never looked at again */
+    head = &type_heads[type];
+    while (*head != REPLAY_NONE && records[*head].consumed)
+        *head = records[*head].next_of_type;
+
+    for (size_t i = *head; i != REPLAY_NONE; i = records[i].next_of_type)
+    {
+        replay_record_t *record = &records[i];
+        if (!record->consumed && match(record, key))
+            return record;
+    }
+    return NULL;
+}
+
+/**
+ * Vendor/product pair used to match enumerations and opens
+ */
+typedef struct {
+    unsigned short vendor_id;
+    unsigned short product_id;
+} replay_ids_t;
+
+static int match_ids(const replay_record_t *record, const void *key)
+{
+    const replay_ids_t *ids = (const replay_ids_t*)key;
+    replay_reader_t reader = payload_reader(record);
+    unsigned short vendor_id = get_u16(&reader);
+    unsigned short product_id = get_u16(&reader);
+
+    return vendor_id == ids->vendor_id && product_id == ids->product_id;
+}
+
+static int match_path(const replay_record_t *record, const void *key)
+{
+    replay_reader_t reader = payload_reader(record);
+    uint16_t length = get_u16(&reader);
+    const unsigned char *bytes;
+
+    if (length == CAPTURE_NULL_STRING || !(bytes = get_bytes(&reader, length)))
+        return 0;
+    return strlen((const char*)key) == length && memcmp(bytes, key, length) == 0;
+}
+
+/**
+ * Serves the next matching enumeration, see hid_enumerate()
+ */
+struct hid_device_info* hid_replay_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+    replay_ids_t ids = { vendor_id, product_id };
+    struct hid_device_info *head = NULL, **tail = &head;
+    replay_record_t *record;
+    replay_reader_t reader;
+    uint16_t count;
+
+    mutex_lock(&replay_lock);
+    record = find_unconsumed(CAPTURE_ENUMERATE, match_ids, &ids);
+    if (record)
+        record->consumed = 1;
+    else
+        divergences++;
+    mutex_unlock(&replay_lock);
+
+    if (!record)
+        return NULL;
+
+    reader = payload_reader(record);
+    get_u16(&reader);
+    get_u16(&reader);
+    count = get_u16(&reader);
+    for (uint16_t i = 0; i < count && !reader.failed; i++)
+    {
+        *tail = get_device_info(&reader);
+        if (!*tail)
+            break;
+        tail = &(*tail)->next;
+    }
+
+    replay_delay(record);
+    return head;
+}
+
+/**
+ * Frees an enumeration returned by hid_replay_enumerate()
+ */
+void hid_replay_free_enumeration(struct hid_device_info *devs)
+{
+    while (devs)
+    {
+        struct hid_device_info *next = devs->next;
+        free(devs->path);
+        free(devs->serial_number);
+        free(devs->manufacturer_string);
+        free(devs->product_string);
+        free(devs);
+        devs = next;
+    }
+}
+
+/**
+ * Turns a matched open record into a replayed handle
+ */
+static hid_device* open_from_record(replay_record_t *record, size_t skip)
+{
+    replay_device_t *device;
+    replay_reader_t reader;
+
+    if (!record)
+        return NULL;
+
+    replay_delay(record);
+    if (record->result < 0)
+        return NULL;
+
+    device = (replay_device_t*)calloc(1, sizeof(replay_device_t));
+    if (!device)
+        return NULL;
+
+    reader = payload_reader(record);
+    get_bytes(&reader, skip);
+    device->id = record->device;
+    device->cursor = record->next_of_device;
+    device->info = get_device_info(&reader);
+    return (hid_device*)device;
+}
+
+/**
+ * Serves the next recorded open of a path, see hid_open_path()
+ */
+hid_device* hid_replay_open_path(const char *path)
+{
+    replay_record_t *record;
+
+    mutex_lock(&replay_lock);
+    record = find_unconsumed(CAPTURE_OPEN_PATH, match_path, path);
+    if (record)
+        record->consumed = 1;
+    else
+        divergences++;
+    mutex_unlock(&replay_lock);
+
+    return open_from_record(record, record ? 2 + strlen(path) : 0);
+}
+
+/**
+ * Serves the next recorded open by vendor and product ID, see hid_open()
+ */
+hid_device* hid_replay_open(unsigned short vendor_id, unsigned short product_id)
+{
+    replay_ids_t ids = { vendor_id, product_id };
+    replay_record_t *record;
+
+    mutex_lock(&replay_lock);
+    record = find_unconsumed(CAPTURE_OPEN, match_ids, &ids);
+    if (record)
+        record->consumed = 1;
+    else
+        divergences++;
+    mutex_unlock(&replay_lock);
+
+    return open_from_record(record, 4);
+}
+
+/**
+ * Takes the device's next transfer record if it has the expected type and report ID
+ *
+ * @return The record, or NULL after noting the divergence in the device's error text
+ */
+static replay_record_t* next_transfer(replay_device_t *device, uint8_t type, int report_id)
+{
+    replay_record_t *record = NULL;
+
+    mutex_lock(&replay_lock);
+    while (device->cursor != REPLAY_NONE && records[device->cursor].consumed)
+        device->cursor = records[device->cursor].next_of_device;
+    if (device->cursor != REPLAY_NONE)
+        record = &records[device->cursor];
+
+    /* Reaching the recorded close means the device has nothing left to serve */
+    if (record && record->type == CAPTURE_CLOSE)
+        record = NULL;
+
+    if (record && (record->type != type || (report_id >= 0 && record->report_id != report_id)))
+    {
+        swprintf(device->error, REPLAY_ERROR_CHARS, L"replay diverged: recorded type %d report 0x%02x",
+                 record->type, record->report_id);
+        record = NULL;
+        divergences++;
+    }
+    else if (!record)
+    {
+        swprintf(device->error, REPLAY_ERROR_CHARS, L"replay exhausted for device %u", device->id);
+    }
+    else
+    {
+        record->consumed = 1;
+        device->cursor = record->next_of_device;
+    }
+    mutex_unlock(&replay_lock);
+
+    return record;
+}
+
+/**
+ * Copies the recorded error text of a failed call to the device
+ */
+static void load_error(replay_device_t *device, replay_reader_t *reader)
+{
+    if (get_wstring_into(reader, device->error, REPLAY_ERROR_CHARS) < 0)
+        device->error[0] = L'\0';
+}
+
+/**
+ * Serves the device's next read of the given type
+ */
+static int serve_read(hid_device *dev, capture_record_t type, int report_id, unsigned char *data, size_t length)
+{
+    replay_device_t *device = (replay_device_t*)dev;
+    replay_record_t *record = next_transfer(device, type, report_id);
+    replay_reader_t reader;
+    size_t available;
+
+    if (!record)
+        return -1;
+
+    reader = payload_reader(record);
+    get_u32(&reader);
+    if (record->result < 0)
+        load_error(device, &reader);
+    else
+    {
+        available = reader.left < length ? reader.left : length;
+        memcpy(data, get_bytes(&reader, available), available);
+    }
+
+    replay_delay(record);
+    return record->result;
+}
+
+/**
+ * Serves the device's next feature report read, see hid_get_feature_report()
+ */
+int hid_replay_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
+{
+    return serve_read(dev, CAPTURE_GET_FEATURE, data[0], data, length);
+}
+
+/**
+ * Serves the device's next report descriptor read, see hid_get_report_descriptor()
+ */
+int hid_replay_get_report_descriptor(hid_device *dev, unsigned char *data, size_t length)
+{
+    return serve_read(dev, CAPTURE_DESCRIPTOR, 0, data, length);
+}
+
+/**
+ * Serves the device's next write of the given type
+ */
+static int serve_write(hid_device *dev, capture_record_t type, const unsigned char *data, size_t length)
+{
+    replay_device_t *device = (replay_device_t*)dev;
+    replay_record_t *record = next_transfer(device, type, data[0]);
+    replay_reader_t reader;
+    const unsigned char *sent;
+    uint32_t sent_length;
+
+    if (!record)
+        return -1;
+
+    /* The recorded outcome is served even if the payload changed, but it is counted */
+    reader = payload_reader(record);
+    sent_length = get_u32(&reader);
+    sent = get_bytes(&reader, sent_length);
+    if (!sent || sent_length != length || memcmp(sent, data, length) != 0)
+    {
+        mutex_lock(&replay_lock);
+        mismatched_writes++;
+        mutex_unlock(&replay_lock);
+    }
+    if (record->result < 0)
+        load_error(device, &reader);
+
+    replay_delay(record);
+    return record->result;
+}
+
+/**
+ * Serves the device's next feature report write, see hid_send_feature_report()
+ */
+int hid_replay_send_feature_report(hid_device *dev, const unsigned char *data, size_t length)
+{
+    return serve_write(dev, CAPTURE_SEND_FEATURE, data, length);
+}
+
+/**
+ * Serves the device's next output report write, see hid_write()
+ */
+int hid_replay_write(hid_device *dev, const unsigned char *data, size_t length)
+{
+    return serve_write(dev, CAPTURE_WRITE, data, length);
+}
+
+/**
+ * Serves the device's next input report, see hid_read_timeout()
+ */
+int hid_replay_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds)
+{
+    replay_device_t *device = (replay_device_t*)dev;
+    replay_record_t *record = next_transfer(device, CAPTURE_READ, -1);
+    replay_reader_t reader;
+    size_t available;
+
+    (void)milliseconds;
+    if (!record)
+        return -1;
+
+    reader = payload_reader(record);
+    get_u32(&reader);
+    get_u32(&reader);
+    available = reader.left < length ? reader.left : length;
+    if (available)
+        memcpy(data, get_bytes(&reader, available), available);
+
+    replay_delay(record);
+    return record->result;
+}
+
+/**
+ * Gets the recorded device information, see hid_get_device_info()
+ */
+struct hid_device_info* hid_replay_get_device_info(hid_device *dev)
+{
+    return dev ? ((replay_device_t*)dev)->info : NULL;
+}
+
+/**
+ * Gets the recorded error of the last failed call, see hid_error()
+ */
+const wchar_t* hid_replay_error(hid_device *dev)
+{
+    return dev ? ((replay_device_t*)dev)->error : L"replayed call failed";
+}
+
+/**
+ * Closes a replayed device, see hid_close()
+ */
+void hid_replay_close_device(hid_device *dev)
+{
+    replay_device_t *device = (replay_device_t*)dev;
+
+    if (!device)
+        return;
+
+    hid_replay_free_enumeration(device->info);
+    free(device);
+}
+
+/**
+ * Gets the next captured input report for offline processing
+ */
+int hid_replay_next_input(size_t *cursor, uint16_t *device, unsigned short *product_id, input_report_t *report)
+{
+    static unsigned short products[CAPTURE_NO_DEVICE + 1];
+
+    if (*cursor == 0)
+        memset(products, 0, sizeof(products));
+
+    for (; *cursor < record_count; (*cursor)++)
+    {
+        const replay_record_t *record = &records[*cursor];
+        replay_reader_t reader = payload_reader(record);
+
+        /* Remember what each device ID was opened as */
+        if ((record->type == CAPTURE_OPEN_PATH || record->type == CAPTURE_OPEN) && record->result >= 0)
+        {
+            struct hid_device_info *info;
+
+            if (record->type == CAPTURE_OPEN_PATH)
+            {
+                uint16_t length = get_u16(&reader);
+                if (length != CAPTURE_NULL_STRING)
+                    get_bytes(&reader, length);
+            }
+            else
+            {
+                get_bytes(&reader, 4);
+            }
+            info = get_device_info(&reader);
+            if (info && !reader.failed)
+                products[record->device] = info->product_id;
+            hid_replay_free_enumeration(info);
+            continue;
+        }
+        if (record->type != CAPTURE_READ || record->result <= 0)
+            continue;
+
+        get_u32(&reader);
+        get_u32(&reader);
+        report->length = reader.left < INPUT_REPORT_MAX ? (uint32_t)reader.left : INPUT_REPORT_MAX;
+        memcpy(report->data, get_bytes(&reader, report->length), report->length);
+        report->timestamp_ns = record->timestamp_ns + record->duration_ns;
+        *device = record->device;
+        *product_id = products[record->device];
+        (*cursor)++;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Reports replay divergences and releases the capture, suitable for atexit()
+ */
+void hid_replay_close(void)
+{
+    if (!hid_replay_enabled)
+        return;
+
+    if (divergences || mismatched_writes)
+    {
+        printf("%s[INFO]%s Replay diverged from the capture %zu time(s); %zu write(s) differed from the recording\n",
+               COLOR_BLUE, COLOR_RESET, divergences, mismatched_writes);
+    }
+
+    hid_replay_enabled = 0;
+    mutex_destroy(&replay_lock);
+    free(records);
+    free(capture_data);
+    records = NULL;
+    capture_data = NULL;
+    record_count = 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * hid_replay.h - HID replay backend
+ *
+ * Serves a capture written by hid_capture.h back to the program in place of
+ * real hardware. Opens are matched by path or by vendor/product ID and every
+ * later transfer on a replayed device is answered from that device's own
+ * records, so the unmodified pairing code (including the multi-threaded
+ * daemon) can run against a capture on a machine with no controllers.
+ */
+
+#ifndef HID_REPLAY_H
+#define HID_REPLAY_H
+
+#include "platform_compat.h"
+#include "report_ring.h"
+#include <stdint.h>
+
+/* Non-zero while HID calls are served from a capture */
+extern int hid_replay_enabled;
+
+/* Non-zero to answer immediately instead of at the recorded call durations */
+extern int hid_replay_fast;
+
+/**
+ * Loads a capture file and switches HID I/O over to it
+ *
+ * @param path Capture file written by --capture
+ * @return 1 on success, 0 if the file is missing or malformed
+ */
+int hid_replay_load(const char *path);
+
+/**
+ * Serves the next matching enumeration, see hid_enumerate()
+ *
+ * @param vendor_id Vendor ID to match, or 0 for any
+ * @param product_id Product ID to match, or 0 for any
+ * @return Linked list of device information, free with hid_replay_free_enumeration()
+ */
+struct hid_device_info* hid_replay_enumerate(unsigned short vendor_id, unsigned short product_id);
+
+/**
+ * Frees an enumeration returned by hid_replay_enumerate()
+ *
+ * @param devs The list to free
+ */
+void hid_replay_free_enumeration(struct hid_device_info *devs);
+
+/**
+ * Serves the next recorded open of a path, see hid_open_path()
+ *
+ * @param path The device path
+ * @return Replayed device handle, or NULL if the open failed or was never recorded
+ */
+hid_device* hid_replay_open_path(const char *path);
+
+/**
+ * Serves the next recorded open by vendor and product ID, see hid_open()
+ *
+ * @param vendor_id The vendor ID
+ * @param product_id The product ID
+ * @return Replayed device handle, or NULL if the open failed or was never recorded
+ */
+hid_device* hid_replay_open(unsigned short vendor_id, unsigned short product_id);
+
+/**
+ * Serves the device's next feature report read, see hid_get_feature_report()
+ *
+ * @param dev Replayed device handle
+ * @param data Buffer whose first byte holds the report ID
+ * @param length Size of the buffer
+ * @return The recorded return value, or -1 if the replay diverged
+ */
+int hid_replay_get_feature_report(hid_device *dev, unsigned char *data, size_t length);
+
+/**
+ * Serves the device's next report descriptor read, see hid_get_report_descriptor()
+ *
+ * @param dev Replayed device handle
+ * @param data Buffer for the descriptor
+ * @param length Size of the buffer
+ * @return The recorded return value, or -1 if the replay diverged
+ */
+int hid_replay_get_report_descriptor(hid_device *dev, unsigned char *data, size_t length);
+
+/**
+ * Serves the device's next feature report write, see hid_send_feature_report()
+ *
+ * @param dev Replayed device handle
+ * @param data Report data, the first byte is the report ID
+ * @param length Number of bytes to send
+ * @return The recorded return value, or -1 if the replay diverged
+ */
+int hid_replay_send_feature_report(hid_device *dev, const unsigned char *data, size_t length);
+
+/**
+ * Serves the device's next output report write, see hid_write()
+ *
+ * @param dev Replayed device handle
+ * @param data Report data, the first byte is the report ID
+ * @param length Number of bytes to send
+ * @return The recorded return value, or -1 if the replay diverged
+ */
+int hid_replay_write(hid_device *dev, const unsigned char *data, size_t length);
+
+/**
+ * Serves the device's next input report, see hid_read_timeout()
+ *
+ * @param dev Replayed device handle
+ * @param data Buffer for the report
+ * @param length Size of the buffer
+ * @param milliseconds Requested timeout
+ * @return The recorded return value, or -1 once the device's records are exhausted
+ */
+int hid_replay_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds);
+
+/**
+ * Gets the recorded device information, see hid_get_device_info()
+ *
+ * @param dev Replayed device handle
+ * @return Device information owned by the handle
+ */
+struct hid_device_info* hid_replay_get_device_info(hid_device *dev);
+
+/**
+ * Gets the recorded error of the last failed call, see hid_error()
+ *
+ * @param dev Replayed device handle
+ * @return Error text owned by the handle
+ */
+const wchar_t* hid_replay_error(hid_device *dev);
+
+/**
+ * Closes a replayed device, see hid_close()
+ *
+ * @param dev Replayed device handle
+ */
+void hid_replay_close_device(hid_device *dev);
+
+/**
+ * Gets the next captured input report for offline processing
+ *
+ * Walks the loaded capture in recording order without consuming anything,
+ * so it does not disturb a replay in progress.
+ *
+ * @param cursor Position in the capture; start at 0
+ * @param device Receives the capture ID of the device that read the report
+ * @param product_id Receives the product ID the device was opened as, or 0
+ * @param report Receives the report, stamped with the end of its read
+ *               relative to the start of the capture
+ * @return 1 if a report was returned, 0 at the end of the capture
+ */
+int hid_replay_next_input(size_t *cursor, uint16_t *device, unsigned short *product_id, input_report_t *report);
+
+/**
+ * Reports replay divergences and releases the capture, suitable for atexit()
+ */
+void hid_replay_close(void);
+
+#endif /* HID_REPLAY_H */
@@ -0,0 +1,387 @@
+/**
+ * imu_calibration.c - Accelerometer and gyro calibration
+ *
+ * Implementation of the DS4 calibration decoder and its cache. The cache
+ * file holds one "address report-hex" line per controller; it is read on
+ * first use and appended to whenever a controller's calibration is read.
+ * The cache is not locked and must only be used from one thread at a time.
+ */
+
+#include "imu_calibration.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "bt_transport.h"
+#include "hid_io.h"
+#include "hid_capture.h"
+#include "hid_replay.h"
+#include "mac_utils.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Nominal DS4 sensitivities: 8192 counts per g, 16 counts per degree per second */
+#define DS4_ACCEL_COUNTS_PER_G 8192.0f
+#define DS4_GYRO_COUNTS_PER_DPS 16.0f
+
+/* Nominal SixAxis accelerometer sensitivity (after removing the 512 offset) */
+#define SIXAXIS_ACCEL_COUNTS_PER_G 113.0f
+
+/**
+ * Cached calibration report of one controller
+ */
+typedef struct {
+    unsigned char address[6];
+    unsigned char report[DS4_CALIBRATION_LENGTH];
+} calibration_entry_t;
+
+static char cache_path[512];
+static int cache_loaded = 0;
+static calibration_entry_t cache[CALIBRATION_CACHE_ENTRIES];
+static int cache_count = 0;
+
+/**
+ * Sets the calibration cache file
+ */
+void imu_calibration_set_cache(const char *path)
+{
+    if (!path || !*path)
+    {
+        cache_path[0] = '\0';
+        return;
+    }
+    strncpy(cache_path, path, sizeof(cache_path) - 1);
+    cache_path[sizeof(cache_path) - 1] = '\0';
+}
+
+/**
+ * Fills in the per-user default cache path if none was set
+ */
+static void resolve_cache_path(void)
+{
+    const char *base;
+
+    if (cache_path[0])
+        return;
+
+#ifdef PLATFORM_WINDOWS
+    base = getenv("LOCALAPPDATA");
+    snprintf(cache_path, sizeof(cache_path), "%s%ssixaxispairer-calibration.txt",
+             base ? base : ".", PATH_SEPARATOR);
+#else
+    base = getenv("XDG_CACHE_HOME");
+    if (base && *base)
+        snprintf(cache_path, sizeof(cache_path), "%s/sixaxispairer-calibration.txt", base);
+    else if ((base = getenv("HOME")) != NULL && *base)
+        snprintf(cache_path, sizeof(cache_path), "%s/.cache/sixaxispairer-calibration.txt", base);
+    else
+        snprintf(cache_path, sizeof(cache_path), "sixaxispairer-calibration.txt");
+#endif
+}
+
+/**
+ * Reads the cache file into memory on first use
+ */
+static void load_cache(void)
+{
+    char line[256];
+    FILE *file;
+
+    if (cache_loaded)
+        return;
+    cache_loaded = 1;
+
+    resolve_cache_path();
+    file = fopen(cache_path, "r");
+    if (!file)
+        return;
+
+    while (cache_count < CALIBRATION_CACHE_ENTRIES && fgets(line, sizeof(line), file))
+    {
+        calibration_entry_t *entry = &cache[cache_count];
+        const char *hex = line + 18;
+        size_t i;
+
+        if (line[0] == '#' || strlen(line) < 18 + 2 * DS4_CALIBRATION_LENGTH ||
+            !mac_to_bytes(line, 17, entry->address, sizeof(entry->address)))
+            continue;
+
+        for (i = 0; i < DS4_CALIBRATION_LENGTH; i++)
+        {
+            unsigned char high = char_to_nibble(hex[2 * i]);
+            unsigned char low = char_to_nibble(hex[2 * i + 1]);
+            if (high > 15 || low > 15)
+                break;
+            entry->report[i] = (unsigned char)(high << 4 | low);
+        }
+        if (i == DS4_CALIBRATION_LENGTH && entry->report[0] == DS4_CALIBRATION_REPORT_ID)
+            cache_count++;
+    }
+    fclose(file);
+}
+
+/**
+ * Looks up the cached calibration report of a controller
+ */
+static const unsigned char* cache_find(const unsigned char *address)
+{
+    load_cache();
+    for (int i = 0; i < cache_count; i++)
+    {
+        if (memcmp(cache[i].address, address, 6) == 0)
+            return cache[i].report;
+    }
+    return NULL;
+}
+
+/**
+ * Adds a calibration report to the in-memory cache and the cache file
+ */
+static void cache_store(const unsigned char *address, const unsigned char *report)
+{
+    char mac[18];
+    FILE *file;
+    long size;
+
+    load_cache();
+    if (cache_find(address))
+        return;
+    if (cache_count < CALIBRATION_CACHE_ENTRIES)
+    {
+        memcpy(cache[cache_count].address, address, 6);
+        memcpy(cache[cache_count].report, report, DS4_CALIBRATION_LENGTH);
+        cache_count++;
+    }
+
+    file = fopen(cache_path, "a");
+    if (!file)
+    {
+        printf("%s[INFO]%s Could not write calibration cache %s\n", COLOR_BLUE, COLOR_RESET, cache_path);
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    if (size == 0)
+        fprintf(file, "# sixaxispairer DS4 IMU calibration cache: address, report 0x02 in hex\n");
+
+    bytes_to_mac_string(address, mac, sizeof(mac), 1);
+    fprintf(file, "%s ", mac);
+    for (int i = 0; i < DS4_CALIBRATION_LENGTH; i++)
+        fprintf(file, "%02x", report[i]);
+    fprintf(file, "\n");
+    fclose(file);
+}
+
+/**
+ * Gets the nominal calibration of a controller family
+ */
+void imu_calibration_nominal(report_family_t family, imu_calibration_t *cal)
+{
+    float accel = 1.0f, gyro = 1.0f;
+
+    switch (family)
+    {
+    case REPORT_FAMILY_DS4:
+        accel = 1.0f / DS4_ACCEL_COUNTS_PER_G;
+        gyro = 1.0f / DS4_GYRO_COUNTS_PER_DPS;
+        break;
+    case REPORT_FAMILY_SIXAXIS:
+        accel = 1.0f / SIXAXIS_ACCEL_COUNTS_PER_G;
+        break;
+    default:
+        break;
+    }
+
+    for (int axis = 0; axis < IMU_AXES; axis++)
+    {
+        cal->scale[axis] = axis < IMU_GYRO_X ? accel : gyro;
+        cal->offset[axis] = 0.0f;
+    }
+    cal->from_device = 0;
+}
+
+/**
+ * Reads a signed little-endian 16-bit value
+ */
+static int le16s(const unsigned char *p)
+{
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * Decodes a DS4 calibration feature report (USB layout)
+ */
+int imu_calibration_parse_ds4(const unsigned char *report, size_t length, imu_calibration_t *cal)
+{
+    int speed;
+
+    if (length < DS4_CALIBRATION_LENGTH || report[0] != DS4_CALIBRATION_REPORT_ID)
+        return 0;
+
+    imu_calibration_nominal(REPORT_FAMILY_DS4, cal);
+    cal->from_device = 1;
+
+    /* Gyro: bias at 1, plus/minus references per axis from 7, full-scale speed at 19 */
+    speed = le16s(report + 19) + le16s(report + 21);
+    for (int i = 0; i < 3; i++)
+    {
+        int bias = le16s(report + 1 + 2 * i);
+        int range = le16s(report + 7 + 4 * i) - le16s(report + 9 + 4 * i);
+
+        if (range != 0 && speed > 0)
+        {
+            cal->scale[IMU_GYRO_X + i] = (float)speed / (float)range;
+            cal->offset[IMU_GYRO_X + i] = -(float)bias * cal->scale[IMU_GYRO_X + i];
+        }
+    }
+
+    /* Accelerometer: +1 g and -1 g readings per axis from 23 */
+    for (int i = 0; i < 3; i++)
+    {
+        int plus = le16s(report + 23 + 4 * i);
+        int range = plus - le16s(report + 25 + 4 * i);
+
+        if (range > 0)
+        {
+            float bias = (float)plus - (float)range / 2.0f;
+            cal->scale[IMU_ACCEL_X + i] = 2.0f / (float)range;
+            cal->offset[IMU_ACCEL_X + i] = -bias * cal->scale[IMU_ACCEL_X + i];
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Rewrites a DS4 Bluetooth calibration report in the USB layout
+ */
+int imu_calibration_ds4_from_bt(const unsigned char *bt, size_t length, unsigned char *usb)
+{
+    if (length < DS4_BT_CALIBRATION_LENGTH - BT_CRC_LENGTH || bt[0] != DS4_BT_CALIBRATION_REPORT_ID)
+        return 0;
+
+    memcpy(usb, bt, DS4_CALIBRATION_LENGTH);
+    usb[0] = DS4_CALIBRATION_REPORT_ID;
+
+    /* Plus references of pitch, yaw, roll from 7, minus references from 13 */
+    for (int i = 0; i < 3; i++)
+    {
+        memcpy(usb + 7 + 4 * i, bt + 7 + 2 * i, 2);
+        memcpy(usb + 9 + 4 * i, bt + 13 + 2 * i, 2);
+    }
+    return 1;
+}
+
+/**
+ * Gets the calibration of a connected controller
+ */
+int imu_calibration_load(hid_device *dev, unsigned short product_id, imu_calibration_t *cal)
+{
+    unsigned char report[DS4_CALIBRATION_LENGTH];
+    unsigned char bt[DS4_BT_CALIBRATION_LENGTH];
+    unsigned char address[6];
+    int have_address;
+
+    imu_calibration_nominal(report_family(product_id), cal);
+    if (product_id != PRODUCT_DS4)
+        return 0;
+
+    /* Captures always contain the calibration read so replays see the same traffic */
+    have_address = read_device_address(dev, product_id, address);
+    if (have_address && !hid_capture_enabled && !hid_replay_enabled)
+    {
+        const unsigned char *cached = cache_find(address);
+        if (cached && imu_calibration_parse_ds4(cached, DS4_CALIBRATION_LENGTH, cal))
+            return 1;
+    }
+
+    if (is_bluetooth_device(dev))
+    {
+        memset(bt, 0, sizeof(bt));
+        bt[0] = DS4_BT_CALIBRATION_REPORT_ID;
+        if (bt_get_feature_report(dev, bt, sizeof(bt)) < 0 || !imu_calibration_ds4_from_bt(bt, sizeof(bt), report))
+            return 0;
+    }
+    else
+    {
+        memset(report, 0, sizeof(report));
+        report[0] = DS4_CALIBRATION_REPORT_ID;
+        if (hid_io_get_feature_report(dev, report, sizeof(report)) < DS4_CALIBRATION_LENGTH)
+            return 0;
+    }
+    if (!imu_calibration_parse_ds4(report, sizeof(report), cal))
+        return 0;
+
+    if (have_address)
+        cache_store(address, report);
+    return 1;
+}
+
+/**
+ * Allocates an empty sample batch
+ */
+int imu_samples_init(imu_samples_t *samples, size_t capacity)
+{
+    memset(samples, 0, sizeof(*samples));
+    samples->capacity = capacity;
+
+    samples->accel_x = (float*)malloc(capacity * sizeof(float));
+    samples->accel_y = (float*)malloc(capacity * sizeof(float));
+    samples->accel_z = (float*)malloc(capacity * sizeof(float));
+    samples->gyro_x = (float*)malloc(capacity * sizeof(float));
+    samples->gyro_y = (float*)malloc(capacity * sizeof(float));
+    samples->gyro_z = (float*)malloc(capacity * sizeof(float));
+
+    if (!samples->accel_x || !samples->accel_y || !samples->accel_z ||
+        !samples->gyro_x || !samples->gyro_y || !samples->gyro_z)
+    {
+        imu_samples_free(samples);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Frees a sample batch
+ */
+void imu_samples_free(imu_samples_t *samples)
+{
+    free(samples->accel_x);
+    free(samples->accel_y);
+    free(samples->accel_z);
+    free(samples->gyro_x);
+    free(samples->gyro_y);
+    free(samples->gyro_z);
+    memset(samples, 0, sizeof(*samples));
+}
+
+/**
+ * Applies one axis transform to a contiguous run of samples
+ */
+static void apply_axis(const int16_t *restrict raw, float *restrict out, size_t n, float scale, float offset)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = (float)raw[i] * scale + offset;
+}
+
+/**
+ * Calibrates every report in a decoded batch and appends the result
+ */
+size_t imu_calibration_apply(const imu_calibration_t *cal, const decoded_reports_t *batch,
+                             imu_samples_t *samples)
+{
+    size_t base = samples->count;
+    size_t n = batch->count < samples->capacity - base ? batch->count : samples->capacity - base;
+
+    apply_axis(batch->accel_x, samples->accel_x + base, n, cal->scale[IMU_ACCEL_X], cal->offset[IMU_ACCEL_X]);
+    apply_axis(batch->accel_y, samples->accel_y + base, n, cal->scale[IMU_ACCEL_Y], cal->offset[IMU_ACCEL_Y]);
+    apply_axis(batch->accel_z, samples->accel_z + base, n, cal->scale[IMU_ACCEL_Z], cal->offset[IMU_ACCEL_Z]);
+    apply_axis(batch->gyro_x, samples->gyro_x + base, n, cal->scale[IMU_GYRO_X], cal->offset[IMU_GYRO_X]);
+    apply_axis(batch->gyro_y, samples->gyro_y + base, n, cal->scale[IMU_GYRO_Y], cal->offset[IMU_GYRO_Y]);
+    apply_axis(batch->gyro_z, samples->gyro_z + base, n, cal->scale[IMU_GYRO_Z], cal->offset[IMU_GYRO_Z]);
+
+    samples->count += n;
+    return n;
+}
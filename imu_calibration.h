@@ -0,0 +1,141 @@
+/**
+ * imu_calibration.h - Accelerometer and gyro calibration
+ *
+ * Reads the factory IMU calibration a DualShock 4 stores in feature report
+ * 0x02 (0x05 over Bluetooth), keeps it in an on-disk cache keyed by the controller's Bluetooth
+ * address, and turns it into a per-axis scale and offset that converts
+ * decoded samples into g and degrees per second.
+ */
+
+#ifndef IMU_CALIBRATION_H
+#define IMU_CALIBRATION_H
+
+#include "platform_compat.h"
+#include "report_decoder.h"
+
+/* DS4 feature report holding the IMU calibration over USB */
+#define DS4_CALIBRATION_REPORT_ID 0x02
+#define DS4_CALIBRATION_LENGTH 37
+
+/* Number of controllers the calibration cache remembers */
+#define CALIBRATION_CACHE_ENTRIES 64
+
+/**
+ * IMU axes in the order used by imu_calibration_t
+ */
+typedef enum {
+    IMU_ACCEL_X = 0,
+    IMU_ACCEL_Y,
+    IMU_ACCEL_Z,
+    IMU_GYRO_X,
+    IMU_GYRO_Y,
+    IMU_GYRO_Z,
+    IMU_AXES
+} imu_axis_t;
+
+/**
+ * Per-axis transform: value = raw * scale + offset
+ *
+ * Accelerometer axes come out in g, gyro axes in degrees per second.
+ */
+typedef struct {
+    float scale[IMU_AXES];
+    float offset[IMU_AXES];
+    int from_device;        /* 1 if read from the controller, 0 if nominal */
+} imu_calibration_t;
+
+/**
+ * Calibrated IMU samples in struct-of-arrays layout
+ */
+typedef struct {
+    size_t count;
+    size_t capacity;
+    float *accel_x, *accel_y, *accel_z;
+    float *gyro_x, *gyro_y, *gyro_z;
+} imu_samples_t;
+
+/**
+ * Sets the calibration cache file
+ *
+ * @param path File path, or NULL for the per-user default
+ */
+void imu_calibration_set_cache(const char *path);
+
+/**
+ * Gets the nominal calibration of a controller family
+ *
+ * Families without a documented sensitivity keep raw counts (scale 1).
+ *
+ * @param family The report family
+ * @param cal Receives the calibration
+ */
+void imu_calibration_nominal(report_family_t family, imu_calibration_t *cal);
+
+/**
+ * Decodes a DS4 calibration feature report
+ *
+ * Axes whose plus/minus references are unusable keep their nominal values.
+ *
+ * @param report The report including its report ID
+ * @param length Length of the report in bytes
+ * @param cal Receives the calibration
+ * @return 1 if the report was decoded, 0 if it is too short or has the wrong ID
+ */
+int imu_calibration_parse_ds4(const unsigned char *report, size_t length, imu_calibration_t *cal);
+
+/**
+ * Rewrites a DS4 Bluetooth calibration report in the USB layout
+ *
+ * Report 0x05 lists the three gyro plus references before the three minus
+ * references; report 0x02 interleaves them per axis. The CRC is not checked.
+ *
+ * @param bt Report 0x05 including its report ID
+ * @param length Length of the report in bytes
+ * @param usb Receives DS4_CALIBRATION_LENGTH bytes of report 0x02
+ * @return 1 on success, 0 if the report is too short or has the wrong ID
+ */
+int imu_calibration_ds4_from_bt(const unsigned char *bt, size_t length, unsigned char *usb);
+
+/**
+ * Gets the calibration of a connected controller
+ *
+ * DS4 calibration is taken from the cache when the controller's address is
+ * known; otherwise report 0x02 (0x05 with its CRC checked over Bluetooth)
+ * is read once and added to the cache in the USB layout. Other
+ * families get their nominal calibration without any HID traffic.
+ *
+ * @param dev Handle to the HID device
+ * @param product_id Product ID of the controller
+ * @param cal Receives the calibration
+ * @return 1 if the calibration came from the controller, 0 if nominal
+ */
+int imu_calibration_load(hid_device *dev, unsigned short product_id, imu_calibration_t *cal);
+
+/**
+ * Allocates an empty sample batch
+ *
+ * @param samples The batch to initialize
+ * @param capacity Maximum number of samples the batch can hold
+ * @return 1 on success, 0 on failure
+ */
+int imu_samples_init(imu_samples_t *samples, size_t capacity);
+
+/**
+ * Frees a sample batch
+ *
+ * @param samples The batch to free
+ */
+void imu_samples_free(imu_samples_t *samples);
+
+/**
+ * Calibrates every report in a decoded batch and appends the result
+ *
+ * @param cal The calibration of the controller the reports came from
+ * @param batch Decoded reports
+ * @param samples Batch to append to; stops when full
+ * @return Number of samples appended
+ */
+size_t imu_calibration_apply(const imu_calibration_t *cal, const decoded_reports_t *batch,
+                             imu_samples_t *samples);
+
+#endif /* IMU_CALIBRATION_H */
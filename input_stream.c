@@ -0,0 +1,843 @@
+/**
+ * input_stream.c - High-rate input report streaming
+ *
+ * Implementation of stream mode. Every controller gets a reader thread that
+ * reads straight into the slots of its own SPSC ring. The main thread merges
+ * the rings: each reader publishes a watermark before every blocking read,
+ * and a report is only written once it is older than every watermark, so
+ * the output is in global timestamp order even though the readers run
+ * independently.
+ *
+ * With --io-uring one thread reads every controller through uring_reader.h
+ * instead. It publishes the same watermark for all of its controllers before
+ * each wait and fills the same rings, so the merge does not change.
+ */
+
+#include "input_stream.h"
+#include "report_ring.h"
+#include "report_decoder.h"
+#include "bt_transport.h"
+#include "imu_calibration.h"
+#include "orientation_filter.h"
+#include "dsu_server.h"
+#include "uinput_bridge.h"
+#include "uring_reader.h"
+#include "state_shm.h"
+#include "recording.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "hid_io.h"
+#include "hid_capture.h"
+#include "hid_replay.h"
+#include "latency_stats.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
+
+/**
+ * Reader thread state for one controller
+ */
+typedef struct {
+    controller_info_t *controller;
+    report_family_t family;
+    imu_calibration_t calibration;
+    decoded_reports_t bridge;       /* Decoded on the reader thread for uinput_bridge.h and state_shm.h */
+    imu_samples_t published;        /* Calibrated on the reader thread for state_shm.h */
+    int index;
+    hid_device *dev;
+    report_ring_t ring;
+    thread_t thread;
+    _Atomic uint64_t watermark_ns;  /* Every later report is stamped at or after this */
+    uint64_t reports;               /* Written by the reader, read after join */
+    uint64_t dropped;
+    uint64_t crc_errors;            /* Bluetooth reports dropped for a bad CRC */
+    int running;
+    int error;
+} stream_reader_t;
+
+/**
+ * Single io_uring reader thread state for all controllers
+ */
+typedef struct {
+    uring_reader_t *ring;           /* Device i is readers[i] */
+    stream_reader_t *readers;
+    int count;
+    thread_t thread;
+    int running;
+    uint64_t batches;               /* Written by the thread, read after join */
+    uint64_t harvested;
+} stream_uring_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+static _Atomic int stopping = 0;
+
+/**
+ * Signal handler requesting a clean shutdown
+ */
+static void handle_stop_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/**
+ * Stamps a report just read into a claimed slot (or the scratch report when
+ * the ring was full), publishes it to the ring and shared memory and
+ * mirrors it to the virtual gamepad; a Bluetooth report is checked and put
+ * in the USB layout first
+ */
+static void finish_report(stream_reader_t *reader, input_report_t *slot, input_report_t *report, int length)
+{
+    report->timestamp_ns = latency_now_ns();
+    report->length = (uint32_t)length;
+
+    /* An unpublished slot is claimed again by the next read */
+    if (!bt_normalize_input(reader->controller->product_id, report))
+    {
+        reader->crc_errors++;
+        return;
+    }
+
+    if (slot)
+    {
+        report_ring_publish(&reader->ring);
+        reader->reports++;
+    }
+    else
+    {
+        reader->dropped++;
+    }
+
+    /* The virtual gamepad and shared memory do not wait for the merge. A
+       published slot is still safe to read: the merge never writes it and
+       the reading thread only reuses it after its next claim. */
+    if (reader->bridge.capacity)
+    {
+        reader->bridge.count = 0;
+        decode_reports(reader->family, report, 1, &reader->bridge);
+        uinput_bridge_write(reader->index, &reader->bridge, 0, report->timestamp_ns);
+        if (reader->published.capacity)
+        {
+            reader->published.count = 0;
+            imu_calibration_apply(&reader->calibration, &reader->bridge, &reader->published);
+            state_shm_publish(reader->index, &reader->bridge, &reader->published, 0);
+        }
+    }
+}
+
+/**
+ * Reader thread: reads input reports into the ring until stopped
+ */
+static void reader_main(void *arg)
+{
+    stream_reader_t *reader = (stream_reader_t*)arg;
+    input_report_t scratch;
+
+    while (!atomic_load_explicit(&stopping, memory_order_relaxed))
+    {
+        input_report_t *slot, *report;
+        int ret;
+
+        atomic_store_explicit(&reader->watermark_ns, latency_now_ns(), memory_order_release);
+
+        /* A full ring still has to be read so the device queue does not overflow */
+        slot = report_ring_claim(&reader->ring);
+        report = slot ? slot : &scratch;
+        ret = hid_io_read_timeout(reader->dev, report->data, INPUT_REPORT_MAX, STREAM_READ_TIMEOUT_MS);
+        if (ret < 0)
+        {
+            reader->error = 1;
+            break;
+        }
+        if (ret == 0)
+            continue;
+
+        finish_report(reader, slot, report, ret);
+    }
+
+    atomic_store_explicit(&reader->watermark_ns, UINT64_MAX, memory_order_release);
+}
+
+/**
+ * io_uring reader thread: harvests batches of reports from every controller
+ * into their rings until stopped
+ */
+static void uring_main(void *arg)
+{
+    stream_uring_t *uring = (stream_uring_t*)arg;
+    uring_completion_t completions[MAX_CONTROLLERS];
+    input_report_t scratch;
+
+    while (!atomic_load_explicit(&stopping, memory_order_relaxed))
+    {
+        uint64_t now = latency_now_ns();
+        int count;
+
+        for (int i = 0; i < uring->count; i++)
+        {
+            if (!uring->readers[i].error)
+                atomic_store_explicit(&uring->readers[i].watermark_ns, now, memory_order_release);
+        }
+
+        count = uring_reader_wait(uring->ring, completions, MAX_CONTROLLERS, STREAM_READ_TIMEOUT_MS);
+        if (count < 0)
+        {
+            for (int i = 0; i < uring->count; i++)
+                uring->readers[i].error = 1;
+            break;
+        }
+        if (count > 0)
+        {
+            uring->batches++;
+            uring->harvested += (uint64_t)count;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            stream_reader_t *reader = &uring->readers[completions[i].device];
+            input_report_t *slot, *report;
+            int length = completions[i].result;
+
+            /* A failed device is never read again; release the merge from it */
+            if (length <= 0)
+            {
+                reader->error = 1;
+                atomic_store_explicit(&reader->watermark_ns, UINT64_MAX, memory_order_release);
+                continue;
+            }
+
+            /* The ring's buffers are reused by the next wait, so copy out */
+            slot = report_ring_claim(&reader->ring);
+            report = slot ? slot : &scratch;
+            memcpy(report->data, completions[i].data, (size_t)length);
+            finish_report(reader, slot, report, length);
+        }
+    }
+
+    for (int i = 0; i < uring->count; i++)
+        atomic_store_explicit(&uring->readers[i].watermark_ns, UINT64_MAX, memory_order_release);
+}
+
+/**
+ * Opens every controller's device node on one io_uring
+ *
+ * @return The started ring, or NULL to keep a reader thread per controller
+ */
+static uring_reader_t* open_uring(stream_reader_t *readers, int count)
+{
+    uring_reader_t *ring;
+    const char *reason = NULL;
+
+    /* Reads through the ring bypass HIDAPI and with it capture and replay */
+    if (hid_capture_enabled || hid_replay_enabled)
+        reason = "capture and replay need HIDAPI reads";
+    for (int i = 0; i < count && !reason; i++)
+    {
+        if (strncmp(readers[i].controller->path, "/dev/hidraw", 11) != 0)
+            reason = "not every controller is a hidraw device";
+    }
+    if (reason)
+    {
+        printf("%s[INFO]%s Not using io_uring (%s), reading on one thread per controller\n", COLOR_BLUE,
+               COLOR_RESET, reason);
+        return NULL;
+    }
+
+    ring = uring_reader_create(count);
+    if (!ring)
+    {
+        printf("%s[INFO]%s io_uring is not available, reading on one thread per controller\n", COLOR_BLUE,
+               COLOR_RESET);
+        return NULL;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (uring_reader_add(ring, readers[i].controller->path) != i)
+        {
+            printf("%s[INFO]%s Could not open %s for io_uring, reading on one thread per controller\n",
+                   COLOR_BLUE, COLOR_RESET, readers[i].controller->path);
+            uring_reader_destroy(ring);
+            return NULL;
+        }
+    }
+    if (!uring_reader_start(ring))
+    {
+        printf("%s[INFO]%s Could not start io_uring reads, reading on one thread per controller\n", COLOR_BLUE,
+               COLOR_RESET);
+        uring_reader_destroy(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/**
+ * Orientation output: one filter lane per controller, each holding at most
+ * one pending sample until all lanes are advanced together
+ */
+typedef struct {
+    orientation_filter_t filter;
+    uint64_t last_ns[MAX_CONTROLLERS];    /* Timestamp of each lane's previous sample */
+    uint64_t sample_ns[MAX_CONTROLLERS];  /* Timestamp of each lane's pending sample */
+    int order[MAX_CONTROLLERS];           /* Pending lanes in timestamp order */
+    int pending;
+    uint64_t updates;
+    uint64_t update_ns;
+    uint64_t max_update_ns;
+} stream_fusion_t;
+
+/**
+ * Where and how merged reports are written
+ */
+typedef struct {
+    FILE *file;
+    uint64_t origin_ns;
+    decoded_reports_t *decoded;  /* Decoded fields instead of raw bytes when not NULL */
+    imu_samples_t *samples;      /* Calibrated IMU axes when not NULL */
+    stream_fusion_t *fusion;     /* Quaternions instead of fields when not NULL */
+    int dsu;                     /* Also serve each report to DSU clients */
+    recording_writer_t *recorder; /* Also record each report when not NULL */
+} stream_output_t;
+
+/**
+ * Writes one report as a CSV line
+ */
+static void write_report(const stream_output_t *output, const input_report_t *report, int controller)
+{
+    static const char HEX[] = "0123456789abcdef";
+    char line[64 + 3 * INPUT_REPORT_MAX];
+    int pos;
+
+    if (!output->file)
+        return;
+    pos = snprintf(line, sizeof(line), "%llu,%d,%u,",
+                   (unsigned long long)((report->timestamp_ns - output->origin_ns) / 1000u), controller,
+                   report->length);
+    for (uint32_t i = 0; i < report->length && i < INPUT_REPORT_MAX; i++)
+    {
+        line[pos++] = HEX[report->data[i] >> 4];
+        line[pos++] = HEX[report->data[i] & 0x0f];
+    }
+    line[pos++] = '\n';
+    fwrite(line, 1, (size_t)pos, output->file);
+}
+
+/**
+ * Advances every pending filter lane and writes their quaternions
+ */
+static void flush_orientation(const stream_output_t *output)
+{
+    stream_fusion_t *fusion = output->fusion;
+    orientation_filter_t *filter = &fusion->filter;
+    uint64_t start, elapsed;
+
+    if (fusion->pending == 0)
+        return;
+
+    start = latency_now_ns();
+    orientation_filter_update(filter);
+    elapsed = latency_now_ns() - start;
+
+    fusion->updates++;
+    fusion->update_ns += elapsed;
+    if (elapsed > fusion->max_update_ns)
+        fusion->max_update_ns = elapsed;
+
+    for (int i = 0; i < fusion->pending && output->file; i++)
+    {
+        int lane = fusion->order[i];
+        fprintf(output->file, "%llu,%d,%.5f,%.5f,%.5f,%.5f\n",
+                (unsigned long long)((fusion->sample_ns[lane] - output->origin_ns) / 1000u), lane,
+                filter->q0[lane], filter->q1[lane], filter->q2[lane], filter->q3[lane]);
+    }
+    fusion->pending = 0;
+}
+
+/**
+ * Queues one calibrated sample on its controller's filter lane
+ */
+static void queue_orientation(const stream_output_t *output, int lane, uint64_t timestamp_ns)
+{
+    stream_fusion_t *fusion = output->fusion;
+    orientation_filter_t *filter = &fusion->filter;
+    const imu_samples_t *samples = output->samples;
+
+    /* A lane takes one sample per update; a second one closes the batch */
+    for (int i = 0; i < fusion->pending; i++)
+    {
+        if (fusion->order[i] == lane)
+        {
+            flush_orientation(output);
+            break;
+        }
+    }
+
+    filter->ax[lane] = samples->accel_x[0];
+    filter->ay[lane] = samples->accel_y[0];
+    filter->az[lane] = samples->accel_z[0];
+    filter->gx[lane] = samples->gyro_x[0];
+    filter->gy[lane] = samples->gyro_y[0];
+    filter->gz[lane] = samples->gyro_z[0];
+    filter->dt[lane] = fusion->last_ns[lane] ? (float)(timestamp_ns - fusion->last_ns[lane]) / 1e9f : 0.0f;
+
+    fusion->last_ns[lane] = timestamp_ns;
+    fusion->sample_ns[lane] = timestamp_ns;
+    fusion->order[fusion->pending++] = lane;
+}
+
+/**
+ * Writes one report as a CSV line of decoded fields, with calibrated IMU
+ * axes or an orientation when the output asks for them
+ */
+static void write_decoded(const stream_output_t *output, const input_report_t *report,
+                          const stream_reader_t *reader, int controller)
+{
+    decoded_reports_t *scratch = output->decoded;
+    imu_samples_t *samples = output->samples;
+    FILE *out = output->file;
+
+    scratch->count = 0;
+    decode_reports(reader->family, report, 1, scratch);
+    if (samples)
+    {
+        samples->count = 0;
+        imu_calibration_apply(&reader->calibration, scratch, samples);
+    }
+    if (output->dsu)
+        dsu_server_queue(controller, scratch, samples, 0);
+
+    /* Only the DS4 has a 3-axis gyro in degrees per second to fuse */
+    if (output->fusion)
+    {
+        if (reader->family == REPORT_FAMILY_DS4)
+            queue_orientation(output, controller, report->timestamp_ns);
+        return;
+    }
+    if (!out)
+        return;
+
+    fprintf(out, "%llu,%d,%05x,%u,%u,%u,%u,%u,%u,",
+            (unsigned long long)((report->timestamp_ns - output->origin_ns) / 1000u), controller,
+            scratch->buttons[0], scratch->left_x[0], scratch->left_y[0], scratch->right_x[0], scratch->right_y[0],
+            scratch->l2[0], scratch->r2[0]);
+    if (samples)
+    {
+        fprintf(out, "%.4f,%.4f,%.4f,%.2f,%.2f,%.2f,", samples->accel_x[0], samples->accel_y[0],
+                samples->accel_z[0], samples->gyro_x[0], samples->gyro_y[0], samples->gyro_z[0]);
+    }
+    else
+    {
+        fprintf(out, "%d,%d,%d,%d,%d,%d,", scratch->accel_x[0], scratch->accel_y[0], scratch->accel_z[0],
+                scratch->gyro_x[0], scratch->gyro_y[0], scratch->gyro_z[0]);
+    }
+    fprintf(out, "%u,%u,%u,%u\n", scratch->touch_active[0], scratch->touch_x[0], scratch->touch_y[0],
+            scratch->battery[0]);
+}
+
+/**
+ * Writes every buffered report older than all reader watermarks
+ *
+ * @return Number of reports written; -1 once all readers have finished and drained
+ */
+static int merge_rings(stream_reader_t *readers, int count, const stream_output_t *output)
+{
+    report_ring_t *rings[MAX_CONTROLLERS];
+    uint64_t watermark = UINT64_MAX;
+    int written = 0, next;
+
+    /* Load the watermarks first: everything stamped before them is already published */
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t mark = atomic_load_explicit(&readers[i].watermark_ns, memory_order_acquire);
+        if (mark < watermark)
+            watermark = mark;
+    }
+
+    for (int i = 0; i < count; i++)
+        rings[i] = &readers[i].ring;
+
+    while ((next = report_ring_next_due(rings, count, watermark)) >= 0)
+    {
+        const input_report_t *oldest = report_ring_peek(rings[next]);
+
+        if (output->recorder)
+            recording_writer_add(output->recorder, next, oldest);
+        if (output->decoded)
+            write_decoded(output, oldest, &readers[next], next);
+        else
+            write_report(output, oldest, next);
+        report_ring_release(rings[next]);
+        written++;
+    }
+
+    /* Nothing later can be merged before these, so do not hold them back */
+    if (output->fusion)
+        flush_orientation(output);
+    if (output->dsu)
+        dsu_server_flush();
+
+    return (watermark == UINT64_MAX && written == 0) ? -1 : written;
+}
+
+/**
+ * Streams input reports until interrupted or the duration elapses
+ */
+int stream_command(int argc, char **argv)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    stream_reader_t *readers;
+    const char *output_path = NULL;
+    decoded_reports_t decoded = {0};
+    imu_samples_t samples = {0};
+    stream_fusion_t fusion = {0};
+    stream_output_t output;
+    stream_uring_t uring = {0};
+    int decode = 0, calibrate = 0, orient = 0, dsu = 0, uinput = 0, io_uring = 0, shm = 0;
+    const char *shm_name = NULL, *record_path = NULL;
+    recording_writer_t *recorder = NULL;
+    float beta = ORIENTATION_DEFAULT_BETA;
+    char dsu_address[64] = DSU_DEFAULT_ADDRESS;
+    int dsu_port = DSU_DEFAULT_PORT;
+    FILE *out = stdout;
+    double duration_s = 0;
+    int controller_count, started = 0;
+    uint64_t origin_ns, total = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--duration") == 0)
+            duration_s = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--output") == 0)
+            output_path = argv[++i];
+        else if (strcmp(argv[i], "--decoded") == 0)
+            decode = 1;
+        else if (strcmp(argv[i], "--calibrated") == 0)
+            decode = calibrate = 1;
+        else if (strcmp(argv[i], "--orientation") == 0)
+            decode = calibrate = orient = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "--beta") == 0)
+            beta = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--dsu") == 0)
+            decode = calibrate = dsu = 1;
+        else if (strcmp(argv[i], "--uinput") == 0)
+            uinput = 1;
+        else if (strcmp(argv[i], "--io-uring") == 0)
+            io_uring = 1;
+        else if (strcmp(argv[i], "--shm") == 0)
+            shm = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "--record") == 0)
+            record_path = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--shm-name") == 0)
+        {
+            shm = 1;
+            shm_name = argv[++i];
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--dsu-bind") == 0)
+        {
+            char *colon;
+
+            decode = calibrate = dsu = 1;
+            snprintf(dsu_address, sizeof(dsu_address), "%s", argv[++i]);
+            colon = strchr(dsu_address, ':');
+            if (colon)
+            {
+                *colon = '\0';
+                dsu_port = atoi(colon + 1);
+            }
+        }
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown stream option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+
+    if ((decode && !decoded_reports_init(&decoded, 1)) || (calibrate && !imu_samples_init(&samples, 1)))
+    {
+        decoded_reports_free(&decoded);
+        imu_samples_free(&samples);
+        return 1;
+    }
+
+    controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+    if (controller_count == 0)
+    {
+        printf("%s[ERROR]%s No supported PlayStation controllers found\n", COLOR_RED, COLOR_RESET);
+        decoded_reports_free(&decoded);
+        imu_samples_free(&samples);
+        orientation_filter_free(&fusion.filter);
+        return 1;
+    }
+
+    readers = (stream_reader_t*)calloc((size_t)controller_count, sizeof(stream_reader_t));
+
+    /* One filter lane per controller found; the update cost grows with the lanes */
+    if (orient && readers && !orientation_filter_init(&fusion.filter, controller_count, beta))
+    {
+        free(readers);
+        readers = NULL;
+    }
+    if (output_path && readers)
+    {
+        out = fopen(output_path, "w");
+        if (!out)
+            fprintf(stderr, "%s[ERROR]%s Failed to create %s\n", COLOR_RED, COLOR_RESET, output_path);
+    }
+    else if (dsu || uinput || shm)
+    {
+        /* DSU clients, virtual gamepads or shared-memory readers are the consumer;
+           only write CSV when asked to */
+        out = NULL;
+    }
+    if (!readers || (output_path && !out) || (dsu && !dsu_server_start(dsu_address, dsu_port)) ||
+        (uinput && !uinput_bridge_start()) || (shm && !state_shm_start(shm_name, controller_count)) ||
+        (record_path && !(recorder = recording_writer_open(record_path, controller_count))))
+    {
+        dsu_server_stop();
+        uinput_bridge_stop();
+        state_shm_stop();
+        recording_writer_close(recorder, NULL);
+        if (out && out != stdout)
+            fclose(out);
+        for (int i = 0; i < controller_count; i++)
+            free_controller_info(controllers[i]);
+        free(readers);
+        decoded_reports_free(&decoded);
+        imu_samples_free(&samples);
+        orientation_filter_free(&fusion.filter);
+        return 1;
+    }
+
+    /* Connect everything and allocate all rings before the first read */
+    for (int i = 0; i < controller_count; i++)
+    {
+        stream_reader_t *reader = &readers[started];
+
+        reader->controller = controllers[i];
+        reader->index = started;
+        reader->family = report_family(controllers[i]->product_id);
+        reader->dev = connect_to_controller(controllers[i]);
+        if (!reader->dev || !report_ring_init(&reader->ring, STREAM_RING_SLOTS))
+        {
+            hid_io_close(reader->dev);
+            free_controller_info(controllers[i]);
+            memset(reader, 0, sizeof(*reader));
+            continue;
+        }
+
+        if ((calibrate || shm) && imu_calibration_load(reader->dev, controllers[i]->product_id, &reader->calibration))
+        {
+            printf("%s[INFO]%s Using the factory IMU calibration of %s\n", COLOR_BLUE, COLOR_RESET,
+                   controllers[i]->path);
+        }
+
+        if (orient && reader->family != REPORT_FAMILY_DS4)
+        {
+            printf("%s[INFO]%s No orientation for %s: only DualShock 4 gyros are fused\n", COLOR_BLUE,
+                   COLOR_RESET, controllers[i]->path);
+        }
+
+        /* DSU slots follow the controller table */
+        if (dsu && started < DSU_SLOTS)
+        {
+            unsigned char mac[6];
+            int have_mac = read_device_address(reader->dev, controllers[i]->product_id, mac);
+            dsu_server_set_slot(started, controllers[i]->product_id, have_mac ? mac : NULL,
+                                is_bluetooth_controller(controllers[i]));
+        }
+
+        if (uinput && (!decoded_reports_init(&reader->bridge, 1) ||
+                       !uinput_bridge_open(started, controllers[i]->product_id)))
+        {
+            printf("%s[INFO]%s Not mirroring %s as a virtual gamepad\n", COLOR_BLUE, COLOR_RESET,
+                   controllers[i]->path);
+            decoded_reports_free(&reader->bridge);
+        }
+
+        /* Shared-memory slots follow the controller table too */
+        if (shm && ((!reader->bridge.capacity && !decoded_reports_init(&reader->bridge, 1)) ||
+                    !imu_samples_init(&reader->published, 1)))
+        {
+            printf("%s[INFO]%s Not publishing %s in shared memory\n", COLOR_BLUE, COLOR_RESET,
+                   controllers[i]->path);
+            imu_samples_free(&reader->published);
+        }
+        else if (shm)
+        {
+            state_shm_set_slot(started, controllers[i]->product_id);
+        }
+
+        recording_writer_set_device(recorder, started, controllers[i]->product_id);
+
+        if (controllers[i]->product_id == PRODUCT_SIXAXIS && !enable_sixaxis_reports(reader->dev))
+        {
+            printf("%s[INFO]%s Could not send the SixAxis enable command to %s, reading anyway\n",
+                   COLOR_BLUE, COLOR_RESET, controllers[i]->path);
+        }
+        started++;
+    }
+
+    if (started == 0)
+    {
+        if (out && out != stdout)
+            fclose(out);
+        dsu_server_stop();
+        uinput_bridge_stop();
+        state_shm_stop();
+        recording_writer_close(recorder, NULL);
+        free(readers);
+        decoded_reports_free(&decoded);
+        imu_samples_free(&samples);
+        orientation_filter_free(&fusion.filter);
+        return 1;
+    }
+
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+
+    origin_ns = latency_now_ns();
+    output.file = out;
+    output.origin_ns = origin_ns;
+    output.decoded = decode ? &decoded : NULL;
+    output.samples = calibrate ? &samples : NULL;
+    output.fusion = orient ? &fusion : NULL;
+    output.dsu = dsu;
+    output.recorder = recorder;
+
+    for (int i = 0; i < started; i++)
+        atomic_init(&readers[i].watermark_ns, origin_ns);
+
+    if (io_uring)
+    {
+        uring.ring = open_uring(readers, started);
+        uring.readers = readers;
+        uring.count = started;
+        if (uring.ring)
+        {
+            uring.running = thread_create(&uring.thread, uring_main, &uring);
+            if (!uring.running)
+            {
+                for (int i = 0; i < started; i++)
+                {
+                    readers[i].error = 1;
+                    atomic_store(&readers[i].watermark_ns, UINT64_MAX);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < started && !uring.ring; i++)
+    {
+        readers[i].running = thread_create(&readers[i].thread, reader_main, &readers[i]);
+        if (!readers[i].running)
+        {
+            readers[i].error = 1;
+            atomic_store(&readers[i].watermark_ns, UINT64_MAX);
+        }
+    }
+
+    printf("%s[INFO]%s Streaming input reports from %d controller(s)%s%s\n", COLOR_BLUE, COLOR_RESET, started,
+           uring.ring ? " on one io_uring" : "", duration_s > 0 ? "" : ", press Ctrl+C to stop");
+
+    for (;;)
+    {
+        int written = merge_rings(readers, started, &output);
+
+        if (dsu)
+            dsu_server_poll();
+
+        if (written < 0)
+            break;
+        if (written > 0)
+            total += (uint64_t)written;
+        else
+            sleep_ms(1);
+
+        if (stop_requested || (duration_s > 0 && latency_now_ns() - origin_ns >= (uint64_t)(duration_s * 1e9)))
+            atomic_store(&stopping, 1);
+    }
+
+    for (int i = 0; i < started; i++)
+    {
+        if (readers[i].running)
+            thread_join(readers[i].thread);
+    }
+    if (uring.running)
+        thread_join(uring.thread);
+    uring_reader_destroy(uring.ring);
+
+    if (out && out != stdout)
+        fclose(out);
+    else if (out)
+        fflush(out);
+    dsu_server_stop();
+    uinput_bridge_stop();
+    state_shm_stop();
+
+    double elapsed_s = (double)(latency_now_ns() - origin_ns) / 1e9;
+    printf("\n%s%s=== Stream Summary ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
+    for (int i = 0; i < started; i++)
+    {
+        stream_reader_t *reader = &readers[i];
+
+        printf("%s  [%d] %-26s %10llu reports %8.1f Hz %6llu dropped%s%s\n", COLOR_WHITE, i,
+               get_controller_name(reader->controller->product_id), (unsigned long long)reader->reports,
+               elapsed_s > 0 ? reader->reports / elapsed_s : 0.0, (unsigned long long)reader->dropped,
+               reader->error ? "  (read error)" : "", COLOR_RESET);
+        if (reader->crc_errors)
+        {
+            printf("%s      %llu Bluetooth reports dropped for a bad CRC%s\n", COLOR_WHITE,
+                   (unsigned long long)reader->crc_errors, COLOR_RESET);
+        }
+
+        hid_io_close(reader->dev);
+        report_ring_free(&reader->ring);
+        decoded_reports_free(&reader->bridge);
+        imu_samples_free(&reader->published);
+        free_controller_info(reader->controller);
+    }
+    printf("%s[INFO]%s %llu reports written in timestamp order over %.1f s\n", COLOR_BLUE, COLOR_RESET,
+           (unsigned long long)total, elapsed_s);
+    if (recorder)
+    {
+        recording_stats_t stats;
+
+        if (recording_writer_close(recorder, &stats))
+        {
+            printf("%s[INFO]%s Recorded %llu reports in %llu chunk(s) to %s: %.1f bytes per report, "
+                   "%.1fx smaller than a capture\n", COLOR_BLUE, COLOR_RESET, (unsigned long long)stats.reports,
+                   (unsigned long long)stats.chunks, record_path,
+                   stats.reports ? (double)stats.bytes / (double)stats.reports : 0.0,
+                   stats.bytes ? (double)stats.capture_bytes / (double)stats.bytes : 0.0);
+        }
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Failed to write the recording %s\n", COLOR_RED, COLOR_RESET, record_path);
+        }
+        if (stats.dropped)
+        {
+            printf("%s[INFO]%s %llu reports dropped from the recording: its writer fell behind\n", COLOR_BLUE,
+                   COLOR_RESET, (unsigned long long)stats.dropped);
+        }
+    }
+    if (uring.batches > 0)
+    {
+        printf("%s[INFO]%s %llu io_uring batches, %.2f reports per batch\n", COLOR_BLUE, COLOR_RESET,
+               (unsigned long long)uring.batches, (double)uring.harvested / (double)uring.batches);
+    }
+    if (orient && fusion.updates > 0)
+    {
+        printf("%s[INFO]%s %llu filter updates of %d lanes: mean %.2f us, max %.2f us\n", COLOR_BLUE, COLOR_RESET,
+               (unsigned long long)fusion.updates, fusion.filter.lanes,
+               (double)fusion.update_ns / (double)fusion.updates / 1000.0, (double)fusion.max_update_ns / 1000.0);
+    }
+
+    free(readers);
+    decoded_reports_free(&decoded);
+    imu_samples_free(&samples);
+    orientation_filter_free(&fusion.filter);
+    return 0;
+}
@@ -0,0 +1,55 @@
+/**
+ * input_stream.h - High-rate input report streaming
+ *
+ * Reads input reports from every connected controller on dedicated reader
+ * threads, or on one io_uring thread, and writes them out merged in
+ * timestamp order
+ */
+
+#ifndef INPUT_STREAM_H
+#define INPUT_STREAM_H
+
+/* Slots per controller ring (about 16 seconds of DS4 reports at 250 Hz) */
+#define STREAM_RING_SLOTS 4096
+
+/* Read timeout; bounds how far the merged output lags behind an idle controller */
+#define STREAM_READ_TIMEOUT_MS 20
+
+/**
+ * Streams input reports until interrupted or the duration elapses
+ *
+ * Usage: stream [--duration <seconds>] [--output <file>] [--decoded] [--calibrated]
+ *               [--orientation [--beta <gain>]] [--dsu | --dsu-bind <address>[:<port>]] [--uinput]
+ *               [--io-uring] [--shm | --shm-name <name>] [--record <file>]
+ *
+ * Each output line is "timestamp_us,controller,length,hex bytes", with
+ * timestamps relative to the start of the stream. With --decoded the raw
+ * bytes are replaced by the fields of report_decoder.h: "timestamp_us,
+ * controller,buttons,lx,ly,rx,ry,l2,r2,ax,ay,az,gx,gy,gz,touch,tx,ty,battery".
+ * --calibrated implies --decoded and writes the IMU axes in g and degrees
+ * per second using imu_calibration.h. --orientation implies --calibrated and
+ * writes "timestamp_us,controller,qw,qx,qy,qz" per report from the batched
+ * filter in orientation_filter.h; only DualShock 4 controllers are fused,
+ * since the SixAxis and Move gyros lack a calibrated 3-axis rate. The filter
+ * also runs when no CSV is written. --dsu serves every report to DSU clients
+ * (dsu_server.h) with the first four controllers as slots 0-3; CSV is then
+ * only written with --output. --uinput mirrors every controller as a virtual
+ * gamepad (uinput_bridge.h): each reader thread decodes its own reports into
+ * a private one-report batch right after publishing them to the ring, so
+ * --uinput decodes even without --decoded, while the CSV output keeps the
+ * format selected by the other options. --io-uring reads every hidraw
+ * device on a single thread through uring_reader.h; where io_uring is not
+ * available, or while capturing or replaying, the reader threads are used.
+ * --shm publishes the latest decoded and calibrated state of every
+ * controller in the shared-memory segment of state_shm.h (named by
+ * --shm-name); like --uinput it is fed from the reading thread. --record
+ * also queues every merged report for the background writer of
+ * recording.h, which compresses it into a chunked recording.
+ *
+ * @param argc Number of arguments after the "stream" command
+ * @param argv Arguments after the "stream" command
+ * @return 0 on success, 1 on failure
+ */
+int stream_command(int argc, char **argv);
+
+#endif /* INPUT_STREAM_H */
@@ -0,0 +1,311 @@
+/**
+ * latency_stats.c - Latency instrumentation for HID operations
+ *
+ * Implementation of the per-thread latency histograms. Each thread records
+ * into its own shard so the hot path never contends on shared cache lines;
+ * shards are only summed when the statistics are read.
+ */
+
+#include "latency_stats.h"
+#include "controller_info.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifdef PLATFORM_WINDOWS
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+/**
+ * Histogram cell owned by a single writer thread
+ */
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[LATENCY_BUCKETS];
+} latency_cell_t;
+
+/**
+ * Per-thread set of histograms, linked into a global list on first use
+ */
+typedef struct latency_shard {
+    latency_cell_t cells[LATENCY_OP_COUNT][LATENCY_PRODUCT_SLOTS];
+    struct latency_shard *next;
+} latency_shard_t;
+
+int latency_stats_enabled = 0;
+
+static _Atomic(latency_shard_t *) shard_list = NULL;
+static THREAD_LOCAL latency_shard_t *thread_shard = NULL;
+
+static const char *OP_NAMES[LATENCY_OP_COUNT] = {
+    "hid_enumerate",
+    "hid_open_path",
+    "hid_open",
+    "hid_get_feature_report",
+    "hid_send_feature_report",
+    "hid_read_timeout",
+    "hid_write",
+    "hid_get_report_descriptor",
+    "uinput_write"
+};
+
+/**
+ * Reads a monotonic clock
+ */
+uint64_t latency_now_ns(void)
+{
+#ifdef PLATFORM_WINDOWS
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Gets the printable name of an instrumented operation
+ */
+const char* latency_op_name(latency_op_t op)
+{
+    if (op < 0 || op >= LATENCY_OP_COUNT)
+        return "unknown";
+    return OP_NAMES[op];
+}
+
+/**
+ * Maps a product ID to its histogram slot
+ */
+int latency_product_slot(unsigned short product_id)
+{
+    int index = get_product_index(product_id);
+
+    if (index < 0 || index + 1 >= LATENCY_PRODUCT_SLOTS)
+        return 0;
+    return index + 1;
+}
+
+/**
+ * Gets the position of the most significant set bit
+ */
+static int highest_bit(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+/**
+ * Maps a duration to its histogram bucket
+ */
+static int bucket_for(uint64_t elapsed_ns)
+{
+    if (elapsed_ns < (1ull << LATENCY_MIN_SHIFT))
+        return 0;
+
+    int msb = highest_bit(elapsed_ns);
+    int sub = (int)((elapsed_ns >> (msb - 2)) & (LATENCY_SUB_BUCKETS - 1));
+    int bucket = 1 + (msb - LATENCY_MIN_SHIFT) * LATENCY_SUB_BUCKETS + sub;
+
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/**
+ * Gets the upper bound of a histogram bucket
+ */
+uint64_t latency_bucket_upper_ns(int bucket)
+{
+    if (bucket <= 0)
+        return (1ull << LATENCY_MIN_SHIFT) - 1;
+
+    int msb = (bucket - 1) / LATENCY_SUB_BUCKETS + LATENCY_MIN_SHIFT;
+    int sub = (bucket - 1) % LATENCY_SUB_BUCKETS;
+
+    return ((uint64_t)(LATENCY_SUB_BUCKETS + sub + 1) << (msb - 2)) - 1;
+}
+
+/**
+ * Gets the calling thread's shard, creating and publishing it on first use
+ */
+static latency_shard_t* get_thread_shard(void)
+{
+    if (thread_shard)
+        return thread_shard;
+
+    latency_shard_t *shard = (latency_shard_t*)calloc(1, sizeof(latency_shard_t));
+    if (!shard)
+        return NULL;
+
+    /* Lock-free push onto the global shard list; shards live until exit */
+    shard->next = atomic_load_explicit(&shard_list, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&shard_list, &shard->next, shard,
+                                                  memory_order_release, memory_order_relaxed))
+        ;
+
+    thread_shard = shard;
+    return shard;
+}
+
+/**
+ * Adds to a counter that only the calling thread writes
+ */
+static void cell_add(_Atomic uint64_t *counter, uint64_t value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+/**
+ * Records one sample into the calling thread's histograms
+ */
+void latency_stats_record(latency_op_t op, unsigned short product_id, uint64_t elapsed_ns)
+{
+    latency_shard_t *shard;
+    latency_cell_t *cell;
+
+    if (!latency_stats_enabled || op < 0 || op >= LATENCY_OP_COUNT)
+        return;
+
+    shard = get_thread_shard();
+    if (!shard)
+        return;
+
+    cell = &shard->cells[op][latency_product_slot(product_id)];
+    cell_add(&cell->count, 1);
+    cell_add(&cell->sum_ns, elapsed_ns);
+    cell_add(&cell->buckets[bucket_for(elapsed_ns)], 1);
+    if (elapsed_ns > atomic_load_explicit(&cell->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&cell->max_ns, elapsed_ns, memory_order_relaxed);
+}
+
+/**
+ * Merges the histograms of all threads for one operation and product slot
+ */
+void latency_stats_collect(latency_op_t op, int product_slot, latency_histogram_t *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    if (op < 0 || op >= LATENCY_OP_COUNT || product_slot < 0 || product_slot >= LATENCY_PRODUCT_SLOTS)
+        return;
+
+    for (latency_shard_t *shard = atomic_load_explicit(&shard_list, memory_order_acquire);
+         shard; shard = shard->next)
+    {
+        latency_cell_t *cell = &shard->cells[op][product_slot];
+        uint64_t max_ns = atomic_load_explicit(&cell->max_ns, memory_order_relaxed);
+
+        out->count += atomic_load_explicit(&cell->count, memory_order_relaxed);
+        out->sum_ns += atomic_load_explicit(&cell->sum_ns, memory_order_relaxed);
+        if (max_ns > out->max_ns)
+            out->max_ns = max_ns;
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+            out->buckets[b] += atomic_load_explicit(&cell->buckets[b], memory_order_relaxed);
+    }
+}
+
+/**
+ * Estimates a percentile from a histogram
+ */
+uint64_t latency_histogram_percentile(const latency_histogram_t *hist, double percentile)
+{
+    uint64_t rank, seen = 0;
+
+    if (hist->count == 0)
+        return 0;
+
+    /* Rank of the sample we are looking for (1-based, rounded up) */
+    rank = (uint64_t)((percentile / 100.0) * (double)hist->count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += hist->buckets[b];
+        if (seen >= rank)
+        {
+            uint64_t upper = latency_bucket_upper_ns(b);
+            return upper < hist->max_ns ? upper : hist->max_ns;
+        }
+    }
+
+    return hist->max_ns;
+}
+
+/**
+ * Formats a duration with a unit that keeps it readable
+ */
+static void format_duration(uint64_t ns, char *out, size_t out_len)
+{
+    if (ns < 10000ull)
+        snprintf(out, out_len, "%lluns", (unsigned long long)ns);
+    else if (ns < 10000000ull)
+        snprintf(out, out_len, "%.1fus", ns / 1e3);
+    else if (ns < 10000000000ull)
+        snprintf(out, out_len, "%.1fms", ns / 1e6);
+    else
+        snprintf(out, out_len, "%.2fs", ns / 1e9);
+}
+
+/**
+ * Prints count, p50, p99 and max for every operation and product with samples
+ */
+void latency_stats_print(void)
+{
+    latency_histogram_t hist;
+    char p50[24], p99[24], max[24];
+
+    if (!latency_stats_enabled)
+        return;
+
+    printf("\n%s%s=== HID Latency Statistics ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
+
+    for (int op = 0; op < LATENCY_OP_COUNT; op++)
+    {
+        int printed_header = 0;
+
+        for (int slot = 0; slot < LATENCY_PRODUCT_SLOTS; slot++)
+        {
+            latency_stats_collect((latency_op_t)op, slot, &hist);
+            if (hist.count == 0)
+                continue;
+
+            if (!printed_header)
+            {
+                printf("%s%s┌─ %s%s\n", COLOR_BOLD, COLOR_MAGENTA, latency_op_name((latency_op_t)op), COLOR_RESET);
+                printf("%s│  %-26s %8s %10s %10s %10s%s\n", COLOR_MAGENTA,
+                       "Product", "Count", "p50", "p99", "Max", COLOR_RESET);
+                printed_header = 1;
+            }
+
+            format_duration(latency_histogram_percentile(&hist, 50.0), p50, sizeof(p50));
+            format_duration(latency_histogram_percentile(&hist, 99.0), p99, sizeof(p99));
+            format_duration(hist.max_ns, max, sizeof(max));
+
+            printf("%s│  %-26s %8llu %10s %10s %10s%s\n", COLOR_MAGENTA,
+                   slot == 0 ? "(any)" : get_controller_name(get_supported_product(slot - 1)),
+                   (unsigned long long)hist.count, p50, p99, max, COLOR_RESET);
+        }
+
+        if (printed_header)
+        {
+            printf("%s└───────────────────────────────────────────────%s\n", COLOR_MAGENTA, COLOR_RESET);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/**
+ * latency_stats.h - Latency instrumentation for HID operations
+ *
+ * Records the duration of HID operations into log-bucketed histograms,
+ * one per operation and per product, and reports percentiles on request
+ */
+
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdint.h>
+
+/* Histogram layout: bucket 0 holds everything below 2^LATENCY_MIN_SHIFT ns,
+ * then LATENCY_SUB_BUCKETS buckets per power of two up to 2^(MIN+OCTAVES) ns */
+#define LATENCY_MIN_SHIFT   10
+#define LATENCY_OCTAVES     32
+#define LATENCY_SUB_BUCKETS 4
+#define LATENCY_BUCKETS     (1 + LATENCY_OCTAVES * LATENCY_SUB_BUCKETS)
+
+/* Product slot 0 collects samples that cannot be attributed to a product,
+ * slot i + 1 belongs to entry i of the supported product table */
+#define LATENCY_PRODUCT_SLOTS 8
+
+/**
+ * Instrumented HID operations
+ */
+typedef enum {
+    LATENCY_OP_ENUMERATE,       /* hid_enumerate() */
+    LATENCY_OP_OPEN_PATH,       /* hid_open_path() */
+    LATENCY_OP_OPEN,            /* hid_open() */
+    LATENCY_OP_GET_FEATURE,     /* hid_get_feature_report() */
+    LATENCY_OP_SEND_FEATURE,    /* hid_send_feature_report() */
+    LATENCY_OP_READ,            /* hid_read_timeout() */
+    LATENCY_OP_WRITE,           /* hid_write() */
+    LATENCY_OP_DESCRIPTOR,      /* hid_get_report_descriptor() */
+    LATENCY_OP_UINPUT,          /* Input report read to uinput event write (not a HID call) */
+    LATENCY_OP_COUNT
+} latency_op_t;
+
+/* Operations below this one are HID calls */
+#define LATENCY_HID_OP_COUNT LATENCY_OP_UINPUT
+
+/**
+ * Aggregated histogram for one operation and product
+ */
+typedef struct {
+    uint64_t count;                     /* Number of samples */
+    uint64_t sum_ns;                    /* Sum of all samples */
+    uint64_t max_ns;                    /* Largest sample */
+    uint64_t buckets[LATENCY_BUCKETS];  /* Sample count per bucket */
+} latency_histogram_t;
+
+/* Non-zero when samples should be recorded (set once at startup) */
+extern int latency_stats_enabled;
+
+/**
+ * Reads a monotonic clock
+ *
+ * @return Current time in nanoseconds from an arbitrary origin
+ */
+uint64_t latency_now_ns(void);
+
+/**
+ * Gets the printable name of an instrumented operation
+ *
+ * @param op The operation
+ * @return The operation name
+ */
+const char* latency_op_name(latency_op_t op);
+
+/**
+ * Maps a product ID to its histogram slot
+ *
+ * @param product_id The product ID, or 0 if unknown
+ * @return Product slot in the range [0, LATENCY_PRODUCT_SLOTS)
+ */
+int latency_product_slot(unsigned short product_id);
+
+/**
+ * Records one sample into the calling thread's histograms
+ *
+ * @param op The operation that was timed
+ * @param product_id The product ID of the device, or 0 if unknown
+ * @param elapsed_ns Duration of the operation in nanoseconds
+ */
+void latency_stats_record(latency_op_t op, unsigned short product_id, uint64_t elapsed_ns);
+
+/**
+ * Merges the histograms of all threads for one operation and product slot
+ *
+ * @param op The operation
+ * @param product_slot The product slot, see latency_product_slot()
+ * @param out Histogram to fill
+ */
+void latency_stats_collect(latency_op_t op, int product_slot, latency_histogram_t *out);
+
+/**
+ * Gets the upper bound of a histogram bucket
+ *
+ * @param bucket The bucket index
+ * @return Largest duration in nanoseconds that falls into the bucket
+ */
+uint64_t latency_bucket_upper_ns(int bucket);
+
+/**
+ * Estimates a percentile from a histogram
+ *
+ * @param hist The histogram
+ * @param percentile The percentile to compute (0-100)
+ * @return Upper bound of the bucket holding the percentile, capped at the maximum
+ */
+uint64_t latency_histogram_percentile(const latency_histogram_t *hist, double percentile);
+
+/**
+ * Prints count, p50, p99 and max for every operation and product with samples
+ */
+void latency_stats_print(void);
+
+#endif /* LATENCY_STATS_H */
@@ -0,0 +1,462 @@
+/**
+ * led_identify.c - Lightbar, player LED and rumble output reports
+ *
+ * Implementation of the output report templates and of identify mode. The
+ * templates are built once per family and transport before any controller
+ * is opened; every worker copies its template, fills in its own lights and
+ * writes it, so the whole bench is marked in the time of the slowest open.
+ * A Bluetooth report is the USB one shifted by two bytes behind its header,
+ * so the same field offsets serve both.
+ */
+
+#include "led_identify.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "hid_io.h"
+#include "flight_recorder.h"
+#include "latency_stats.h"
+#include "mac_utils.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Families with a template, in table order */
+static const unsigned short TEMPLATE_PRODUCTS[] = { PRODUCT_DS4, PRODUCT_DUALSENSE, PRODUCT_SIXAXIS, PRODUCT_MOVE };
+#define TEMPLATE_FAMILIES (sizeof(TEMPLATE_PRODUCTS) / sizeof(TEMPLATE_PRODUCTS[0]))
+
+/* A SixAxis player LED lit steadily: on time, duty length, enabled, duty off, duty on */
+static const unsigned char SIXAXIS_LED_STEADY[5] = { 0xff, 0x27, 0x10, 0x00, 0x32 };
+
+/**
+ * A slot colour
+ */
+typedef struct {
+    const char *name;
+    unsigned char red, green, blue;
+} slot_color_t;
+
+static const slot_color_t SLOT_COLORS[] = {
+    { "blue", 0, 0, 255 },
+    { "yellow", 255, 200, 0 },
+    { "magenta", 255, 0, 255 },
+    { "cyan", 0, 255, 255 },
+    { "white", 255, 255, 255 },
+    { "orange", 255, 80, 0 },
+    { "purple", 120, 0, 255 },
+    { "pink", 255, 100, 150 }
+};
+#define SLOT_COLOR_COUNT (sizeof(SLOT_COLORS) / sizeof(SLOT_COLORS[0]))
+
+/* Result colours */
+static const led_state_t STATE_PAIRED = { 0, 255, 0, 0x01, -1 };
+static const led_state_t STATE_NOT_PAIRED = { 255, 0, 0, 0x0f, -1 };
+
+/**
+ * Builds the template output report of a controller family
+ */
+int led_report_template(led_report_t *report, unsigned short product_id, int bluetooth)
+{
+    unsigned char usb[LED_REPORT_MAX];
+
+    memset(report, 0, sizeof(*report));
+    memset(usb, 0, sizeof(usb));
+    report->product_id = product_id;
+
+    switch (product_id)
+    {
+    case PRODUCT_DS4:
+        usb[0] = DS4_OUTPUT_REPORT_ID;
+        report->length = DS4_OUTPUT_LENGTH;
+        break;
+    case PRODUCT_DUALSENSE:
+    case PRODUCT_DUALSENSE_EDGE:
+        usb[0] = DUALSENSE_OUTPUT_REPORT_ID;
+        report->length = DUALSENSE_OUTPUT_LENGTH;
+        break;
+    case PRODUCT_MOVE:
+        usb[0] = MOVE_OUTPUT_REPORT_ID;
+        report->length = MOVE_OUTPUT_LENGTH;
+        bluetooth = 0;
+        break;
+    case PRODUCT_SIXAXIS:
+        usb[0] = SIXAXIS_OUTPUT_REPORT_ID;
+        for (int i = 0; i < LED_PLAYER_COUNT; i++)
+            memcpy(usb + 11 + i * 5, SIXAXIS_LED_STEADY, sizeof(SIXAXIS_LED_STEADY));
+        report->length = SIXAXIS_OUTPUT_LENGTH;
+        bluetooth = 0;
+        break;
+    default:
+        return 0;
+    }
+
+    report->bluetooth = bluetooth != 0;
+    if (report->bluetooth)
+        report->length = bt_wrap_output(product_id, usb, report->length, report->data);
+    else
+        memcpy(report->data, usb, report->length);
+    return report->length != 0;
+}
+
+/**
+ * Fills lights and rumble into a copy of a template
+ */
+void led_report_apply(led_report_t *report, const led_state_t *state)
+{
+    /* Byte n of the USB report is byte n + 2 of the Bluetooth one */
+    unsigned char *usb = report->data + (report->bluetooth ? 2 : 0);
+    unsigned char rumble = state->rumble > 0 ? (unsigned char)state->rumble : 0;
+
+    switch (report->product_id)
+    {
+    case PRODUCT_DS4:
+        /* Valid fields: rumble when given, lightbar, and flash (off) */
+        usb[1] = (unsigned char)(0x06 | (state->rumble >= 0 ? 0x01 : 0));
+        usb[4] = rumble;
+        usb[5] = rumble;
+        usb[6] = state->red;
+        usb[7] = state->green;
+        usb[8] = state->blue;
+        break;
+    case PRODUCT_DUALSENSE:
+    case PRODUCT_DUALSENSE_EDGE:
+        /* Rumble in compatible mode when given; lightbar; player LEDs when given */
+        usb[1] = state->rumble >= 0 ? 0x03 : 0x00;
+        usb[2] = (unsigned char)(0x04 | (state->player >= 0 ? 0x10 : 0));
+        usb[3] = rumble;
+        usb[4] = rumble;
+        usb[44] = state->player > 0 ? (unsigned char)(state->player & 0x1f) : 0;
+        usb[45] = state->red;
+        usb[46] = state->green;
+        usb[47] = state->blue;
+        break;
+    case PRODUCT_MOVE:
+        usb[2] = state->red;
+        usb[3] = state->green;
+        usb[4] = state->blue;
+        usb[6] = rumble;
+        break;
+    case PRODUCT_SIXAXIS:
+        /* Right motor on or off, left motor strength, both until the next report */
+        usb[2] = rumble ? 0xff : 0;
+        usb[3] = rumble ? 1 : 0;
+        usb[4] = rumble ? 0xff : 0;
+        usb[5] = rumble;
+        usb[10] = state->player > 0 ? (unsigned char)((state->player & 0x0f) << 1) : 0;
+        break;
+    default:
+        return;
+    }
+
+    if (report->bluetooth)
+        bt_report_seal(BT_SEED_OUTPUT, report->data, report->length);
+}
+
+/**
+ * Gets the player LEDs showing a slot number
+ */
+int led_slot_pattern(int slot)
+{
+    static const unsigned char PATTERNS[10] = { 0x01, 0x02, 0x04, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x0e, 0x0f };
+
+    return PATTERNS[(slot - 1) % 10];
+}
+
+/**
+ * Gets the colour marking a slot
+ */
+const char* led_slot_color(int slot, led_state_t *state)
+{
+    const slot_color_t *color = &SLOT_COLORS[(size_t)(slot - 1) % SLOT_COLOR_COUNT];
+
+    state->red = color->red;
+    state->green = color->green;
+    state->blue = color->blue;
+    return color->name;
+}
+
+/**
+ * What identify mode does
+ */
+typedef struct {
+    int check_host;
+    unsigned char host_mac[6];
+    int rumble_ms;
+    int off;
+    led_report_t templates[TEMPLATE_FAMILIES][2];   /* By family and Bluetooth */
+    int have_template[TEMPLATE_FAMILIES][2];
+} identify_options_t;
+
+/**
+ * One controller and how it was marked
+ */
+typedef struct {
+    const identify_options_t *options;
+    controller_info_t *controller;
+    int slot;
+    led_state_t state;
+    const char *mark;                   /* Colour name */
+    int opened;
+    int pairing;                        /* 1 paired with the host, 0 not, -1 unreadable */
+    int sent;                           /* 1 written, 0 failed, -1 the controller takes no report */
+    uint64_t elapsed_us;
+    thread_t thread;
+    int running;
+} identify_worker_t;
+
+/**
+ * Finds the template row of a controller
+ *
+ * @return The row, or -1 for a controller without a template
+ */
+static int template_family(unsigned short product_id)
+{
+    if (product_id == PRODUCT_DUALSENSE_EDGE)
+        product_id = PRODUCT_DUALSENSE;
+    for (size_t i = 0; i < TEMPLATE_FAMILIES; i++)
+    {
+        if (TEMPLATE_PRODUCTS[i] == product_id)
+            return (int)i;
+    }
+    return -1;
+}
+
+/**
+ * Copies a template, fills in a state and writes it
+ */
+static int send_state(hid_device *dev, const led_report_t *template_report, unsigned short product_id,
+                      const led_state_t *state)
+{
+    led_report_t report = *template_report;
+
+    report.product_id = product_id;
+    led_report_apply(&report, state);
+    return hid_io_write(dev, report.data, report.length) >= 0;
+}
+
+/**
+ * Worker thread: opens one controller, works out its mark and sends it
+ */
+static void worker_main(void *arg)
+{
+    identify_worker_t *worker = (identify_worker_t*)arg;
+    const identify_options_t *options = worker->options;
+    unsigned short product_id = worker->controller->product_id;
+    int family = template_family(product_id);
+    uint64_t start = latency_now_ns();
+    const led_report_t *template_report;
+    hid_device *dev;
+    unsigned char mac[6];
+
+    worker->pairing = -1;
+    worker->sent = -1;
+    dev = connect_to_controller(worker->controller);
+    worker->opened = dev != NULL;
+    if (!dev || family < 0)
+    {
+        hid_io_close(dev);
+        return;
+    }
+
+    if (options->check_host)
+    {
+        if (read_pairing(dev, mac))
+            worker->pairing = memcmp(mac, options->host_mac, 6) == 0;
+        worker->state = worker->pairing == 1 ? STATE_PAIRED : STATE_NOT_PAIRED;
+        worker->mark = worker->pairing == 1 ? "green" : "red";
+        if (worker->pairing != 1 && options->rumble_ms > 0)
+            worker->state.rumble = 255;
+    }
+
+    template_report = &options->templates[family][options->have_template[family][1] && is_bluetooth_device(dev)];
+    worker->sent = send_state(dev, template_report, product_id, &worker->state);
+    if (worker->sent && worker->state.rumble > 0)
+    {
+        led_state_t still = worker->state;
+
+        sleep_ms(options->rumble_ms);
+        still.rumble = 0;
+        worker->sent = send_state(dev, template_report, product_id, &still);
+    }
+    if (!worker->sent)
+        flight_recorder_dump(dev, "identify output report failed");
+
+    hid_io_close(dev);
+    worker->elapsed_us = (latency_now_ns() - start) / 1000ull;
+}
+
+/**
+ * Describes player LEDs such as "LEDs 1+4"
+ */
+static void describe_player(int player, char *out, size_t out_len)
+{
+    size_t used = (size_t)snprintf(out, out_len, "LED%s", (player & (player - 1)) ? "s" : "");
+    const char *separator = " ";
+
+    for (int i = 0; i < LED_PLAYER_COUNT && used < out_len; i++)
+    {
+        if (!(player & (1 << i)))
+            continue;
+        used += (size_t)snprintf(out + used, out_len - used, "%s%d", separator, i + 1);
+        separator = "+";
+    }
+}
+
+/**
+ * Prints how one controller was marked
+ */
+static void print_worker(const identify_worker_t *worker)
+{
+    const identify_options_t *options = worker->options;
+    unsigned short product_id = worker->controller->product_id;
+    char player[24] = "";
+
+    printf("%s  [%d] %-26s %-14s ", COLOR_WHITE, worker->slot, get_controller_name(product_id),
+           worker->controller->path);
+    if (!worker->opened)
+    {
+        printf("%scould not open the controller%s\n", COLOR_RED, COLOR_RESET);
+        return;
+    }
+    if (worker->sent < 0)
+    {
+        printf("%sno lights%s\n", COLOR_YELLOW, COLOR_RESET);
+        return;
+    }
+
+    if (options->check_host)
+        printf("%s%-16s%s ", worker->pairing == 1 ? COLOR_GREEN : COLOR_RED,
+               worker->pairing == 1 ? "paired" : worker->pairing == 0 ? "NOT paired" : "pairing unread",
+               COLOR_RESET);
+    if (options->off)
+        printf("off");
+    else if (product_id == PRODUCT_SIXAXIS)
+    {
+        describe_player(worker->state.player, player, sizeof(player));
+        printf("%s", player);
+    }
+    else
+        printf("%s", worker->mark);
+    if (worker->state.rumble > 0)
+        printf(", rumble");
+    if (!worker->sent)
+        printf(" %s(write failed)%s", COLOR_RED, COLOR_RESET);
+    printf(" %.1fms\n", worker->elapsed_us / 1000.0);
+}
+
+/**
+ * Marks every connected controller with its lights, in parallel
+ */
+int identify_command(int argc, char **argv)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    identify_options_t options;
+    identify_worker_t *workers;
+    uint64_t start;
+    int controller_count, failed = 0, marked = 0;
+
+    memset(&options, 0, sizeof(options));
+    for (int i = 0; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--host") == 0)
+        {
+            size_t length = strlen(argv[++i]);
+
+            if ((length != 12 && length != 17) || !mac_to_bytes(argv[i], length, options.host_mac, 6))
+            {
+                fprintf(stderr, "%s[ERROR]%s --host requires a MAC address\n", COLOR_RED, COLOR_RESET);
+                return 1;
+            }
+            options.check_host = 1;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--rumble") == 0)
+        {
+            options.rumble_ms = atoi(argv[++i]);
+            if (options.rumble_ms <= 0 || options.rumble_ms > 5000)
+            {
+                fprintf(stderr, "%s[ERROR]%s --rumble takes 1 to 5000 ms\n", COLOR_RED, COLOR_RESET);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--off") == 0)
+            options.off = 1;
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown identify option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+    if (options.off && (options.check_host || options.rumble_ms))
+    {
+        fprintf(stderr, "%s[ERROR]%s --off cannot be combined with --host or --rumble\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    if (options.rumble_ms && !options.check_host)
+    {
+        fprintf(stderr, "%s[ERROR]%s --rumble marks controllers not paired with --host\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    /* One template per family and transport, before any controller is opened */
+    for (size_t f = 0; f < TEMPLATE_FAMILIES; f++)
+    {
+        for (int bt = 0; bt < 2; bt++)
+        {
+            led_report_t *report = &options.templates[f][bt];
+
+            options.have_template[f][bt] = led_report_template(report, TEMPLATE_PRODUCTS[f], bt) &&
+                                           report->bluetooth == bt;
+        }
+    }
+
+    controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+    if (controller_count == 0)
+    {
+        printf("%s[ERROR]%s No supported PlayStation controllers found\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    workers = (identify_worker_t*)calloc((size_t)controller_count, sizeof(identify_worker_t));
+    if (!workers)
+    {
+        for (int i = 0; i < controller_count; i++)
+            free_controller_info(controllers[i]);
+        return 1;
+    }
+
+    start = latency_now_ns();
+    for (int i = 0; i < controller_count; i++)
+    {
+        identify_worker_t *worker = &workers[i];
+
+        worker->options = &options;
+        worker->controller = controllers[i];
+        worker->slot = i + 1;
+        worker->state.player = options.off ? 0 : led_slot_pattern(worker->slot);
+        worker->state.rumble = -1;
+        worker->mark = options.off ? "off" : led_slot_color(worker->slot, &worker->state);
+        worker->running = thread_create(&worker->thread, worker_main, worker);
+        if (!worker->running)
+            worker_main(worker);
+    }
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (workers[i].running)
+            thread_join(workers[i].thread);
+    }
+
+    printf("\n%s%s=== Identify ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (!workers[i].opened || workers[i].sent == 0 || (options.check_host && workers[i].pairing != 1))
+            failed++;
+        marked += workers[i].sent == 1;
+        print_worker(&workers[i]);
+        free_controller_info(workers[i].controller);
+    }
+    printf("%s[INFO]%s Marked %d of %d controller(s) in %.1fms%s\n", COLOR_BLUE, COLOR_RESET, marked,
+           controller_count, (latency_now_ns() - start) / 1e6, options.check_host && failed ? ", red ones are not paired" : "");
+
+    free(workers);
+    return failed ? 1 : 0;
+}
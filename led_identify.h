@@ -0,0 +1,111 @@
+/**
+ * led_identify.h - Lightbar, player LED and rumble output reports
+ *
+ * Builds the output reports that set a controller's lights and rumble:
+ * the lightbar of a DualShock 4 or DualSense, the sphere of a Move and the
+ * player LEDs of a SixAxis or DualSense. A report is made from a template
+ * per controller family and transport, so marking many controllers only
+ * patches a few bytes (and the CRC on Bluetooth) per controller. Identify
+ * mode uses them to mark every controller on a bench at once, by slot or
+ * by pairing result.
+ */
+
+#ifndef LED_IDENTIFY_H
+#define LED_IDENTIFY_H
+
+#include "bt_transport.h"
+#include <stddef.h>
+
+/* Longest output report, the Bluetooth form */
+#define LED_REPORT_MAX BT_OUTPUT_LENGTH
+
+/* Player LEDs of a SixAxis; a DualSense has a fifth */
+#define LED_PLAYER_COUNT 4
+
+/**
+ * Lights and rumble to set
+ */
+typedef struct {
+    unsigned char red;
+    unsigned char green;
+    unsigned char blue;
+    int player;                 /* Player LEDs, LED 1 in bit 0; -1 leaves them as they are */
+    int rumble;                 /* Motor strength 0-255; -1 leaves the motors as they are */
+} led_state_t;
+
+/**
+ * An output report ready to write
+ */
+typedef struct {
+    unsigned short product_id;
+    int bluetooth;
+    size_t length;
+    unsigned char data[LED_REPORT_MAX];
+} led_report_t;
+
+/**
+ * Builds the template output report of a controller family
+ *
+ * The template sets nothing until led_report_apply() fills it in. Only the
+ * DualShock 4 and DualSense have a Bluetooth form; the others ignore
+ * bluetooth.
+ *
+ * @param report Receives the template
+ * @param product_id Product ID of the controller
+ * @param bluetooth Nonzero for the Bluetooth form
+ * @return 1 on success, 0 if the controller takes no such report
+ */
+int led_report_template(led_report_t *report, unsigned short product_id, int bluetooth);
+
+/**
+ * Fills lights and rumble into a copy of a template
+ *
+ * Fields a controller does not have are ignored: colour on a SixAxis,
+ * player LEDs on a DualShock 4 or Move. The Bluetooth CRC is updated.
+ *
+ * @param report The report, made by led_report_template()
+ * @param state Lights and rumble
+ */
+void led_report_apply(led_report_t *report, const led_state_t *state);
+
+/**
+ * Gets the player LEDs showing a slot number
+ *
+ * Slots 1 to 4 light one LED; 5 to 10 add LEDs to LED 4 the way a PS3
+ * numbers players 5 to 10, and higher slots count from 1 again.
+ *
+ * @param slot Slot number, from 1
+ * @return Player LEDs, LED 1 in bit 0
+ */
+int led_slot_pattern(int slot);
+
+/**
+ * Gets the colour marking a slot, cycling through colours easy to tell apart
+ *
+ * Red and green are left out, for marking results.
+ *
+ * @param slot Slot number, from 1
+ * @param state Receives the colour; other fields are left alone
+ * @return Name of the colour
+ */
+const char* led_slot_color(int slot, led_state_t *state);
+
+/**
+ * Marks every connected controller with its lights, in parallel
+ *
+ * Usage: identify [--host <mac>] [--rumble <ms>] [--off]
+ *
+ * By default each controller shows its slot in the printed list: a colour
+ * on the lightbar or sphere and the slot number on the player LEDs. With
+ * --host each shows its pairing instead: green with LED 1 if paired with
+ * the host, red with every LED if not, with a rumble of the given length
+ * for --rumble. --off turns the lights off.
+ *
+ * @param argc Number of arguments after the "identify" command
+ * @param argv Arguments after the "identify" command
+ * @return 0 if every controller was marked (and, with --host, is paired
+ *         with it), 1 otherwise
+ */
+int identify_command(int argc, char **argv);
+
+#endif /* LED_IDENTIFY_H */
@@ -0,0 +1,366 @@
+/**
+ * link_key_pairing.c - USB pairing with a link key for DualShock 4 and DualSense
+ *
+ * Implementation of the layout table, the link key transaction and of the BlueZ storage
+ * entry. The entry is written to a temporary file and renamed into place,
+ * so bluetoothd never reads a partial key.
+ */
+
+#ifdef _WIN32
+    #define _CRT_RAND_S
+#endif
+
+#include "link_key_pairing.h"
+#include "controller_info.h"
+#include "bt_transport.h"
+#include "hid_io.h"
+#include "trace_events.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PLATFORM_WINDOWS
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <errno.h>
+#endif
+
+/* Bluetooth class of device of every layout: peripheral, gamepad */
+#define GAMEPAD_CLASS_OF_DEVICE 0x002508
+
+/* HID service UUID announced by the controller */
+#define BLUEZ_HID_SERVICE "00001124-0000-1000-8000-00805f9b34fb"
+
+/* BlueZ link key type of an unauthenticated combination key */
+#define BLUEZ_LINK_KEY_TYPE 4
+
+static const link_key_layout_t LAYOUTS[] = {
+    { PRODUCT_DS4, "Wireless Controller", 0x12, 16, 0x13, 23, MAC_REPORT_ID },
+    { PRODUCT_DUALSENSE, "DualSense Wireless Controller", 0x09, 20, 0x0A, 27, 0 },
+    { PRODUCT_DUALSENSE_EDGE, "DualSense Edge Wireless Controller", 0x09, 20, 0x0A, 27, 0 }
+};
+
+static char storage_dir[512] = LINK_KEY_BLUEZ_DEFAULT_STORAGE;
+
+/**
+ * Gets the pairing reports of a product
+ */
+const link_key_layout_t* link_key_layout(unsigned short product_id)
+{
+    for (size_t i = 0; i < sizeof(LAYOUTS) / sizeof(LAYOUTS[0]); i++)
+    {
+        if (LAYOUTS[i].product_id == product_id)
+            return &LAYOUTS[i];
+    }
+    return NULL;
+}
+
+/**
+ * Gets the pairing reports of an open controller
+ */
+const link_key_layout_t* link_key_device_layout(hid_device *dev)
+{
+    struct hid_device_info *info = hid_io_get_device_info(dev);
+    return (info && info->vendor_id == VENDOR_SONY) ? link_key_layout(info->product_id) : NULL;
+}
+
+/**
+ * Sets the BlueZ storage directory
+ */
+void link_key_set_storage(const char *path)
+{
+    snprintf(storage_dir, sizeof(storage_dir), "%s", path && *path ? path : LINK_KEY_BLUEZ_DEFAULT_STORAGE);
+}
+
+/**
+ * Gets the BlueZ storage directory
+ */
+const char* link_key_storage(void)
+{
+    return storage_dir;
+}
+
+/**
+ * Generates a random link key from the operating system's CSPRNG
+ */
+int link_key_generate(unsigned char *key)
+{
+#ifdef PLATFORM_WINDOWS
+    for (int i = 0; i < LINK_KEY_LENGTH; i += 4)
+    {
+        unsigned int value;
+
+        if (rand_s(&value) != 0)
+            return 0;
+        memcpy(key + i, &value, 4);
+    }
+    return 1;
+#else
+    FILE *random = fopen("/dev/urandom", "rb");
+    size_t got;
+
+    if (!random)
+        return 0;
+    got = fread(key, 1, LINK_KEY_LENGTH, random);
+    fclose(random);
+    return got == LINK_KEY_LENGTH;
+#endif
+}
+
+/**
+ * Builds the link key set-report
+ */
+void link_key_build_report(const link_key_layout_t *layout, const unsigned char *host_mac,
+                           const unsigned char *key, unsigned char *report)
+{
+    memset(report, 0, layout->link_key_length);
+    report[0] = layout->link_key_report_id;
+    for (int i = 0; i < 6; i++)
+        report[1 + i] = host_mac[5 - i];
+    memcpy(report + LINK_KEY_KEY_OFFSET, key, LINK_KEY_LENGTH);
+}
+
+/**
+ * Parses the pairing get-report
+ */
+int link_key_parse_pairing(const link_key_layout_t *layout, const unsigned char *report, size_t length,
+                           unsigned char *device_mac, unsigned char *host_mac)
+{
+    if (length < layout->pairing_length || report[0] != layout->pairing_report_id)
+        return 0;
+    for (int i = 0; i < 6; i++)
+    {
+        device_mac[i] = report[LINK_KEY_DEVICE_OFFSET + 5 - i];
+        host_mac[i] = report[LINK_KEY_HOST_OFFSET + 5 - i];
+    }
+    return 1;
+}
+
+/**
+ * Reads the controller and host addresses in one get-report
+ */
+int link_key_read_pairing(hid_device *dev, const link_key_layout_t *layout, unsigned char *device_mac,
+                          unsigned char *host_mac)
+{
+    unsigned char report[LINK_KEY_MAX_PAIRING_LENGTH + BT_CRC_LENGTH];
+    int ret;
+
+    memset(report, 0, sizeof(report));
+    report[0] = layout->pairing_report_id;
+    if (is_bluetooth_device(dev))
+        ret = bt_get_feature_report(dev, report, layout->pairing_length + BT_CRC_LENGTH);
+    else
+        ret = hid_io_get_feature_report(dev, report, layout->pairing_length);
+    return ret > 0 && link_key_parse_pairing(layout, report, (size_t)ret, device_mac, host_mac);
+}
+
+/**
+ * Renders the BlueZ info file of a bonded controller
+ */
+size_t link_key_bluez_info(const link_key_layout_t *layout, const unsigned char *key, char *out, size_t out_len)
+{
+    char hex[2 * LINK_KEY_LENGTH + 1];
+    int length;
+
+    for (int i = 0; i < LINK_KEY_LENGTH; i++)
+        snprintf(hex + 2 * i, 3, "%02X", key[i]);
+
+    length = snprintf(out, out_len,
+                      "[General]\n"
+                      "Name=%s\n"
+                      "Class=0x%06X\n"
+                      "SupportedTechnologies=BR/EDR;\n"
+                      "Trusted=true\n"
+                      "Blocked=false\n"
+                      "Services=" BLUEZ_HID_SERVICE ";\n"
+                      "\n"
+                      "[LinkKey]\n"
+                      "Key=%s\n"
+                      "Type=%d\n"
+                      "PINLength=0\n"
+                      "\n"
+                      "[DeviceID]\n"
+                      "Source=2\n"
+                      "Vendor=%u\n"
+                      "Product=%u\n"
+                      "Version=256\n",
+                      layout->bluetooth_name, GAMEPAD_CLASS_OF_DEVICE, hex, BLUEZ_LINK_KEY_TYPE, VENDOR_SONY,
+                      layout->product_id);
+    return (length > 0 && (size_t)length < out_len) ? (size_t)length : 0;
+}
+
+/**
+ * Formats an address the way BlueZ names its storage directories
+ */
+static void bluez_address(const unsigned char *mac, char *out)
+{
+    snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+#ifndef PLATFORM_WINDOWS
+
+/**
+ * Checks whether link keys can be handed to the host's Bluetooth stack
+ */
+int link_key_available(void)
+{
+    return 1;
+}
+
+/**
+ * Creates a directory readable only by its owner, as bluetoothd does
+ */
+static int make_private_dir(const char *path)
+{
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+/**
+ * Writes a controller's entry to the BlueZ storage directory
+ */
+int link_key_bluez_store(const unsigned char *adapter_mac, const unsigned char *device_mac, const unsigned char *key,
+                         const link_key_layout_t *layout)
+{
+    char adapter[18], device[18], path[640], temp[660], info[512];
+    size_t length = link_key_bluez_info(layout, key, info, sizeof(info));
+    FILE *file;
+    int fd, ok;
+
+    bluez_address(adapter_mac, adapter);
+    bluez_address(device_mac, device);
+
+    snprintf(path, sizeof(path), "%s/%s", storage_dir, adapter);
+    if (!length || !make_private_dir(storage_dir) || !make_private_dir(path))
+        return 0;
+    snprintf(path, sizeof(path), "%s/%s/%s", storage_dir, adapter, device);
+    if (!make_private_dir(path))
+        return 0;
+
+    snprintf(path, sizeof(path), "%s/%s/%s/info", storage_dir, adapter, device);
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file)
+    {
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+    ok = fwrite(info, 1, length, file) == length;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp, path) != 0)
+    {
+        remove(temp);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Checks whether the BlueZ storage directory has a link key for a controller
+ */
+int link_key_bluez_has_key(const unsigned char *adapter_mac, const unsigned char *device_mac)
+{
+    char adapter[18], device[18], path[640], line[128];
+    int in_link_key = 0, found = 0;
+    FILE *file;
+
+    bluez_address(adapter_mac, adapter);
+    bluez_address(device_mac, device);
+    snprintf(path, sizeof(path), "%s/%s/%s/info", storage_dir, adapter, device);
+    file = fopen(path, "r");
+    if (!file)
+        return 0;
+
+    while (!found && fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '[')
+            in_link_key = strncmp(line, "[LinkKey]", 9) == 0;
+        else if (in_link_key && strncmp(line, "Key=", 4) == 0 && strlen(line) >= 4 + 2 * LINK_KEY_LENGTH)
+            found = 1;
+    }
+    fclose(file);
+    return found;
+}
+
+#else /* PLATFORM_WINDOWS */
+
+/**
+ * Checks whether link keys can be handed to the host's Bluetooth stack
+ */
+int link_key_available(void)
+{
+    return 0;
+}
+
+/**
+ * Writes a controller's entry to the BlueZ storage directory
+ */
+int link_key_bluez_store(const unsigned char *adapter_mac, const unsigned char *device_mac, const unsigned char *key,
+                         const link_key_layout_t *layout)
+{
+    (void)adapter_mac;
+    (void)device_mac;
+    (void)key;
+    (void)layout;
+    return 0;
+}
+
+/**
+ * Checks whether the BlueZ storage directory has a link key for a controller
+ */
+int link_key_bluez_has_key(const unsigned char *adapter_mac, const unsigned char *device_mac)
+{
+    (void)adapter_mac;
+    (void)device_mac;
+    return 0;
+}
+
+#endif /* PLATFORM_WINDOWS */
+
+/**
+ * Pairs a controller with a host in one transaction
+ */
+link_key_pair_result_t link_key_pair(hid_device *dev, const link_key_layout_t *layout, const unsigned char *host_mac,
+                                     unsigned char *device_mac)
+{
+    unsigned char key[LINK_KEY_LENGTH];
+    unsigned char report[LINK_KEY_MAX_REPORT_LENGTH];
+    unsigned char device[6], paired[6];
+    struct hid_device_info *info = hid_io_get_device_info(dev);
+    link_key_pair_result_t result;
+    uint64_t stage_start = trace_events_begin();
+
+    if (!link_key_generate(key))
+    {
+        result = LINK_KEY_PAIR_KEY_FAILED;
+    }
+    else
+    {
+        link_key_build_report(layout, host_mac, key, report);
+        if (hid_io_send_feature_report(dev, report, layout->link_key_length) < 0)
+            result = LINK_KEY_PAIR_WRITE_FAILED;
+        else if (!link_key_read_pairing(dev, layout, device, paired))
+            result = LINK_KEY_PAIR_UNVERIFIED;
+        else if (memcmp(paired, host_mac, 6) != 0)
+            result = LINK_KEY_PAIR_MISMATCH;
+        else if (!link_key_bluez_store(host_mac, device, key, layout))
+            result = LINK_KEY_PAIR_STORE_FAILED;
+        else
+            result = LINK_KEY_PAIR_OK;
+
+        if (device_mac && (result == LINK_KEY_PAIR_OK || result == LINK_KEY_PAIR_MISMATCH ||
+                           result == LINK_KEY_PAIR_STORE_FAILED))
+            memcpy(device_mac, device, 6);
+    }
+
+    trace_events_record("link_key_pair", TRACE_CAT_STAGE, stage_start, info ? info->path : NULL,
+                        layout->link_key_report_id, result == LINK_KEY_PAIR_OK ? 0 : -1);
+
+    /* The key only lives in the controller and the storage entry */
+    memset(key, 0, sizeof(key));
+    memset(report, 0, sizeof(report));
+    return result;
+}
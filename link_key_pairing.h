@@ -0,0 +1,205 @@
+/**
+ * link_key_pairing.h - USB pairing with a link key for DualShock 4 and DualSense
+ *
+ * A DualShock 4 or DualSense is paired over USB by giving it the host's
+ * Bluetooth address together with a 16-byte link key in one set-report.
+ * When the host's Bluetooth stack knows the same key for the controller's
+ * address, the controller reconnects over Bluetooth as a bonded device and
+ * the interactive Bluetooth pairing step is skipped. On Linux the key is
+ * handed to BlueZ by writing the device's entry in its storage directory,
+ * <storage>/<adapter address>/<device address>/info; bluetoothd reads the
+ * storage at startup, so it has to be restarted once after a batch of
+ * controllers has been paired.
+ *
+ * Each family has its own pairing reports, listed in a layout table; every
+ * read or write is a single get or set of the family's report.
+ *
+ *   Family           Get (addresses)   Set (host address, link key)
+ *   DualShock 4      0x12, 16 bytes    0x13, 23 bytes
+ *   DualSense (Edge) 0x09, 20 bytes    0x0A, 27 bytes
+ *
+ * The get-report holds the device address in bytes 1-6 and the paired host
+ * in bytes 10-15; the set-report holds the host address in bytes 1-6 and
+ * the key in bytes 7-22, zero-padded to its length. Addresses are
+ * little-endian in both. A DualShock 4 also takes the host address alone
+ * in report 0xF5; a DualSense has no such report and is only paired with
+ * a link key.
+ */
+
+#ifndef LINK_KEY_PAIRING_H
+#define LINK_KEY_PAIRING_H
+
+#include "platform_compat.h"
+#include <stddef.h>
+
+#define LINK_KEY_LENGTH 16
+
+/* Longest reports of any layout, for buffers */
+#define LINK_KEY_MAX_PAIRING_LENGTH 20
+#define LINK_KEY_MAX_REPORT_LENGTH 27
+
+/* Byte offsets shared by every layout */
+#define LINK_KEY_DEVICE_OFFSET 1    /* Device address in the get-report */
+#define LINK_KEY_HOST_OFFSET 10     /* Paired host address in the get-report */
+#define LINK_KEY_KEY_OFFSET 7       /* Link key in the set-report, after the host address */
+
+/* Default BlueZ storage directory */
+#define LINK_KEY_BLUEZ_DEFAULT_STORAGE "/var/lib/bluetooth"
+
+/**
+ * Pairing reports of one product
+ */
+typedef struct {
+    unsigned short product_id;
+    const char *bluetooth_name;         /* Name the controller announces over Bluetooth */
+    unsigned char pairing_report_id;    /* Get: device and paired host address */
+    unsigned char pairing_length;
+    unsigned char link_key_report_id;   /* Set: host address and link key */
+    unsigned char link_key_length;
+    unsigned char address_report_id;    /* Set: host address only, 0 if the family needs the link key */
+} link_key_layout_t;
+
+/**
+ * Outcome of link_key_pair()
+ */
+typedef enum {
+    LINK_KEY_PAIR_OK = 0,           /* Written, verified and stored */
+    LINK_KEY_PAIR_KEY_FAILED,       /* No link key could be generated */
+    LINK_KEY_PAIR_WRITE_FAILED,     /* The controller rejected the set-report */
+    LINK_KEY_PAIR_UNVERIFIED,       /* The get-report could not be read back */
+    LINK_KEY_PAIR_MISMATCH,         /* The get-report names another host */
+    LINK_KEY_PAIR_STORE_FAILED      /* The controller is paired but BlueZ does not know the key */
+} link_key_pair_result_t;
+
+/**
+ * Gets the pairing reports of a product
+ *
+ * @param product_id Product ID of the controller
+ * @return The layout, or NULL if the product is not paired with a link key
+ */
+const link_key_layout_t* link_key_layout(unsigned short product_id);
+
+/**
+ * Gets the pairing reports of an open controller
+ *
+ * @param dev Handle to the HID device
+ * @return The layout, or NULL if the controller is not paired with a link key
+ */
+const link_key_layout_t* link_key_device_layout(hid_device *dev);
+
+/**
+ * Sets the BlueZ storage directory
+ *
+ * @param path Directory, or NULL for LINK_KEY_BLUEZ_DEFAULT_STORAGE
+ */
+void link_key_set_storage(const char *path);
+
+/**
+ * Gets the BlueZ storage directory
+ *
+ * @return The directory
+ */
+const char* link_key_storage(void);
+
+/**
+ * Checks whether link keys can be handed to the host's Bluetooth stack
+ *
+ * @return 1 where BlueZ storage is written (Linux and macOS), 0 otherwise
+ */
+int link_key_available(void);
+
+/**
+ * Generates a random link key from the operating system's CSPRNG
+ *
+ * @param key Receives LINK_KEY_LENGTH bytes
+ * @return 1 on success, 0 on failure
+ */
+int link_key_generate(unsigned char *key);
+
+/**
+ * Builds the link key set-report
+ *
+ * @param layout Pairing reports of the controller
+ * @param host_mac Host Bluetooth address, most significant byte first
+ * @param key Link key
+ * @param report Receives layout->link_key_length bytes
+ */
+void link_key_build_report(const link_key_layout_t *layout, const unsigned char *host_mac,
+                           const unsigned char *key, unsigned char *report);
+
+/**
+ * Parses the pairing get-report
+ *
+ * @param layout Pairing reports of the controller
+ * @param report The get-report as read
+ * @param length Number of bytes read
+ * @param device_mac Receives the controller's address, most significant byte first
+ * @param host_mac Receives the paired host's address, most significant byte first
+ * @return 1 on success, 0 if the report is too short or has another ID
+ */
+int link_key_parse_pairing(const link_key_layout_t *layout, const unsigned char *report, size_t length,
+                           unsigned char *device_mac, unsigned char *host_mac);
+
+/**
+ * Reads the controller and host addresses in one get-report
+ *
+ * Over Bluetooth the report carries a CRC trailer, which is checked.
+ *
+ * @param dev Handle to the HID device
+ * @param layout Pairing reports of the controller
+ * @param device_mac Receives the controller's address
+ * @param host_mac Receives the paired host's address
+ * @return 1 on success, 0 on failure
+ */
+int link_key_read_pairing(hid_device *dev, const link_key_layout_t *layout, unsigned char *device_mac,
+                          unsigned char *host_mac);
+
+/**
+ * Renders the BlueZ info file of a bonded controller
+ *
+ * @param layout Pairing reports of the controller, for its name and product ID
+ * @param key Link key
+ * @param out Output buffer
+ * @param out_len Size of the output buffer
+ * @return Length of the text, or 0 if it does not fit
+ */
+size_t link_key_bluez_info(const link_key_layout_t *layout, const unsigned char *key, char *out, size_t out_len);
+
+/**
+ * Writes a controller's entry to the BlueZ storage directory
+ *
+ * @param adapter_mac Address of the host adapter
+ * @param device_mac Address of the controller
+ * @param key Link key
+ * @param layout Pairing reports of the controller
+ * @return 1 on success, 0 on failure or where BlueZ storage does not exist
+ */
+int link_key_bluez_store(const unsigned char *adapter_mac, const unsigned char *device_mac, const unsigned char *key,
+                         const link_key_layout_t *layout);
+
+/**
+ * Checks whether the BlueZ storage directory has a link key for a controller
+ *
+ * @param adapter_mac Address of the host adapter
+ * @param device_mac Address of the controller
+ * @return 1 if the entry exists with a link key, 0 otherwise
+ */
+int link_key_bluez_has_key(const unsigned char *adapter_mac, const unsigned char *device_mac);
+
+/**
+ * Pairs a controller with a host in one transaction
+ *
+ * Generates a link key, writes it with the host address in the layout's
+ * set-report, reads the get-report back to verify the host address, then
+ * stores the key in the BlueZ storage directory.
+ *
+ * @param dev Handle to the HID device
+ * @param layout Pairing reports of the controller
+ * @param host_mac Host Bluetooth address
+ * @param device_mac Receives the controller's address when it could be read, or NULL
+ * @return The outcome
+ */
+link_key_pair_result_t link_key_pair(hid_device *dev, const link_key_layout_t *layout, const unsigned char *host_mac,
+                                     unsigned char *device_mac);
+
+#endif /* LINK_KEY_PAIRING_H */
@@ -1,7 +1,7 @@
 /**
  * PlayStation Controller Pairer - A utility for pairing PlayStation controllers with custom MAC addresses
  *
- * This program allows users to pair PlayStation controllers (SixAxis, Move Motion, and DualShock 4)
+ * This program allows users to pair PlayStation controllers (SixAxis, Move Motion, DualShock 4 and DualSense)
  * with a custom MAC address or display the currently paired MAC address.
  *
  * Copyright (c) 2014 John Schember <john@nachtimwald.com>
@@ -17,6 +17,127 @@
 #include "controller_info.h"
 #include "controller_connection.h"
 #include "ui.h"
+#include "latency_stats.h"
+#include "trace_events.h"
+#include "pairing_daemon.h"
+#include "input_stream.h"
+#include "report_decoder.h"
+#include "imu_calibration.h"
+#include "flight_recorder.h"
+#include "hid_io.h"
+#include "hid_capture.h"
+#include "hid_replay.h"
+#include "controller_qa.h"
+#include "link_key_pairing.h"
+#include "provision_recipe.h"
+#include "manifest_apply.h"
+#include "led_identify.h"
+#include "config_snapshot.h"
+#include "capability_cache.h"
+#include "feature_survey.h"
+
+/**
+ * Removes global options from the argument list and applies them
+ *
+ * Global options may appear anywhere on the command line; the remaining
+ * arguments are compacted so the command handling below is unaffected.
+ *
+ * @param argc Pointer to the number of command line arguments
+ * @param argv Array of command line arguments
+ * @return 1 on success, 0 if an option is malformed
+ */
+static int strip_global_options(int *argc, char **argv)
+{
+    int kept = 1;
+
+    for (int i = 1; i < *argc; i++)
+    {
+        if (strcmp(argv[i], "--stats") == 0)
+        {
+            latency_stats_enabled = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--trace") == 0)
+        {
+            if (i + 1 >= *argc || !trace_events_open(argv[i + 1]))
+            {
+                fprintf(stderr, "%s[ERROR]%s --trace requires an output file\n", COLOR_RED, COLOR_RESET);
+                return 0;
+            }
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "--flight-dir") == 0)
+        {
+            if (i + 1 >= *argc)
+            {
+                fprintf(stderr, "%s[ERROR]%s --flight-dir requires a directory\n", COLOR_RED, COLOR_RESET);
+                return 0;
+            }
+            flight_recorder_set_dir(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--calibration-cache") == 0)
+        {
+            if (i + 1 >= *argc)
+            {
+                fprintf(stderr, "%s[ERROR]%s --calibration-cache requires a file\n", COLOR_RED, COLOR_RESET);
+                return 0;
+            }
+            imu_calibration_set_cache(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--capability-cache") == 0)
+        {
+            if (i + 1 >= *argc)
+            {
+                fprintf(stderr, "%s[ERROR]%s --capability-cache requires a file\n", COLOR_RED, COLOR_RESET);
+                return 0;
+            }
+            capability_cache_set_file(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--no-capability-cache") == 0)
+        {
+            capability_cache_enabled = 0;
+            continue;
+        }
+        if (strcmp(argv[i], "--bluez-dir") == 0)
+        {
+            if (i + 1 >= *argc)
+            {
+                fprintf(stderr, "%s[ERROR]%s --bluez-dir requires a directory\n", COLOR_RED, COLOR_RESET);
+                return 0;
+            }
+            link_key_set_storage(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--capture") == 0 || strcmp(argv[i], "--replay") == 0)
+        {
+            int capture = argv[i][2] == 'c';
+
+            if (i + 1 >= *argc || hid_capture_enabled || hid_replay_enabled)
+            {
+                fprintf(stderr, "%s[ERROR]%s %s requires a file and cannot be combined with --capture/--replay\n",
+                        COLOR_RED, COLOR_RESET, argv[i]);
+                return 0;
+            }
+            if (!(capture ? hid_capture_open(argv[i + 1]) : hid_replay_load(argv[i + 1])))
+                return 0;
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "--replay-fast") == 0)
+        {
+            hid_replay_fast = 1;
+            continue;
+        }
+        argv[kept++] = argv[i];
+    }
+
+    *argc = kept;
+    return 1;
+}
 
 /**
  * Main function - Entry point of the program
@@ -28,6 +149,29 @@
  *   sixaxispairer -a      - List all connected USB devices (not just Sony)
  *   sixaxispairer -d      - Dump all available information from connected controller
  *   sixaxispairer -h      - Show help message
+ *   sixaxispairer daemon <mac> [options] - Pair every controller that is plugged in
+ *   sixaxispairer stream [options] - Stream input reports from all controllers
+ *   sixaxispairer bench [options]  - Benchmark the input report decoders
+ *   sixaxispairer decode <capture | recording> [options] - Decode the input reports of a capture or recording
+ *   sixaxispairer qa [options]     - Check every controller against refurbishment thresholds
+ *   sixaxispairer provision <recipe> [options] - Run a provisioning recipe on every controller
+ *   sixaxispairer apply <manifest> [options] - Pair every controller listed in a manifest
+ *   sixaxispairer identify [options] - Mark every controller by slot or pairing with its lights
+ *   sixaxispairer snapshot <file> [options] - Save the feature reports of a controller
+ *   sixaxispairer restore <file> [options] - Write a snapshot to every matching controller
+ *   sixaxispairer survey [options]  - Probe every feature report ID on every controller
+ *
+ * Global options:
+ *   --stats               - Print HID latency statistics at exit
+ *   --trace <file>        - Write a Chrome trace-event JSON file of the run at exit
+ *   --flight-dir <dir>    - Directory for flight recorder dumps on failure
+ *   --calibration-cache <file> - DS4 IMU calibration cache file
+ *   --capability-cache <file> - Feature report capability file
+ *   --no-capability-cache - Send every feature report request, learning nothing
+ *   --bluez-dir <dir>     - BlueZ storage directory for DS4 and DualSense link keys
+ *   --capture <file>      - Record all HID traffic to a capture file
+ *   --replay <file>       - Serve HID traffic from a capture file instead of hardware
+ *   --replay-fast         - Replay without the recorded call durations
  *
  * @param argc Number of command line arguments
  * @param argv Array of command line arguments
@@ -45,6 +189,119 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    /* Apply global options such as --stats and --trace */
+    if (!strip_global_options(&argc, argv))
+    {
+        show_usage(argv[0]);
+        hid_exit();
+        return 1;
+    }
+    if (latency_stats_enabled)
+    {
+        atexit(latency_stats_print);
+    }
+    if (trace_events_enabled)
+    {
+        atexit(trace_events_write);
+    }
+    if (hid_capture_enabled)
+    {
+        atexit(hid_capture_close);
+    }
+    if (hid_replay_enabled)
+    {
+        /* Replayed traffic teaches the capability cache nothing */
+        atexit(hid_replay_close);
+        capability_cache_enabled = 0;
+    }
+    atexit(capability_cache_close);
+
+    /* Run the resident pairing daemon */
+    if (argc >= 2 && strcmp(argv[1], "daemon") == 0)
+    {
+        result = daemon_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Stream input reports from every controller */
+    if (argc >= 2 && strcmp(argv[1], "stream") == 0)
+    {
+        result = stream_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Benchmark the input report decoders */
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0)
+    {
+        result = bench_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Decode the input reports of a capture offline */
+    if (argc >= 2 && strcmp(argv[1], "decode") == 0)
+    {
+        result = decode_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Check every controller for refurbishment */
+    if (argc >= 2 && strcmp(argv[1], "qa") == 0)
+    {
+        result = qa_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Run a provisioning recipe on every controller */
+    if (argc >= 2 && strcmp(argv[1], "provision") == 0)
+    {
+        result = provision_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Pair every controller listed in a manifest */
+    if (argc >= 2 && strcmp(argv[1], "apply") == 0)
+    {
+        result = apply_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Mark every controller with its lights */
+    if (argc >= 2 && strcmp(argv[1], "identify") == 0)
+    {
+        result = identify_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Save a controller's configuration, or clone one onto other controllers */
+    if (argc >= 2 && strcmp(argv[1], "snapshot") == 0)
+    {
+        result = snapshot_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+    if (argc >= 2 && strcmp(argv[1], "restore") == 0)
+    {
+        result = restore_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
+    /* Probe every feature report ID, for reverse-engineering new revisions */
+    if (argc >= 2 && strcmp(argv[1], "survey") == 0)
+    {
+        result = survey_command(argc - 2, argv + 2);
+        hid_exit();
+        return result;
+    }
+
     /* Check command line arguments and show usage if needed */
     if ((argc != 1 && argc != 2) ||
         (argc == 2 && (strncmp(argv[1], "-h", 2) == 0 || strncmp(argv[1], "--help", 6) == 0)))
@@ -159,7 +416,7 @@ int main(int argc, char **argv)
     }
 
     /* Clean up and close the connection */
-    hid_close(dev);
+    hid_io_close(dev);
     
     /* Free controller info structures */
     for (int i = 0; i < controller_count; i++)
@@ -0,0 +1,837 @@
+/**
+ * manifest_apply.c - Bulk pairing from a manifest
+ *
+ * Implementation of the manifest index and of apply mode. Entries are kept
+ * in an array and indexed by an open-addressing table with linear probing,
+ * hashed with FNV-1a over the kind and identity, and grown to keep it at
+ * most half full. Path and serial matches are resolved on the main thread
+ * before any controller is opened; address matches need the controller
+ * open, so they are resolved on its worker thread, which then pairs it and
+ * records the entry in the checkpoint journal.
+ */
+
+#include "manifest_apply.h"
+#include "checkpoint_journal.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "link_key_pairing.h"
+#include "mac_utils.h"
+#include "hid_io.h"
+#include "flight_recorder.h"
+#include "latency_stats.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Initial index size */
+#define MANIFEST_INITIAL_SLOTS 64
+
+/* Longest serial number compared */
+#define APPLY_MAX_SERIAL 64
+
+static const char *KIND_NAMES[MANIFEST_KINDS] = { "path", "serial", "address" };
+
+/**
+ * State shared by the workers
+ */
+typedef struct apply_state {
+    manifest_t *manifest;
+    checkpoint_t *journal;          /* NULL without --journal */
+    int dry_run;
+    mutex_t lock;                   /* Guards entry->matched for address matches */
+} apply_state_t;
+
+/**
+ * Outcome for one connected controller
+ */
+typedef enum {
+    APPLY_UNMATCHED = 0,    /* No entry names it */
+    APPLY_AMBIGUOUS,        /* Its entry also matches another controller */
+    APPLY_OPEN_FAILED,
+    APPLY_MATCHED,          /* --dry-run */
+    APPLY_RESUMED,          /* Recorded by an earlier run */
+    APPLY_ALREADY_PAIRED,
+    APPLY_PAIRED,
+    APPLY_UNVERIFIED,       /* Written but not read back */
+    APPLY_FAILED
+} apply_outcome_t;
+
+/**
+ * One connected controller
+ */
+typedef struct {
+    struct apply_state *state;
+    controller_info_t *controller;
+    int index;
+    char serial[APPLY_MAX_SERIAL];
+    char address[18];               /* Read only when matching by address */
+    manifest_entry_t *entry;
+    apply_outcome_t outcome;
+    int journal_failed;             /* Paired but could not be recorded */
+    uint64_t elapsed_ms;
+    thread_t thread;
+    int running;
+} apply_job_t;
+
+
+/**
+ * Hashes a kind and identity (FNV-1a)
+ */
+static uint32_t hash_identity(manifest_kind_t kind, const char *identity)
+{
+    uint32_t hash = 2166136261u;
+
+    hash = (hash ^ (uint32_t)kind) * 16777619u;
+    for (; *identity; identity++)
+        hash = (hash ^ (unsigned char)*identity) * 16777619u;
+    return hash;
+}
+
+/**
+ * Finds the slot of an identity, or the empty slot where it belongs
+ */
+static size_t find_slot(const manifest_t *manifest, manifest_kind_t kind, const char *identity)
+{
+    size_t mask = manifest->slot_count - 1;
+    size_t slot = hash_identity(kind, identity) & mask;
+
+    while (manifest->slots[slot])
+    {
+        const manifest_entry_t *entry = &manifest->entries[manifest->slots[slot] - 1];
+
+        if (entry->kind == kind && strcmp(entry->identity, identity) == 0)
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * Doubles the index and reinserts every entry
+ */
+static int grow_index(manifest_t *manifest)
+{
+    size_t slot_count = manifest->slot_count ? manifest->slot_count * 2 : MANIFEST_INITIAL_SLOTS;
+    uint32_t *slots = (uint32_t*)calloc(slot_count, sizeof(uint32_t));
+
+    if (!slots)
+        return 0;
+    free(manifest->slots);
+    manifest->slots = slots;
+    manifest->slot_count = slot_count;
+    for (size_t i = 0; i < manifest->count; i++)
+    {
+        const manifest_entry_t *entry = &manifest->entries[i];
+        manifest->slots[find_slot(manifest, entry->kind, entry->identity)] = (uint32_t)(i + 1);
+    }
+    return 1;
+}
+
+/**
+ * Initializes an empty manifest
+ */
+void manifest_init(manifest_t *manifest)
+{
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+/**
+ * Frees a manifest's entries and index
+ */
+void manifest_free(manifest_t *manifest)
+{
+    for (size_t i = 0; i < manifest->count; i++)
+        free(manifest->entries[i].identity);
+    free(manifest->entries);
+    free(manifest->slots);
+    manifest_init(manifest);
+}
+
+/**
+ * Reports an error on a manifest line
+ */
+static int line_error(char *error, size_t error_len, int line_number, const char *message)
+{
+    snprintf(error, error_len, "line %d: %s", line_number, message);
+    return 0;
+}
+
+/**
+ * Parses a MAC address field
+ */
+static int parse_mac(const char *text, unsigned char *mac)
+{
+    size_t length = strlen(text);
+
+    return (length == 12 || length == 17) && mac_to_bytes(text, length, mac, 6);
+}
+
+/**
+ * Adds an entry to the manifest and its index
+ */
+static int add_entry(manifest_t *manifest, manifest_kind_t kind, const char *identity, const char *host,
+                     int line_number, char *error, size_t error_len)
+{
+    manifest_entry_t *entry;
+    unsigned char mac[6];
+    char address[18];
+    size_t slot;
+
+    if (!parse_mac(host, mac))
+        return line_error(error, error_len, line_number, "the host is not a MAC address");
+    if (kind == MANIFEST_ADDRESS)
+    {
+        unsigned char device[6];
+
+        if (!parse_mac(identity, device))
+            return line_error(error, error_len, line_number, "the address is not a MAC address");
+        bytes_to_mac_string(device, address, sizeof(address), 1);
+        identity = address;
+    }
+    if (!*identity)
+        return line_error(error, error_len, line_number, "empty identity");
+
+    if ((manifest->count + 1) * 2 > manifest->slot_count && !grow_index(manifest))
+        return line_error(error, error_len, line_number, "out of memory");
+    slot = find_slot(manifest, kind, identity);
+    if (manifest->slots[slot])
+    {
+        snprintf(error, error_len, "line %d: %s %s is already listed on line %d", line_number, KIND_NAMES[kind],
+                 identity, manifest->entries[manifest->slots[slot] - 1].line);
+        return 0;
+    }
+
+    if (manifest->count == manifest->capacity)
+    {
+        size_t capacity = manifest->capacity ? manifest->capacity * 2 : MANIFEST_INITIAL_SLOTS;
+        manifest_entry_t *entries = (manifest_entry_t*)realloc(manifest->entries, capacity * sizeof(*entries));
+
+        if (!entries)
+            return line_error(error, error_len, line_number, "out of memory");
+        manifest->entries = entries;
+        manifest->capacity = capacity;
+    }
+
+    entry = &manifest->entries[manifest->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->identity = (char*)malloc(strlen(identity) + 1);
+    if (!entry->identity)
+        return line_error(error, error_len, line_number, "out of memory");
+    strcpy(entry->identity, identity);
+    entry->kind = kind;
+    memcpy(entry->host_mac, mac, 6);
+    entry->line = line_number;
+
+    manifest->slots[slot] = (uint32_t)(++manifest->count);
+    manifest->kind_counts[kind]++;
+    return 1;
+}
+
+/**
+ * Looks a kind name up
+ *
+ * @return The kind, or MANIFEST_KINDS if the name is not one
+ */
+static manifest_kind_t parse_kind(const char *name)
+{
+    for (int k = 0; k < MANIFEST_KINDS; k++)
+    {
+        if (strcmp(name, KIND_NAMES[k]) == 0)
+            return (manifest_kind_t)k;
+    }
+    return MANIFEST_KINDS;
+}
+
+/**
+ * Reads a JSON string in place, resolving the simple escapes
+ *
+ * @return Pointer past the closing quote, or NULL if the string is malformed
+ */
+static char* read_json_string(char *cursor, char **value)
+{
+    char *out;
+
+    if (*cursor != '"')
+        return NULL;
+    *value = out = ++cursor;
+    while (*cursor && *cursor != '"')
+    {
+        if (*cursor == '\\')
+        {
+            cursor++;
+            if (*cursor != '"' && *cursor != '\\' && *cursor != '/')
+                return NULL;
+        }
+        *out++ = *cursor++;
+    }
+    if (*cursor != '"')
+        return NULL;
+    *out = '\0';
+    return cursor + 1;
+}
+
+/**
+ * Skips whitespace
+ */
+static char* skip_space(char *cursor)
+{
+    while (isspace((unsigned char)*cursor))
+        cursor++;
+    return cursor;
+}
+
+/**
+ * Parses a JSON line: one flat object of string members
+ */
+static int add_json_line(manifest_t *manifest, char *cursor, int line_number, char *error, size_t error_len)
+{
+    manifest_kind_t kind = MANIFEST_KINDS;
+    char *identity = NULL, *host = NULL;
+
+    cursor = skip_space(cursor + 1);
+    while (*cursor != '}')
+    {
+        char *name, *value;
+        manifest_kind_t member;
+
+        cursor = read_json_string(cursor, &name);
+        if (!cursor || *(cursor = skip_space(cursor)) != ':')
+            return line_error(error, error_len, line_number, "malformed JSON");
+        cursor = read_json_string(skip_space(cursor + 1), &value);
+        if (!cursor)
+            return line_error(error, error_len, line_number, "malformed JSON, values must be strings");
+
+        member = parse_kind(name);
+        if (member != MANIFEST_KINDS)
+        {
+            if (identity)
+                return line_error(error, error_len, line_number, "more than one identity");
+            kind = member;
+            identity = value;
+        }
+        else if (strcmp(name, "host") == 0)
+            host = value;
+
+        cursor = skip_space(cursor);
+        if (*cursor == ',')
+            cursor = skip_space(cursor + 1);
+        else if (*cursor != '}')
+            return line_error(error, error_len, line_number, "malformed JSON");
+    }
+    if (*skip_space(cursor + 1))
+        return line_error(error, error_len, line_number, "text after the JSON object");
+    if (!identity || !host)
+        return line_error(error, error_len, line_number, "needs an address, serial or path and a host");
+
+    return add_entry(manifest, kind, identity, host, line_number, error, error_len);
+}
+
+/**
+ * Trims whitespace and one pair of double quotes around a CSV field in place
+ */
+static char* trim_field(char *field)
+{
+    char *end;
+
+    field = skip_space(field);
+    end = field + strlen(field);
+    while (end > field && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    if (end - field >= 2 && field[0] == '"' && end[-1] == '"')
+    {
+        end[-1] = '\0';
+        field++;
+    }
+    return field;
+}
+
+/**
+ * Parses one manifest line and adds its entry
+ */
+int manifest_add_line(manifest_t *manifest, const char *line, int line_number, char *error, size_t error_len)
+{
+    char buffer[MANIFEST_MAX_LINE], *fields[3], *cursor;
+    manifest_kind_t kind;
+    size_t length = strlen(line);
+    int count = 0;
+
+    if (length >= sizeof(buffer))
+        return line_error(error, error_len, line_number, "line too long");
+    memcpy(buffer, line, length + 1);
+    cursor = skip_space(buffer);
+    if (!*cursor || *cursor == '#')
+        return 1;
+    if (*cursor == '{')
+        return add_json_line(manifest, cursor, line_number, error, error_len);
+
+    fields[count++] = cursor;
+    for (; *cursor; cursor++)
+    {
+        if (*cursor != ',')
+            continue;
+        if (count == 3)
+            return line_error(error, error_len, line_number, "expected kind,identity,host");
+        *cursor = '\0';
+        fields[count++] = cursor + 1;
+    }
+    if (count != 3)
+        return line_error(error, error_len, line_number, "expected kind,identity,host");
+    for (int i = 0; i < 3; i++)
+        fields[i] = trim_field(fields[i]);
+
+    if (strcmp(fields[0], "kind") == 0)
+        return 1;
+    kind = parse_kind(fields[0]);
+    if (kind == MANIFEST_KINDS)
+        return line_error(error, error_len, line_number, "the kind must be address, serial or path");
+    return add_entry(manifest, kind, fields[1], fields[2], line_number, error, error_len);
+}
+
+/**
+ * Reads a manifest a line at a time
+ */
+int manifest_load(manifest_t *manifest, FILE *file, char *error, size_t error_len)
+{
+    char line[MANIFEST_MAX_LINE + 1];
+    int line_number = 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        size_t length = strlen(line);
+
+        line_number++;
+        if (length && line[length - 1] == '\n')
+            line[--length] = '\0';
+        else if (!feof(file))
+            return line_error(error, error_len, line_number, "line too long");
+        if (length && line[length - 1] == '\r')
+            line[--length] = '\0';
+        if (!manifest_add_line(manifest, line, line_number, error, error_len))
+            return 0;
+    }
+    if (ferror(file))
+    {
+        snprintf(error, error_len, "read error");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Looks an identity up
+ */
+manifest_entry_t* manifest_find(const manifest_t *manifest, manifest_kind_t kind, const char *identity)
+{
+    size_t slot;
+
+    if (!manifest->count || !identity || !*identity)
+        return NULL;
+    slot = find_slot(manifest, kind, identity);
+    return manifest->slots[slot] ? &manifest->entries[manifest->slots[slot] - 1] : NULL;
+}
+
+/**
+ * Gets the name of an identity kind
+ */
+const char* manifest_kind_name(manifest_kind_t kind)
+{
+    return kind < MANIFEST_KINDS ? KIND_NAMES[kind] : "unknown";
+}
+
+/**
+ * Copies a serial number as ASCII, leaving it empty if it has other characters
+ */
+static void copy_serial(const wchar_t *serial, char *out, size_t out_len)
+{
+    size_t i = 0;
+
+    out[0] = '\0';
+    if (!serial)
+        return;
+    for (; serial[i] && i + 1 < out_len; i++)
+    {
+        if (serial[i] < 0x20 || serial[i] > 0x7e)
+        {
+            out[0] = '\0';
+            return;
+        }
+        out[i] = (char)serial[i];
+    }
+    out[serial[i] ? 0 : i] = '\0';
+}
+
+/**
+ * Names an entry in the checkpoint journal
+ */
+static void entry_key(const manifest_entry_t *entry, char *key, size_t key_len)
+{
+    snprintf(key, key_len, "%s:%s", KIND_NAMES[entry->kind], entry->identity);
+}
+
+/**
+ * Checks whether an earlier run recorded an entry
+ */
+static int entry_done(const checkpoint_t *journal, const manifest_entry_t *entry)
+{
+    char key[CHECKPOINT_MAX_KEY];
+
+    if (!journal)
+        return 0;
+    entry_key(entry, key, sizeof(key));
+    return checkpoint_done(journal, key);
+}
+
+/**
+ * Checks whether a controller is already paired with a host, including
+ * BlueZ's link key where the controller is paired with one
+ */
+static int already_paired(hid_device *dev, const unsigned char *host_mac)
+{
+    const link_key_layout_t *layout = link_key_device_layout(dev);
+    unsigned char device[6], current[6];
+
+    if (layout && link_key_available() && !is_bluetooth_device(dev))
+        return link_key_read_pairing(dev, layout, device, current) && memcmp(current, host_mac, 6) == 0 &&
+               link_key_bluez_has_key(host_mac, device);
+    return read_pairing(dev, current) && memcmp(current, host_mac, 6) == 0;
+}
+
+/**
+ * Matches a controller by address, pairs it with its entry's host and reports the outcome
+ */
+static apply_outcome_t apply_controller(apply_state_t *state, apply_job_t *job, hid_device *dev)
+{
+    unsigned char mac[6];
+
+    if (!job->entry)
+    {
+        manifest_entry_t *entry;
+
+        if (!read_device_address(dev, job->controller->product_id, mac))
+            return APPLY_UNMATCHED;
+        bytes_to_mac_string(mac, job->address, sizeof(job->address), 1);
+        entry = manifest_find(state->manifest, MANIFEST_ADDRESS, job->address);
+        if (!entry)
+            return APPLY_UNMATCHED;
+
+        mutex_lock(&state->lock);
+        if (!entry->matched)
+            entry->matched = job->index + 1;
+        mutex_unlock(&state->lock);
+        job->entry = entry;
+        if (entry->matched != job->index + 1)
+            return APPLY_AMBIGUOUS;
+        if (entry_done(state->journal, entry))
+            return APPLY_RESUMED;
+    }
+
+    if (state->dry_run)
+        return APPLY_MATCHED;
+    if (already_paired(dev, job->entry->host_mac))
+        return APPLY_ALREADY_PAIRED;
+    if (!write_host_pairing(dev, job->entry->host_mac))
+        return APPLY_FAILED;
+    if (!read_pairing(dev, mac))
+        return APPLY_UNVERIFIED;
+    return memcmp(mac, job->entry->host_mac, 6) == 0 ? APPLY_PAIRED : APPLY_FAILED;
+}
+
+/**
+ * Worker thread: opens one controller and applies its entry
+ */
+static void worker_main(void *arg)
+{
+    apply_job_t *job = (apply_job_t*)arg;
+    uint64_t start = latency_now_ns();
+    hid_device *dev = connect_to_controller(job->controller);
+
+    char key[CHECKPOINT_MAX_KEY];
+
+    if (!dev)
+        job->outcome = APPLY_OPEN_FAILED;
+    else
+        job->outcome = apply_controller(job->state, job, dev);
+    if (job->state->journal && (job->outcome == APPLY_PAIRED || job->outcome == APPLY_ALREADY_PAIRED))
+    {
+        entry_key(job->entry, key, sizeof(key));
+        job->journal_failed = !checkpoint_record(job->state->journal, key);
+    }
+    if (dev && job->outcome == APPLY_FAILED)
+        flight_recorder_dump(dev, "manifest pairing failed");
+    hid_io_close(dev);
+    job->elapsed_ms = (latency_now_ns() - start) / 1000000ull;
+}
+
+/**
+ * Gets the name of an outcome
+ */
+static const char* outcome_name(apply_outcome_t outcome)
+{
+    switch (outcome)
+    {
+    case APPLY_UNMATCHED:       return "no entry";
+    case APPLY_AMBIGUOUS:       return "ambiguous";
+    case APPLY_OPEN_FAILED:     return "open failed";
+    case APPLY_MATCHED:         return "matched";
+    case APPLY_RESUMED:         return "resumed";
+    case APPLY_ALREADY_PAIRED:  return "already paired";
+    case APPLY_PAIRED:          return "paired";
+    case APPLY_UNVERIFIED:      return "unverified";
+    default:                    return "failed";
+    }
+}
+
+/**
+ * Prints what apply did to one controller
+ */
+static void print_job(const apply_job_t *job)
+{
+    apply_outcome_t outcome = job->outcome;
+    int bad = outcome == APPLY_AMBIGUOUS || outcome == APPLY_OPEN_FAILED || outcome == APPLY_FAILED ||
+              outcome == APPLY_UNVERIFIED || job->journal_failed;
+    char host[18];
+
+    printf("%s  [%d] %-26s %-14s %s%-14s%s", COLOR_WHITE, job->index,
+           get_controller_name(job->controller->product_id), job->controller->path,
+           bad ? COLOR_RED : outcome == APPLY_UNMATCHED ? COLOR_YELLOW : COLOR_GREEN, outcome_name(outcome),
+           COLOR_RESET);
+    if (job->entry)
+    {
+        bytes_to_mac_string(job->entry->host_mac, host, sizeof(host), 1);
+        printf(" %s %s -> %s (line %d)", manifest_kind_name(job->entry->kind), job->entry->identity, host,
+               job->entry->line);
+    }
+    else if (job->address[0])
+        printf(" address %s", job->address);
+    printf(" %llums%s\n", (unsigned long long)job->elapsed_ms, job->journal_failed ? ", not journaled" : "");
+}
+
+/**
+ * Matches controllers by path and serial number, marking every controller
+ * that shares an entry with another as ambiguous
+ */
+static void match_identities(manifest_t *manifest, const checkpoint_t *journal, apply_job_t *jobs, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        manifest_entry_t *entry = manifest_find(manifest, MANIFEST_PATH, jobs[i].controller->path);
+
+        if (!entry)
+            entry = manifest_find(manifest, MANIFEST_SERIAL, jobs[i].serial);
+        if (!entry)
+            continue;
+        jobs[i].entry = entry;
+        if (entry->matched)
+        {
+            jobs[entry->matched - 1].outcome = APPLY_AMBIGUOUS;
+            jobs[i].outcome = APPLY_AMBIGUOUS;
+        }
+        else
+        {
+            entry->matched = i + 1;
+            if (entry_done(journal, entry))
+                jobs[i].outcome = APPLY_RESUMED;
+        }
+    }
+}
+
+/**
+ * Pairs every connected controller listed in a manifest, in parallel
+ */
+int apply_command(int argc, char **argv)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    apply_state_t state;
+    manifest_t manifest;
+    checkpoint_t journal;
+    apply_job_t *jobs;
+    char error[160];
+    FILE *file;
+    const char *journal_path = NULL;
+    uint32_t fingerprint = 0;
+    int controller_count, failed = 0, paired = 0, unmatched = 0, resumed = 0, loaded, resume = 0;
+    size_t leftover = 0, done_before = 0;
+
+    memset(&state, 0, sizeof(state));
+    if (argc < 1)
+    {
+        fprintf(stderr, "%s[ERROR]%s apply requires a manifest file\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--dry-run") == 0)
+            state.dry_run = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "--journal") == 0)
+            journal_path = argv[++i];
+        else if (strcmp(argv[i], "--resume") == 0)
+            resume = 1;
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown apply option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+
+    if (resume && !journal_path)
+    {
+        fprintf(stderr, "%s[ERROR]%s --resume requires --journal\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    file = fopen(argv[0], "r");
+    if (!file)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to open %s\n", COLOR_RED, COLOR_RESET, argv[0]);
+        return 1;
+    }
+    manifest_init(&manifest);
+    snprintf(error, sizeof(error), "read error");
+    loaded = (!journal_path || checkpoint_fingerprint_file(file, &fingerprint)) &&
+             manifest_load(&manifest, file, error, sizeof(error));
+    fclose(file);
+    if (!loaded)
+    {
+        fprintf(stderr, "%s[ERROR]%s %s, %s\n", COLOR_RED, COLOR_RESET, argv[0], error);
+        manifest_free(&manifest);
+        return 1;
+    }
+    if (manifest.count == 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s %s has no entries\n", COLOR_RED, COLOR_RESET, argv[0]);
+        manifest_free(&manifest);
+        return 1;
+    }
+
+    /* A dry run leaves the journal alone */
+    if (journal_path && !state.dry_run)
+    {
+        if (!checkpoint_open(&journal, journal_path, fingerprint, resume, error, sizeof(error)))
+        {
+            fprintf(stderr, "%s[ERROR]%s %s, %s\n", COLOR_RED, COLOR_RESET, journal_path, error);
+            manifest_free(&manifest);
+            return 1;
+        }
+        state.journal = &journal;
+        if (checkpoint_resumed_count(&journal))
+            printf("%s[INFO]%s Resuming: %zu entr%s done by an earlier run\n", COLOR_BLUE, COLOR_RESET,
+                   checkpoint_resumed_count(&journal), checkpoint_resumed_count(&journal) == 1 ? "y" : "ies");
+    }
+
+    controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+    if (controller_count == 0)
+    {
+        printf("%s[ERROR]%s No supported PlayStation controllers found\n", COLOR_RED, COLOR_RESET);
+        if (state.journal)
+            checkpoint_close(&journal);
+        manifest_free(&manifest);
+        return 1;
+    }
+
+    jobs = (apply_job_t*)calloc((size_t)controller_count, sizeof(apply_job_t));
+    if (!jobs)
+    {
+        for (int i = 0; i < controller_count; i++)
+            free_controller_info(controllers[i]);
+        if (state.journal)
+            checkpoint_close(&journal);
+        manifest_free(&manifest);
+        return 1;
+    }
+
+    printf("%s[INFO]%s Applying %zu manifest entr%s to %d controller(s)%s\n", COLOR_BLUE, COLOR_RESET,
+           manifest.count, manifest.count == 1 ? "y" : "ies", controller_count,
+           state.dry_run ? " (dry run)" : "");
+
+    state.manifest = &manifest;
+    mutex_init(&state.lock);
+    for (int i = 0; i < controller_count; i++)
+    {
+        jobs[i].state = &state;
+        jobs[i].controller = controllers[i];
+        jobs[i].index = i;
+        jobs[i].outcome = APPLY_UNMATCHED;
+        copy_serial(controllers[i]->serial_number, jobs[i].serial, sizeof(jobs[i].serial));
+    }
+    match_identities(&manifest, state.journal, jobs, controller_count);
+
+    /* Only controllers that may have an entry are opened */
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (jobs[i].outcome == APPLY_AMBIGUOUS || jobs[i].outcome == APPLY_RESUMED ||
+            (!jobs[i].entry && !manifest.kind_counts[MANIFEST_ADDRESS]))
+            continue;
+        jobs[i].running = thread_create(&jobs[i].thread, worker_main, &jobs[i]);
+        if (!jobs[i].running)
+            worker_main(&jobs[i]);
+    }
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (jobs[i].running)
+            thread_join(jobs[i].thread);
+    }
+    mutex_destroy(&state.lock);
+
+    printf("\n%s%s=== Apply Summary ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
+    for (int i = 0; i < controller_count; i++)
+    {
+        switch (jobs[i].outcome)
+        {
+        case APPLY_UNMATCHED:
+            unmatched++;
+            break;
+        case APPLY_RESUMED:
+            resumed++;
+            break;
+        case APPLY_MATCHED:
+        case APPLY_ALREADY_PAIRED:
+        case APPLY_PAIRED:
+            if (jobs[i].journal_failed)
+                failed++;
+            else
+                paired++;
+            break;
+        default:
+            failed++;
+            break;
+        }
+        print_job(&jobs[i]);
+        free_controller_info(jobs[i].controller);
+    }
+
+    for (size_t i = 0; i < manifest.count; i++)
+    {
+        const manifest_entry_t *entry = &manifest.entries[i];
+
+        if (entry->matched)
+            continue;
+        if (entry_done(state.journal, entry))
+        {
+            done_before++;
+            continue;
+        }
+        if (!leftover++)
+            printf("%s  Entries without a controller:%s\n", COLOR_YELLOW, COLOR_RESET);
+        printf("    line %d: %s %s\n", entry->line, manifest_kind_name(entry->kind), entry->identity);
+    }
+
+    if (state.journal)
+    {
+        printf("%s[INFO]%s Journal: %zu fsync(s), %d controller(s) and %zu unplugged entr%s skipped as done\n",
+               COLOR_BLUE, COLOR_RESET, journal.commit_count, resumed, done_before, done_before == 1 ? "y" : "ies");
+        if (!checkpoint_close(&journal))
+        {
+            fprintf(stderr, "%s[ERROR]%s Failed to write journal %s\n", COLOR_RED, COLOR_RESET, journal_path);
+            failed++;
+        }
+    }
+    printf("%s[INFO]%s %d controller(s) %s, %d failed, %d without an entry, %zu entr%s without a controller\n",
+           COLOR_BLUE, COLOR_RESET, paired, state.dry_run ? "matched" : "paired", failed, unmatched, leftover,
+           leftover == 1 ? "y" : "ies");
+
+    free(jobs);
+    manifest_free(&manifest);
+    return failed ? 1 : 0;
+}
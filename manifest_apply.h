@@ -0,0 +1,141 @@
+/**
+ * manifest_apply.h - Bulk pairing from a manifest
+ *
+ * A manifest maps controller identities to the host each controller is to
+ * be paired with, one entry per line, as CSV or JSON lines (both may be
+ * mixed; a line starting with '{' is JSON):
+ *
+ *   kind,identity,host
+ *   address,a4:53:85:0e:12:34,00:1a:7d:da:71:13
+ *   serial,0123456789ab,00:1a:7d:da:71:13
+ *   path,/dev/hidraw3,00:1a:7d:da:71:14
+ *   {"address":"a4:53:85:0e:12:35","host":"00:1a:7d:da:71:13"}
+ *
+ * An identity is the controller's own Bluetooth address (as read by
+ * read_device_address()), its USB serial number or its device path. The
+ * header line and lines starting with '#' are skipped. The manifest is read
+ * a line at a time into an open-addressing hash index, so a controller is
+ * matched in constant time however long the manifest is.
+ */
+
+#ifndef MANIFEST_APPLY_H
+#define MANIFEST_APPLY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Longest manifest line */
+#define MANIFEST_MAX_LINE 1024
+
+/**
+ * Identity kinds, in the order a controller is matched
+ */
+typedef enum {
+    MANIFEST_PATH = 0,
+    MANIFEST_SERIAL,
+    MANIFEST_ADDRESS,
+    MANIFEST_KINDS
+} manifest_kind_t;
+
+/**
+ * One manifest entry
+ */
+typedef struct {
+    manifest_kind_t kind;
+    char *identity;                 /* Addresses in lowercase with colons */
+    unsigned char host_mac[6];
+    int line;                       /* Line in the manifest */
+    int matched;                    /* Index of the controller that matched it plus one, 0 if none */
+} manifest_entry_t;
+
+/**
+ * A manifest and its hash index
+ */
+typedef struct {
+    manifest_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;                /* Entry index plus one, 0 for an empty slot */
+    size_t slot_count;              /* A power of two, at least twice count */
+    size_t kind_counts[MANIFEST_KINDS];
+} manifest_t;
+
+/**
+ * Initializes an empty manifest
+ *
+ * @param manifest The manifest
+ */
+void manifest_init(manifest_t *manifest);
+
+/**
+ * Frees a manifest's entries and index
+ *
+ * @param manifest The manifest
+ */
+void manifest_free(manifest_t *manifest);
+
+/**
+ * Parses one manifest line and adds its entry
+ *
+ * @param manifest The manifest
+ * @param line The line, without its newline
+ * @param line_number Line number for messages
+ * @param error Receives a message naming the line on failure
+ * @param error_len Size of the error buffer
+ * @return 1 if the line was added or skipped, 0 on a malformed line, a
+ *         duplicate identity or out of memory
+ */
+int manifest_add_line(manifest_t *manifest, const char *line, int line_number, char *error, size_t error_len);
+
+/**
+ * Reads a manifest a line at a time
+ *
+ * @param manifest The manifest
+ * @param file The open manifest file
+ * @param error Receives a message naming the line of the first error
+ * @param error_len Size of the error buffer
+ * @return 1 on success, 0 on the first error
+ */
+int manifest_load(manifest_t *manifest, FILE *file, char *error, size_t error_len);
+
+/**
+ * Looks an identity up
+ *
+ * @param manifest The manifest
+ * @param kind Kind of identity
+ * @param identity The identity; addresses in lowercase with colons
+ * @return The entry, or NULL if the manifest has none for the identity
+ */
+manifest_entry_t* manifest_find(const manifest_t *manifest, manifest_kind_t kind, const char *identity);
+
+/**
+ * Gets the name of an identity kind
+ *
+ * @param kind The kind
+ * @return Name as written in manifests, such as "serial"
+ */
+const char* manifest_kind_name(manifest_kind_t kind);
+
+/**
+ * Pairs every connected controller listed in a manifest, in parallel
+ *
+ * Usage: apply <manifest> [--dry-run] [--journal <file> [--resume]]
+ *
+ * The bus is enumerated once. A controller is matched by path, then serial
+ * number, then Bluetooth address; the address is only read, with the
+ * controller opened once, when the manifest lists addresses. Controllers
+ * already paired with their host are left alone, the others are written
+ * and read back. --dry-run only reports the matches. Controllers without
+ * an entry, and entries without a controller, are listed at the end.
+ * With --journal, each entry whose controller ends up paired is recorded
+ * in a checkpoint journal; --resume skips the recorded entries, their
+ * controllers matched by path or serial number without being opened.
+ *
+ * @param argc Number of arguments after the "apply" command
+ * @param argv Arguments after the "apply" command
+ * @return 0 if every matched controller is paired with its host, 1 otherwise
+ */
+int apply_command(int argc, char **argv);
+
+#endif /* MANIFEST_APPLY_H */
@@ -0,0 +1,433 @@
+/**
+ * metrics.c - Daemon metrics and Prometheus text endpoint
+ *
+ * Implementation of the per-thread counters and the Unix socket server.
+ * Writers only ever touch their own shard; a scrape walks the shard list
+ * and sums, so the pairing path never takes a lock for accounting.
+ */
+
+#include "metrics.h"
+#include "latency_stats.h"
+#include "controller_info.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+
+#ifndef PLATFORM_WINDOWS
+    #include <unistd.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+/**
+ * Per-thread counter block, linked into a global list on first use
+ */
+typedef struct metrics_shard {
+    _Atomic uint64_t counters[METRIC_COUNT];
+    struct metrics_shard *next;
+} metrics_shard_t;
+
+/**
+ * Growable text buffer used while rendering a scrape
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} text_buffer_t;
+
+static const char *COUNTER_NAMES[METRIC_COUNT] = {
+    "sixaxispairer_devices_seen_total",
+    "sixaxispairer_devices_paired_total",
+    "sixaxispairer_devices_already_correct_total",
+    "sixaxispairer_devices_failed_total",
+    "sixaxispairer_devices_timed_out_total",
+    "sixaxispairer_devices_unverified_total"
+};
+
+static const char *COUNTER_HELP[METRIC_COUNT] = {
+    "Controllers that appeared on the bus",
+    "Controllers whose pairing was written and verified",
+    "Controllers already paired with the target address",
+    "Controllers that could not be opened, read or written",
+    "Controllers whose job exceeded the per-device deadline",
+    "Controllers written whose pairing could not be read back"
+};
+
+static _Atomic(metrics_shard_t *) shard_list = NULL;
+static THREAD_LOCAL metrics_shard_t *thread_shard = NULL;
+static atomic_int queue_depth = 0;
+
+/**
+ * Gets the calling thread's shard, creating and publishing it on first use
+ */
+static metrics_shard_t* get_thread_shard(void)
+{
+    if (thread_shard)
+        return thread_shard;
+
+    metrics_shard_t *shard = (metrics_shard_t*)calloc(1, sizeof(metrics_shard_t));
+    if (!shard)
+        return NULL;
+
+    shard->next = atomic_load_explicit(&shard_list, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&shard_list, &shard->next, shard,
+                                                  memory_order_release, memory_order_relaxed))
+        ;
+
+    thread_shard = shard;
+    return shard;
+}
+
+/**
+ * Adds one to a counter in the calling thread's shard
+ */
+void metrics_increment(metric_counter_t counter)
+{
+    metrics_shard_t *shard;
+
+    if (counter < 0 || counter >= METRIC_COUNT)
+        return;
+
+    shard = get_thread_shard();
+    if (!shard)
+        return;
+
+    /* Single writer per shard, so a relaxed load/store pair is enough */
+    atomic_store_explicit(&shard->counters[counter],
+                          atomic_load_explicit(&shard->counters[counter], memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+/**
+ * Sums a counter over all threads
+ */
+uint64_t metrics_total(metric_counter_t counter)
+{
+    uint64_t total = 0;
+
+    if (counter < 0 || counter >= METRIC_COUNT)
+        return 0;
+
+    for (metrics_shard_t *shard = atomic_load_explicit(&shard_list, memory_order_acquire);
+         shard; shard = shard->next)
+    {
+        total += atomic_load_explicit(&shard->counters[counter], memory_order_relaxed);
+    }
+
+    return total;
+}
+
+/**
+ * Sets the current depth of the daemon's work queue
+ */
+void metrics_set_queue_depth(int depth)
+{
+    atomic_store_explicit(&queue_depth, depth, memory_order_relaxed);
+}
+
+/**
+ * Appends formatted text to a buffer, growing it as needed
+ */
+static void append(text_buffer_t *buf, const char *fmt, ...)
+{
+    va_list args;
+    int needed;
+
+    if (buf->failed)
+        return;
+
+    for (;;)
+    {
+        va_start(args, fmt);
+        needed = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+        va_end(args);
+
+        if (needed < 0)
+        {
+            buf->failed = 1;
+            return;
+        }
+        if ((size_t)needed < buf->cap - buf->len)
+        {
+            buf->len += (size_t)needed;
+            return;
+        }
+
+        size_t new_cap = buf->cap * 2 + (size_t)needed;
+        char *data = (char*)realloc(buf->data, new_cap);
+        if (!data)
+        {
+            buf->failed = 1;
+            return;
+        }
+        buf->data = data;
+        buf->cap = new_cap;
+    }
+}
+
+/**
+ * Renders the latency histograms of one operation
+ */
+static void render_histograms(text_buffer_t *buf, latency_op_t op)
+{
+    latency_histogram_t hist;
+
+    for (int slot = 0; slot < LATENCY_PRODUCT_SLOTS; slot++)
+    {
+        char product[8];
+        uint64_t cumulative = 0;
+
+        latency_stats_collect(op, slot, &hist);
+        if (hist.count == 0)
+            continue;
+
+        if (slot == 0)
+            snprintf(product, sizeof(product), "any");
+        else
+            snprintf(product, sizeof(product), "0x%04x", get_supported_product(slot - 1));
+
+        /* Emit one cumulative bucket per power of two to keep scrapes small */
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            cumulative += hist.buckets[b];
+            if (b % LATENCY_SUB_BUCKETS != 0)
+                continue;
+            append(buf, "sixaxispairer_hid_latency_seconds_bucket{op=\"%s\",product=\"%s\",le=\"%.9g\"} %llu\n",
+                   latency_op_name(op), product, (latency_bucket_upper_ns(b) + 1) / 1e9,
+                   (unsigned long long)cumulative);
+        }
+        append(buf, "sixaxispairer_hid_latency_seconds_bucket{op=\"%s\",product=\"%s\",le=\"+Inf\"} %llu\n",
+               latency_op_name(op), product, (unsigned long long)hist.count);
+        append(buf, "sixaxispairer_hid_latency_seconds_sum{op=\"%s\",product=\"%s\"} %.9f\n",
+               latency_op_name(op), product, hist.sum_ns / 1e9);
+        append(buf, "sixaxispairer_hid_latency_seconds_count{op=\"%s\",product=\"%s\"} %llu\n",
+               latency_op_name(op), product, (unsigned long long)hist.count);
+    }
+}
+
+/**
+ * Renders all counters, the queue depth and the HID latency histograms
+ */
+char* metrics_render(size_t *out_len)
+{
+    text_buffer_t buf = { NULL, 0, 4096, 0 };
+
+    buf.data = (char*)malloc(buf.cap);
+    if (!buf.data)
+        return NULL;
+    buf.data[0] = '\0';
+
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        append(&buf, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+               COUNTER_NAMES[i], COUNTER_HELP[i], COUNTER_NAMES[i], COUNTER_NAMES[i],
+               (unsigned long long)metrics_total((metric_counter_t)i));
+    }
+
+    append(&buf, "# HELP sixaxispairer_queue_depth Controllers waiting for a pairing worker\n"
+                 "# TYPE sixaxispairer_queue_depth gauge\n"
+                 "sixaxispairer_queue_depth %d\n",
+           atomic_load_explicit(&queue_depth, memory_order_relaxed));
+
+    append(&buf, "# HELP sixaxispairer_hid_latency_seconds Duration of HID operations\n"
+                 "# TYPE sixaxispairer_hid_latency_seconds histogram\n");
+    for (int op = 0; op < LATENCY_HID_OP_COUNT; op++)
+    {
+        render_histograms(&buf, (latency_op_t)op);
+    }
+
+    if (buf.failed)
+    {
+        free(buf.data);
+        return NULL;
+    }
+
+    *out_len = buf.len;
+    return buf.data;
+}
+
+#ifndef PLATFORM_WINDOWS
+
+static int server_fd = -1;
+static char *server_path = NULL;
+static thread_t server_thread;
+static atomic_int server_stop = 0;
+
+/* A scraper that disconnects mid-response must not raise SIGPIPE */
+#ifdef MSG_NOSIGNAL
+    #define SEND_FLAGS MSG_NOSIGNAL
+#else
+    #define SEND_FLAGS 0
+#endif
+
+/**
+ * Writes a whole buffer to a socket
+ */
+static void write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t written = send(fd, data, len, SEND_FLAGS);
+        if (written <= 0)
+            return;
+        data += written;
+        len -= (size_t)written;
+    }
+}
+
+/**
+ * Answers one scrape on an accepted connection
+ */
+static void serve_client(int fd)
+{
+    char request[512];
+    ssize_t got = 0;
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    size_t len = 0;
+    char *body;
+
+    /* Give HTTP clients a moment to send their request line */
+    if (poll(&pfd, 1, 100) > 0)
+    {
+        got = read(fd, request, sizeof(request) - 1);
+    }
+
+    body = metrics_render(&len);
+    if (!body)
+        return;
+
+    if (got >= 4 && strncmp(request, "GET ", 4) == 0)
+    {
+        char header[160];
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\n"
+                                  "Content-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n\r\n", len);
+        write_all(fd, header, (size_t)header_len);
+    }
+    write_all(fd, body, len);
+    free(body);
+}
+
+/**
+ * Accept loop of the metrics server thread
+ */
+static void server_main(void *arg)
+{
+    (void)arg;
+
+    while (!atomic_load(&server_stop))
+    {
+        struct pollfd pfd = { server_fd, POLLIN, 0 };
+
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+
+        int client = accept(server_fd, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        serve_client(client);
+        close(client);
+    }
+}
+
+/**
+ * Starts serving metrics on a Unix domain socket in a background thread
+ */
+int metrics_server_start(const char *socket_path)
+{
+    struct sockaddr_un addr;
+
+    if (!socket_path || strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%s[ERROR]%s Invalid metrics socket path\n", COLOR_RED, COLOR_RESET);
+        return 0;
+    }
+
+    server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_fd < 0)
+    {
+        perror("socket");
+        return 0;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+
+    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(server_fd, 8) != 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to listen on %s\n", COLOR_RED, COLOR_RESET, socket_path);
+        close(server_fd);
+        server_fd = -1;
+        return 0;
+    }
+
+    /* Histograms are only populated while latency recording is on */
+    latency_stats_enabled = 1;
+
+    server_path = strdup(socket_path);
+    atomic_store(&server_stop, 0);
+    if (!thread_create(&server_thread, server_main, NULL))
+    {
+        close(server_fd);
+        server_fd = -1;
+        unlink(socket_path);
+        return 0;
+    }
+
+    printf("%s[INFO]%s Serving metrics on unix:%s\n", COLOR_BLUE, COLOR_RESET, socket_path);
+    return 1;
+}
+
+/**
+ * Stops the metrics server and removes its socket
+ */
+void metrics_server_stop(void)
+{
+    if (server_fd < 0)
+        return;
+
+    atomic_store(&server_stop, 1);
+    thread_join(server_thread);
+    close(server_fd);
+    server_fd = -1;
+
+    if (server_path)
+    {
+        unlink(server_path);
+        free(server_path);
+        server_path = NULL;
+    }
+}
+
+#else /* PLATFORM_WINDOWS */
+
+/**
+ * Starts serving metrics on a Unix domain socket in a background thread
+ */
+int metrics_server_start(const char *socket_path)
+{
+    (void)socket_path;
+    fprintf(stderr, "%s[ERROR]%s The metrics socket is not supported on this platform\n",
+            COLOR_RED, COLOR_RESET);
+    return 0;
+}
+
+/**
+ * Stops the metrics server and removes its socket
+ */
+void metrics_server_stop(void)
+{
+}
+
+#endif /* PLATFORM_WINDOWS */
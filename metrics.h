@@ -0,0 +1,75 @@
+/**
+ * metrics.h - Daemon metrics and Prometheus text endpoint
+ *
+ * Counters for the pairing daemon, kept in lock-free per-thread shards that
+ * are only summed when scraped, and a Prometheus text-format endpoint served
+ * on a local Unix domain socket
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Daemon event counters
+ */
+typedef enum {
+    METRIC_DEVICES_SEEN,        /* Controllers that appeared on the bus */
+    METRIC_PAIRED,              /* Controllers whose pairing was written and verified */
+    METRIC_ALREADY_CORRECT,     /* Controllers already paired with the target address */
+    METRIC_FAILED,              /* Controllers that could not be opened, read or written */
+    METRIC_TIMED_OUT,           /* Controllers whose job exceeded the per-device deadline */
+    METRIC_UNVERIFIED,          /* Controllers written whose pairing could not be read back */
+    METRIC_COUNT
+} metric_counter_t;
+
+/**
+ * Adds one to a counter in the calling thread's shard
+ *
+ * @param counter The counter to increment
+ */
+void metrics_increment(metric_counter_t counter);
+
+/**
+ * Sums a counter over all threads
+ *
+ * @param counter The counter to read
+ * @return Current total
+ */
+uint64_t metrics_total(metric_counter_t counter);
+
+/**
+ * Sets the current depth of the daemon's work queue
+ *
+ * @param depth Number of queued jobs
+ */
+void metrics_set_queue_depth(int depth);
+
+/**
+ * Renders all counters, the queue depth and the HID latency histograms
+ * in the Prometheus text exposition format
+ *
+ * @param out_len Output for the length of the returned text
+ * @return Newly allocated text (free with free()), or NULL on failure
+ */
+char* metrics_render(size_t *out_len);
+
+/**
+ * Starts serving metrics on a Unix domain socket in a background thread
+ *
+ * Each connection receives one scrape. Requests starting with "GET " are
+ * answered with an HTTP/1.0 response so curl --unix-socket works directly.
+ *
+ * @param socket_path Filesystem path of the socket (replaced if it exists)
+ * @return 1 on success, 0 on failure or if unsupported on this platform
+ */
+int metrics_server_start(const char *socket_path);
+
+/**
+ * Stops the metrics server and removes its socket
+ */
+void metrics_server_stop(void);
+
+#endif /* METRICS_H */
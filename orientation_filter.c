@@ -0,0 +1,125 @@
+/**
+ * orientation_filter.c - Batched orientation fusion
+ *
+ * Implementation of the Madgwick IMU update. The loop body is straight-line
+ * arithmetic with selects instead of branches so that it vectorizes across
+ * controllers; an idle lane is a lane with dt == 0, whose quaternion only
+ * gets renormalized.
+ */
+
+#include "orientation_filter.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEG_TO_RAD 0.017453292519943295f
+
+/* Keeps the normalizations finite without branching on zero vectors */
+#define NORM_EPSILON 1e-12f
+
+/* Number of float arrays in the filter */
+#define FILTER_ARRAYS 11
+
+/**
+ * Allocates a filter with every lane at the identity orientation
+ */
+int orientation_filter_init(orientation_filter_t *filter, int lanes, float beta)
+{
+    int padded = (lanes + ORIENTATION_LANE_ALIGN - 1) / ORIENTATION_LANE_ALIGN * ORIENTATION_LANE_ALIGN;
+    float *block;
+
+    memset(filter, 0, sizeof(*filter));
+    block = (float*)calloc((size_t)padded * FILTER_ARRAYS, sizeof(float));
+    if (!block)
+        return 0;
+
+    filter->lanes = padded;
+    filter->beta = beta;
+    filter->q0 = block;
+    filter->q1 = block + padded;
+    filter->q2 = block + 2 * padded;
+    filter->q3 = block + 3 * padded;
+    filter->ax = block + 4 * padded;
+    filter->ay = block + 5 * padded;
+    filter->az = block + 6 * padded;
+    filter->gx = block + 7 * padded;
+    filter->gy = block + 8 * padded;
+    filter->gz = block + 9 * padded;
+    filter->dt = block + 10 * padded;
+
+    for (int i = 0; i < padded; i++)
+        filter->q0[i] = 1.0f;
+    return 1;
+}
+
+/**
+ * Frees a filter
+ */
+void orientation_filter_free(orientation_filter_t *filter)
+{
+    free(filter->q0);
+    memset(filter, 0, sizeof(*filter));
+}
+
+/**
+ * Madgwick IMU update over a run of lanes; restrict parameters let the
+ * compiler vectorize without runtime alias checks
+ */
+static void madgwick_lanes(float *restrict q0, float *restrict q1, float *restrict q2, float *restrict q3,
+                           const float *restrict ax_in, const float *restrict ay_in, const float *restrict az_in,
+                           const float *restrict gx_in, const float *restrict gy_in, const float *restrict gz_in,
+                           float *restrict dt, int lanes, float beta)
+{
+    for (int i = 0; i < lanes; i++)
+    {
+        float w = q0[i], x = q1[i], y = q2[i], z = q3[i];
+        float gx = gx_in[i] * DEG_TO_RAD, gy = gy_in[i] * DEG_TO_RAD, gz = gz_in[i] * DEG_TO_RAD;
+        float ax = ax_in[i], ay = ay_in[i], az = az_in[i];
+
+        /* Rate of change from the gyro */
+        float dw = 0.5f * (-x * gx - y * gy - z * gz);
+        float dx = 0.5f * (w * gx + y * gz - z * gy);
+        float dy = 0.5f * (w * gy - x * gz + z * gx);
+        float dz = 0.5f * (w * gz + x * gy - y * gx);
+
+        /* Gradient descent step towards the measured gravity; a_valid is 1 for any
+           real reading and 0 for a zero one, without a comparison */
+        float a_norm = ax * ax + ay * ay + az * az;
+        float a_valid = a_norm / (a_norm + NORM_EPSILON);
+        float a_inv = a_valid / sqrtf(a_norm + NORM_EPSILON);
+        ax *= a_inv;
+        ay *= a_inv;
+        az *= a_inv;
+
+        float ww = w * w, xx = x * x, yy = y * y, zz = z * z;
+        float sw = 4.0f * w * yy + 2.0f * y * ax + 4.0f * w * xx - 2.0f * x * ay;
+        float sx = 4.0f * x * zz - 2.0f * z * ax + 4.0f * ww * x - 2.0f * w * ay - 4.0f * x
+                 + 8.0f * x * xx + 8.0f * x * yy + 4.0f * x * az;
+        float sy = 4.0f * ww * y + 2.0f * w * ax + 4.0f * y * zz - 2.0f * z * ay - 4.0f * y
+                 + 8.0f * y * xx + 8.0f * y * yy + 4.0f * y * az;
+        float sz = 4.0f * xx * z - 2.0f * x * ax + 4.0f * yy * z - 2.0f * y * ay;
+        float s_norm = sw * sw + sx * sx + sy * sy + sz * sz;
+        float s_gain = a_valid * beta / sqrtf(s_norm + NORM_EPSILON);
+
+        w += (dw - s_gain * sw) * dt[i];
+        x += (dx - s_gain * sx) * dt[i];
+        y += (dy - s_gain * sy) * dt[i];
+        z += (dz - s_gain * sz) * dt[i];
+
+        float q_inv = 1.0f / sqrtf(w * w + x * x + y * y + z * z);
+        q0[i] = w * q_inv;
+        q1[i] = x * q_inv;
+        q2[i] = y * q_inv;
+        q3[i] = z * q_inv;
+        dt[i] = 0.0f;
+    }
+}
+
+/**
+ * Advances every lane by its pending sample and clears the pending dt
+ */
+void orientation_filter_update(orientation_filter_t *filter)
+{
+    madgwick_lanes(filter->q0, filter->q1, filter->q2, filter->q3, filter->ax, filter->ay, filter->az,
+                   filter->gx, filter->gy, filter->gz, filter->dt, filter->lanes, filter->beta);
+}
@@ -0,0 +1,58 @@
+/**
+ * orientation_filter.h - Batched orientation fusion
+ *
+ * Madgwick IMU filter over many controllers at once. Filter state and the
+ * per-update inputs are kept in struct-of-arrays layout with one lane per
+ * controller, so a single update step advances every controller and
+ * vectorizes across lanes.
+ */
+
+#ifndef ORIENTATION_FILTER_H
+#define ORIENTATION_FILTER_H
+
+/* Default filter gain (Madgwick's suggested value for IMU-only fusion) */
+#define ORIENTATION_DEFAULT_BETA 0.1f
+
+/* Lane count is rounded up to this so update loops have no remainder */
+#define ORIENTATION_LANE_ALIGN 8
+
+/**
+ * Filter state and pending inputs, one lane per controller
+ *
+ * Set ax..gz and dt for the lanes that have a new sample, then call
+ * orientation_filter_update(). Lanes with dt == 0 are left unchanged.
+ */
+typedef struct {
+    int lanes;
+    float beta;
+    float *q0, *q1, *q2, *q3;   /* Orientation quaternion (w, x, y, z) */
+    float *ax, *ay, *az;        /* Accelerometer in g (any scale works) */
+    float *gx, *gy, *gz;        /* Gyro in degrees per second */
+    float *dt;                  /* Seconds since the lane's previous sample */
+} orientation_filter_t;
+
+/**
+ * Allocates a filter with every lane at the identity orientation
+ *
+ * @param filter The filter to initialize
+ * @param lanes Number of controllers
+ * @param beta Filter gain; higher trusts the accelerometer more
+ * @return 1 on success, 0 on failure
+ */
+int orientation_filter_init(orientation_filter_t *filter, int lanes, float beta);
+
+/**
+ * Frees a filter
+ *
+ * @param filter The filter to free
+ */
+void orientation_filter_free(orientation_filter_t *filter);
+
+/**
+ * Advances every lane by its pending sample and clears the pending dt
+ *
+ * @param filter The filter
+ */
+void orientation_filter_update(orientation_filter_t *filter);
+
+#endif /* ORIENTATION_FILTER_H */
@@ -0,0 +1,437 @@
+/**
+ * pairing_daemon.c - Resident pairing daemon
+ *
+ * Implementation of the daemon. The main thread rescans the bus and queues
+ * controllers it has not seen before; worker threads connect, compare the
+ * current pairing with the target and write it if needed.
+ */
+
+#include "pairing_daemon.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "link_key_pairing.h"
+#include "hid_io.h"
+#include "mac_utils.h"
+#include "metrics.h"
+#include "flight_recorder.h"
+#include "latency_stats.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+/* Capacity of the job queue */
+#define DAEMON_QUEUE_CAPACITY 64
+
+/* Maximum number of controller paths remembered between scans */
+#define DAEMON_MAX_KNOWN 64
+
+/**
+ * Bounded FIFO of controllers waiting for a worker
+ */
+typedef struct {
+    controller_info_t *jobs[DAEMON_QUEUE_CAPACITY];
+    int head;
+    int count;
+    int stopping;
+    mutex_t lock;
+    cond_t ready;
+} job_queue_t;
+
+/**
+ * State shared between the scanner and the workers
+ */
+typedef struct {
+    job_queue_t queue;
+    unsigned char host_mac[6];
+    int timeout_ms;
+} daemon_state_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * Signal handler requesting a clean shutdown
+ */
+static void handle_stop_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/**
+ * Adds a controller to the queue
+ *
+ * @return 1 if queued, 0 if the queue is full
+ */
+static int queue_push(job_queue_t *queue, controller_info_t *job)
+{
+    int queued = 0;
+
+    mutex_lock(&queue->lock);
+    if (queue->count < DAEMON_QUEUE_CAPACITY)
+    {
+        queue->jobs[(queue->head + queue->count) % DAEMON_QUEUE_CAPACITY] = job;
+        queue->count++;
+        metrics_set_queue_depth(queue->count);
+        cond_signal(&queue->ready);
+        queued = 1;
+    }
+    mutex_unlock(&queue->lock);
+
+    return queued;
+}
+
+/**
+ * Takes the next controller from the queue, waiting if it is empty
+ *
+ * @return The controller, or NULL once the queue is stopping
+ */
+static controller_info_t* queue_pop(job_queue_t *queue)
+{
+    controller_info_t *job = NULL;
+
+    mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->stopping)
+    {
+        cond_timedwait(&queue->ready, &queue->lock, 500);
+    }
+    if (queue->count > 0)
+    {
+        job = queue->jobs[queue->head];
+        queue->head = (queue->head + 1) % DAEMON_QUEUE_CAPACITY;
+        queue->count--;
+        metrics_set_queue_depth(queue->count);
+    }
+    mutex_unlock(&queue->lock);
+
+    return job;
+}
+
+/**
+ * Checks whether a job has run past its deadline
+ */
+static int past_deadline(uint64_t deadline_ns)
+{
+    return latency_now_ns() > deadline_ns;
+}
+
+/**
+ * Pairs a DualShock 4 or DualSense with a link key unless it is paired with
+ * the target and BlueZ already holds a key for it
+ *
+ * Where the host stack cannot learn link keys, a DualSense is still paired
+ * with one and only its host address is checked.
+ *
+ * @return The counter describing the outcome, or METRIC_COUNT when a
+ *         DualShock 4 rejected the link key and only its host address
+ *         should be written
+ */
+static metric_counter_t process_link_key(daemon_state_t *state, hid_device *dev, const link_key_layout_t *layout,
+                                         uint64_t deadline_ns)
+{
+    unsigned char device[6], current[6];
+    int stored = link_key_available();
+    link_key_pair_result_t result;
+
+    if (link_key_read_pairing(dev, layout, device, current) && memcmp(current, state->host_mac, 6) == 0 &&
+        (!stored || link_key_bluez_has_key(state->host_mac, device)))
+        return METRIC_ALREADY_CORRECT;
+    if (past_deadline(deadline_ns))
+        return METRIC_TIMED_OUT;
+
+    result = link_key_pair(dev, layout, state->host_mac, NULL);
+    if (result == LINK_KEY_PAIR_KEY_FAILED || result == LINK_KEY_PAIR_WRITE_FAILED)
+        return layout->address_report_id ? METRIC_COUNT : METRIC_FAILED;
+    if (result == LINK_KEY_PAIR_UNVERIFIED)
+        return METRIC_UNVERIFIED;
+    if (result != LINK_KEY_PAIR_OK && !(result == LINK_KEY_PAIR_STORE_FAILED && !stored))
+        return METRIC_FAILED;
+    if (past_deadline(deadline_ns))
+        return METRIC_TIMED_OUT;
+
+    return METRIC_PAIRED;
+}
+
+/**
+ * Brings the pairing of a connected controller in line with the target
+ *
+ * The deadline is checked between the HID calls, so a job that is already
+ * late never starts a write. A single call that hangs cannot be aborted and
+ * is only counted as timed out once it returns.
+ *
+ * @return The counter describing the outcome
+ */
+static metric_counter_t process_controller(daemon_state_t *state, hid_device *dev, uint64_t deadline_ns)
+{
+    unsigned char current[6];
+    int have_current;
+    const link_key_layout_t *layout = link_key_device_layout(dev);
+
+    /* A controller on Bluetooth is checked but never written: its pairing
+       reports are only written over the cable */
+    if (is_bluetooth_device(dev))
+    {
+        have_current = read_pairing(dev, current);
+        if (past_deadline(deadline_ns))
+            return METRIC_TIMED_OUT;
+        return (have_current && memcmp(current, state->host_mac, 6) == 0) ? METRIC_ALREADY_CORRECT : METRIC_FAILED;
+    }
+
+    /* A DualShock 4 is bonded with a link key where the host stack can learn
+       it; a DualSense is always paired with one */
+    if (layout && (link_key_available() || !layout->address_report_id))
+    {
+        metric_counter_t outcome = process_link_key(state, dev, layout, deadline_ns);
+        if (outcome != METRIC_COUNT)
+            return outcome;
+    }
+
+    have_current = read_pairing(dev, current);
+    if (past_deadline(deadline_ns))
+        return METRIC_TIMED_OUT;
+    if (have_current && memcmp(current, state->host_mac, 6) == 0)
+        return METRIC_ALREADY_CORRECT;
+
+    if (!write_pairing(dev, state->host_mac))
+        return METRIC_FAILED;
+    if (past_deadline(deadline_ns))
+        return METRIC_TIMED_OUT;
+
+    /* Verify by reading back; only a matching read-back counts as paired */
+    if (!read_pairing(dev, current))
+        return METRIC_UNVERIFIED;
+    if (memcmp(current, state->host_mac, 6) != 0)
+        return METRIC_FAILED;
+    if (past_deadline(deadline_ns))
+        return METRIC_TIMED_OUT;
+
+    return METRIC_PAIRED;
+}
+
+/**
+ * Worker thread: processes queued controllers until the queue stops
+ */
+static void worker_main(void *arg)
+{
+    daemon_state_t *state = (daemon_state_t*)arg;
+    controller_info_t *controller;
+
+    while ((controller = queue_pop(&state->queue)) != NULL)
+    {
+        uint64_t start = latency_now_ns();
+        uint64_t deadline = start + (uint64_t)state->timeout_ms * 1000000ull;
+        hid_device *dev = connect_to_controller(controller);
+        metric_counter_t outcome;
+        uint64_t elapsed_ms;
+
+        if (!dev)
+            outcome = past_deadline(deadline) ? METRIC_TIMED_OUT : METRIC_FAILED;
+        else
+            outcome = past_deadline(deadline) ? METRIC_TIMED_OUT : process_controller(state, dev, deadline);
+        elapsed_ms = (latency_now_ns() - start) / 1000000ull;
+        metrics_increment(outcome);
+
+        if (dev && (outcome == METRIC_FAILED || outcome == METRIC_TIMED_OUT))
+            flight_recorder_dump(dev, outcome == METRIC_FAILED ? "daemon pairing failed" : "daemon pairing timed out");
+        hid_io_close(dev);
+
+        switch (outcome)
+        {
+        case METRIC_PAIRED:
+            printf("%s[SUCCESS]%s Paired %s (%llums)\n", COLOR_GREEN, COLOR_RESET,
+                   controller->path, (unsigned long long)elapsed_ms);
+            break;
+        case METRIC_ALREADY_CORRECT:
+            printf("%s[INFO]%s %s already paired with target (%llums)\n", COLOR_BLUE, COLOR_RESET,
+                   controller->path, (unsigned long long)elapsed_ms);
+            break;
+        case METRIC_UNVERIFIED:
+            printf("%s[INFO]%s Wrote pairing of %s but could not read it back (%llums)\n", COLOR_BLUE, COLOR_RESET,
+                   controller->path, (unsigned long long)elapsed_ms);
+            break;
+        case METRIC_TIMED_OUT:
+            printf("%s[ERROR]%s Timed out pairing %s (%llums)\n", COLOR_RED, COLOR_RESET,
+                   controller->path, (unsigned long long)elapsed_ms);
+            break;
+        default:
+            printf("%s[ERROR]%s Failed to pair %s (%llums)\n", COLOR_RED, COLOR_RESET,
+                   controller->path, (unsigned long long)elapsed_ms);
+            break;
+        }
+
+        free_controller_info(controller);
+    }
+}
+
+/**
+ * Checks whether a path is in the known list
+ */
+static int find_known(char *known[], int known_count, const char *path)
+{
+    for (int i = 0; i < known_count; i++)
+    {
+        if (strcmp(known[i], path) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Scans the bus once, queues new controllers and forgets removed ones
+ */
+static void scan_bus(daemon_state_t *state, char *known[], int *known_count)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    int present[DAEMON_MAX_KNOWN] = {0};
+    int controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+
+    for (int i = 0; i < controller_count; i++)
+    {
+        controller_info_t *controller = controllers[i];
+        int index = controller->path ? find_known(known, *known_count, controller->path) : -1;
+
+        if (index >= 0 || !controller->path || *known_count >= DAEMON_MAX_KNOWN)
+        {
+            if (index >= 0)
+                present[index] = 1;
+            free_controller_info(controller);
+            continue;
+        }
+
+        /* A full queue leaves the controller unknown so the next scan retries it */
+        char *path = strdup(controller->path);
+        if (!path || !queue_push(&state->queue, controller))
+        {
+            free(path);
+            free_controller_info(controller);
+            continue;
+        }
+
+        metrics_increment(METRIC_DEVICES_SEEN);
+        present[*known_count] = 1;
+        known[(*known_count)++] = path;
+    }
+
+    /* Forget controllers that were unplugged so a re-plug is processed again */
+    for (int i = *known_count - 1; i >= 0; i--)
+    {
+        if (!present[i])
+        {
+            free(known[i]);
+            known[i] = known[*known_count - 1];
+            present[i] = present[*known_count - 1];
+            (*known_count)--;
+        }
+    }
+}
+
+/**
+ * Runs the pairing daemon until interrupted (SIGINT/SIGTERM)
+ */
+int daemon_command(int argc, char **argv)
+{
+    daemon_state_t state;
+    thread_t workers[DAEMON_MAX_WORKERS];
+    char *known[DAEMON_MAX_KNOWN];
+    const char *metrics_socket = NULL;
+    int worker_count = 1;
+    int interval_ms = DAEMON_POLL_INTERVAL_MS;
+    int known_count = 0;
+    int started = 0;
+
+    memset(&state, 0, sizeof(state));
+    state.timeout_ms = DAEMON_DEVICE_TIMEOUT_MS;
+
+    if (argc < 1 || (strlen(argv[0]) != 12 && strlen(argv[0]) != 17) ||
+        !mac_to_bytes(argv[0], strlen(argv[0]), state.host_mac, sizeof(state.host_mac)))
+    {
+        fprintf(stderr, "%s[ERROR]%s daemon requires a host MAC address (AABBCCDDEEFF or AA:BB:CC:DD:EE:FF)\n",
+                COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--metrics") == 0)
+            metrics_socket = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--workers") == 0)
+            worker_count = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--interval") == 0)
+            interval_ms = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--timeout") == 0)
+            state.timeout_ms = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown daemon option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+
+    if (worker_count < 1 || worker_count > DAEMON_MAX_WORKERS || interval_ms < 10 || state.timeout_ms < 1)
+    {
+        fprintf(stderr, "%s[ERROR]%s Invalid daemon option value\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    if (metrics_socket && !metrics_server_start(metrics_socket))
+        return 1;
+
+    mutex_init(&state.queue.lock);
+    cond_init(&state.queue.ready);
+
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+#ifdef SIGPIPE
+    /* Platforms without MSG_NOSIGNAL would otherwise die when a scraper hangs up */
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (!thread_create(&workers[started], worker_main, &state))
+            break;
+        started++;
+    }
+
+    printf("%s[INFO]%s Pairing daemon running with %d worker(s), target %02x:%02x:%02x:%02x:%02x:%02x\n",
+           COLOR_BLUE, COLOR_RESET, started,
+           state.host_mac[0], state.host_mac[1], state.host_mac[2],
+           state.host_mac[3], state.host_mac[4], state.host_mac[5]);
+
+    while (!stop_requested && started > 0)
+    {
+        scan_bus(&state, known, &known_count);
+
+        /* Sleep in short slices so a signal is noticed promptly */
+        for (int slept = 0; slept < interval_ms && !stop_requested; slept += 100)
+        {
+            sleep_ms(interval_ms - slept < 100 ? interval_ms - slept : 100);
+        }
+    }
+
+    printf("%s[INFO]%s Shutting down pairing daemon...\n", COLOR_BLUE, COLOR_RESET);
+
+    /* Let workers drain what is already queued, then stop them */
+    mutex_lock(&state.queue.lock);
+    state.queue.stopping = 1;
+    cond_broadcast(&state.queue.ready);
+    mutex_unlock(&state.queue.lock);
+
+    for (int i = 0; i < started; i++)
+    {
+        thread_join(workers[i]);
+    }
+
+    metrics_server_stop();
+    cond_destroy(&state.queue.ready);
+    mutex_destroy(&state.queue.lock);
+
+    for (int i = 0; i < known_count; i++)
+    {
+        free(known[i]);
+    }
+
+    return started > 0 ? 0 : 1;
+}
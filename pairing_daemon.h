@@ -0,0 +1,33 @@
+/**
+ * pairing_daemon.h - Resident pairing daemon
+ *
+ * Watches for PlayStation controllers and pairs every new one with a fixed
+ * host MAC address, optionally exposing metrics on a Unix domain socket
+ */
+
+#ifndef PAIRING_DAEMON_H
+#define PAIRING_DAEMON_H
+
+/* Default interval between bus scans */
+#define DAEMON_POLL_INTERVAL_MS 1000
+
+/* Default per-device deadline; checked between HID calls, since a call in
+ * progress cannot be aborted */
+#define DAEMON_DEVICE_TIMEOUT_MS 5000
+
+/* Maximum number of pairing worker threads */
+#define DAEMON_MAX_WORKERS 16
+
+/**
+ * Runs the pairing daemon until interrupted (SIGINT/SIGTERM)
+ *
+ * Usage: daemon <mac> [--metrics <socket>] [--workers <n>]
+ *                     [--interval <ms>] [--timeout <ms>]
+ *
+ * @param argc Number of arguments after the "daemon" command
+ * @param argv Arguments after the "daemon" command
+ * @return 0 on clean shutdown, 1 on failure
+ */
+int daemon_command(int argc, char **argv);
+
+#endif /* PAIRING_DAEMON_H */
@@ -33,6 +33,13 @@
     /* Add other Windows-specific mappings as needed */
 #endif
 
+/* Thread-local storage qualifier (MSVC does not support C11 _Thread_local) */
+#ifdef _MSC_VER
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL _Thread_local
+#endif
+
 /* Platform-specific command definitions */
 #ifdef PLATFORM_WINDOWS
     #define PATH_SEPARATOR "\\"
@@ -0,0 +1,719 @@
+/**
+ * provision_recipe.c - Declarative provisioning recipes
+ *
+ * Implementation of the recipe parser and of provision mode. Every
+ * controller gets a worker thread that opens it once, runs the steps in
+ * order and keeps each step's outcome and note instead of printing them.
+ * The main thread prints one block per controller and appends the ledger
+ * records once every worker has finished. Checkpoint records, which must be
+ * durable before a worker counts as done, are written by the workers.
+ */
+
+#include "provision_recipe.h"
+#include "checkpoint_journal.h"
+#include "controller_info.h"
+#include "controller_connection.h"
+#include "mac_utils.h"
+#include "hid_io.h"
+#include "flight_recorder.h"
+#include "latency_stats.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Most tokens on one recipe line */
+#define RECIPE_MAX_TOKENS 12
+
+/* Longest recipe line */
+#define RECIPE_MAX_LINE 512
+
+/* Room for one controller's ledger record */
+#define RECIPE_LEDGER_RECORD 1024
+
+/* Room for a step's note */
+#define RECIPE_NOTE_LENGTH 40
+
+/* Room for a checkpoint key */
+#define RECIPE_KEY_LENGTH 160
+
+static const char *ACTION_NAMES[RECIPE_ACTIONS] = {
+    "identify", "read_pairing", "compare", "write", "verify", "lightbar", "ledger"
+};
+
+static const char *CONDITION_NAMES[RECIPE_CONDITIONS] = {
+    "ok", "always", "failed", "match", "mismatch", "usb", "bluetooth", "ds4", "dualsense", "sixaxis", "move"
+};
+
+static const char *RESULT_NAMES[] = { "skipped", "ok", "failed", "timed out", "unsupported" };
+
+/**
+ * One controller and what the recipe did to it
+ */
+typedef struct {
+    const recipe_t *recipe;
+    checkpoint_t *journal;              /* NULL without --journal */
+    controller_info_t *controller;
+    recipe_device_t device;
+    recipe_step_result_t results[RECIPE_MAX_STEPS];
+    uint32_t elapsed_ms[RECIPE_MAX_STEPS];
+    char notes[RECIPE_MAX_STEPS][RECIPE_NOTE_LENGTH];
+    char ledger[RECIPE_LEDGER_RECORD];  /* Record of the last ledger step, empty if none ran */
+    uint64_t total_ms;
+    int opened;
+    int resumed;                        /* Recorded by an earlier run, skipped */
+    int journal_failed;                 /* Passed but could not be recorded */
+    thread_t thread;
+    int running;
+} recipe_worker_t;
+
+/**
+ * Reports a parse error on a line
+ */
+static int parse_error(char *error, size_t error_len, int line, const char *message, const char *token)
+{
+    snprintf(error, error_len, "line %d: %s%s%s", line, message, token ? " " : "", token ? token : "");
+    return 0;
+}
+
+/**
+ * Parses a positive number of milliseconds
+ */
+static int parse_timeout(const char *token, int *timeout_ms)
+{
+    char *end;
+    long value = strtol(token, &end, 10);
+
+    if (*end || value < 1 || value > 600000)
+        return 0;
+    *timeout_ms = (int)value;
+    return 1;
+}
+
+/**
+ * Parses a colour level
+ */
+static int parse_level(const char *token, unsigned char *level)
+{
+    char *end;
+    long value = strtol(token, &end, 10);
+
+    if (*end || value < 0 || value > 255)
+        return 0;
+    *level = (unsigned char)value;
+    return 1;
+}
+
+/**
+ * Splits a line into whitespace-separated tokens, stopping at a comment
+ *
+ * @return Number of tokens, or -1 if there are too many
+ */
+static int split_line(char *line, char *tokens[])
+{
+    int count = 0;
+    char *cursor = line;
+
+    while (*cursor)
+    {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+            cursor++;
+        if (!*cursor || *cursor == '#')
+            break;
+        if (count == RECIPE_MAX_TOKENS)
+            return -1;
+        tokens[count++] = cursor;
+        while (*cursor && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')
+            cursor++;
+        if (*cursor)
+            *cursor++ = '\0';
+    }
+    return count;
+}
+
+/**
+ * Parses one step line into the next step of the recipe
+ */
+static int parse_step(recipe_t *recipe, char *tokens[], int count, int line, int default_timeout_ms,
+                      char *error, size_t error_len)
+{
+    recipe_step_t *step;
+    int action = -1, next = 1;
+
+    for (int a = 0; a < RECIPE_ACTIONS; a++)
+    {
+        if (strcmp(tokens[0], ACTION_NAMES[a]) == 0)
+            action = a;
+    }
+    if (action < 0)
+        return parse_error(error, error_len, line, "unknown step", tokens[0]);
+    if (recipe->step_count == RECIPE_MAX_STEPS)
+        return parse_error(error, error_len, line, "too many steps", NULL);
+
+    step = &recipe->steps[recipe->step_count];
+    memset(step, 0, sizeof(*step));
+    step->action = (recipe_action_t)action;
+    step->condition = RECIPE_IF_OK;
+    step->timeout_ms = default_timeout_ms;
+    step->line = line;
+
+    if (step->action == RECIPE_LIGHTBAR)
+    {
+        if (count < 4 || !parse_level(tokens[1], &step->color[0]) || !parse_level(tokens[2], &step->color[1]) ||
+            !parse_level(tokens[3], &step->color[2]))
+            return parse_error(error, error_len, line, "lightbar takes red, green and blue levels (0-255)", NULL);
+        next = 4;
+    }
+    else if (step->action == RECIPE_LEDGER)
+    {
+        if (count < 2 || strcmp(tokens[1], "if") == 0 || strcmp(tokens[1], "timeout") == 0)
+            return parse_error(error, error_len, line, "ledger takes a file", NULL);
+        if (strlen(tokens[1]) >= RECIPE_MAX_PATH)
+            return parse_error(error, error_len, line, "ledger path too long", NULL);
+        if (recipe->ledger_path[0] && strcmp(recipe->ledger_path, tokens[1]) != 0)
+            return parse_error(error, error_len, line, "every ledger step must name the same file, not", tokens[1]);
+        strcpy(recipe->ledger_path, tokens[1]);
+        next = 2;
+    }
+
+    while (next < count)
+    {
+        if (strcmp(tokens[next], "if") == 0 && next + 1 < count)
+        {
+            const char *name = tokens[next + 1];
+            int condition = -1;
+
+            step->negate = name[0] == '!';
+            name += step->negate;
+            for (int c = 0; c < RECIPE_CONDITIONS; c++)
+            {
+                if (strcmp(name, CONDITION_NAMES[c]) == 0)
+                    condition = c;
+            }
+            if (condition < 0)
+                return parse_error(error, error_len, line, "unknown condition", tokens[next + 1]);
+            step->condition = (recipe_condition_t)condition;
+        }
+        else if (strcmp(tokens[next], "timeout") == 0 && next + 1 < count)
+        {
+            if (!parse_timeout(tokens[next + 1], &step->timeout_ms))
+                return parse_error(error, error_len, line, "invalid timeout", tokens[next + 1]);
+        }
+        else
+            return parse_error(error, error_len, line, "unexpected", tokens[next]);
+        next += 2;
+    }
+
+    recipe->step_count++;
+    return 1;
+}
+
+/**
+ * Parses a recipe
+ */
+int recipe_parse(const char *text, recipe_t *recipe, char *error, size_t error_len)
+{
+    int default_timeout_ms = RECIPE_DEFAULT_TIMEOUT_MS;
+    int line = 0;
+
+    memset(recipe, 0, sizeof(*recipe));
+    error[0] = '\0';
+
+    while (*text)
+    {
+        char buffer[RECIPE_MAX_LINE], *tokens[RECIPE_MAX_TOKENS];
+        size_t length = strcspn(text, "\n");
+        int count;
+
+        line++;
+        if (length >= sizeof(buffer))
+            return parse_error(error, error_len, line, "line too long", NULL);
+        memcpy(buffer, text, length);
+        buffer[length] = '\0';
+        text += length + (text[length] == '\n');
+
+        count = split_line(buffer, tokens);
+        if (count < 0)
+            return parse_error(error, error_len, line, "too many words", NULL);
+        if (count == 0)
+            continue;
+
+        if (strcmp(tokens[0], "host") == 0)
+        {
+            if (count != 2 || (strlen(tokens[1]) != 12 && strlen(tokens[1]) != 17) ||
+                !mac_to_bytes(tokens[1], strlen(tokens[1]), recipe->host_mac, sizeof(recipe->host_mac)))
+                return parse_error(error, error_len, line, "host takes a MAC address", NULL);
+            recipe->have_host = 1;
+        }
+        else if (strcmp(tokens[0], "timeout") == 0)
+        {
+            if (count != 2 || !parse_timeout(tokens[1], &default_timeout_ms))
+                return parse_error(error, error_len, line, "timeout takes milliseconds", NULL);
+        }
+        else if (!parse_step(recipe, tokens, count, line, default_timeout_ms, error, error_len))
+            return 0;
+    }
+
+    if (recipe->step_count == 0)
+    {
+        snprintf(error, error_len, "the recipe has no steps");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Checks whether any step compares with or writes the target host
+ */
+int recipe_needs_host(const recipe_t *recipe)
+{
+    for (int i = 0; i < recipe->step_count; i++)
+    {
+        recipe_action_t action = recipe->steps[i].action;
+
+        if (action == RECIPE_COMPARE || action == RECIPE_WRITE || action == RECIPE_VERIFY)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Checks whether a step runs on a controller
+ */
+int recipe_should_run(const recipe_step_t *step, const recipe_device_t *device)
+{
+    unsigned short pid = device->product_id;
+    int holds;
+
+    switch (step->condition)
+    {
+    case RECIPE_IF_OK:        holds = !device->failed; break;
+    case RECIPE_IF_ALWAYS:    holds = 1; break;
+    case RECIPE_IF_FAILED:    holds = device->failed; break;
+    case RECIPE_IF_MATCH:     holds = device->match; break;
+    case RECIPE_IF_MISMATCH:  holds = !device->match; break;
+    case RECIPE_IF_USB:       holds = !device->bluetooth; break;
+    case RECIPE_IF_BLUETOOTH: holds = device->bluetooth; break;
+    case RECIPE_IF_DS4:       holds = pid == PRODUCT_DS4; break;
+    case RECIPE_IF_DUALSENSE: holds = pid == PRODUCT_DUALSENSE || pid == PRODUCT_DUALSENSE_EDGE; break;
+    case RECIPE_IF_SIXAXIS:   holds = pid == PRODUCT_SIXAXIS; break;
+    case RECIPE_IF_MOVE:      holds = pid == PRODUCT_MOVE; break;
+    default:                  holds = 0; break;
+    }
+    return step->negate ? !holds : holds;
+}
+
+/**
+ * Gets the name of an action
+ */
+const char* recipe_action_name(recipe_action_t action)
+{
+    return action < RECIPE_ACTIONS ? ACTION_NAMES[action] : "unknown";
+}
+
+/**
+ * Gets the name of a step outcome
+ */
+const char* recipe_result_name(recipe_step_result_t result)
+{
+    return result <= RECIPE_STEP_UNSUPPORTED ? RESULT_NAMES[result] : "unknown";
+}
+
+/**
+ * Renders the ledger record of a controller as a line of JSON
+ */
+static void render_ledger(recipe_worker_t *worker)
+{
+    char address[18] = "", host[18] = "";
+    char *path = worker->controller->path;
+    int written;
+
+    if (worker->device.have_address)
+        bytes_to_mac_string(worker->device.address, address, sizeof(address), 1);
+    if (worker->device.have_current)
+        bytes_to_mac_string(worker->device.current, host, sizeof(host), 1);
+
+    /* Paths, names and addresses hold no characters that need escaping */
+    written = snprintf(worker->ledger, sizeof(worker->ledger),
+                       "{\"time\":%lld,\"path\":\"%s\",\"product\":\"%s\",\"product_id\":%u,\"address\":\"%s\","
+                       "\"host\":\"%s\",\"match\":%s,\"result\":\"%s\",\"steps\":[",
+                       (long long)time(NULL), path ? path : "", get_controller_name(worker->device.product_id),
+                       worker->device.product_id, address, host, worker->device.match ? "true" : "false",
+                       worker->device.failed ? "fail" : "pass");
+    for (int i = 0; i < worker->recipe->step_count && written > 0 && (size_t)written < sizeof(worker->ledger); i++)
+    {
+        if (worker->recipe->steps[i].action == RECIPE_LEDGER)
+            break;
+        written += snprintf(worker->ledger + written, sizeof(worker->ledger) - (size_t)written,
+                            "%s{\"step\":\"%s\",\"result\":\"%s\",\"ms\":%u}", i ? "," : "",
+                            recipe_action_name(worker->recipe->steps[i].action),
+                            recipe_result_name(worker->results[i]), worker->elapsed_ms[i]);
+    }
+    if (written > 0 && (size_t)written < sizeof(worker->ledger))
+        snprintf(worker->ledger + written, sizeof(worker->ledger) - (size_t)written, "]}\n");
+}
+
+/**
+ * Runs one step on an open controller
+ */
+static recipe_step_result_t run_step(recipe_worker_t *worker, hid_device *dev, const recipe_step_t *step,
+                                     char *note)
+{
+    const recipe_t *recipe = worker->recipe;
+    recipe_device_t *device = &worker->device;
+    unsigned char mac[6];
+    int ret;
+
+    switch (step->action)
+    {
+    case RECIPE_IDENTIFY:
+        device->have_address = read_device_address(dev, device->product_id, device->address);
+        if (device->have_address)
+            bytes_to_mac_string(device->address, note, RECIPE_NOTE_LENGTH, 1);
+        else if (device->product_id == PRODUCT_MOVE)
+            snprintf(note, RECIPE_NOTE_LENGTH, "no address report");
+        return device->have_address || device->product_id == PRODUCT_MOVE ? RECIPE_STEP_OK : RECIPE_STEP_FAILED;
+    case RECIPE_READ_PAIRING:
+        device->have_current = read_pairing(dev, device->current);
+        if (!device->have_current)
+            return RECIPE_STEP_FAILED;
+        bytes_to_mac_string(device->current, note, RECIPE_NOTE_LENGTH, 1);
+        return RECIPE_STEP_OK;
+    case RECIPE_COMPARE:
+        if (!device->have_current)
+            return RECIPE_STEP_FAILED;
+        device->match = memcmp(device->current, recipe->host_mac, 6) == 0;
+        snprintf(note, RECIPE_NOTE_LENGTH, "%s", device->match ? "match" : "mismatch");
+        return RECIPE_STEP_OK;
+    case RECIPE_WRITE:
+        if (device->bluetooth)
+            snprintf(note, RECIPE_NOTE_LENGTH, "refused over Bluetooth");
+        return write_host_pairing(dev, recipe->host_mac) ? RECIPE_STEP_OK : RECIPE_STEP_FAILED;
+    case RECIPE_VERIFY:
+        device->have_current = read_pairing(dev, mac);
+        if (device->have_current)
+            memcpy(device->current, mac, 6);
+        device->match = device->have_current && memcmp(mac, recipe->host_mac, 6) == 0;
+        if (device->have_current)
+            bytes_to_mac_string(mac, note, RECIPE_NOTE_LENGTH, 1);
+        return device->match ? RECIPE_STEP_OK : RECIPE_STEP_FAILED;
+    case RECIPE_LIGHTBAR:
+        ret = set_lightbar(dev, device->product_id, step->color[0], step->color[1], step->color[2]);
+        if (ret < 0)
+            snprintf(note, RECIPE_NOTE_LENGTH, "no lightbar");
+        return ret < 0 ? RECIPE_STEP_UNSUPPORTED : ret ? RECIPE_STEP_OK : RECIPE_STEP_FAILED;
+    case RECIPE_LEDGER:
+        render_ledger(worker);
+        return RECIPE_STEP_OK;
+    default:
+        return RECIPE_STEP_FAILED;
+    }
+}
+
+/**
+ * Names a controller in the checkpoint journal by its Bluetooth address,
+ * or by its path where the address cannot be read
+ */
+static void checkpoint_key(const recipe_worker_t *worker, hid_device *dev, char *key, size_t key_len)
+{
+    unsigned char mac[6];
+    char address[18];
+
+    if (read_device_address(dev, worker->device.product_id, mac))
+    {
+        bytes_to_mac_string(mac, address, sizeof(address), 1);
+        snprintf(key, key_len, "address:%s", address);
+    }
+    else
+        snprintf(key, key_len, "path:%s", worker->controller->path);
+}
+
+/**
+ * Worker thread: opens one controller and runs the recipe on it
+ */
+static void worker_main(void *arg)
+{
+    recipe_worker_t *worker = (recipe_worker_t*)arg;
+    const recipe_t *recipe = worker->recipe;
+    uint64_t origin = latency_now_ns();
+    hid_device *dev = connect_to_controller(worker->controller);
+
+    char key[RECIPE_KEY_LENGTH];
+
+    worker->opened = dev != NULL;
+    worker->device.failed = !dev;
+    if (dev)
+        worker->device.bluetooth = is_bluetooth_device(dev);
+    if (dev && worker->journal)
+    {
+        checkpoint_key(worker, dev, key, sizeof(key));
+        worker->resumed = checkpoint_done(worker->journal, key);
+    }
+
+    for (int i = 0; dev && !worker->resumed && i < recipe->step_count; i++)
+    {
+        const recipe_step_t *step = &recipe->steps[i];
+        uint64_t start;
+
+        if (!recipe_should_run(step, &worker->device))
+            continue;
+
+        start = latency_now_ns();
+        worker->results[i] = run_step(worker, dev, step, worker->notes[i]);
+        worker->elapsed_ms[i] = (uint32_t)((latency_now_ns() - start) / 1000000ull);
+        if (worker->results[i] == RECIPE_STEP_OK && worker->elapsed_ms[i] > (uint32_t)step->timeout_ms)
+            worker->results[i] = RECIPE_STEP_TIMED_OUT;
+        if (worker->results[i] == RECIPE_STEP_FAILED || worker->results[i] == RECIPE_STEP_TIMED_OUT)
+        {
+            if (!worker->device.failed)
+                flight_recorder_dump(dev, "provisioning step failed");
+            worker->device.failed = 1;
+        }
+    }
+
+    if (dev && worker->journal && !worker->resumed && !worker->device.failed)
+        worker->journal_failed = !checkpoint_record(worker->journal, key);
+    hid_io_close(dev);
+    worker->total_ms = (latency_now_ns() - origin) / 1000000ull;
+}
+
+/**
+ * Prints what the recipe did to one controller
+ */
+static void print_worker(int index, const recipe_worker_t *worker)
+{
+    const recipe_t *recipe = worker->recipe;
+    int failed = worker->device.failed;
+
+    printf("%s  [%d] %-26s %-14s %s%s%s (%llums)\n", COLOR_WHITE, index,
+           get_controller_name(worker->controller->product_id), worker->controller->path,
+           failed ? COLOR_RED : COLOR_GREEN, failed ? "FAIL" : "PASS", COLOR_RESET,
+           (unsigned long long)worker->total_ms);
+    if (!worker->opened)
+    {
+        printf("      %scould not open the controller%s\n", COLOR_RED, COLOR_RESET);
+        return;
+    }
+    if (worker->resumed)
+    {
+        printf("      done by an earlier run, skipped\n");
+        return;
+    }
+    if (worker->journal_failed)
+        printf("      %scould not be recorded in the journal%s\n", COLOR_RED, COLOR_RESET);
+    for (int i = 0; i < recipe->step_count; i++)
+    {
+        recipe_step_result_t result = worker->results[i];
+        int bad = result == RECIPE_STEP_FAILED || result == RECIPE_STEP_TIMED_OUT;
+
+        printf("      %-13s %s%-11s%s", recipe_action_name(recipe->steps[i].action), bad ? COLOR_RED : "",
+               recipe_result_name(result), bad ? COLOR_RESET : "");
+        if (result != RECIPE_STEP_SKIPPED)
+            printf(" %5ums", worker->elapsed_ms[i]);
+        printf("%s%s\n", worker->notes[i][0] ? "  " : "", worker->notes[i]);
+    }
+}
+
+/**
+ * Reads a whole recipe file
+ *
+ * @return The NUL-terminated text, or NULL on failure
+ */
+static char* read_recipe_file(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    char *text = (char*)malloc(RECIPE_MAX_FILE + 1);
+    size_t length = 0;
+
+    if (file && text)
+    {
+        length = fread(text, 1, RECIPE_MAX_FILE + 1, file);
+        if (length <= RECIPE_MAX_FILE && !ferror(file))
+        {
+            text[length] = '\0';
+            fclose(file);
+            return text;
+        }
+    }
+    if (file)
+        fclose(file);
+    free(text);
+    return NULL;
+}
+
+/**
+ * Runs a recipe file on every connected controller in parallel
+ */
+int provision_command(int argc, char **argv)
+{
+    controller_info_t *controllers[MAX_CONTROLLERS];
+    recipe_worker_t *workers;
+    recipe_t recipe;
+    checkpoint_t journal;
+    char error[128];
+    char *text;
+    const char *journal_path = NULL;
+    FILE *ledger = NULL;
+    uint32_t fingerprint;
+    int controller_count, failed = 0, ledger_failed = 0, journal_failed = 0, resume = 0, resumed = 0;
+
+    if (argc < 1)
+    {
+        fprintf(stderr, "%s[ERROR]%s provision requires a recipe file\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    text = read_recipe_file(argv[0]);
+    if (!text)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to read %s (at most %d bytes)\n", COLOR_RED, COLOR_RESET, argv[0],
+                RECIPE_MAX_FILE);
+        return 1;
+    }
+    if (!recipe_parse(text, &recipe, error, sizeof(error)))
+    {
+        fprintf(stderr, "%s[ERROR]%s %s, %s\n", COLOR_RED, COLOR_RESET, argv[0], error);
+        free(text);
+        return 1;
+    }
+    fingerprint = checkpoint_fingerprint(text, strlen(text), 0);
+    free(text);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--host") == 0)
+        {
+            size_t length = strlen(argv[++i]);
+
+            if ((length != 12 && length != 17) || !mac_to_bytes(argv[i], length, recipe.host_mac, 6))
+            {
+                fprintf(stderr, "%s[ERROR]%s --host requires a MAC address\n", COLOR_RED, COLOR_RESET);
+                return 1;
+            }
+            recipe.have_host = 1;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--journal") == 0)
+            journal_path = argv[++i];
+        else if (strcmp(argv[i], "--resume") == 0)
+            resume = 1;
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown provision option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+    if (recipe_needs_host(&recipe) && !recipe.have_host)
+    {
+        fprintf(stderr, "%s[ERROR]%s The recipe compares or writes the pairing but names no host; add a host "
+                "line or --host\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    if (resume && !journal_path)
+    {
+        fprintf(stderr, "%s[ERROR]%s --resume requires --journal\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    /* Open the ledger before touching any controller so a bad path costs nothing */
+    if (recipe.ledger_path[0])
+    {
+        ledger = fopen(recipe.ledger_path, "a");
+        if (!ledger)
+        {
+            fprintf(stderr, "%s[ERROR]%s Failed to open ledger %s\n", COLOR_RED, COLOR_RESET, recipe.ledger_path);
+            return 1;
+        }
+    }
+
+    /* The same recipe with another host is another job */
+    if (journal_path)
+    {
+        if (recipe.have_host)
+            fingerprint = checkpoint_fingerprint(recipe.host_mac, 6, fingerprint);
+        if (!checkpoint_open(&journal, journal_path, fingerprint, resume, error, sizeof(error)))
+        {
+            fprintf(stderr, "%s[ERROR]%s %s, %s\n", COLOR_RED, COLOR_RESET, journal_path, error);
+            if (ledger)
+                fclose(ledger);
+            return 1;
+        }
+        if (checkpoint_resumed_count(&journal))
+            printf("%s[INFO]%s Resuming: %zu controller(s) done by an earlier run\n", COLOR_BLUE, COLOR_RESET,
+                   checkpoint_resumed_count(&journal));
+    }
+
+    controller_count = find_controllers(controllers, MAX_CONTROLLERS);
+    if (controller_count == 0)
+    {
+        printf("%s[ERROR]%s No supported PlayStation controllers found\n", COLOR_RED, COLOR_RESET);
+        if (ledger)
+            fclose(ledger);
+        if (journal_path)
+            checkpoint_close(&journal);
+        return 1;
+    }
+
+    workers = (recipe_worker_t*)calloc((size_t)controller_count, sizeof(recipe_worker_t));
+    if (!workers)
+    {
+        for (int i = 0; i < controller_count; i++)
+            free_controller_info(controllers[i]);
+        if (ledger)
+            fclose(ledger);
+        if (journal_path)
+            checkpoint_close(&journal);
+        return 1;
+    }
+
+    printf("%s[INFO]%s Provisioning %d controller(s) with %d step(s)\n", COLOR_BLUE, COLOR_RESET,
+           controller_count, recipe.step_count);
+
+    for (int i = 0; i < controller_count; i++)
+    {
+        workers[i].recipe = &recipe;
+        workers[i].journal = journal_path ? &journal : NULL;
+        workers[i].controller = controllers[i];
+        workers[i].device.product_id = controllers[i]->product_id;
+        workers[i].running = thread_create(&workers[i].thread, worker_main, &workers[i]);
+        if (!workers[i].running)
+            worker_main(&workers[i]);
+    }
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (workers[i].running)
+            thread_join(workers[i].thread);
+    }
+
+    printf("\n%s%s=== Provisioning Summary ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (workers[i].device.failed || workers[i].journal_failed)
+            failed++;
+        resumed += workers[i].resumed;
+        print_worker(i, &workers[i]);
+        if (ledger && workers[i].ledger[0])
+            fputs(workers[i].ledger, ledger);
+        free_controller_info(workers[i].controller);
+    }
+    if (ledger && fclose(ledger) != 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to write ledger %s\n", COLOR_RED, COLOR_RESET, recipe.ledger_path);
+        ledger_failed = 1;
+    }
+    if (journal_path)
+    {
+        printf("%s[INFO]%s Journal: %zu fsync(s), %d controller(s) skipped as done\n", COLOR_BLUE, COLOR_RESET,
+               journal.commit_count, resumed);
+        if (!checkpoint_close(&journal))
+        {
+            fprintf(stderr, "%s[ERROR]%s Failed to write journal %s\n", COLOR_RED, COLOR_RESET, journal_path);
+            journal_failed = 1;
+        }
+    }
+    printf("%s[INFO]%s %d of %d controller(s) provisioned\n", COLOR_BLUE, COLOR_RESET,
+           controller_count - failed, controller_count);
+
+    free(workers);
+    return failed || ledger_failed || journal_failed ? 1 : 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * provision_recipe.h - Declarative provisioning recipes
+ *
+ * A recipe lists the steps that provision one controller, one per line,
+ * each built from a primitive of controller_connection.h. The recipe is
+ * run on every connected controller at once, on one thread per controller
+ * that keeps its device open from the first step to the last.
+ *
+ *   # Bench recipe
+ *   host 00:1a:7d:da:71:13
+ *   timeout 2000
+ *   identify
+ *   read_pairing
+ *   compare
+ *   write if mismatch timeout 5000
+ *   verify
+ *   lightbar 0 255 0
+ *   lightbar 255 0 0 if failed
+ *   ledger bench-ledger.jsonl if always
+ *
+ * Directives: "host <mac>" sets the target host address and "timeout <ms>"
+ * the default step timeout. Steps:
+ *
+ *   identify        Read the controller's own Bluetooth address
+ *   read_pairing    Read the paired host address
+ *   compare         Compare the paired host with the target
+ *   write           Pair with the target (a link key where the controller takes one)
+ *   verify          Read the paired host back and require the target
+ *   lightbar R G B  Set the lightbar (DualShock 4, DualSense) or sphere (Move)
+ *   ledger <file>   Append the controller's record to a JSON-lines ledger
+ *
+ * A step runs only if its condition holds: "if ok" (the default, no step
+ * has failed so far), "always", "failed", "match", "mismatch", "usb",
+ * "bluetooth", "ds4", "dualsense", "sixaxis" or "move", each negated by a
+ * leading '!'. "timeout <ms>" overrides the step's timeout; the deadline
+ * is checked once the step's HID calls return, since a call in progress
+ * cannot be aborted.
+ */
+
+#ifndef PROVISION_RECIPE_H
+#define PROVISION_RECIPE_H
+
+#include <stddef.h>
+
+/* Longest recipe, in steps */
+#define RECIPE_MAX_STEPS 32
+
+/* Default step timeout */
+#define RECIPE_DEFAULT_TIMEOUT_MS 2000
+
+/* Longest ledger path */
+#define RECIPE_MAX_PATH 256
+
+/* Longest recipe file */
+#define RECIPE_MAX_FILE (64 * 1024)
+
+/**
+ * Step actions
+ */
+typedef enum {
+    RECIPE_IDENTIFY = 0,
+    RECIPE_READ_PAIRING,
+    RECIPE_COMPARE,
+    RECIPE_WRITE,
+    RECIPE_VERIFY,
+    RECIPE_LIGHTBAR,
+    RECIPE_LEDGER,
+    RECIPE_ACTIONS
+} recipe_action_t;
+
+/**
+ * Step conditions
+ */
+typedef enum {
+    RECIPE_IF_OK = 0,       /* No step has failed so far */
+    RECIPE_IF_ALWAYS,
+    RECIPE_IF_FAILED,       /* A step has failed */
+    RECIPE_IF_MATCH,        /* The paired host is known to be the target */
+    RECIPE_IF_MISMATCH,     /* The paired host is not known to be the target */
+    RECIPE_IF_USB,
+    RECIPE_IF_BLUETOOTH,
+    RECIPE_IF_DS4,
+    RECIPE_IF_DUALSENSE,    /* DualSense or DualSense Edge */
+    RECIPE_IF_SIXAXIS,
+    RECIPE_IF_MOVE,
+    RECIPE_CONDITIONS
+} recipe_condition_t;
+
+/**
+ * Outcome of one step on one controller
+ */
+typedef enum {
+    RECIPE_STEP_SKIPPED = 0,    /* Its condition did not hold */
+    RECIPE_STEP_OK,
+    RECIPE_STEP_FAILED,
+    RECIPE_STEP_TIMED_OUT,
+    RECIPE_STEP_UNSUPPORTED     /* The controller has no such feature; not a failure */
+} recipe_step_result_t;
+
+/**
+ * One step of a recipe
+ */
+typedef struct {
+    recipe_action_t action;
+    recipe_condition_t condition;
+    int negate;                     /* Run when the condition does not hold */
+    int timeout_ms;
+    unsigned char color[3];         /* RECIPE_LIGHTBAR */
+    int line;                       /* Line in the recipe file */
+} recipe_step_t;
+
+/**
+ * A parsed recipe
+ */
+typedef struct {
+    recipe_step_t steps[RECIPE_MAX_STEPS];
+    int step_count;
+    int have_host;
+    unsigned char host_mac[6];
+    char ledger_path[RECIPE_MAX_PATH];  /* Empty without a ledger step */
+} recipe_t;
+
+/**
+ * What the steps so far have learned about one controller
+ */
+typedef struct {
+    unsigned short product_id;
+    int bluetooth;
+    int failed;                     /* A step has failed or timed out */
+    int match;                      /* The paired host was read as the target */
+    int have_address;
+    unsigned char address[6];       /* The controller's own address */
+    int have_current;
+    unsigned char current[6];       /* The paired host address last read */
+} recipe_device_t;
+
+/**
+ * Parses a recipe
+ *
+ * @param text The recipe file, NUL-terminated
+ * @param recipe Receives the recipe
+ * @param error Receives a message naming the line of the first error
+ * @param error_len Size of the error buffer
+ * @return 1 on success, 0 on a syntax error
+ */
+int recipe_parse(const char *text, recipe_t *recipe, char *error, size_t error_len);
+
+/**
+ * Checks whether any step compares with or writes the target host
+ *
+ * @param recipe The recipe
+ * @return 1 if the recipe needs a host address, 0 otherwise
+ */
+int recipe_needs_host(const recipe_t *recipe);
+
+/**
+ * Checks whether a step runs on a controller
+ *
+ * @param step The step
+ * @param device What the steps so far have learned about the controller
+ * @return 1 if the step's condition holds (or, negated, does not), 0 otherwise
+ */
+int recipe_should_run(const recipe_step_t *step, const recipe_device_t *device);
+
+/**
+ * Gets the name of an action
+ *
+ * @param action The action
+ * @return Name as written in recipes, such as "read_pairing"
+ */
+const char* recipe_action_name(recipe_action_t action);
+
+/**
+ * Gets the name of a step outcome
+ *
+ * @param result The outcome
+ * @return Short name such as "timed out"
+ */
+const char* recipe_result_name(recipe_step_result_t result);
+
+/**
+ * Runs a recipe file on every connected controller in parallel
+ *
+ * Usage: provision <recipe> [--host <mac>] [--journal <file> [--resume]]
+ *
+ * --host overrides the recipe's host directive. Each controller is opened
+ * once and runs every step on its own thread; the steps' results are
+ * printed per controller and the ledger records appended in one batch once
+ * every controller is done. With --journal, every controller that passes is
+ * recorded by its Bluetooth address (or path) in a checkpoint journal, and
+ * --resume skips the controllers an interrupted run already recorded.
+ *
+ * @param argc Number of arguments after the "provision" command
+ * @param argv Arguments after the "provision" command
+ * @return 0 if no step failed on any controller, 1 otherwise
+ */
+int provision_command(int argc, char **argv);
+
+#endif /* PROVISION_RECIPE_H */
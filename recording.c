@@ -0,0 +1,927 @@
+/**
+ * recording.c - Compressed input report recordings
+ *
+ * Implementation of the recording format of recording.h. The stream only
+ * copies each report into a per-device SPSC queue; a writer thread encodes
+ * the queued reports into per-device chunk buffers and writes a chunk once
+ * it is full, so neither encoding nor file I/O runs on the stream's thread.
+ * Encoder and decoder share one codec that tracks the previous two reports
+ * of a device and the field layout of its current report length.
+ */
+
+/* 64-bit file offsets on 32-bit POSIX systems */
+#ifndef _FILE_OFFSET_BITS
+    #define _FILE_OFFSET_BITS 64
+#endif
+
+#include "recording.h"
+#include "report_decoder.h"
+#include "hid_capture.h"
+#include "crc32.h"
+#include "thread_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#ifdef PLATFORM_WINDOWS
+    #define file_seek _fseeki64
+    #define file_tell _ftelli64
+#else
+    #define file_seek fseeko
+    #define file_tell ftello
+#endif
+
+#define RECORDING_INDEX_MAGIC "SXIX"
+
+/* Most bytes one report can encode to: the timestamp and length tokens and
+   two five-byte varints per field */
+#define RECORDING_MAX_ENCODED (2 * 10 + INPUT_REPORT_MAX * 10)
+
+/**
+ * Field kinds: width, byte order and prediction
+ */
+typedef enum {
+    FIELD_U8 = 0,       /* Predicted unchanged */
+    FIELD_U8_STEP,      /* Predicted to repeat its last step (counters) */
+    FIELD_LE16,
+    FIELD_LE16_STEP,
+    FIELD_BE16
+} field_kind_t;
+
+typedef struct {
+    uint8_t offset;
+    uint8_t kind;
+} field_t;
+
+/* Multi-byte and counting fields of each layout; every other byte is a FIELD_U8 */
+static const field_t DS4_FIELDS[] = {
+    { 7, FIELD_U8_STEP },               /* Report counter in the upper six bits */
+    { 10, FIELD_LE16_STEP },            /* Sensor timestamp */
+    { 13, FIELD_LE16 }, { 15, FIELD_LE16 }, { 17, FIELD_LE16 },  /* Gyro */
+    { 19, FIELD_LE16 }, { 21, FIELD_LE16 }, { 23, FIELD_LE16 },  /* Accelerometer */
+};
+
+static const field_t SIXAXIS_FIELDS[] = {
+    { 41, FIELD_BE16 }, { 43, FIELD_BE16 }, { 45, FIELD_BE16 }, { 47, FIELD_BE16 },
+};
+
+static const field_t MOVE_FIELDS[] = {
+    { 13, FIELD_LE16 }, { 15, FIELD_LE16 }, { 17, FIELD_LE16 },  /* Accelerometer, two frames */
+    { 19, FIELD_LE16 }, { 21, FIELD_LE16 }, { 23, FIELD_LE16 },
+    { 25, FIELD_LE16 }, { 27, FIELD_LE16 }, { 29, FIELD_LE16 },  /* Gyro, two frames */
+    { 31, FIELD_LE16 }, { 33, FIELD_LE16 }, { 35, FIELD_LE16 },
+};
+
+/**
+ * Prediction state of one device within a chunk
+ */
+typedef struct {
+    report_family_t family;
+    uint32_t length;
+    int field_count;
+    field_t fields[INPUT_REPORT_MAX];
+    unsigned char prev[INPUT_REPORT_MAX];    /* Previous report, zero-padded */
+    unsigned char before[INPUT_REPORT_MAX];  /* The one before it */
+    uint64_t last_us;
+    int64_t last_step_us;
+} codec_t;
+
+/**
+ * Per-device writer state
+ */
+typedef struct {
+    report_ring_t queue;
+    unsigned short product_id;
+    uint64_t dropped;           /* Written by the adding thread */
+    codec_t codec;
+    unsigned char *payload;
+    size_t size, capacity;
+    uint32_t count;
+    uint64_t first_us, last_us;
+} writer_device_t;
+
+struct recording_writer {
+    FILE *file;
+    int device_count;
+    writer_device_t *devices;
+    recording_chunk_t *index;
+    size_t index_count, index_capacity;
+    uint64_t offset;
+    thread_t thread;
+    _Atomic int stopping;
+    recording_stats_t stats;    /* Written by the writer thread, read after join */
+};
+
+struct recording_reader {
+    FILE *file;
+    recording_chunk_t *chunks;
+    int chunk_count;
+    unsigned char *payload;
+    size_t capacity;
+};
+
+/**
+ * Little-endian field writers and readers
+ */
+static void put_u16(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    put_u16(p, v & 0xffff);
+    put_u16(p + 2, v >> 16);
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get_u16(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return get_u16(p) | get_u16(p + 2) << 16;
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+/**
+ * Varint and zigzag coding
+ */
+static size_t put_varint(unsigned char *p, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80)
+    {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+static int get_varint(const unsigned char *p, size_t size, size_t *pos, uint64_t *v)
+{
+    uint64_t value = 0;
+
+    for (int shift = 0; shift < 64 && *pos < size; shift += 7)
+    {
+        unsigned char byte = p[(*pos)++];
+
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            *v = value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**
+ * Reads a field's value
+ */
+static uint32_t field_get(const unsigned char *p, const field_t *f)
+{
+    switch (f->kind)
+    {
+        case FIELD_LE16:
+        case FIELD_LE16_STEP:
+            return get_u16(p + f->offset);
+        case FIELD_BE16:
+            return (uint32_t)p[f->offset] << 8 | p[f->offset + 1];
+        default:
+            return p[f->offset];
+    }
+}
+
+/**
+ * Writes a field's value, truncated to its width
+ */
+static void field_put(unsigned char *p, const field_t *f, uint32_t v)
+{
+    switch (f->kind)
+    {
+        case FIELD_LE16:
+        case FIELD_LE16_STEP:
+            put_u16(p + f->offset, v);
+            break;
+        case FIELD_BE16:
+            p[f->offset] = (unsigned char)(v >> 8);
+            p[f->offset + 1] = (unsigned char)v;
+            break;
+        default:
+            p[f->offset] = (unsigned char)v;
+            break;
+    }
+}
+
+/**
+ * Predicts a field from the previous two reports
+ */
+static uint32_t field_predict(const codec_t *c, const field_t *f)
+{
+    uint32_t last = field_get(c->prev, f);
+
+    if (f->kind == FIELD_U8_STEP || f->kind == FIELD_LE16_STEP)
+        return 2 * last - field_get(c->before, f);
+    return last;
+}
+
+/**
+ * Gets the difference of a value from its prediction, wrapped to the field width
+ */
+static int32_t field_residual(const field_t *f, uint32_t value, uint32_t predicted)
+{
+    int bits = (f->kind == FIELD_U8 || f->kind == FIELD_U8_STEP) ? 8 : 16;
+    uint32_t mask = (1u << bits) - 1;
+    uint32_t wrapped = (value - predicted) & mask;
+
+    return wrapped & (1u << (bits - 1)) ? (int32_t)wrapped - (int32_t)(mask + 1) : (int32_t)wrapped;
+}
+
+/**
+ * Lays out the fields of a report length: the family's listed fields where
+ * they fit, single bytes everywhere else
+ */
+static void codec_set_length(codec_t *c, uint32_t length)
+{
+    const field_t *table = NULL;
+    size_t table_count = 0;
+    uint32_t pos = 0;
+
+    switch (c->family)
+    {
+        case REPORT_FAMILY_DS4:
+            table = DS4_FIELDS;
+            table_count = sizeof(DS4_FIELDS) / sizeof(DS4_FIELDS[0]);
+            break;
+        case REPORT_FAMILY_SIXAXIS:
+            table = SIXAXIS_FIELDS;
+            table_count = sizeof(SIXAXIS_FIELDS) / sizeof(SIXAXIS_FIELDS[0]);
+            break;
+        case REPORT_FAMILY_MOVE:
+            table = MOVE_FIELDS;
+            table_count = sizeof(MOVE_FIELDS) / sizeof(MOVE_FIELDS[0]);
+            break;
+        default:
+            break;
+    }
+
+    c->length = length;
+    c->field_count = 0;
+    while (pos < length)
+    {
+        field_t field = { (uint8_t)pos, FIELD_U8 };
+
+        for (size_t i = 0; i < table_count; i++)
+        {
+            int width = table[i].kind == FIELD_U8 || table[i].kind == FIELD_U8_STEP ? 1 : 2;
+
+            if (table[i].offset == pos && pos + (uint32_t)width <= length)
+            {
+                field = table[i];
+                break;
+            }
+        }
+        c->fields[c->field_count++] = field;
+        pos += (field.kind == FIELD_U8 || field.kind == FIELD_U8_STEP) ? 1 : 2;
+    }
+}
+
+/**
+ * Starts a chunk: predictions begin from an all-zero, empty report
+ */
+static void codec_reset(codec_t *c, unsigned short product_id, uint64_t first_us)
+{
+    memset(c, 0, sizeof(*c));
+    c->family = report_family(product_id);
+    c->last_us = first_us;
+}
+
+/**
+ * Makes a report the previous one
+ */
+static void codec_advance(codec_t *c, const unsigned char *report, uint64_t us, int64_t step_us)
+{
+    memcpy(c->before, c->prev, INPUT_REPORT_MAX);
+    memcpy(c->prev, report, INPUT_REPORT_MAX);
+    c->last_us = us;
+    c->last_step_us = step_us;
+}
+
+/**
+ * Encodes one report
+ *
+ * @return Bytes written to out, at most RECORDING_MAX_ENCODED
+ */
+static size_t encode_report(codec_t *c, const input_report_t *report, unsigned char *out)
+{
+    unsigned char cur[INPUT_REPORT_MAX] = {0};
+    uint32_t length = report->length < INPUT_REPORT_MAX ? report->length : INPUT_REPORT_MAX;
+    uint64_t us = report->timestamp_ns / 1000u;
+    int64_t step = (int64_t)(us - c->last_us);
+    int changed = length != c->length;
+    uint64_t zeros = 0;
+    size_t n;
+
+    memcpy(cur, report->data, length);
+    n = put_varint(out, zigzag(step - c->last_step_us) << 1 | (uint64_t)changed);
+    if (changed)
+    {
+        n += put_varint(out + n, length);
+        codec_set_length(c, length);
+    }
+
+    for (int i = 0; i < c->field_count; i++)
+    {
+        const field_t *f = &c->fields[i];
+        uint64_t residual = zigzag(field_residual(f, field_get(cur, f), field_predict(c, f)));
+
+        if (residual == 0)
+        {
+            zeros++;
+            continue;
+        }
+        n += put_varint(out + n, zeros);
+        n += put_varint(out + n, residual - 1);
+        zeros = 0;
+    }
+    if (zeros)
+        n += put_varint(out + n, zeros);
+
+    codec_advance(c, cur, us, step);
+    return n;
+}
+
+/**
+ * Decodes one report
+ *
+ * @return 1 on success, 0 if the payload is damaged
+ */
+static int decode_report(codec_t *c, const unsigned char *in, size_t size, size_t *pos, input_report_t *report)
+{
+    unsigned char cur[INPUT_REPORT_MAX] = {0};
+    uint64_t token, value;
+    int64_t step;
+    int i = 0;
+
+    if (!get_varint(in, size, pos, &token))
+        return 0;
+    step = c->last_step_us + unzigzag(token >> 1);
+    if (token & 1)
+    {
+        if (!get_varint(in, size, pos, &value) || value > INPUT_REPORT_MAX)
+            return 0;
+        codec_set_length(c, (uint32_t)value);
+    }
+
+    while (i < c->field_count)
+    {
+        if (!get_varint(in, size, pos, &value) || value > (uint64_t)(c->field_count - i))
+            return 0;
+        for (uint64_t z = 0; z < value; z++, i++)
+            field_put(cur, &c->fields[i], field_predict(c, &c->fields[i]));
+        if (i == c->field_count)
+            break;
+
+        if (!get_varint(in, size, pos, &value) || value >= 0xffffffffu)
+            return 0;
+        field_put(cur, &c->fields[i], field_predict(c, &c->fields[i]) + (uint32_t)unzigzag(value + 1));
+        i++;
+    }
+
+    report->timestamp_ns = (c->last_us + (uint64_t)step) * 1000u;
+    report->length = c->length;
+    memcpy(report->data, cur, INPUT_REPORT_MAX);
+    codec_advance(c, cur, c->last_us + (uint64_t)step, step);
+    return 1;
+}
+
+/**
+ * Writes a device's buffered chunk and adds it to the index
+ */
+static void flush_chunk(recording_writer_t *writer, int device)
+{
+    writer_device_t *d = &writer->devices[device];
+    unsigned char header[RECORDING_CHUNK_HEADER_SIZE];
+    recording_chunk_t *entry;
+
+    if (d->count == 0)
+        return;
+
+    if (writer->index_count == writer->index_capacity)
+    {
+        size_t capacity = writer->index_capacity ? writer->index_capacity * 2 : 64;
+        recording_chunk_t *index = (recording_chunk_t*)realloc(writer->index, capacity * sizeof(*index));
+
+        if (!index)
+        {
+            writer->stats.write_failed = 1;
+            d->count = 0;
+            d->size = 0;
+            return;
+        }
+        writer->index = index;
+        writer->index_capacity = capacity;
+    }
+
+    put_u16(header, (uint32_t)device);
+    put_u16(header + 2, d->product_id);
+    put_u32(header + 4, d->count);
+    put_u32(header + 8, (uint32_t)d->size);
+    put_u32(header + 12, crc32(d->payload, d->size));
+    put_u64(header + 16, d->first_us);
+    put_u64(header + 24, d->last_us);
+    if (fwrite(header, 1, sizeof(header), writer->file) != sizeof(header) ||
+        fwrite(d->payload, 1, d->size, writer->file) != d->size)
+    {
+        writer->stats.write_failed = 1;
+    }
+
+    entry = &writer->index[writer->index_count++];
+    entry->device = (uint16_t)device;
+    entry->product_id = d->product_id;
+    entry->count = d->count;
+    entry->offset = writer->offset;
+    entry->first_us = d->first_us;
+    entry->last_us = d->last_us;
+
+    writer->offset += sizeof(header) + d->size;
+    writer->stats.chunks++;
+    d->count = 0;
+    d->size = 0;
+}
+
+/**
+ * Encodes one report into its device's chunk
+ */
+static void append_report(recording_writer_t *writer, int device, const input_report_t *report)
+{
+    writer_device_t *d = &writer->devices[device];
+
+    if (d->capacity - d->size < RECORDING_MAX_ENCODED)
+    {
+        size_t capacity = d->capacity * 2;
+        unsigned char *payload = (unsigned char*)realloc(d->payload, capacity);
+
+        if (!payload)
+        {
+            writer->stats.write_failed = 1;
+            return;
+        }
+        d->payload = payload;
+        d->capacity = capacity;
+    }
+
+    if (d->count == 0)
+    {
+        d->first_us = report->timestamp_ns / 1000u;
+        codec_reset(&d->codec, d->product_id, d->first_us);
+    }
+    d->size += encode_report(&d->codec, report, d->payload + d->size);
+    d->last_us = report->timestamp_ns / 1000u;
+    d->count++;
+
+    writer->stats.reports++;
+    writer->stats.capture_bytes += HID_CAPTURE_RECORD_HEADER_SIZE + 8 + report->length;
+    if (d->count == RECORDING_CHUNK_REPORTS)
+        flush_chunk(writer, device);
+}
+
+/**
+ * Writer thread: drains the device queues until stopped, then writes the
+ * partial chunks
+ */
+static void writer_main(void *arg)
+{
+    recording_writer_t *writer = (recording_writer_t*)arg;
+
+    for (;;)
+    {
+        /* Checked before draining, so the last pass sees every report added before the stop */
+        int stopping = atomic_load_explicit(&writer->stopping, memory_order_acquire);
+        int drained = 0;
+
+        for (int i = 0; i < writer->device_count; i++)
+        {
+            const input_report_t *report;
+
+            while ((report = report_ring_peek(&writer->devices[i].queue)) != NULL)
+            {
+                append_report(writer, i, report);
+                report_ring_release(&writer->devices[i].queue);
+                drained++;
+            }
+        }
+        if (stopping)
+            break;
+        if (drained == 0)
+            sleep_ms(1);
+    }
+
+    for (int i = 0; i < writer->device_count; i++)
+        flush_chunk(writer, i);
+}
+
+/**
+ * Frees a writer and everything it allocated
+ */
+static void free_writer(recording_writer_t *writer)
+{
+    for (int i = 0; i < writer->device_count; i++)
+    {
+        report_ring_free(&writer->devices[i].queue);
+        free(writer->devices[i].payload);
+    }
+    free(writer->devices);
+    free(writer->index);
+    free(writer);
+}
+
+/**
+ * Creates a recording and starts its writer thread
+ */
+recording_writer_t* recording_writer_open(const char *path, int device_count)
+{
+    unsigned char header[RECORDING_FILE_HEADER_SIZE];
+    recording_writer_t *writer;
+
+    if (device_count <= 0)
+        return NULL;
+    writer = (recording_writer_t*)calloc(1, sizeof(*writer));
+    if (!writer)
+        return NULL;
+    writer->devices = (writer_device_t*)calloc((size_t)device_count, sizeof(writer_device_t));
+    if (!writer->devices)
+    {
+        free(writer);
+        return NULL;
+    }
+    writer->device_count = device_count;
+    for (int i = 0; i < device_count; i++)
+    {
+        writer_device_t *d = &writer->devices[i];
+
+        d->capacity = RECORDING_MAX_ENCODED * 16;
+        d->payload = (unsigned char*)malloc(d->capacity);
+        if (!d->payload || !report_ring_init(&d->queue, RECORDING_QUEUE_SLOTS))
+        {
+            free_writer(writer);
+            return NULL;
+        }
+    }
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to create %s\n", COLOR_RED, COLOR_RESET, path);
+        free_writer(writer);
+        return NULL;
+    }
+
+    memcpy(header, RECORDING_MAGIC, 6);
+    put_u16(header + 6, RECORDING_VERSION);
+    put_u64(header + 8, (uint64_t)time(NULL));
+    if (fwrite(header, 1, sizeof(header), writer->file) != sizeof(header))
+        writer->stats.write_failed = 1;
+    writer->offset = sizeof(header);
+
+    atomic_init(&writer->stopping, 0);
+    if (!thread_create(&writer->thread, writer_main, writer))
+    {
+        fclose(writer->file);
+        free_writer(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/**
+ * Sets the product of a device before its first report
+ */
+void recording_writer_set_device(recording_writer_t *writer, int device, unsigned short product_id)
+{
+    if (writer && device >= 0 && device < writer->device_count)
+        writer->devices[device].product_id = product_id;
+}
+
+/**
+ * Queues one report for the writer thread without blocking
+ */
+int recording_writer_add(recording_writer_t *writer, int device, const input_report_t *report)
+{
+    writer_device_t *d;
+    input_report_t *slot;
+
+    if (!writer || device < 0 || device >= writer->device_count)
+        return 0;
+    d = &writer->devices[device];
+
+    slot = report_ring_claim(&d->queue);
+    if (!slot)
+    {
+        d->dropped++;
+        return 0;
+    }
+    slot->timestamp_ns = report->timestamp_ns;
+    slot->length = report->length < INPUT_REPORT_MAX ? report->length : INPUT_REPORT_MAX;
+    memcpy(slot->data, report->data, slot->length);
+    report_ring_publish(&d->queue);
+    return 1;
+}
+
+/**
+ * Encodes every queued report, writes the index and closes the file
+ */
+int recording_writer_close(recording_writer_t *writer, recording_stats_t *stats)
+{
+    unsigned char entry[RECORDING_INDEX_ENTRY_SIZE], footer[RECORDING_FOOTER_SIZE];
+    uint64_t index_offset;
+    int ok;
+
+    if (!writer)
+        return 0;
+
+    atomic_store_explicit(&writer->stopping, 1, memory_order_release);
+    thread_join(writer->thread);
+
+    index_offset = writer->offset;
+    for (size_t i = 0; i < writer->index_count; i++)
+    {
+        const recording_chunk_t *chunk = &writer->index[i];
+
+        put_u16(entry, chunk->device);
+        put_u16(entry + 2, chunk->product_id);
+        put_u32(entry + 4, chunk->count);
+        put_u64(entry + 8, chunk->offset);
+        put_u64(entry + 16, chunk->first_us);
+        put_u64(entry + 24, chunk->last_us);
+        if (fwrite(entry, 1, sizeof(entry), writer->file) != sizeof(entry))
+            writer->stats.write_failed = 1;
+    }
+    put_u64(footer, index_offset);
+    put_u32(footer + 8, (uint32_t)writer->index_count);
+    memcpy(footer + 12, RECORDING_INDEX_MAGIC, 4);
+    if (fwrite(footer, 1, sizeof(footer), writer->file) != sizeof(footer))
+        writer->stats.write_failed = 1;
+    if (fclose(writer->file) != 0)
+        writer->stats.write_failed = 1;
+
+    writer->stats.bytes = index_offset + writer->index_count * RECORDING_INDEX_ENTRY_SIZE + RECORDING_FOOTER_SIZE;
+    for (int i = 0; i < writer->device_count; i++)
+        writer->stats.dropped += writer->devices[i].dropped;
+    if (stats)
+        *stats = writer->stats;
+
+    ok = !writer->stats.write_failed;
+    free_writer(writer);
+    return ok;
+}
+
+/**
+ * Checks whether a file starts like a recording
+ */
+int recording_is_recording(const char *path)
+{
+    unsigned char magic[6];
+    FILE *file = fopen(path, "rb");
+    int match;
+
+    if (!file)
+        return 0;
+    match = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, RECORDING_MAGIC, 6) == 0;
+    fclose(file);
+    return match;
+}
+
+/**
+ * Appends a chunk to a reader's index
+ */
+static int add_chunk(recording_reader_t *reader, const recording_chunk_t *chunk, int *capacity)
+{
+    if (reader->chunk_count == *capacity)
+    {
+        int grown = *capacity ? *capacity * 2 : 64;
+        recording_chunk_t *chunks = (recording_chunk_t*)realloc(reader->chunks, (size_t)grown * sizeof(*chunks));
+
+        if (!chunks)
+            return 0;
+        reader->chunks = chunks;
+        *capacity = grown;
+    }
+    reader->chunks[reader->chunk_count++] = *chunk;
+    return 1;
+}
+
+/**
+ * Loads the index from the footer
+ *
+ * @return 1 on success, 0 if there is no valid index
+ */
+static int load_index(recording_reader_t *reader, uint64_t size)
+{
+    unsigned char footer[RECORDING_FOOTER_SIZE], entry[RECORDING_INDEX_ENTRY_SIZE];
+    uint64_t index_offset;
+    uint32_t count;
+    int capacity = 0;
+
+    if (size < RECORDING_FILE_HEADER_SIZE + RECORDING_FOOTER_SIZE ||
+        file_seek(reader->file, (int64_t)(size - RECORDING_FOOTER_SIZE), SEEK_SET) != 0 ||
+        fread(footer, 1, sizeof(footer), reader->file) != sizeof(footer) ||
+        memcmp(footer + 12, RECORDING_INDEX_MAGIC, 4) != 0)
+    {
+        return 0;
+    }
+
+    index_offset = get_u64(footer);
+    count = get_u32(footer + 8);
+    if (index_offset + (uint64_t)count * RECORDING_INDEX_ENTRY_SIZE + RECORDING_FOOTER_SIZE != size ||
+        file_seek(reader->file, (int64_t)index_offset, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        recording_chunk_t chunk;
+
+        if (fread(entry, 1, sizeof(entry), reader->file) != sizeof(entry))
+            return 0;
+        chunk.device = (uint16_t)get_u16(entry);
+        chunk.product_id = (uint16_t)get_u16(entry + 2);
+        chunk.count = get_u32(entry + 4);
+        chunk.offset = get_u64(entry + 8);
+        chunk.first_us = get_u64(entry + 16);
+        chunk.last_us = get_u64(entry + 24);
+        if (!add_chunk(reader, &chunk, &capacity))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Rebuilds the index by walking the chunk headers, up to the first
+ * incomplete chunk
+ */
+static void scan_chunks(recording_reader_t *reader, uint64_t size)
+{
+    unsigned char header[RECORDING_CHUNK_HEADER_SIZE];
+    uint64_t offset = RECORDING_FILE_HEADER_SIZE;
+    int capacity = 0;
+
+    reader->chunk_count = 0;
+    while (offset + RECORDING_CHUNK_HEADER_SIZE <= size && file_seek(reader->file, (int64_t)offset, SEEK_SET) == 0 &&
+           fread(header, 1, sizeof(header), reader->file) == sizeof(header))
+    {
+        recording_chunk_t chunk;
+        uint64_t end = offset + RECORDING_CHUNK_HEADER_SIZE + get_u32(header + 8);
+
+        if (end > size)
+            break;
+        chunk.device = (uint16_t)get_u16(header);
+        chunk.product_id = (uint16_t)get_u16(header + 2);
+        chunk.count = get_u32(header + 4);
+        chunk.offset = offset;
+        chunk.first_us = get_u64(header + 16);
+        chunk.last_us = get_u64(header + 24);
+        if (!add_chunk(reader, &chunk, &capacity))
+            break;
+        offset = end;
+    }
+}
+
+/**
+ * Opens a recording and loads its index
+ */
+recording_reader_t* recording_reader_open(const char *path)
+{
+    unsigned char header[RECORDING_FILE_HEADER_SIZE];
+    recording_reader_t *reader;
+    int64_t size;
+
+    reader = (recording_reader_t*)calloc(1, sizeof(*reader));
+    if (!reader)
+        return NULL;
+    reader->file = fopen(path, "rb");
+    if (!reader->file || fread(header, 1, sizeof(header), reader->file) != sizeof(header) ||
+        memcmp(header, RECORDING_MAGIC, 6) != 0 || get_u16(header + 6) != RECORDING_VERSION ||
+        file_seek(reader->file, 0, SEEK_END) != 0 || (size = file_tell(reader->file)) < 0)
+    {
+        recording_reader_close(reader);
+        return NULL;
+    }
+
+    if (!load_index(reader, (uint64_t)size))
+    {
+        printf("%s[INFO]%s %s has no index, reading its chunks in order\n", COLOR_BLUE, COLOR_RESET, path);
+        scan_chunks(reader, (uint64_t)size);
+    }
+    return reader;
+}
+
+/**
+ * Gets the index of a recording
+ */
+const recording_chunk_t* recording_reader_chunks(const recording_reader_t *reader, int *count)
+{
+    *count = reader->chunk_count;
+    return reader->chunks;
+}
+
+/**
+ * Finds the first chunk of a device that ends at or after a time
+ */
+int recording_reader_seek(const recording_reader_t *reader, int device, uint64_t timestamp_us)
+{
+    for (int i = 0; i < reader->chunk_count; i++)
+    {
+        if (reader->chunks[i].device == device && reader->chunks[i].last_us >= timestamp_us)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Decodes one chunk back into reports
+ */
+int recording_reader_read(recording_reader_t *reader, int chunk, input_report_t *reports)
+{
+    unsigned char header[RECORDING_CHUNK_HEADER_SIZE];
+    const recording_chunk_t *entry;
+    uint32_t count, size;
+    size_t pos = 0;
+    codec_t codec;
+
+    if (chunk < 0 || chunk >= reader->chunk_count)
+        return -1;
+    entry = &reader->chunks[chunk];
+    if (file_seek(reader->file, (int64_t)entry->offset, SEEK_SET) != 0 ||
+        fread(header, 1, sizeof(header), reader->file) != sizeof(header))
+    {
+        return -1;
+    }
+
+    count = get_u32(header + 4);
+    size = get_u32(header + 8);
+    if (count > RECORDING_CHUNK_REPORTS || size > (uint64_t)count * RECORDING_MAX_ENCODED)
+        return -1;
+    if (size > reader->capacity)
+    {
+        unsigned char *payload = (unsigned char*)realloc(reader->payload, size);
+
+        if (!payload)
+            return -1;
+        reader->payload = payload;
+        reader->capacity = size;
+    }
+    if (fread(reader->payload, 1, size, reader->file) != size || crc32(reader->payload, size) != get_u32(header + 12))
+        return -1;
+
+    codec_reset(&codec, (unsigned short)get_u16(header + 2), get_u64(header + 16));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!decode_report(&codec, reader->payload, size, &pos, &reports[i]))
+            return -1;
+    }
+    return pos == size ? (int)count : -1;
+}
+
+/**
+ * Closes a reader
+ */
+void recording_reader_close(recording_reader_t *reader)
+{
+    if (!reader)
+        return;
+    if (reader->file)
+        fclose(reader->file);
+    free(reader->chunks);
+    free(reader->payload);
+    free(reader);
+}
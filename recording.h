@@ -0,0 +1,193 @@
+/**
+ * recording.h - Compressed input report recordings
+ *
+ * Long-running storage for streamed input reports. Every report is stored
+ * as per-field residuals against a prediction from the same device's
+ * previous reports, zigzag and varint encoded with runs of unchanged fields
+ * collapsed, so a resting or slowly moving controller costs a few bytes per
+ * report instead of the whole report. Reports are grouped into chunks of
+ * one device that decode on their own, and an index at the end of the file
+ * lets readers seek to a chunk by device and time.
+ *
+ * File layout (all integers little-endian):
+ *
+ *   File header (16 bytes)
+ *     0  char[6]  magic "SXPREC"
+ *     6  u16      format version (RECORDING_VERSION)
+ *     8  u64      wall-clock start time, seconds since the epoch
+ *
+ *   Chunk header (32 bytes), followed by <payload> bytes
+ *     0  u16      device (the stream's controller index)
+ *     2  u16      product ID
+ *     4  u32      report count
+ *     8  u32      payload bytes
+ *    12  u32      CRC-32 of the payload
+ *    16  u64      timestamp of the first report, microseconds
+ *    24  u64      timestamp of the last report, microseconds
+ *
+ *   Index (32 bytes per chunk, in file order)
+ *     0  u16      device
+ *     2  u16      product ID
+ *     4  u32      report count
+ *     8  u64      file offset of the chunk header
+ *    16  u64      timestamp of the first report, microseconds
+ *    24  u64      timestamp of the last report, microseconds
+ *
+ *   Footer (16 bytes)
+ *     0  u64      file offset of the index
+ *     8  u32      chunk count
+ *    12  char[4]  magic "SXIX"
+ *
+ * Payload, per report:
+ *   varint  zigzag(timestamp second difference in microseconds) << 1 | length changed
+ *   varint  length, only if it changed
+ *   tokens  for the report's fields in layout order: varint count of fields
+ *           equal to their prediction, then varint zigzag(residual) - 1 of
+ *           the next field, until every field is covered
+ *
+ * Fields are the 8- and 16-bit values of the controller family's layout;
+ * counters and report timestamps are predicted to keep their last step,
+ * everything else to stay the same. Report bytes are stored exactly and
+ * timestamps to the microsecond. A file without a valid footer (e.g. from a
+ * killed stream) is read by walking the chunk headers.
+ */
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "report_ring.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define RECORDING_MAGIC "SXPREC"
+#define RECORDING_VERSION 1
+#define RECORDING_FILE_HEADER_SIZE 16
+#define RECORDING_CHUNK_HEADER_SIZE 32
+#define RECORDING_INDEX_ENTRY_SIZE 32
+#define RECORDING_FOOTER_SIZE 16
+
+/* Reports per chunk; one chunk is one batch of the vectorized decoders */
+#define RECORDING_CHUNK_REPORTS 4096
+
+/* Queued reports per device between the stream and the writer thread */
+#define RECORDING_QUEUE_SLOTS 4096
+
+/**
+ * One chunk of the index
+ */
+typedef struct {
+    uint16_t device;
+    uint16_t product_id;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t first_us;
+    uint64_t last_us;
+} recording_chunk_t;
+
+/**
+ * Totals of a finished recording
+ */
+typedef struct {
+    uint64_t reports;
+    uint64_t dropped;           /* Reports that found the writer's queue full */
+    uint64_t chunks;
+    uint64_t bytes;             /* File size */
+    uint64_t capture_bytes;     /* Size of the same reports in a hid_capture.h file */
+    int write_failed;
+} recording_stats_t;
+
+typedef struct recording_writer recording_writer_t;
+typedef struct recording_reader recording_reader_t;
+
+/**
+ * Creates a recording and starts its writer thread
+ *
+ * @param path Output file path
+ * @param device_count Number of devices (0 to device_count - 1) that will add reports
+ * @return The writer, or NULL on failure
+ */
+recording_writer_t* recording_writer_open(const char *path, int device_count);
+
+/**
+ * Sets the product of a device before its first report
+ *
+ * @param writer The writer
+ * @param device Device number
+ * @param product_id Product ID, which selects the field layout
+ */
+void recording_writer_set_device(recording_writer_t *writer, int device, unsigned short product_id);
+
+/**
+ * Queues one report for the writer thread without blocking
+ *
+ * All reports of a device must be added from the same thread.
+ *
+ * @param writer The writer
+ * @param device Device number
+ * @param report The report
+ * @return 1 if queued, 0 if the device's queue was full and the report is dropped
+ */
+int recording_writer_add(recording_writer_t *writer, int device, const input_report_t *report);
+
+/**
+ * Encodes every queued report, writes the index and closes the file
+ *
+ * @param writer The writer, or NULL
+ * @param stats Receives the totals, or NULL
+ * @return 1 if everything was written, 0 on a write failure
+ */
+int recording_writer_close(recording_writer_t *writer, recording_stats_t *stats);
+
+/**
+ * Checks whether a file starts like a recording
+ *
+ * @param path File path
+ * @return 1 for a recording, 0 otherwise
+ */
+int recording_is_recording(const char *path);
+
+/**
+ * Opens a recording and loads its index
+ *
+ * @param path File path
+ * @return The reader, or NULL if the file is not a readable recording
+ */
+recording_reader_t* recording_reader_open(const char *path);
+
+/**
+ * Gets the index of a recording
+ *
+ * @param reader The reader
+ * @param count Receives the number of chunks
+ * @return The chunks in file order
+ */
+const recording_chunk_t* recording_reader_chunks(const recording_reader_t *reader, int *count);
+
+/**
+ * Finds the first chunk of a device that ends at or after a time
+ *
+ * @param reader The reader
+ * @param device Device number
+ * @param timestamp_us Time in microseconds
+ * @return Chunk number, or -1 if the device has no such chunk
+ */
+int recording_reader_seek(const recording_reader_t *reader, int device, uint64_t timestamp_us);
+
+/**
+ * Decodes one chunk back into reports
+ *
+ * @param reader The reader
+ * @param chunk Chunk number
+ * @param reports Receives the reports; room for RECORDING_CHUNK_REPORTS
+ * @return Number of reports, or -1 if the chunk is damaged
+ */
+int recording_reader_read(recording_reader_t *reader, int chunk, input_report_t *reports);
+
+/**
+ * Closes a reader
+ *
+ * @param reader The reader, or NULL
+ */
+void recording_reader_close(recording_reader_t *reader);
+
+#endif /* RECORDING_H */
@@ -0,0 +1,770 @@
+/**
+ * report_decoder.c - Input report decoding
+ *
+ * Implementation of the family decoders. Each decoder runs field by field
+ * over the whole batch: every loop reads one source byte (or byte pair) from
+ * reports at a fixed stride and writes one contiguous output array through a
+ * restrict pointer, with no branches or table lookups in the loop body, which
+ * is the shape GCC and Clang turn into SIMD code (check with
+ * -fopt-info-vec). Buttons are assembled in one OR pass per source byte for
+ * the same reason. Constant fields become memset() calls; only the SixAxis
+ * and Move battery lookups remain scalar table gathers. Reports that fail
+ * validation are patched to neutral input in a separate pass.
+ */
+
+#include "report_decoder.h"
+#include "controller_info.h"
+#include "latency_stats.h"
+#include "hid_replay.h"
+#include "recording.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Report ID of the USB input report shared by all families */
+#define INPUT_REPORT_ID 0x01
+
+/* Shortest report each decoder reads all of its fields from */
+#define SIXAXIS_MIN_LENGTH 49
+#define MOVE_MIN_LENGTH 37
+#define DS4_MIN_LENGTH 39
+
+/* Reports decoded per pass (about 18 KiB of raw reports) */
+#define DECODE_CHUNK 128
+
+/* Reports buffered per device before a capture batch is decoded */
+#define DECODE_FILE_BATCH 4096
+
+/* Devices of a capture decoded at the same time */
+#define DECODE_FILE_DEVICES 16
+
+/* SixAxis/Move battery status byte to percentage; 0xEE and above mean charging */
+static const uint8_t SIXAXIS_BATTERY[256] = {
+    0, 1, 25, 50, 75, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, BATTERY_CHARGING, BATTERY_CHARGING,
+    BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING,
+    BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING,
+    BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING, BATTERY_CHARGING
+};
+
+/**
+ * Gets the input report layout used by a product
+ */
+report_family_t report_family(unsigned short product_id)
+{
+    switch (product_id)
+    {
+    case PRODUCT_SIXAXIS:
+        return REPORT_FAMILY_SIXAXIS;
+    case PRODUCT_MOVE:
+        return REPORT_FAMILY_MOVE;
+    case PRODUCT_DS4:
+        return REPORT_FAMILY_DS4;
+    default:
+        return REPORT_FAMILY_UNKNOWN;
+    }
+}
+
+/**
+ * Gets the shortest report a family's decoder reads all of its fields from
+ */
+uint32_t report_min_length(report_family_t family)
+{
+    switch (family)
+    {
+    case REPORT_FAMILY_SIXAXIS:
+        return SIXAXIS_MIN_LENGTH;
+    case REPORT_FAMILY_MOVE:
+        return MOVE_MIN_LENGTH;
+    case REPORT_FAMILY_DS4:
+        return DS4_MIN_LENGTH;
+    default:
+        return UINT32_MAX;
+    }
+}
+
+/**
+ * Allocates an empty batch
+ */
+int decoded_reports_init(decoded_reports_t *batch, size_t capacity)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->capacity = capacity;
+
+    batch->timestamp_ns = (uint64_t*)malloc(capacity * sizeof(uint64_t));
+    batch->buttons = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    batch->left_x = (uint8_t*)malloc(capacity);
+    batch->left_y = (uint8_t*)malloc(capacity);
+    batch->right_x = (uint8_t*)malloc(capacity);
+    batch->right_y = (uint8_t*)malloc(capacity);
+    batch->l2 = (uint8_t*)malloc(capacity);
+    batch->r2 = (uint8_t*)malloc(capacity);
+    batch->accel_x = (int16_t*)malloc(capacity * sizeof(int16_t));
+    batch->accel_y = (int16_t*)malloc(capacity * sizeof(int16_t));
+    batch->accel_z = (int16_t*)malloc(capacity * sizeof(int16_t));
+    batch->gyro_x = (int16_t*)malloc(capacity * sizeof(int16_t));
+    batch->gyro_y = (int16_t*)malloc(capacity * sizeof(int16_t));
+    batch->gyro_z = (int16_t*)malloc(capacity * sizeof(int16_t));
+    batch->touch_active = (uint8_t*)malloc(capacity);
+    batch->touch_x = (uint16_t*)malloc(capacity * sizeof(uint16_t));
+    batch->touch_y = (uint16_t*)malloc(capacity * sizeof(uint16_t));
+    batch->battery = (uint8_t*)malloc(capacity);
+
+    if (!batch->timestamp_ns || !batch->buttons || !batch->left_x || !batch->left_y ||
+        !batch->right_x || !batch->right_y || !batch->l2 || !batch->r2 ||
+        !batch->accel_x || !batch->accel_y || !batch->accel_z ||
+        !batch->gyro_x || !batch->gyro_y || !batch->gyro_z ||
+        !batch->touch_active || !batch->touch_x || !batch->touch_y || !batch->battery)
+    {
+        decoded_reports_free(batch);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Frees a batch
+ */
+void decoded_reports_free(decoded_reports_t *batch)
+{
+    free(batch->timestamp_ns);
+    free(batch->buttons);
+    free(batch->left_x);
+    free(batch->left_y);
+    free(batch->right_x);
+    free(batch->right_y);
+    free(batch->l2);
+    free(batch->r2);
+    free(batch->accel_x);
+    free(batch->accel_y);
+    free(batch->accel_z);
+    free(batch->gyro_x);
+    free(batch->gyro_y);
+    free(batch->gyro_z);
+    free(batch->touch_active);
+    free(batch->touch_x);
+    free(batch->touch_y);
+    free(batch->battery);
+    memset(batch, 0, sizeof(*batch));
+}
+
+/* Copies one byte field of every report into an output array; the output
+   goes through a restrict local because a byte store could otherwise alias
+   the batch and force the array pointer to be reloaded every iteration */
+#define DECODE_U8(out, offset) \
+    do { \
+        uint8_t *restrict o_ = (out) + base; \
+        for (size_t i = 0; i < n; i++) o_[i] = r[i].data[offset]; \
+    } while (0)
+
+/* Copies one little-endian 16-bit field, re-centered by subtracting bias */
+#define DECODE_LE16(out, offset, bias) \
+    do { \
+        int16_t *restrict o_ = (out) + base; \
+        for (size_t i = 0; i < n; i++) \
+            o_[i] = (int16_t)((r[i].data[offset] | (r[i].data[(offset) + 1] << 8)) - (bias)); \
+    } while (0)
+
+/* Copies one big-endian 16-bit field, re-centered by subtracting bias */
+#define DECODE_BE16(out, offset, bias) \
+    do { \
+        int16_t *restrict o_ = (out) + base; \
+        for (size_t i = 0; i < n; i++) \
+            o_[i] = (int16_t)(((r[i].data[offset] << 8) | r[i].data[(offset) + 1]) - (bias)); \
+    } while (0)
+
+/* Fills one output array with a constant */
+#define DECODE_FILL(out, value) \
+    for (size_t i = 0; i < n; i++) (out)[base + i] = (value)
+
+/* ORs the button bits derived from one byte field into the button array */
+#define DECODE_BITS(out, offset, expr) \
+    do { \
+        uint32_t *restrict o_ = (out); \
+        for (size_t i = 0; i < n; i++) \
+        { \
+            uint32_t v = r[i].data[offset]; \
+            o_[i] |= (expr); \
+        } \
+    } while (0)
+
+/**
+ * Decodes SixAxis USB input reports (report 0x01)
+ */
+static void decode_sixaxis(const input_report_t *restrict r, size_t n, decoded_reports_t *b, size_t base)
+{
+    uint32_t *buttons = b->buttons + base;
+
+    /* One pass per source byte: a single strided load per loop vectorizes,
+       three interleaved ones do not */
+    memset(buttons, 0, n * sizeof(*buttons));
+    DECODE_BITS(buttons, 2, ((v & 0x01) << 8) |          /* select */
+                            ((v & 0x02) << 9) |          /* L3 */
+                            ((v & 0x04) << 9) |          /* R3 */
+                            ((v & 0x08) << 6) |          /* start */
+                            ((v & 0xf0) << 10));         /* up, right, down, left */
+    DECODE_BITS(buttons, 3, ((v & 0x01) << 6) |          /* L2 */
+                            ((v & 0x02) << 6) |          /* R2 */
+                            ((v & 0x04) << 2) |          /* L1 */
+                            ((v & 0x08) << 2) |          /* R1 */
+                            ((v & 0x10) >> 1) |          /* triangle */
+                            ((v & 0x20) >> 4) |          /* circle */
+                            ((v & 0x40) >> 6) |          /* cross */
+                            ((v & 0x80) >> 5));          /* square */
+    DECODE_BITS(buttons, 4, (v & 0x01) << 12);           /* PS */
+
+    DECODE_U8(b->left_x, 6);
+    DECODE_U8(b->left_y, 7);
+    DECODE_U8(b->right_x, 8);
+    DECODE_U8(b->right_y, 9);
+    DECODE_U8(b->l2, 18);
+    DECODE_U8(b->r2, 19);
+
+    /* 10-bit sensors centered on 512; only the Z gyro axis exists */
+    DECODE_BE16(b->accel_x, 41, 512);
+    DECODE_BE16(b->accel_y, 43, 512);
+    DECODE_BE16(b->accel_z, 45, 512);
+    DECODE_FILL(b->gyro_x, 0);
+    DECODE_FILL(b->gyro_y, 0);
+    DECODE_BE16(b->gyro_z, 47, 512);
+
+    DECODE_FILL(b->touch_active, 0);
+    DECODE_FILL(b->touch_x, 0);
+    DECODE_FILL(b->touch_y, 0);
+    for (size_t i = 0; i < n; i++)
+        b->battery[base + i] = SIXAXIS_BATTERY[r[i].data[30]];
+}
+
+/**
+ * Decodes Move USB input reports (report 0x01); each report carries two
+ * sensor frames and the newer second one is kept
+ */
+static void decode_move(const input_report_t *restrict r, size_t n, decoded_reports_t *b, size_t base)
+{
+    uint32_t *buttons = b->buttons + base;
+
+    memset(buttons, 0, n * sizeof(*buttons));
+    DECODE_BITS(buttons, 1, ((v & 0x01) << 8) |          /* select */
+                            ((v & 0x08) << 6));          /* start */
+    DECODE_BITS(buttons, 2, ((v & 0x10) >> 1) |          /* triangle */
+                            ((v & 0x20) >> 4) |          /* circle */
+                            ((v & 0x40) >> 6) |          /* cross */
+                            ((v & 0x80) >> 5));          /* square */
+    DECODE_BITS(buttons, 3, (v & 0x01) << 12);           /* PS */
+    DECODE_BITS(buttons, 4, ((v & 0x40) << 12) |         /* Move */
+                            ((v & 0x80) << 12));         /* T */
+
+    DECODE_FILL(b->left_x, 128);
+    DECODE_FILL(b->left_y, 128);
+    DECODE_FILL(b->right_x, 128);
+    DECODE_FILL(b->right_y, 128);
+    DECODE_FILL(b->l2, 0);
+    DECODE_U8(b->r2, 6);
+
+    /* 16-bit sensors centered on 0x8000, second frame */
+    DECODE_LE16(b->accel_x, 19, 0x8000);
+    DECODE_LE16(b->accel_y, 21, 0x8000);
+    DECODE_LE16(b->accel_z, 23, 0x8000);
+    DECODE_LE16(b->gyro_x, 31, 0x8000);
+    DECODE_LE16(b->gyro_y, 33, 0x8000);
+    DECODE_LE16(b->gyro_z, 35, 0x8000);
+
+    DECODE_FILL(b->touch_active, 0);
+    DECODE_FILL(b->touch_x, 0);
+    DECODE_FILL(b->touch_y, 0);
+    for (size_t i = 0; i < n; i++)
+        b->battery[base + i] = SIXAXIS_BATTERY[r[i].data[12]];
+}
+
+/**
+ * Decodes DualShock 4 USB input reports (report 0x01)
+ */
+static void decode_ds4(const input_report_t *restrict r, size_t n, decoded_reports_t *b, size_t base)
+{
+    uint32_t *buttons = b->buttons + base;
+
+    /* Byte 5 is the hat switch (low nibble, 8 and above mean released) and the
+       face buttons square, cross, circle, triangle (high nibble); computed
+       with compares instead of table lookups so the pass vectorizes */
+    memset(buttons, 0, n * sizeof(*buttons));
+    DECODE_BITS(buttons, 5, (-(uint32_t)(((v & 0x0f) == 0) | ((v & 0x0f) == 1) | ((v & 0x0f) == 7)) & BUTTON_UP) |
+                            (-(uint32_t)(((v & 0x0f) >= 1) & ((v & 0x0f) <= 3)) & BUTTON_RIGHT) |
+                            (-(uint32_t)(((v & 0x0f) >= 3) & ((v & 0x0f) <= 5)) & BUTTON_DOWN) |
+                            (-(uint32_t)(((v & 0x0f) >= 5) & ((v & 0x0f) <= 7)) & BUTTON_LEFT) |
+                            ((v & 0x10) >> 2) |          /* square */
+                            ((v & 0x20) >> 5) |          /* cross */
+                            ((v & 0x40) >> 5) |          /* circle */
+                            ((v & 0x80) >> 4));          /* triangle */
+    /* Byte 6 already holds L1..R3 in the order of the shared button bits */
+    DECODE_BITS(buttons, 6, v << 4);
+    DECODE_BITS(buttons, 7, (v & 0x03) << 12);           /* PS, touchpad */
+
+    DECODE_U8(b->left_x, 1);
+    DECODE_U8(b->left_y, 2);
+    DECODE_U8(b->right_x, 3);
+    DECODE_U8(b->right_y, 4);
+    DECODE_U8(b->l2, 8);
+    DECODE_U8(b->r2, 9);
+
+    DECODE_LE16(b->gyro_x, 13, 0);
+    DECODE_LE16(b->gyro_y, 15, 0);
+    DECODE_LE16(b->gyro_z, 17, 0);
+    DECODE_LE16(b->accel_x, 19, 0);
+    DECODE_LE16(b->accel_y, 21, 0);
+    DECODE_LE16(b->accel_z, 23, 0);
+
+    /* First touch point: bit 7 of the contact byte is set while not touching */
+    uint8_t *restrict touch_active = b->touch_active + base;
+    uint16_t *restrict touch_x = b->touch_x + base;
+    uint16_t *restrict touch_y = b->touch_y + base;
+    for (size_t i = 0; i < n; i++)
+        touch_active[i] = (uint8_t)(((r[i].data[35] >> 7) & 1) ^ 1);
+    for (size_t i = 0; i < n; i++)
+        touch_x[i] = (uint16_t)((r[i].data[36] | (r[i].data[37] << 8)) & 0x0fff);
+    for (size_t i = 0; i < n; i++)
+        touch_y[i] = (uint16_t)((r[i].data[37] | (r[i].data[38] << 8)) >> 4);
+
+    /* Low nibble is the level in tenths, bit 4 is set while on the cable */
+    uint8_t *restrict battery = b->battery + base;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t status = r[i].data[30], level = status & 0x0f;
+        uint32_t percent = level >= 10 ? 100 : level * 10 + 5;
+        battery[i] = (uint8_t)(((status & 0x10) && level < 11) ? BATTERY_CHARGING : percent);
+    }
+}
+
+/**
+ * Resets one decoded entry to neutral input
+ */
+static void neutral_entry(decoded_reports_t *b, size_t index)
+{
+    b->buttons[index] = 0;
+    b->left_x[index] = b->left_y[index] = b->right_x[index] = b->right_y[index] = 128;
+    b->l2[index] = b->r2[index] = 0;
+    b->accel_x[index] = b->accel_y[index] = b->accel_z[index] = 0;
+    b->gyro_x[index] = b->gyro_y[index] = b->gyro_z[index] = 0;
+    b->touch_active[index] = 0;
+    b->touch_x[index] = b->touch_y[index] = 0;
+    b->battery[index] = 0;
+}
+
+/**
+ * Decodes reports of one family and appends them to a batch
+ */
+size_t decode_reports(report_family_t family, const input_report_t *reports, size_t count,
+                      decoded_reports_t *batch)
+{
+    size_t base = batch->count;
+    size_t n = count < batch->capacity - base ? count : batch->capacity - base;
+    uint32_t min_length = report_min_length(family);
+
+    /* Each field pass re-reads the chunk, so keep the chunk resident in L1 */
+    for (size_t done = 0; done < n; done += DECODE_CHUNK)
+    {
+        size_t chunk = n - done < DECODE_CHUNK ? n - done : DECODE_CHUNK;
+
+        switch (family)
+        {
+        case REPORT_FAMILY_SIXAXIS:
+            decode_sixaxis(reports + done, chunk, batch, base + done);
+            break;
+        case REPORT_FAMILY_MOVE:
+            decode_move(reports + done, chunk, batch, base + done);
+            break;
+        case REPORT_FAMILY_DS4:
+            decode_ds4(reports + done, chunk, batch, base + done);
+            break;
+        default:
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        batch->timestamp_ns[base + i] = reports[i].timestamp_ns;
+        if (reports[i].length < min_length || reports[i].data[0] != INPUT_REPORT_ID)
+            neutral_entry(batch, base + i);
+    }
+
+    batch->count += n;
+    return n;
+}
+
+/**
+ * Fills reports with pseudo-random input of a family's length
+ */
+static void synthesize_reports(input_report_t *reports, size_t count, uint32_t length)
+{
+    uint32_t state = 0x12345678u;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        for (uint32_t j = 0; j < INPUT_REPORT_MAX; j++)
+        {
+            state = state * 1664525u + 1013904223u;
+            reports[i].data[j] = (unsigned char)(state >> 24);
+        }
+        reports[i].data[0] = INPUT_REPORT_ID;
+        reports[i].length = length;
+        reports[i].timestamp_ns = i * 4000000ull;
+    }
+}
+
+/**
+ * Runs the decoder benchmark on synthetic reports
+ */
+int bench_command(int argc, char **argv)
+{
+    static const struct {
+        report_family_t family;
+        unsigned short product_id;
+        uint32_t length;
+    } CASES[] = {
+        { REPORT_FAMILY_SIXAXIS, PRODUCT_SIXAXIS, 49 },
+        { REPORT_FAMILY_MOVE, PRODUCT_MOVE, 49 },
+        { REPORT_FAMILY_DS4, PRODUCT_DS4, 64 }
+    };
+    size_t report_count = 100000;
+    int rounds = 20;
+    input_report_t *reports;
+    decoded_reports_t batch;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--reports") == 0)
+            report_count = (size_t)strtoul(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--rounds") == 0)
+            rounds = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown bench option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+    if (report_count == 0 || rounds < 1)
+    {
+        fprintf(stderr, "%s[ERROR]%s Invalid bench option value\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    reports = (input_report_t*)malloc(report_count * sizeof(input_report_t));
+    if (!reports || !decoded_reports_init(&batch, report_count))
+    {
+        free(reports);
+        fprintf(stderr, "%s[ERROR]%s Not enough memory for %zu reports\n", COLOR_RED, COLOR_RESET, report_count);
+        return 1;
+    }
+
+    printf("\n%s%s=== Decoder Benchmark (%zu reports x %d rounds) ===%s\n",
+           COLOR_BOLD, COLOR_YELLOW, report_count, rounds, COLOR_RESET);
+    printf("%s  %-26s %14s %12s %10s%s\n", COLOR_MAGENTA, "Family", "Reports/s", "MB/s", "ns/report", COLOR_RESET);
+
+    for (size_t c = 0; c < sizeof(CASES) / sizeof(CASES[0]); c++)
+    {
+        uint64_t checksum = 0, start, elapsed;
+
+        synthesize_reports(reports, report_count, CASES[c].length);
+
+        start = latency_now_ns();
+        for (int round = 0; round < rounds; round++)
+        {
+            batch.count = 0;
+            decode_reports(CASES[c].family, reports, report_count, &batch);
+            checksum += batch.buttons[round % report_count] + (uint16_t)batch.gyro_z[report_count - 1];
+        }
+        elapsed = latency_now_ns() - start;
+
+        double total = (double)report_count * rounds;
+        double seconds = elapsed / 1e9;
+        printf("%s  %-26s %14.0f %12.1f %10.2f%s\n", COLOR_WHITE, get_controller_name(CASES[c].product_id),
+               total / seconds, total * CASES[c].length / seconds / 1e6, elapsed / total, COLOR_RESET);
+
+        /* Keeps the decode loops observable to the optimizer */
+        if (checksum == 1)
+            printf(" ");
+    }
+
+    decoded_reports_free(&batch);
+    free(reports);
+    return 0;
+}
+
+/**
+ * Input reports of one captured device waiting to be decoded
+ */
+typedef struct {
+    uint16_t device;
+    report_family_t family;
+    size_t count;
+    input_report_t *reports;
+} pending_device_t;
+
+/**
+ * Decodes the buffered reports of one device as one batch and writes them
+ * as CSV lines
+ *
+ * @return Nanoseconds spent decoding
+ */
+static uint64_t flush_pending(pending_device_t *pending, decoded_reports_t *batch, FILE *out)
+{
+    uint64_t start, elapsed;
+
+    batch->count = 0;
+    start = latency_now_ns();
+    decode_reports(pending->family, pending->reports, pending->count, batch);
+    elapsed = latency_now_ns() - start;
+
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        fprintf(out, "%llu,%u,%05x,%u,%u,%u,%u,%u,%u,%d,%d,%d,%d,%d,%d,%u,%u,%u,%u\n",
+                (unsigned long long)(batch->timestamp_ns[i] / 1000u), pending->device, batch->buttons[i],
+                batch->left_x[i], batch->left_y[i], batch->right_x[i], batch->right_y[i], batch->l2[i], batch->r2[i],
+                batch->accel_x[i], batch->accel_y[i], batch->accel_z[i],
+                batch->gyro_x[i], batch->gyro_y[i], batch->gyro_z[i],
+                batch->touch_active[i], batch->touch_x[i], batch->touch_y[i], batch->battery[i]);
+    }
+    pending->count = 0;
+    return elapsed;
+}
+
+/* A recording chunk is decoded as one batch */
+_Static_assert(RECORDING_CHUNK_REPORTS <= DECODE_FILE_BATCH, "recording chunks must fit a decode batch");
+
+/**
+ * Decodes a recording one chunk at a time, each chunk as one batch; chunks
+ * that end before from_us are skipped through the index without reading them
+ */
+static int decode_recording(const char *path, uint64_t from_us, decoded_reports_t *batch, FILE *out)
+{
+    static unsigned char seen[65536 / 8];
+    recording_reader_t *reader = recording_reader_open(path);
+    const recording_chunk_t *chunks;
+    pending_device_t pending;
+    uint64_t origin_us = UINT64_MAX, decoded = 0, batches = 0, decode_ns = 0, skipped = 0;
+    int chunk_count, devices = 0, damaged = 0;
+
+    if (!reader)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to read recording %s\n", COLOR_RED, COLOR_RESET, path);
+        return 1;
+    }
+    pending.reports = (input_report_t*)malloc(RECORDING_CHUNK_REPORTS * sizeof(input_report_t));
+    if (!pending.reports)
+    {
+        recording_reader_close(reader);
+        return 1;
+    }
+
+    /* Timestamps are written relative to the first report of the recording */
+    chunks = recording_reader_chunks(reader, &chunk_count);
+    for (int i = 0; i < chunk_count; i++)
+    {
+        if (chunks[i].first_us < origin_us)
+            origin_us = chunks[i].first_us;
+    }
+    memset(seen, 0, sizeof(seen));
+
+    for (int i = 0; i < chunk_count; i++)
+    {
+        size_t start = 0;
+        int count;
+
+        if (chunks[i].last_us - origin_us < from_us)
+            continue;
+        pending.family = report_family(chunks[i].product_id);
+        if (pending.family == REPORT_FAMILY_UNKNOWN)
+        {
+            skipped += chunks[i].count;
+            continue;
+        }
+        count = recording_reader_read(reader, i, pending.reports);
+        if (count < 0)
+        {
+            damaged++;
+            continue;
+        }
+
+        for (int r = 0; r < count; r++)
+            pending.reports[r].timestamp_ns -= origin_us * 1000u;
+        while (start < (size_t)count && pending.reports[start].timestamp_ns < from_us * 1000u)
+            start++;
+        memmove(pending.reports, pending.reports + start, ((size_t)count - start) * sizeof(input_report_t));
+        pending.device = chunks[i].device;
+        pending.count = (size_t)count - start;
+        if (pending.count == 0)
+            continue;
+
+        if (!(seen[pending.device / 8] & (1u << (pending.device % 8))))
+        {
+            seen[pending.device / 8] |= (unsigned char)(1u << (pending.device % 8));
+            devices++;
+        }
+        decoded += pending.count;
+        decode_ns += flush_pending(&pending, batch, out);
+        batches++;
+    }
+
+    free(pending.reports);
+    recording_reader_close(reader);
+
+    printf("%s[INFO]%s Decoded %llu reports of %d device(s) in %llu batches: %.2f ns/report\n",
+           COLOR_BLUE, COLOR_RESET, (unsigned long long)decoded, devices, (unsigned long long)batches,
+           decoded ? (double)decode_ns / (double)decoded : 0.0);
+    if (skipped)
+    {
+        printf("%s[INFO]%s Skipped %llu reports of unknown devices\n", COLOR_BLUE, COLOR_RESET,
+               (unsigned long long)skipped);
+    }
+    if (damaged)
+    {
+        fprintf(stderr, "%s[ERROR]%s %d damaged chunk(s) could not be decoded\n", COLOR_RED, COLOR_RESET, damaged);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Decodes every input report of a capture file in full batches
+ */
+int decode_command(int argc, char **argv)
+{
+    pending_device_t pending[DECODE_FILE_DEVICES];
+    int pending_count = 0;
+    decoded_reports_t batch = {0};
+    const char *capture_path = NULL, *output_path = NULL;
+    FILE *out = stdout;
+    input_report_t report;
+    unsigned short product_id;
+    uint16_t device;
+    size_t cursor = 0;
+    uint64_t decoded = 0, skipped = 0, batches = 0, decode_ns = 0, from_us = 0;
+    int result = 0, recording;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--output") == 0)
+            output_path = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--from") == 0)
+            from_us = (uint64_t)(atof(argv[++i]) * 1e6);
+        else if (!capture_path && argv[i][0] != '-')
+            capture_path = argv[i];
+        else
+        {
+            fprintf(stderr, "%s[ERROR]%s Unknown decode option: %s\n", COLOR_RED, COLOR_RESET, argv[i]);
+            return 1;
+        }
+    }
+
+    /* A capture given with --replay is already loaded */
+    recording = !hid_replay_enabled && capture_path && recording_is_recording(capture_path);
+    if (!recording && !hid_replay_enabled && (!capture_path || !hid_replay_load(capture_path)))
+    {
+        if (!capture_path)
+            fprintf(stderr, "%s[ERROR]%s decode requires a capture or recording file\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    if (!decoded_reports_init(&batch, DECODE_FILE_BATCH))
+        return 1;
+    if (output_path && !(out = fopen(output_path, "w")))
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to create %s\n", COLOR_RED, COLOR_RESET, output_path);
+        decoded_reports_free(&batch);
+        return 1;
+    }
+
+    if (recording)
+    {
+        result = decode_recording(capture_path, from_us, &batch, out);
+        if (out != stdout)
+            fclose(out);
+        else
+            fflush(out);
+        decoded_reports_free(&batch);
+        return result;
+    }
+
+    while (hid_replay_next_input(&cursor, &device, &product_id, &report))
+    {
+        pending_device_t *target = NULL;
+
+        if (report.timestamp_ns < from_us * 1000u)
+            continue;
+
+        for (int i = 0; i < pending_count && !target; i++)
+        {
+            if (pending[i].device == device)
+                target = &pending[i];
+        }
+        if (!target && pending_count < DECODE_FILE_DEVICES && report_family(product_id) != REPORT_FAMILY_UNKNOWN)
+        {
+            target = &pending[pending_count];
+            target->reports = (input_report_t*)malloc(DECODE_FILE_BATCH * sizeof(input_report_t));
+            if (!target->reports)
+            {
+                result = 1;
+                break;
+            }
+            target->device = device;
+            target->family = report_family(product_id);
+            target->count = 0;
+            pending_count++;
+        }
+        if (!target)
+        {
+            skipped++;
+            continue;
+        }
+
+        target->reports[target->count++] = report;
+        if (target->count == DECODE_FILE_BATCH)
+        {
+            decoded += target->count;
+            decode_ns += flush_pending(target, &batch, out);
+            batches++;
+        }
+    }
+
+    for (int i = 0; i < pending_count; i++)
+    {
+        if (pending[i].count > 0)
+        {
+            decoded += pending[i].count;
+            decode_ns += flush_pending(&pending[i], &batch, out);
+            batches++;
+        }
+        free(pending[i].reports);
+    }
+
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+    decoded_reports_free(&batch);
+
+    printf("%s[INFO]%s Decoded %llu reports of %d device(s) in %llu batches: %.2f ns/report\n",
+           COLOR_BLUE, COLOR_RESET, (unsigned long long)decoded, pending_count, (unsigned long long)batches,
+           decoded ? (double)decode_ns / (double)decoded : 0.0);
+    if (skipped)
+    {
+        printf("%s[INFO]%s Skipped %llu reports of unknown or excess devices\n", COLOR_BLUE, COLOR_RESET,
+               (unsigned long long)skipped);
+    }
+    return result;
+}
@@ -0,0 +1,154 @@
+/**
+ * report_decoder.h - Input report decoding
+ *
+ * Turns raw USB input reports into a struct-of-arrays batch with one
+ * specialized decoder per controller family. Decoding is batched so that
+ * hours of captured reports can be reprocessed with few calls (see
+ * decode_command()).
+ */
+
+#ifndef REPORT_DECODER_H
+#define REPORT_DECODER_H
+
+#include "report_ring.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Button bits shared by all families */
+#define BUTTON_CROSS     (1u << 0)
+#define BUTTON_CIRCLE    (1u << 1)
+#define BUTTON_SQUARE    (1u << 2)
+#define BUTTON_TRIANGLE  (1u << 3)
+#define BUTTON_L1        (1u << 4)
+#define BUTTON_R1        (1u << 5)
+#define BUTTON_L2        (1u << 6)
+#define BUTTON_R2        (1u << 7)
+#define BUTTON_SELECT    (1u << 8)   /* Share on DS4 */
+#define BUTTON_START     (1u << 9)   /* Options on DS4 */
+#define BUTTON_L3        (1u << 10)
+#define BUTTON_R3        (1u << 11)
+#define BUTTON_PS        (1u << 12)
+#define BUTTON_TOUCHPAD  (1u << 13)
+#define BUTTON_UP        (1u << 14)
+#define BUTTON_RIGHT     (1u << 15)
+#define BUTTON_DOWN      (1u << 16)
+#define BUTTON_LEFT      (1u << 17)
+#define BUTTON_MOVE      (1u << 18)  /* Move controller only */
+#define BUTTON_T         (1u << 19)  /* Move controller trigger */
+
+/* Battery value reported while charging */
+#define BATTERY_CHARGING 0xff
+
+/**
+ * Input report layouts
+ */
+typedef enum {
+    REPORT_FAMILY_UNKNOWN = 0,
+    REPORT_FAMILY_SIXAXIS,
+    REPORT_FAMILY_MOVE,
+    REPORT_FAMILY_DS4
+} report_family_t;
+
+/**
+ * Decoded reports in struct-of-arrays layout
+ *
+ * Sticks and triggers are raw 0-255 values; IMU axes are signed and
+ * centered on zero but not yet calibrated; battery is a percentage or
+ * BATTERY_CHARGING.
+ */
+typedef struct {
+    size_t count;
+    size_t capacity;
+    uint64_t *timestamp_ns;
+    uint32_t *buttons;
+    uint8_t *left_x, *left_y, *right_x, *right_y;
+    uint8_t *l2, *r2;
+    int16_t *accel_x, *accel_y, *accel_z;
+    int16_t *gyro_x, *gyro_y, *gyro_z;
+    uint8_t *touch_active;
+    uint16_t *touch_x, *touch_y;
+    uint8_t *battery;
+} decoded_reports_t;
+
+/**
+ * Gets the input report layout used by a product
+ *
+ * @param product_id The product ID of the controller
+ * @return The family, or REPORT_FAMILY_UNKNOWN
+ */
+report_family_t report_family(unsigned short product_id);
+
+/**
+ * Gets the shortest report a family's decoder reads all of its fields from
+ *
+ * Shorter reports, and reports with another ID than 0x01, decode as
+ * neutral input.
+ *
+ * @param family The report family
+ * @return Length in bytes, UINT32_MAX for REPORT_FAMILY_UNKNOWN
+ */
+uint32_t report_min_length(report_family_t family);
+
+/**
+ * Allocates an empty batch
+ *
+ * @param batch The batch to initialize
+ * @param capacity Maximum number of reports the batch can hold
+ * @return 1 on success, 0 on failure
+ */
+int decoded_reports_init(decoded_reports_t *batch, size_t capacity);
+
+/**
+ * Frees a batch
+ *
+ * @param batch The batch to free
+ */
+void decoded_reports_free(decoded_reports_t *batch);
+
+/**
+ * Decodes reports of one family and appends them to a batch
+ *
+ * Reports that are too short or carry the wrong report ID are decoded as
+ * neutral input. Decoding stops when the batch is full.
+ *
+ * @param family Layout of the reports
+ * @param reports Raw reports
+ * @param count Number of reports
+ * @param batch Batch to append to
+ * @return Number of reports appended
+ */
+size_t decode_reports(report_family_t family, const input_report_t *reports, size_t count,
+                      decoded_reports_t *batch);
+
+/**
+ * Runs the decoder benchmark on synthetic reports
+ *
+ * Usage: bench [--reports <n>] [--rounds <n>]
+ *
+ * @param argc Number of arguments after the "bench" command
+ * @param argv Arguments after the "bench" command
+ * @return 0 on success, 1 on failure
+ */
+int bench_command(int argc, char **argv);
+
+/**
+ * Decodes every input report of a capture file in full batches
+ *
+ * Usage: decode <capture | recording> [--output <file>] [--from <seconds>]
+ *
+ * Reports are buffered per captured device and decoded DECODE_FILE_BATCH at
+ * a time. Lines have the format of "stream --decoded" with the capture's
+ * device ID as the controller column and timestamps relative to the start
+ * of the capture; they are grouped per device batch rather than merged.
+ * A recording of "stream --record" (recording.h) is decoded one chunk per
+ * batch with the stream's controller index as the controller column.
+ * --from skips the reports before a time; recording chunks that end before
+ * it are skipped through the index without being read.
+ *
+ * @param argc Number of arguments after the "decode" command
+ * @param argv Arguments after the "decode" command
+ * @return 0 on success, 1 on failure
+ */
+int decode_command(int argc, char **argv);
+
+#endif /* REPORT_DECODER_H */
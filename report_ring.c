@@ -0,0 +1,106 @@
+/**
+ * report_ring.c - Single-producer/single-consumer input report ring
+ *
+ * Implementation of the ring. Each side owns one index and only reads the
+ * other with acquire ordering, so a slot's contents are always visible
+ * before its index is.
+ */
+
+#include "report_ring.h"
+#include <stdlib.h>
+
+/**
+ * Allocates the slots of a ring
+ */
+int report_ring_init(report_ring_t *ring, size_t capacity)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+        return 0;
+
+    ring->slots = (input_report_t*)calloc(capacity, sizeof(input_report_t));
+    if (!ring->slots)
+        return 0;
+
+    ring->mask = capacity - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 1;
+}
+
+/**
+ * Frees the slots of a ring
+ */
+void report_ring_free(report_ring_t *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/**
+ * Gets the next free slot for the producer to fill
+ */
+input_report_t* report_ring_claim(report_ring_t *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail > ring->mask)
+        return NULL;
+
+    return &ring->slots[head & ring->mask];
+}
+
+/**
+ * Makes the slot returned by report_ring_claim() visible to the consumer
+ */
+void report_ring_publish(report_ring_t *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * Gets the oldest published slot without removing it
+ */
+const input_report_t* report_ring_peek(report_ring_t *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail == head)
+        return NULL;
+
+    return &ring->slots[tail & ring->mask];
+}
+
+/**
+ * Returns the slot returned by report_ring_peek() to the producer
+ */
+void report_ring_release(report_ring_t *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+/**
+ * Finds the ring whose oldest report comes next in a timestamp-ordered merge
+ */
+int report_ring_next_due(report_ring_t *const rings[], int count, uint64_t watermark_ns)
+{
+    const input_report_t *oldest = NULL;
+    int oldest_index = -1;
+
+    for (int i = 0; i < count; i++)
+    {
+        const input_report_t *report = report_ring_peek(rings[i]);
+        if (report && (!oldest || report->timestamp_ns < oldest->timestamp_ns))
+        {
+            oldest = report;
+            oldest_index = i;
+        }
+    }
+
+    if (!oldest || oldest->timestamp_ns >= watermark_ns)
+        return -1;
+    return oldest_index;
+}
@@ -0,0 +1,103 @@
+/**
+ * report_ring.h - Single-producer/single-consumer input report ring
+ *
+ * Fixed-capacity lock-free ring of preallocated input report slots. The
+ * producer reads straight into a claimed slot and publishes it; the consumer
+ * peeks the oldest slot and releases it. Nothing is allocated after
+ * report_ring_init().
+ */
+
+#ifndef REPORT_RING_H
+#define REPORT_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* Largest input report kept in a slot (DS4 over Bluetooth sends 78 bytes) */
+#define INPUT_REPORT_MAX 128
+
+/* Assumed cache line size, used to keep producer and consumer indices apart */
+#define REPORT_RING_CACHE_LINE 64
+
+/**
+ * One timestamped input report
+ */
+typedef struct {
+    uint64_t timestamp_ns;                 /* latency_now_ns() when the read returned */
+    uint32_t length;                       /* Number of valid bytes in data */
+    unsigned char data[INPUT_REPORT_MAX];  /* Report as returned by hid_read_timeout() */
+} input_report_t;
+
+/**
+ * Ring state; head is written only by the producer, tail only by the consumer
+ */
+typedef struct {
+    _Atomic size_t head;
+    char head_pad[REPORT_RING_CACHE_LINE - sizeof(size_t)];
+    _Atomic size_t tail;
+    char tail_pad[REPORT_RING_CACHE_LINE - sizeof(size_t)];
+    size_t mask;
+    input_report_t *slots;
+} report_ring_t;
+
+/**
+ * Allocates the slots of a ring
+ *
+ * @param ring The ring to initialize
+ * @param capacity Number of slots, must be a power of two
+ * @return 1 on success, 0 on failure
+ */
+int report_ring_init(report_ring_t *ring, size_t capacity);
+
+/**
+ * Frees the slots of a ring
+ *
+ * @param ring The ring to free
+ */
+void report_ring_free(report_ring_t *ring);
+
+/**
+ * Gets the next free slot for the producer to fill
+ *
+ * @param ring The ring
+ * @return The slot, or NULL if the ring is full
+ */
+input_report_t* report_ring_claim(report_ring_t *ring);
+
+/**
+ * Makes the slot returned by report_ring_claim() visible to the consumer
+ *
+ * @param ring The ring
+ */
+void report_ring_publish(report_ring_t *ring);
+
+/**
+ * Gets the oldest published slot without removing it
+ *
+ * @param ring The ring
+ * @return The slot, or NULL if the ring is empty
+ */
+const input_report_t* report_ring_peek(report_ring_t *ring);
+
+/**
+ * Returns the slot returned by report_ring_peek() to the producer
+ *
+ * @param ring The ring
+ */
+void report_ring_release(report_ring_t *ring);
+
+/**
+ * Finds the ring whose oldest report comes next in a timestamp-ordered merge
+ *
+ * Reports stamped at or after the watermark are held back, since a ring
+ * may still publish an earlier one. Must only be called by the consumer.
+ *
+ * @param rings The rings being merged
+ * @param count Number of rings
+ * @param watermark_ns Lowest watermark of all producers
+ * @return Index of the ring to release next, or -1 if no report is due
+ */
+int report_ring_next_due(report_ring_t *const rings[], int count, uint64_t watermark_ns);
+
+#endif /* REPORT_RING_H */
@@ -0,0 +1,218 @@
+/**
+ * state_shm.c - Shared-memory publication of controller state
+ *
+ * Implementation of the writer side of state_shm_reader.h. A publish bumps
+ * the slot's sequence to odd, stores the state and bumps it back to even
+ * with a release store, so a reader that saw the same even value before and
+ * after its copy has a state no publish was in the middle of.
+ */
+
+#include "state_shm.h"
+#include "ui.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef PLATFORM_WINDOWS
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#ifndef PLATFORM_WINDOWS
+
+static state_shm_header_t *segment = NULL;
+static state_shm_slot_t *slots = NULL;
+static size_t segment_size = 0;
+static char segment_name[256];
+
+/**
+ * Creates (or replaces) the segment with every slot disconnected
+ */
+int state_shm_start(const char *name, int slot_count)
+{
+    void *base;
+    int fd;
+
+    if (segment || slot_count <= 0)
+        return 0;
+    snprintf(segment_name, sizeof(segment_name), "%s", name ? name : STATE_SHM_DEFAULT_NAME);
+
+    /* A segment left behind by a killed stream may have another size */
+    shm_unlink(segment_name);
+    fd = shm_open(segment_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to create shared memory %s\n", COLOR_RED, COLOR_RESET, segment_name);
+        return 0;
+    }
+
+    segment_size = sizeof(state_shm_header_t) + (size_t)slot_count * sizeof(state_shm_slot_t);
+    base = ftruncate(fd, (off_t)segment_size) == 0
+               ? mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+               : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to map shared memory %s\n", COLOR_RED, COLOR_RESET, segment_name);
+        shm_unlink(segment_name);
+        return 0;
+    }
+
+    /* ftruncate() zero-fills: every sequence is even and every slot disconnected */
+    segment = (state_shm_header_t*)base;
+    slots = (state_shm_slot_t*)(segment + 1);
+    segment->version = STATE_SHM_VERSION;
+    segment->slot_count = (uint32_t)slot_count;
+    segment->slot_size = sizeof(state_shm_slot_t);
+    segment->writer_pid = (uint64_t)getpid();
+    atomic_thread_fence(memory_order_release);
+    segment->magic = STATE_SHM_MAGIC;
+
+    printf("%s[INFO]%s Publishing controller state in shared memory %s\n", COLOR_BLUE, COLOR_RESET,
+           segment_name);
+    return 1;
+}
+
+/**
+ * Opens a slot for writing; returns the state to fill in
+ */
+static state_shm_state_t* begin_write(int slot)
+{
+    state_shm_slot_t *s = &slots[slot];
+    uint32_t sequence = atomic_load_explicit(&s->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&s->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return &s->state;
+}
+
+/**
+ * Closes a slot opened by begin_write()
+ */
+static void end_write(int slot)
+{
+    state_shm_slot_t *s = &slots[slot];
+    uint32_t sequence = atomic_load_explicit(&s->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&s->sequence, sequence + 1, memory_order_release);
+}
+
+/**
+ * Marks a slot as connected to a controller
+ */
+void state_shm_set_slot(int slot, unsigned short product_id)
+{
+    state_shm_state_t *state;
+
+    if (!segment || slot < 0 || (uint32_t)slot >= segment->slot_count)
+        return;
+
+    state = begin_write(slot);
+    state->product_id = product_id;
+    state->connected = 1;
+    end_write(slot);
+}
+
+/**
+ * Publishes one report as the slot's latest state
+ */
+void state_shm_publish(int slot, const decoded_reports_t *decoded, const imu_samples_t *samples, size_t index)
+{
+    state_shm_state_t *state;
+
+    if (!segment || slot < 0 || (uint32_t)slot >= segment->slot_count)
+        return;
+
+    state = begin_write(slot);
+    state->timestamp_ns = decoded->timestamp_ns[index];
+    state->reports++;
+    state->buttons = decoded->buttons[index];
+    state->battery = decoded->battery[index];
+    state->left_x = decoded->left_x[index];
+    state->left_y = decoded->left_y[index];
+    state->right_x = decoded->right_x[index];
+    state->right_y = decoded->right_y[index];
+    state->l2 = decoded->l2[index];
+    state->r2 = decoded->r2[index];
+    state->touch_active = decoded->touch_active[index];
+    state->touch_x = decoded->touch_x[index];
+    state->touch_y = decoded->touch_y[index];
+    state->accel_raw[0] = decoded->accel_x[index];
+    state->accel_raw[1] = decoded->accel_y[index];
+    state->accel_raw[2] = decoded->accel_z[index];
+    state->gyro_raw[0] = decoded->gyro_x[index];
+    state->gyro_raw[1] = decoded->gyro_y[index];
+    state->gyro_raw[2] = decoded->gyro_z[index];
+    state->accel_g[0] = samples->accel_x[index];
+    state->accel_g[1] = samples->accel_y[index];
+    state->accel_g[2] = samples->accel_z[index];
+    state->gyro_dps[0] = samples->gyro_x[index];
+    state->gyro_dps[1] = samples->gyro_y[index];
+    state->gyro_dps[2] = samples->gyro_z[index];
+    end_write(slot);
+}
+
+/**
+ * Marks every slot disconnected and removes the segment name
+ */
+void state_shm_stop(void)
+{
+    if (!segment)
+        return;
+
+    for (uint32_t i = 0; i < segment->slot_count; i++)
+    {
+        state_shm_state_t *state = begin_write((int)i);
+        state->connected = 0;
+        end_write((int)i);
+    }
+
+    munmap(segment, segment_size);
+    shm_unlink(segment_name);
+    segment = NULL;
+    slots = NULL;
+}
+
+#else /* PLATFORM_WINDOWS */
+
+/**
+ * Creates (or replaces) the segment with every slot disconnected
+ */
+int state_shm_start(const char *name, int slot_count)
+{
+    (void)name;
+    (void)slot_count;
+    fprintf(stderr, "%s[ERROR]%s Shared-memory state is not supported on this platform\n", COLOR_RED,
+            COLOR_RESET);
+    return 0;
+}
+
+/**
+ * Marks a slot as connected to a controller
+ */
+void state_shm_set_slot(int slot, unsigned short product_id)
+{
+    (void)slot;
+    (void)product_id;
+}
+
+/**
+ * Publishes one report as the slot's latest state
+ */
+void state_shm_publish(int slot, const decoded_reports_t *decoded, const imu_samples_t *samples, size_t index)
+{
+    (void)slot;
+    (void)decoded;
+    (void)samples;
+    (void)index;
+}
+
+/**
+ * Marks every slot disconnected and removes the segment name
+ */
+void state_shm_stop(void)
+{
+}
+
+#endif /* PLATFORM_WINDOWS */
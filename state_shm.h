@@ -0,0 +1,53 @@
+/**
+ * state_shm.h - Shared-memory publication of controller state
+ *
+ * Publishes the latest decoded and calibrated state of every streamed
+ * controller in a POSIX shared-memory segment, one seqlock-guarded slot per
+ * controller, so local consumers can read it with state_shm_reader.h
+ * instead of opening the hidraw devices themselves.
+ */
+
+#ifndef STATE_SHM_H
+#define STATE_SHM_H
+
+#include "state_shm_reader.h"
+#include "report_decoder.h"
+#include "imu_calibration.h"
+
+/**
+ * Creates (or replaces) the segment with every slot disconnected
+ *
+ * @param name Segment name, or NULL for STATE_SHM_DEFAULT_NAME
+ * @param slot_count Number of slots, one per controller
+ * @return 1 on success, 0 on failure
+ */
+int state_shm_start(const char *name, int slot_count);
+
+/**
+ * Marks a slot as connected to a controller
+ *
+ * @param slot Slot number (0 to slot_count - 1)
+ * @param product_id Product ID of the controller
+ */
+void state_shm_set_slot(int slot, unsigned short product_id);
+
+/**
+ * Publishes one report as the slot's latest state
+ *
+ * Each slot must only be published from one thread at a time.
+ *
+ * @param slot Slot of the controller
+ * @param decoded Decoded reports
+ * @param samples Calibrated IMU samples matching decoded
+ * @param index Index of the report in both batches
+ */
+void state_shm_publish(int slot, const decoded_reports_t *decoded, const imu_samples_t *samples, size_t index);
+
+/**
+ * Marks every slot disconnected and removes the segment name
+ *
+ * Consumers that still have the segment mapped keep their mapping.
+ */
+void state_shm_stop(void);
+
+#endif /* STATE_SHM_H */
@@ -0,0 +1,181 @@
+/**
+ * state_shm_reader.h - Reader of the shared-memory controller state
+ *
+ * Header-only API for local consumers of "stream --shm": it maps the
+ * segment published by state_shm.h read-only and copies the latest state
+ * of a controller out of its slot without system calls or locks. Every
+ * slot is guarded by a sequence counter that is odd while the stream is
+ * writing it; a copy is only returned when the counter was even and did
+ * not change across it. Linux and macOS.
+ */
+
+#ifndef STATE_SHM_READER_H
+#define STATE_SHM_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifndef _WIN32
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+/* Default segment name */
+#define STATE_SHM_DEFAULT_NAME "/sixaxispairer"
+
+#define STATE_SHM_MAGIC 0x53585053u  /* "SPXS" */
+#define STATE_SHM_VERSION 1
+
+/* Copies attempted while a slot keeps being rewritten */
+#define STATE_SHM_READ_ATTEMPTS 64
+
+/**
+ * Segment header, followed by slot_count slots
+ */
+typedef struct {
+    _Alignas(64) uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;        /* sizeof(state_shm_slot_t) of the writer */
+    uint64_t writer_pid;
+} state_shm_header_t;
+
+/**
+ * Latest state of one controller
+ *
+ * Fields follow report_decoder.h: sticks and triggers 0-255, buttons as
+ * BUTTON_* bits, battery as a percentage or 0xff while charging. The raw
+ * IMU axes are centered counts; the calibrated axes are in g and degrees
+ * per second (see imu_calibration.h).
+ */
+typedef struct {
+    uint64_t timestamp_ns;     /* CLOCK_MONOTONIC time the report was read */
+    uint64_t reports;          /* Reports published to the slot so far */
+    uint32_t buttons;
+    uint16_t product_id;
+    uint8_t connected;         /* Cleared when the stream stops */
+    uint8_t battery;
+    uint8_t left_x, left_y, right_x, right_y;
+    uint8_t l2, r2;
+    uint8_t touch_active;
+    uint8_t reserved;
+    uint16_t touch_x, touch_y;
+    int16_t accel_raw[3], gyro_raw[3];
+    float accel_g[3];
+    float gyro_dps[3];
+} state_shm_state_t;
+
+/**
+ * One controller slot on its own cache lines
+ */
+typedef struct {
+    _Alignas(64) _Atomic uint32_t sequence;  /* Odd while being written */
+    state_shm_state_t state;
+} state_shm_slot_t;
+
+/**
+ * A mapped segment
+ */
+typedef struct {
+    const state_shm_header_t *header;
+    const state_shm_slot_t *slots;
+    size_t size;
+} state_shm_map_t;
+
+#ifndef _WIN32
+
+/**
+ * Maps a published segment read-only
+ *
+ * @param name Segment name, or NULL for STATE_SHM_DEFAULT_NAME
+ * @param map Receives the mapping
+ * @return 1 on success, 0 if there is no compatible segment
+ */
+static inline int state_shm_attach(const char *name, state_shm_map_t *map)
+{
+    struct stat st;
+    void *base;
+    int fd = shm_open(name ? name : STATE_SHM_DEFAULT_NAME, O_RDONLY, 0);
+
+    map->header = NULL;
+    map->slots = NULL;
+    map->size = 0;
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(state_shm_header_t))
+    {
+        close(fd);
+        return 0;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return 0;
+
+    map->header = (const state_shm_header_t*)base;
+    map->slots = (const state_shm_slot_t*)(map->header + 1);
+    map->size = (size_t)st.st_size;
+    if (map->header->magic != STATE_SHM_MAGIC || map->header->version != STATE_SHM_VERSION ||
+        map->header->slot_size != sizeof(state_shm_slot_t) ||
+        map->size < sizeof(state_shm_header_t) + (size_t)map->header->slot_count * sizeof(state_shm_slot_t))
+    {
+        munmap(base, map->size);
+        map->header = NULL;
+        map->slots = NULL;
+        map->size = 0;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Copies the latest consistent state of one slot
+ *
+ * @param map The mapping
+ * @param slot Slot number (0 to slot_count - 1), the controller index of the stream
+ * @param state Receives the state
+ * @return 1 on success, 0 for an invalid slot or one that kept changing
+ */
+static inline int state_shm_read(const state_shm_map_t *map, int slot, state_shm_state_t *state)
+{
+    const state_shm_slot_t *s;
+
+    if (!map->header || slot < 0 || (uint32_t)slot >= map->header->slot_count)
+        return 0;
+    s = &map->slots[slot];
+
+    for (int attempt = 0; attempt < STATE_SHM_READ_ATTEMPTS; attempt++)
+    {
+        uint32_t before = atomic_load_explicit(&s->sequence, memory_order_acquire);
+
+        if (before & 1u)
+            continue;
+        *state = s->state;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->sequence, memory_order_relaxed) == before)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Unmaps a segment
+ *
+ * @param map The mapping
+ */
+static inline void state_shm_detach(state_shm_map_t *map)
+{
+    if (map->header)
+        munmap((void*)map->header, map->size);
+    map->header = NULL;
+    map->slots = NULL;
+    map->size = 0;
+}
+
+#endif /* !_WIN32 */
+
+#endif /* STATE_SHM_READER_H */
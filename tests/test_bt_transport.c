@@ -0,0 +1,132 @@
+/**
+ * test_bt_transport.c - Bluetooth CRC trailers, input report rewriting and DS4 calibration layout
+ */
+
+#include "test_util.h"
+#include "bt_transport.h"
+#include "controller_info.h"
+#include "crc32.h"
+#include "imu_calibration.h"
+#include "report_decoder.h"
+#include <string.h>
+
+int main(void)
+{
+    unsigned char joined[BT_INPUT_LENGTH + 1];
+    unsigned char bt[DS4_BT_CALIBRATION_LENGTH], usb[DS4_CALIBRATION_LENGTH];
+    input_report_t report, copy;
+    decoded_reports_t batch;
+
+    /* The CRC covers the seed byte followed by the report */
+    memset(&report, 0, sizeof(report));
+    report.data[0] = DS4_BT_INPUT_REPORT_ID;
+    for (int i = 1; i < BT_INPUT_LENGTH; i++)
+        report.data[i] = (unsigned char)(i * 7 + 3);
+    joined[0] = BT_SEED_INPUT;
+    memcpy(joined + 1, report.data, BT_INPUT_LENGTH - BT_CRC_LENGTH);
+    CHECK_EQ(bt_report_crc(BT_SEED_INPUT, report.data, BT_INPUT_LENGTH - BT_CRC_LENGTH),
+             crc32(joined, BT_INPUT_LENGTH - BT_CRC_LENGTH + 1));
+
+    /* A sealed report checks out only with its own seed and unmodified */
+    bt_report_seal(BT_SEED_INPUT, report.data, BT_INPUT_LENGTH);
+    CHECK(bt_report_valid(BT_SEED_INPUT, report.data, BT_INPUT_LENGTH));
+    CHECK(!bt_report_valid(BT_SEED_FEATURE, report.data, BT_INPUT_LENGTH));
+    CHECK(!bt_report_valid(BT_SEED_INPUT, report.data, BT_CRC_LENGTH));
+    report.data[40] ^= 0x01;
+    CHECK(!bt_report_valid(BT_SEED_INPUT, report.data, BT_INPUT_LENGTH));
+    report.data[40] ^= 0x01;
+
+    /* DS4 report 0x11 becomes report 0x01: two header bytes and the CRC go */
+    report.length = BT_INPUT_LENGTH;
+    copy = report;
+    CHECK(bt_normalize_input(PRODUCT_DS4, &report));
+    CHECK_EQ(report.data[0], 0x01);
+    CHECK_EQ(report.length, BT_INPUT_LENGTH - BT_CRC_LENGTH - 2);
+    CHECK(memcmp(report.data + 1, copy.data + 3, report.length - 1) == 0);
+
+    /* Other reports, and other controllers, are left as they are */
+    copy = report;
+    CHECK(bt_normalize_input(PRODUCT_DS4, &report));
+    CHECK(memcmp(&report, &copy, sizeof(report)) == 0);
+    report.data[0] = DS4_BT_INPUT_REPORT_ID;
+    copy = report;
+    CHECK(bt_normalize_input(PRODUCT_SIXAXIS, &report));
+    CHECK(memcmp(&report, &copy, sizeof(report)) == 0);
+
+    /* A bad CRC is refused and a short full report cannot be checked */
+    report.length = BT_INPUT_LENGTH;
+    CHECK(!bt_normalize_input(PRODUCT_DS4, &report));
+    report.length = 10;
+    CHECK(!bt_normalize_input(PRODUCT_DS4, &report));
+
+    /* DualSense report 0x31 has one header byte */
+    memset(&report, 0, sizeof(report));
+    report.data[0] = DUALSENSE_BT_INPUT_REPORT_ID;
+    for (int i = 1; i < BT_INPUT_LENGTH; i++)
+        report.data[i] = (unsigned char)(255 - i);
+    bt_report_seal(BT_SEED_INPUT, report.data, BT_INPUT_LENGTH);
+    report.length = BT_INPUT_LENGTH;
+    copy = report;
+    CHECK(bt_normalize_input(PRODUCT_DUALSENSE_EDGE, &report));
+    CHECK_EQ(report.data[0], 0x01);
+    CHECK_EQ(report.length, BT_INPUT_LENGTH - BT_CRC_LENGTH - 1);
+    CHECK(memcmp(report.data + 1, copy.data + 2, report.length - 1) == 0);
+
+    /* A rewritten DS4 report decodes like the USB one */
+    memset(&report, 0, sizeof(report));
+    report.data[0] = DS4_BT_INPUT_REPORT_ID;
+    report.data[1] = 0xc0;
+    report.data[2 + 1] = 12;            /* Left X */
+    report.data[2 + 4] = 240;           /* Right Y */
+    report.data[2 + 5] = 0x28;          /* Cross, hat released */
+    report.data[2 + 30] = 0x07;         /* Battery 75% */
+    bt_report_seal(BT_SEED_INPUT, report.data, BT_INPUT_LENGTH);
+    report.length = BT_INPUT_LENGTH;
+    CHECK(bt_normalize_input(PRODUCT_DS4, &report));
+    CHECK(report.length >= report_min_length(REPORT_FAMILY_DS4));
+    CHECK(decoded_reports_init(&batch, 1));
+    decode_reports(REPORT_FAMILY_DS4, &report, 1, &batch);
+    CHECK_EQ(batch.left_x[0], 12);
+    CHECK_EQ(batch.right_y[0], 240);
+    CHECK_EQ(batch.buttons[0], BUTTON_CROSS);
+    CHECK_EQ(batch.battery[0], 75);
+    decoded_reports_free(&batch);
+
+    /* USB output reports gain the Bluetooth header and a CRC; others have no Bluetooth form */
+    {
+        unsigned char usb[DS4_OUTPUT_LENGTH] = { DS4_OUTPUT_REPORT_ID, 0x07 }, out[BT_OUTPUT_LENGTH];
+
+        usb[6] = 0xff;
+        CHECK_EQ(bt_wrap_output(PRODUCT_DS4, usb, sizeof(usb), out), BT_OUTPUT_LENGTH);
+        CHECK_EQ(out[0], DS4_BT_OUTPUT_REPORT_ID);
+        CHECK_EQ(out[3], 0x07);
+        CHECK_EQ(out[8], 0xff);
+        CHECK(bt_report_valid(BT_SEED_OUTPUT, out, BT_OUTPUT_LENGTH));
+        usb[0] = DUALSENSE_OUTPUT_REPORT_ID;
+        CHECK_EQ(bt_wrap_output(PRODUCT_DUALSENSE, usb, sizeof(usb), out), BT_OUTPUT_LENGTH);
+        CHECK_EQ(out[0], DUALSENSE_BT_OUTPUT_REPORT_ID);
+        CHECK_EQ(out[2], 0x10);
+        CHECK(bt_report_valid(BT_SEED_OUTPUT, out, BT_OUTPUT_LENGTH));
+        CHECK_EQ(bt_wrap_output(PRODUCT_DS4, usb, sizeof(usb), out), 0);
+    }
+
+    /* DS4 calibration 0x05 lists the gyro plus references first, 0x02 interleaves them */
+    memset(bt, 0, sizeof(bt));
+    bt[0] = DS4_BT_CALIBRATION_REPORT_ID;
+    for (int i = 1; i < DS4_BT_CALIBRATION_LENGTH - BT_CRC_LENGTH; i++)
+        bt[i] = (unsigned char)i;
+    CHECK(imu_calibration_ds4_from_bt(bt, sizeof(bt), usb));
+    CHECK_EQ(usb[0], DS4_CALIBRATION_REPORT_ID);
+    CHECK(memcmp(usb + 1, bt + 1, 6) == 0);
+    CHECK(usb[7] == 7 && usb[8] == 8);      /* Pitch plus */
+    CHECK(usb[9] == 13 && usb[10] == 14);   /* Pitch minus */
+    CHECK(usb[11] == 9 && usb[12] == 10);   /* Yaw plus */
+    CHECK(usb[13] == 15 && usb[14] == 16);  /* Yaw minus */
+    CHECK(usb[15] == 11 && usb[16] == 12);  /* Roll plus */
+    CHECK(usb[17] == 17 && usb[18] == 18);  /* Roll minus */
+    CHECK(memcmp(usb + 19, bt + 19, DS4_CALIBRATION_LENGTH - 19) == 0);
+    bt[0] = DS4_CALIBRATION_REPORT_ID;
+    CHECK(!imu_calibration_ds4_from_bt(bt, sizeof(bt), usb));
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,92 @@
+/**
+ * test_capability_cache.c - Capability file entries, failure counting and persistence
+ */
+
+#include "test_util.h"
+#include "capability_cache.h"
+#include "controller_info.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_FILE "test_capabilities.bin"
+
+int main(void)
+{
+    uint64_t usb = capability_key(VENDOR_SONY, PRODUCT_DS4, 0x0102, 0);
+    uint64_t bt = capability_key(VENDOR_SONY, PRODUCT_DS4, 0x0102, 1);
+    uint64_t other = capability_key(VENDOR_SONY, PRODUCT_DS4, 0x0103, 0);
+    capability_report_t reports[8];
+    FILE *file;
+
+    remove(TEST_FILE);
+    capability_cache_set_file(TEST_FILE);
+
+    /* Keys differ by transport and firmware and are never free */
+    CHECK(usb != 0 && usb != bt && usb != other);
+    CHECK(capability_key(0, 0, 0, 0) != 0);
+
+    /* A request is skipped only after failing CAPABILITY_FAIL_LIMIT times in a row */
+    for (int i = 0; i < CAPABILITY_FAIL_LIMIT - 1; i++)
+        capability_cache_record(usb, CAPABILITY_GET, 0x81, -1);
+    CHECK(!capability_cache_failing(usb, CAPABILITY_GET, 0x81));
+    capability_cache_record(usb, CAPABILITY_GET, 0x81, -1);
+    CHECK(capability_cache_failing(usb, CAPABILITY_GET, 0x81));
+    CHECK(!capability_cache_failing(usb, CAPABILITY_SET, 0x81));
+    CHECK(!capability_cache_failing(bt, CAPABILITY_GET, 0x81));
+    CHECK(!capability_cache_failing(other, CAPABILITY_GET, 0x81));
+
+    /* A success starts the count over */
+    capability_cache_record(usb, CAPABILITY_SET, 0x13, -1);
+    capability_cache_record(usb, CAPABILITY_SET, 0x13, -1);
+    capability_cache_record(usb, CAPABILITY_SET, 0x13, 23);
+    capability_cache_record(usb, CAPABILITY_SET, 0x13, -1);
+    capability_cache_record(usb, CAPABILITY_SET, 0x13, -1);
+    CHECK(!capability_cache_failing(usb, CAPABILITY_SET, 0x13));
+
+    /* Readable reports, merged across transports, in report ID order */
+    capability_cache_record(usb, CAPABILITY_GET, 0x12, 16);
+    capability_cache_record(bt, CAPABILITY_GET, 0x12, 20);
+    capability_cache_record(bt, CAPABILITY_GET, 0x05, 41);
+    CHECK_EQ(capability_cache_reports(VENDOR_SONY, PRODUCT_DS4, 0x0102, reports, 8), 2);
+    CHECK_EQ(reports[0].report_id, 0x05);
+    CHECK_EQ(reports[0].size, 41);
+    CHECK_EQ(reports[0].transports, CAPABILITY_BLUETOOTH);
+    CHECK_EQ(reports[1].report_id, 0x12);
+    CHECK_EQ(reports[1].size, 16);
+    CHECK_EQ(reports[1].transports, CAPABILITY_USB | CAPABILITY_BLUETOOTH);
+    CHECK_EQ(capability_cache_reports(VENDOR_SONY, PRODUCT_DS4, 0x0103, reports, 8), 0);
+    CHECK_EQ(capability_cache_reports(VENDOR_SONY, PRODUCT_DS4, 0x0102, reports, 1), 1);
+
+    /* The file keeps everything across mappings */
+    capability_cache_close();
+    CHECK(capability_cache_failing(usb, CAPABILITY_GET, 0x81));
+    CHECK_EQ(capability_cache_reports(VENDOR_SONY, PRODUCT_DS4, 0x0102, reports, 8), 2);
+
+    /* Every entry can be claimed; the next kind is simply not recorded */
+    for (int i = 0; i < CAPABILITY_MAX_ENTRIES + 4; i++)
+        capability_cache_record(capability_key(0x1234, (unsigned short)i, 0, 0), CAPABILITY_GET, 0x01, 8);
+    CHECK(capability_cache_failing(usb, CAPABILITY_GET, 0x81));
+
+    /* A damaged file is started over */
+    capability_cache_close();
+    file = fopen(TEST_FILE, "r+b");
+    CHECK(file != NULL);
+    if (file)
+    {
+        fputs("garbage", file);
+        fclose(file);
+    }
+    CHECK(!capability_cache_failing(usb, CAPABILITY_GET, 0x81));
+    CHECK_EQ(capability_cache_reports(VENDOR_SONY, PRODUCT_DS4, 0x0102, reports, 8), 0);
+
+    /* Switched off, nothing is recorded or skipped */
+    capability_cache_close();
+    capability_cache_enabled = 0;
+    capability_cache_record(usb, CAPABILITY_GET, 0x44, -1);
+    capability_cache_record(usb, CAPABILITY_GET, 0x44, -1);
+    capability_cache_record(usb, CAPABILITY_GET, 0x44, -1);
+    CHECK(!capability_cache_failing(usb, CAPABILITY_GET, 0x44));
+
+    remove(TEST_FILE);
+    TEST_RESULT();
+}
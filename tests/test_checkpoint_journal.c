@@ -0,0 +1,122 @@
+/**
+ * test_checkpoint_journal.c - Journal records, group commit, torn records and resume
+ */
+
+#include "test_util.h"
+#include "checkpoint_journal.h"
+#include "thread_compat.h"
+#include <string.h>
+
+#define JOURNAL_PATH "test_checkpoint_journal.journal"
+#define WORKERS 8
+
+typedef struct {
+    checkpoint_t *journal;
+    int index;
+    int ok;
+} worker_t;
+
+static void record_worker(void *arg)
+{
+    worker_t *worker = (worker_t*)arg;
+    char key[32];
+
+    snprintf(key, sizeof(key), "serial:S%02d", worker->index);
+    worker->ok = checkpoint_record(worker->journal, key);
+}
+
+int main(void)
+{
+    checkpoint_t journal;
+    worker_t workers[WORKERS];
+    thread_t threads[WORKERS];
+    int running[WORKERS];
+    char error[128];
+    FILE *file;
+    uint32_t fingerprint = checkpoint_fingerprint("recipe", 6, 0);
+
+    /* A fresh journal records from many threads at once */
+    CHECK(checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 0, error, sizeof(error)));
+    CHECK_EQ(checkpoint_resumed_count(&journal), 0);
+    for (int i = 0; i < WORKERS; i++)
+    {
+        workers[i].journal = &journal;
+        workers[i].index = i;
+        workers[i].ok = 0;
+        running[i] = thread_create(&threads[i], record_worker, &workers[i]);
+        if (!running[i])
+            record_worker(&workers[i]);
+    }
+    for (int i = 0; i < WORKERS; i++)
+    {
+        if (running[i])
+            thread_join(threads[i]);
+        CHECK(workers[i].ok);
+    }
+    CHECK(journal.commit_count >= 1 && journal.commit_count <= WORKERS);
+    CHECK(checkpoint_record(&journal, "path:/dev/hid\traw0"));
+    CHECK(checkpoint_close(&journal));
+
+    /* Resuming sees every record; tabs in keys were replaced */
+    CHECK(checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 1, error, sizeof(error)));
+    CHECK_EQ(checkpoint_resumed_count(&journal), WORKERS + 1);
+    CHECK(checkpoint_done(&journal, "serial:S00"));
+    CHECK(checkpoint_done(&journal, "serial:S07"));
+    CHECK(checkpoint_done(&journal, "path:/dev/hid_raw0"));
+    CHECK(!checkpoint_done(&journal, "serial:S08"));
+    CHECK(!checkpoint_done(NULL, "serial:S00"));
+    CHECK(checkpoint_close(&journal));
+
+    /* A record torn by a crash is dropped, and the next one follows the last good one */
+    file = fopen(JOURNAL_PATH, "ab");
+    CHECK(file != NULL);
+    fputs("serial:S99\t1234", file);
+    fclose(file);
+    CHECK(checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 1, error, sizeof(error)));
+    CHECK_EQ(checkpoint_resumed_count(&journal), WORKERS + 1);
+    CHECK(!checkpoint_done(&journal, "serial:S99"));
+    CHECK(checkpoint_record(&journal, "serial:S42"));
+    CHECK(checkpoint_close(&journal));
+    CHECK(checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 1, error, sizeof(error)));
+    CHECK_EQ(checkpoint_resumed_count(&journal), WORKERS + 2);
+    CHECK(checkpoint_done(&journal, "serial:S42"));
+    CHECK(checkpoint_close(&journal));
+
+    /* A record with a bad CRC ends the journal */
+    file = fopen(JOURNAL_PATH, "ab");
+    CHECK(file != NULL);
+    fputs("serial:S98\t00000000\nserial:S97\t00000000\n", file);
+    fclose(file);
+    CHECK(checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 1, error, sizeof(error)));
+    CHECK_EQ(checkpoint_resumed_count(&journal), WORKERS + 2);
+    CHECK(checkpoint_close(&journal));
+
+    /* Another job's journal, or another file, is refused */
+    CHECK(!checkpoint_open(&journal, JOURNAL_PATH, fingerprint + 1, 1, error, sizeof(error)));
+    CHECK(strstr(error, "another job") != NULL);
+    file = fopen(JOURNAL_PATH, "wb");
+    CHECK(file != NULL);
+    fputs("kind,identity,host\n", file);
+    fclose(file);
+    CHECK(!checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 1, error, sizeof(error)));
+    CHECK(strstr(error, "not a journal") != NULL);
+
+    /* Without resume the journal starts afresh; a torn header counts as no journal */
+    CHECK(checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 0, error, sizeof(error)));
+    CHECK_EQ(checkpoint_resumed_count(&journal), 0);
+    CHECK(checkpoint_close(&journal));
+    file = fopen(JOURNAL_PATH, "wb");
+    CHECK(file != NULL);
+    fputs("sixaxispairer-jou", file);
+    fclose(file);
+    CHECK(checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 1, error, sizeof(error)));
+    CHECK_EQ(checkpoint_resumed_count(&journal), 0);
+    CHECK(checkpoint_record(&journal, "serial:S01"));
+    CHECK(checkpoint_close(&journal));
+    CHECK(checkpoint_open(&journal, JOURNAL_PATH, fingerprint, 1, error, sizeof(error)));
+    CHECK(checkpoint_done(&journal, "serial:S01"));
+    CHECK(checkpoint_close(&journal));
+
+    remove(JOURNAL_PATH);
+    return TEST_RESULT();
+}
@@ -0,0 +1,102 @@
+/**
+ * test_config_snapshot.c - Snapshot file format, hash and restorable reports
+ */
+
+#include "test_util.h"
+#include "config_snapshot.h"
+#include "controller_info.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Adds a report filled with a byte pattern
+ */
+static void add_report(snapshot_t *snapshot, unsigned char report_id, uint16_t length, unsigned char fill,
+                       uint8_t flags)
+{
+    snapshot_report_t *report = &snapshot->reports[snapshot->count++];
+
+    report->report_id = report_id;
+    report->flags = flags;
+    report->length = length;
+    memset(report->data, fill, length);
+    report->data[0] = report_id;
+}
+
+int main(void)
+{
+    snapshot_t *snapshot = (snapshot_t*)calloc(1, sizeof(snapshot_t));
+    snapshot_t *decoded = (snapshot_t*)calloc(1, sizeof(snapshot_t));
+    unsigned char *image = (unsigned char*)malloc(SNAPSHOT_MAX_FILE);
+    char error[96];
+    uint32_t hash;
+    size_t length;
+
+    if (!snapshot || !decoded || !image)
+        return 1;
+
+    /* Pairing, address, firmware and calibration reports are never restored */
+    CHECK(!snapshot_restorable(PRODUCT_DS4, 0x12));
+    CHECK(!snapshot_restorable(PRODUCT_DS4, 0x13));
+    CHECK(!snapshot_restorable(PRODUCT_DS4, MAC_REPORT_ID));
+    CHECK(!snapshot_restorable(PRODUCT_DS4, 0x02));
+    CHECK(!snapshot_restorable(PRODUCT_DS4, 0xa3));
+    CHECK(!snapshot_restorable(PRODUCT_DS4, 0xf2));
+    CHECK(snapshot_restorable(PRODUCT_DS4, 0x14));
+    CHECK(!snapshot_restorable(PRODUCT_DUALSENSE, 0x09));
+    CHECK(!snapshot_restorable(PRODUCT_DUALSENSE_EDGE, 0x0a));
+    CHECK(!snapshot_restorable(PRODUCT_DUALSENSE, 0x20));
+    CHECK(snapshot_restorable(PRODUCT_DUALSENSE, 0x08));
+    CHECK(!snapshot_restorable(PRODUCT_SIXAXIS, MAC_REPORT_ID));
+    CHECK(!snapshot_restorable(PRODUCT_SIXAXIS, SIXAXIS_ENABLE_REPORT_ID));
+    CHECK(!snapshot_restorable(PRODUCT_MOVE, 0xf2));
+    CHECK(snapshot_restorable(PRODUCT_SIXAXIS, 0xef));
+
+    snapshot->vendor_id = VENDOR_SONY;
+    snapshot->product_id = PRODUCT_DS4;
+    add_report(snapshot, 0x14, 17, 0x11, SNAPSHOT_FLAG_RESTORE);
+    add_report(snapshot, 0xa3, 49, 0x22, 0);
+    add_report(snapshot, 0x15, SNAPSHOT_MAX_LENGTH, 0x33, SNAPSHOT_FLAG_RESTORE);
+    snapshot->hash = snapshot_hash(snapshot);
+
+    /* The hash covers only the restored reports */
+    hash = snapshot->hash;
+    snapshot->reports[1].data[5] ^= 0xff;
+    CHECK_EQ(snapshot_hash(snapshot), hash);
+    snapshot->reports[0].data[5] ^= 0xff;
+    CHECK(snapshot_hash(snapshot) != hash);
+    snapshot->reports[0].data[5] ^= 0xff;
+
+    /* Round trip */
+    length = snapshot_encode(snapshot, image, SNAPSHOT_MAX_FILE);
+    CHECK_EQ(length, SNAPSHOT_HEADER_SIZE + 3 * SNAPSHOT_REPORT_HEADER_SIZE + 17 + 49 + SNAPSHOT_MAX_LENGTH);
+    CHECK(memcmp(image, SNAPSHOT_MAGIC, 6) == 0);
+    CHECK(snapshot_decode(image, length, decoded, error, sizeof(error)));
+    CHECK_EQ(decoded->product_id, PRODUCT_DS4);
+    CHECK_EQ(decoded->count, 3);
+    CHECK_EQ(decoded->hash, hash);
+    CHECK_EQ(decoded->reports[2].length, SNAPSHOT_MAX_LENGTH);
+    CHECK(memcmp(decoded->reports[1].data, snapshot->reports[1].data, 49) == 0);
+    CHECK_EQ(snapshot_encode(snapshot, image, length - 1), 0);
+
+    /* Damage is caught */
+    length = snapshot_encode(snapshot, image, SNAPSHOT_MAX_FILE);
+    CHECK(!snapshot_decode(image, length - 1, decoded, error, sizeof(error)));
+    image[SNAPSHOT_HEADER_SIZE + SNAPSHOT_REPORT_HEADER_SIZE + 3] ^= 0x01;
+    CHECK(!snapshot_decode(image, length, decoded, error, sizeof(error)));
+    CHECK(strcmp(error, "content hash mismatch") == 0);
+    image[SNAPSHOT_HEADER_SIZE + SNAPSHOT_REPORT_HEADER_SIZE + 3] ^= 0x01;
+    image[SNAPSHOT_HEADER_SIZE] = 0x16;
+    CHECK(!snapshot_decode(image, length, decoded, error, sizeof(error)));
+    image[SNAPSHOT_HEADER_SIZE] = 0x14;
+    image[6] = 9;
+    CHECK(!snapshot_decode(image, length, decoded, error, sizeof(error)));
+    image[6] = SNAPSHOT_VERSION;
+    CHECK(snapshot_decode(image, length, decoded, error, sizeof(error)));
+    CHECK(!snapshot_decode((const unsigned char*)"SXPSN", 5, decoded, error, sizeof(error)));
+
+    free(snapshot);
+    free(decoded);
+    free(image);
+    TEST_RESULT();
+}
@@ -0,0 +1,177 @@
+/**
+ * test_controller_qa.c - Single-pass channel statistics and QA verdicts
+ */
+
+#include "test_util.h"
+#include "controller_qa.h"
+#include <math.h>
+#include <string.h>
+
+#define REPORTS 1000
+
+static decoded_reports_t decoded;
+static imu_samples_t samples;
+
+/**
+ * Fills a batch with a healthy unit resting at 250 Hz
+ */
+static void fill_resting(void)
+{
+    decoded.count = samples.count = REPORTS;
+    for (int i = 0; i < REPORTS; i++)
+    {
+        decoded.timestamp_ns[i] = 1000000000ull + (uint64_t)i * 4000000u;
+        decoded.buttons[i] = 0;
+        decoded.left_x[i] = (uint8_t)(127 + (i & 1));
+        decoded.left_y[i] = decoded.right_x[i] = decoded.right_y[i] = 128;
+        decoded.l2[i] = decoded.r2[i] = 0;
+        decoded.battery[i] = 80;
+        samples.accel_x[i] = samples.accel_z[i] = 0.0f;
+        samples.accel_y[i] = (i & 1) ? -1.001f : -0.999f;
+        samples.gyro_x[i] = samples.gyro_y[i] = 0.1f;
+        samples.gyro_z[i] = (i & 1) ? 0.3f : -0.1f;
+    }
+}
+
+int main(void)
+{
+    static const double values[] = { 2, 4, 4, 4, 5, 5, 7, 9 };
+    qa_channel_t channel;
+    qa_thresholds_t thresholds;
+    qa_unit_t unit;
+
+    /* Welford matches the two-pass mean and sample deviation */
+    qa_channel_init(&channel, 0, 16);
+    CHECK_NEAR(qa_channel_stddev(&channel), 0.0, 1e-12);
+    CHECK_NEAR(qa_channel_percentile(&channel, 0.5), 0.0, 1e-12);
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+        qa_channel_add(&channel, values[i]);
+    CHECK_EQ(channel.count, 8);
+    CHECK_NEAR(channel.mean, 5.0, 1e-12);
+    CHECK_NEAR(qa_channel_stddev(&channel), sqrt(32.0 / 7.0), 1e-12);
+    CHECK_NEAR(channel.min, 2.0, 1e-12);
+    CHECK_NEAR(channel.max, 9.0, 1e-12);
+
+    /* 16 over 32 bins: half a unit per bin */
+    CHECK_EQ(channel.bins[4], 1);
+    CHECK_EQ(channel.bins[8], 3);
+    CHECK_EQ(channel.bins[18], 1);
+    CHECK(qa_channel_percentile(&channel, 0.5) >= 4.0 && qa_channel_percentile(&channel, 0.5) <= 5.0);
+    CHECK_NEAR(qa_channel_percentile(&channel, 0.0), 2.0, 1e-12);
+    CHECK_NEAR(qa_channel_percentile(&channel, 1.0), 9.0, 1e-12);
+
+    /* Out-of-range values land in the end bins but keep their min and max */
+    qa_channel_add(&channel, -100);
+    qa_channel_add(&channel, 100);
+    CHECK_EQ(channel.bins[0], 1);
+    CHECK_EQ(channel.bins[QA_HISTOGRAM_BINS - 1], 1);
+    CHECK_NEAR(channel.min, -100.0, 1e-12);
+    CHECK_NEAR(channel.max, 100.0, 1e-12);
+
+    /* Stable far from zero, where the naive sum of squares is not */
+    qa_channel_init(&channel, 0, 1);
+    for (int i = 0; i < 100000; i++)
+        qa_channel_add(&channel, 1e9 + (i & 1));
+    CHECK_NEAR(qa_channel_stddev(&channel), 0.5 * sqrt(100000.0 / 99999.0), 1e-6);
+
+    CHECK(decoded_reports_init(&decoded, REPORTS));
+    CHECK(imu_samples_init(&samples, REPORTS));
+    qa_thresholds_default(&thresholds);
+
+    /* A healthy resting unit passes */
+    qa_unit_init(&unit);
+    CHECK_EQ(qa_unit_evaluate(&unit, &thresholds), QA_FAIL_NO_REPORTS);
+    fill_resting();
+    qa_unit_add(&unit, &decoded, &samples, thresholds.bounce_ms);
+    CHECK_EQ(unit.reports, REPORTS);
+    CHECK_NEAR(unit.channels[QA_LEFT_X].mean, 127.5, 1e-9);
+    CHECK_NEAR(unit.channels[QA_GYRO_Z].mean, 0.1, 1e-6);
+    CHECK_EQ(unit.battery_min, 80);
+    CHECK_EQ(qa_unit_evaluate(&unit, &thresholds), 0);
+
+    /* Batches add up to the same statistics as one pass */
+    {
+        qa_unit_t split;
+        size_t half = REPORTS / 2;
+
+        qa_unit_init(&split);
+        decoded.count = samples.count = half;
+        qa_unit_add(&split, &decoded, &samples, thresholds.bounce_ms);
+        memmove(decoded.timestamp_ns, decoded.timestamp_ns + half, half * sizeof(uint64_t));
+        memmove(decoded.left_x, decoded.left_x + half, half);
+        memmove(samples.accel_y, samples.accel_y + half, half * sizeof(float));
+        memmove(samples.gyro_z, samples.gyro_z + half, half * sizeof(float));
+        qa_unit_add(&split, &decoded, &samples, thresholds.bounce_ms);
+        CHECK_EQ(split.reports, REPORTS);
+        CHECK_NEAR(split.channels[QA_ACCEL_Y].mean, unit.channels[QA_ACCEL_Y].mean, 1e-9);
+        CHECK_NEAR(qa_channel_stddev(&split.channels[QA_GYRO_Z]), qa_channel_stddev(&unit.channels[QA_GYRO_Z]),
+                   1e-9);
+        CHECK_EQ(qa_unit_evaluate(&split, &thresholds), 0);
+    }
+
+    /* A drifting, noisy stick, a held trigger, noisy and biased sensors */
+    fill_resting();
+    for (int i = 0; i < REPORTS; i++)
+    {
+        decoded.right_y[i] = 140;
+        decoded.left_y[i] = (uint8_t)((i & 1) ? 120 : 136);
+        decoded.r2[i] = 30;
+        samples.accel_x[i] = (i & 1) ? 0.1f : -0.1f;
+        samples.gyro_y[i] = 5.0f;
+        samples.gyro_x[i] = (i & 1) ? 4.0f : -4.0f;
+    }
+    qa_unit_init(&unit);
+    qa_unit_add(&unit, &decoded, &samples, thresholds.bounce_ms);
+    CHECK_EQ(qa_unit_evaluate(&unit, &thresholds), QA_FAIL_STICK_DRIFT | QA_FAIL_STICK_NOISE |
+                                                   QA_FAIL_TRIGGER_DRIFT | QA_FAIL_ACCEL_NOISE |
+                                                   QA_FAIL_GYRO_NOISE | QA_FAIL_GYRO_BIAS);
+
+    /* Clean presses pass; a re-press 4 ms after a release is a bounce */
+    fill_resting();
+    for (int i = 100; i < 110; i++)
+        decoded.buttons[i] = BUTTON_CROSS;
+    for (int i = 300; i < 310; i++)
+        decoded.buttons[i] = BUTTON_CIRCLE;
+    qa_unit_init(&unit);
+    qa_unit_add(&unit, &decoded, &samples, thresholds.bounce_ms);
+    CHECK_EQ(unit.presses, 2);
+    CHECK_EQ(unit.bounces, 0);
+    CHECK_EQ(unit.buttons_seen, BUTTON_CROSS | BUTTON_CIRCLE);
+    CHECK_EQ(qa_unit_evaluate(&unit, &thresholds), 0);
+
+    decoded.buttons[111] = BUTTON_CROSS;
+    qa_unit_init(&unit);
+    qa_unit_add(&unit, &decoded, &samples, thresholds.bounce_ms);
+    CHECK_EQ(unit.presses, 3);
+    CHECK_EQ(unit.bounces, 1);
+    CHECK_EQ(qa_unit_evaluate(&unit, &thresholds), QA_FAIL_BUTTON_BOUNCE);
+
+    /* A slow unit with a low battery; charging reports are not judged */
+    fill_resting();
+    for (int i = 0; i < REPORTS; i++)
+    {
+        decoded.timestamp_ns[i] = (uint64_t)i * 40000000u;
+        decoded.battery[i] = (uint8_t)(i < 10 ? BATTERY_CHARGING : 10);
+    }
+    qa_unit_init(&unit);
+    qa_unit_add(&unit, &decoded, &samples, thresholds.bounce_ms);
+    CHECK(unit.charging);
+    CHECK_EQ(unit.battery_min, 10);
+    CHECK_EQ(qa_unit_evaluate(&unit, &thresholds), QA_FAIL_REPORT_RATE | QA_FAIL_BATTERY);
+
+    for (int i = 0; i < REPORTS; i++)
+        decoded.battery[i] = BATTERY_CHARGING;
+    thresholds.min_rate_hz = 20.0;
+    qa_unit_init(&unit);
+    qa_unit_add(&unit, &decoded, &samples, thresholds.bounce_ms);
+    CHECK_EQ(unit.battery_min, -1);
+    CHECK_EQ(qa_unit_evaluate(&unit, &thresholds), 0);
+
+    CHECK(strcmp(qa_failure_name(QA_FAIL_GYRO_BIAS), "gyro_bias") == 0);
+    CHECK(strcmp(qa_channel_name(QA_ACCEL_Z), "accel_z") == 0);
+
+    imu_samples_free(&samples);
+    decoded_reports_free(&decoded);
+
+    return TEST_RESULT();
+}
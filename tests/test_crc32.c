@@ -0,0 +1,60 @@
+/**
+ * test_crc32.c - CRC-32 check values and incremental updates
+ */
+
+#include "test_util.h"
+#include "crc32.h"
+#include <string.h>
+
+/**
+ * Bit-at-a-time reference CRC-32
+ */
+static uint32_t reference_crc32(const unsigned char *p, size_t length)
+{
+    uint32_t crc = 0xffffffffu;
+
+    while (length--)
+    {
+        crc ^= *p++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+    }
+    return ~crc;
+}
+
+int main(void)
+{
+    static const char CHECK_INPUT[] = "123456789";
+    static const char FOX[] = "The quick brown fox jumps over the lazy dog";
+    unsigned char block[1000];
+
+    /* Published check values of the reflected IEEE CRC-32 */
+    CHECK_EQ(crc32("", 0), 0x00000000u);
+    CHECK_EQ(crc32("a", 1), 0xe8b7be43u);
+    CHECK_EQ(crc32(CHECK_INPUT, 9), 0xcbf43926u);
+    CHECK_EQ(crc32(FOX, strlen(FOX)), 0x414fa339u);
+
+    /* Any split of the input gives the same result */
+    for (size_t i = 0; i < sizeof(block); i++)
+        block[i] = (unsigned char)(i * 31 + 7);
+    uint32_t whole = crc32(block, sizeof(block));
+    for (size_t split = 0; split <= sizeof(block); split += 37)
+        CHECK_EQ(crc32_update(crc32_update(0, block, split), block + split, sizeof(block) - split), whole);
+
+    /* Unaligned starts */
+    for (size_t offset = 1; offset < 8; offset++)
+    {
+        uint32_t expected = crc32_update(crc32_update(0, block, offset), block + offset, 100);
+        CHECK_EQ(crc32(block, offset + 100), expected);
+    }
+
+    /* Every length and alignment around the 8-byte steps matches the reference */
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t length = 0; length <= 80; length++)
+            CHECK_EQ(crc32(block + offset, length), reference_crc32(block + offset, length));
+    }
+    CHECK_EQ(crc32(block, sizeof(block)), reference_crc32(block, sizeof(block)));
+
+    return TEST_RESULT();
+}
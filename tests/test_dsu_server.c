@@ -0,0 +1,215 @@
+/**
+ * test_dsu_server.c - DSU packet layout, CRC and subscriptions over loopback UDP
+ */
+
+#include "test_util.h"
+#include "dsu_server.h"
+#include "crc32.h"
+#include "controller_info.h"
+#include "platform_compat.h"
+#include <string.h>
+
+#ifndef PLATFORM_WINDOWS
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define TEST_PORT 26790
+
+static struct sockaddr_in server;
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static float get_float(const unsigned char *p)
+{
+    uint32_t bits = get_u32(p);
+    float f;
+
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/**
+ * Opens a client socket that gives up on receives after 200 ms
+ */
+static int open_client(void)
+{
+    struct timeval timeout = { 0, 200000 };
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+/**
+ * Sends a client request of one message type and lets the server answer it
+ */
+static void request(int fd, uint32_t type, const unsigned char *payload, size_t length)
+{
+    unsigned char p[64];
+
+    memset(p, 0, sizeof(p));
+    memcpy(p, "DSUC", 4);
+    p[4] = 1001 & 0xff;
+    p[5] = 1001 >> 8;
+    p[6] = (unsigned char)(4 + length);
+    put_u32(p + 12, 42);
+    put_u32(p + 16, type);
+    memcpy(p + 20, payload, length);
+    put_u32(p + 8, crc32(p, 20 + length));
+    sendto(fd, p, 20 + length, 0, (const struct sockaddr*)&server, sizeof(server));
+    usleep(10000);
+    dsu_server_poll();
+}
+
+/**
+ * Receives one server packet and checks its header and CRC
+ *
+ * @return Packet length, or -1 if nothing arrived
+ */
+static int receive(int fd, unsigned char *p, size_t size, uint32_t type)
+{
+    unsigned char copy[128];
+    ssize_t got = recv(fd, p, size, 0);
+
+    if (got < 20)
+        return -1;
+
+    CHECK(memcmp(p, "DSUS", 4) == 0);
+    CHECK_EQ(p[4] | p[5] << 8, 1001);
+    CHECK_EQ(p[6] | p[7] << 8, got - 16);
+    CHECK_EQ(get_u32(p + 16), type);
+
+    memcpy(copy, p, (size_t)got);
+    put_u32(copy + 8, 0);
+    CHECK_EQ(get_u32(p + 8), crc32(copy, (size_t)got));
+    return (int)got;
+}
+
+int main(void)
+{
+    static const unsigned char MAC[6] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+    unsigned char p[128], payload[8];
+    decoded_reports_t decoded;
+    imu_samples_t samples;
+    int fd, other;
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(TEST_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &server.sin_addr);
+
+    CHECK(dsu_server_start("127.0.0.1", TEST_PORT));
+    dsu_server_set_slot(0, PRODUCT_DS4, MAC, 0);
+    dsu_server_set_slot(1, PRODUCT_MOVE, NULL, 1);
+    fd = open_client();
+    other = open_client();
+
+    /* Version */
+    request(fd, 0x100000u, NULL, 0);
+    CHECK_EQ(receive(fd, p, sizeof(p), 0x100000u), 22);
+    CHECK_EQ(p[20] | p[21] << 8, 1001);
+
+    /* Slot info: state, model, connection, MAC, battery */
+    put_u32(payload, 3);
+    payload[4] = 0;
+    payload[5] = 1;
+    payload[6] = 2;
+    request(fd, 0x100001u, payload, 7);
+    CHECK_EQ(receive(fd, p, sizeof(p), 0x100001u), 32);
+    CHECK(p[20] == 0 && p[21] == 2 && p[22] == 2 && p[23] == 1);
+    CHECK(memcmp(p + 24, MAC, 6) == 0);
+    CHECK_EQ(receive(fd, p, sizeof(p), 0x100001u), 32);
+    CHECK(p[20] == 1 && p[21] == 2 && p[22] == 0 && p[23] == 2);
+    CHECK_EQ(receive(fd, p, sizeof(p), 0x100001u), 32);
+    CHECK(p[20] == 2 && p[21] == 0);
+
+    /* One subscription to every slot, one by an unknown (all-zero) MAC */
+    memset(payload, 0, sizeof(payload));
+    request(fd, 0x100002u, payload, 8);
+    payload[0] = 0x02;
+    request(other, 0x100002u, payload, 8);
+
+    CHECK(decoded_reports_init(&decoded, 1));
+    CHECK(imu_samples_init(&samples, 1));
+    decoded.count = samples.count = 1;
+    decoded.timestamp_ns[0] = 5000000;
+    decoded.buttons[0] = BUTTON_CROSS | BUTTON_UP | BUTTON_START | BUTTON_PS;
+    decoded.left_x[0] = 10;
+    decoded.left_y[0] = 20;
+    decoded.right_x[0] = 30;
+    decoded.right_y[0] = 40;
+    decoded.l2[0] = 50;
+    decoded.r2[0] = 60;
+    decoded.touch_active[0] = 1;
+    decoded.touch_x[0] = 0x123;
+    decoded.touch_y[0] = 0x234;
+    decoded.battery[0] = 80;
+    samples.accel_x[0] = 0.5f;
+    samples.accel_y[0] = -1.0f;
+    samples.accel_z[0] = 0.25f;
+    samples.gyro_x[0] = 10.0f;
+    samples.gyro_y[0] = -20.0f;
+    samples.gyro_z[0] = 30.0f;
+
+    dsu_server_queue(0, &decoded, &samples, 0);
+    dsu_server_queue(1, &decoded, &samples, 0);
+    dsu_server_flush();
+
+    /* DS4 slot: full layout */
+    CHECK_EQ(receive(fd, p, sizeof(p), 0x100002u), 100);
+    CHECK_EQ(p[20], 0);
+    CHECK_EQ(p[30], 0x04);                  /* battery high */
+    CHECK_EQ(p[31], 1);
+    CHECK_EQ(get_u32(p + 32), 0);
+    CHECK_EQ(p[36], 0x18);                  /* up, options */
+    CHECK_EQ(p[37], 0x20);                  /* cross */
+    CHECK_EQ(p[38], 1);
+    CHECK(p[40] == 10 && p[41] == 235 && p[42] == 30 && p[43] == 215);
+    CHECK(p[47] == 255 && p[50] == 255 && p[54] == 60 && p[55] == 50);
+    CHECK(p[56] == 1 && (p[58] | p[59] << 8) == 0x123 && (p[60] | p[61] << 8) == 0x234);
+    CHECK_EQ(get_u32(p + 68), 5000);
+    CHECK(get_float(p + 76) == 0.5f && get_float(p + 80) == -1.0f && get_float(p + 84) == 0.25f);
+    CHECK(get_float(p + 88) == 10.0f && get_float(p + 92) == -20.0f && get_float(p + 96) == 30.0f);
+
+    /* Move slot: no motion in physical units, so zero axes */
+    CHECK_EQ(receive(fd, p, sizeof(p), 0x100002u), 100);
+    CHECK_EQ(p[20], 1);
+    CHECK_EQ(p[22], 0);
+    CHECK(get_float(p + 76) == 0.0f && get_float(p + 96) == 0.0f);
+
+    /* The all-zero MAC subscription matched neither slot */
+    CHECK_EQ(receive(other, p, sizeof(p), 0x100002u), -1);
+
+    close(fd);
+    close(other);
+    imu_samples_free(&samples);
+    decoded_reports_free(&decoded);
+    dsu_server_stop();
+
+    return TEST_RESULT();
+}
+
+#else /* PLATFORM_WINDOWS */
+
+int main(void)
+{
+    /* The DSU server is not built on Windows */
+    return 77;
+}
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * test_feature_survey.c - Adaptive probe timeout of survey mode
+ */
+
+#include "test_util.h"
+#include "feature_survey.h"
+
+int main(void)
+{
+    survey_timeout_t timeout;
+
+    /* Before any answer the initial timeout applies */
+    survey_timeout_init(&timeout);
+    CHECK_EQ(survey_timeout_ms(&timeout), SURVEY_INITIAL_TIMEOUT_MS);
+
+    /* The first sample sets the smoothed time and half of it as variation: 10ms + 4 * 5ms */
+    survey_timeout_sample(&timeout, 10000);
+    CHECK_NEAR(timeout.smoothed_us, 10000.0, 1e-9);
+    CHECK_NEAR(timeout.variation_us, 5000.0, 1e-9);
+    CHECK_EQ(survey_timeout_ms(&timeout), 30);
+
+    /* Later samples are weighted 1/8 and their deviation 1/4 */
+    survey_timeout_sample(&timeout, 2000);
+    CHECK_NEAR(timeout.variation_us, 0.75 * 5000.0 + 0.25 * 8000.0, 1e-9);
+    CHECK_NEAR(timeout.smoothed_us, 0.875 * 10000.0 + 0.125 * 2000.0, 1e-9);
+    CHECK_EQ(survey_timeout_ms(&timeout), 32);
+
+    /* Steady fast answers settle at the floor */
+    for (int i = 0; i < 100; i++)
+        survey_timeout_sample(&timeout, 1000);
+    CHECK_EQ(survey_timeout_ms(&timeout), SURVEY_MIN_TIMEOUT_MS);
+
+    /* Slow answers are capped */
+    survey_timeout_init(&timeout);
+    survey_timeout_sample(&timeout, 5000000);
+    CHECK_EQ(survey_timeout_ms(&timeout), SURVEY_MAX_TIMEOUT_MS);
+
+    /* A steady 40ms answer time converges on it */
+    survey_timeout_init(&timeout);
+    for (int i = 0; i < 200; i++)
+        survey_timeout_sample(&timeout, 40000);
+    CHECK_EQ(survey_timeout_ms(&timeout), 40);
+
+    return TEST_RESULT();
+}
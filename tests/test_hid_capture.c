@@ -0,0 +1,102 @@
+/**
+ * test_hid_capture.c - Capture round-trip through the replay backend
+ */
+
+#include "test_util.h"
+#include "hid_capture.h"
+#include "hid_replay.h"
+#include "controller_info.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#define CAPTURE_PATH "test_hid_capture.cap"
+#define DEVICE_PATH "/dev/hidraw-test"
+
+int main(void)
+{
+    struct hid_device_info info, *devs;
+    hid_device *recorded = (hid_device*)&info;  /* Any unique handle will do */
+    hid_device *dev;
+    unsigned char feature[17], buf[64];
+    unsigned char input[49];
+    input_report_t report;
+    size_t cursor = 0;
+    uint16_t device;
+    unsigned short product_id;
+
+    memset(&info, 0, sizeof(info));
+    info.path = DEVICE_PATH;
+    info.vendor_id = VENDOR_SONY;
+    info.product_id = PRODUCT_SIXAXIS;
+    info.serial_number = L"0123";
+    info.product_string = L"Test Controller";
+    info.interface_number = 0;
+
+    for (size_t i = 0; i < sizeof(feature); i++)
+        feature[i] = (unsigned char)(0xf5 + i);
+    for (size_t i = 0; i < sizeof(input); i++)
+        input[i] = (unsigned char)(i * 7);
+
+    /* Record an enumeration, an open, a feature report and two reads */
+    CHECK(hid_capture_open(CAPTURE_PATH));
+    CHECK(hid_capture_enabled);
+    hid_capture_enumerate(1000, 2000, VENDOR_SONY, 0, &info);
+    hid_capture_open_device(CAPTURE_OPEN_PATH, 3000, 4000, DEVICE_PATH, 0, 0, recorded, &info);
+    hid_capture_feature(CAPTURE_GET_FEATURE, 5000, 6000, recorded, feature[0], feature, sizeof(feature),
+                        (int)sizeof(feature));
+    hid_capture_read(7000, 8000, recorded, input, sizeof(input), 100, (int)sizeof(input));
+    input[1] ^= 0xff;
+    hid_capture_read(9000, 10000, recorded, input, sizeof(input), 100, (int)sizeof(input));
+    hid_capture_close_device(recorded);
+    hid_capture_close();
+    CHECK(!hid_capture_enabled);
+
+    /* Replay serves everything back in order */
+    hid_replay_fast = 1;
+    CHECK(hid_replay_load(CAPTURE_PATH));
+
+    devs = hid_replay_enumerate(VENDOR_SONY, 0);
+    CHECK(devs != NULL);
+    if (devs)
+    {
+        CHECK(strcmp(devs->path, DEVICE_PATH) == 0);
+        CHECK_EQ(devs->vendor_id, VENDOR_SONY);
+        CHECK_EQ(devs->product_id, PRODUCT_SIXAXIS);
+        CHECK(devs->serial_number && wcscmp(devs->serial_number, L"0123") == 0);
+        CHECK(devs->next == NULL);
+        hid_replay_free_enumeration(devs);
+    }
+
+    dev = hid_replay_open_path(DEVICE_PATH);
+    CHECK(dev != NULL);
+    if (dev)
+    {
+        memset(buf, 0, sizeof(buf));
+        buf[0] = feature[0];
+        CHECK_EQ(hid_replay_get_feature_report(dev, buf, sizeof(feature)), sizeof(feature));
+        CHECK(memcmp(buf, feature, sizeof(feature)) == 0);
+
+        input[1] ^= 0xff;
+        CHECK_EQ(hid_replay_read_timeout(dev, buf, sizeof(buf), 100), sizeof(input));
+        CHECK(memcmp(buf, input, sizeof(input)) == 0);
+        input[1] ^= 0xff;
+        CHECK_EQ(hid_replay_read_timeout(dev, buf, sizeof(buf), 100), sizeof(input));
+        CHECK(memcmp(buf, input, sizeof(input)) == 0);
+        hid_replay_close_device(dev);
+    }
+
+    /* The offline walk sees both reads with the product they were opened as */
+    CHECK(hid_replay_next_input(&cursor, &device, &product_id, &report));
+    CHECK_EQ(product_id, PRODUCT_SIXAXIS);
+    CHECK_EQ(report.length, sizeof(input));
+    CHECK_EQ(report.data[1], 7);
+    CHECK(hid_replay_next_input(&cursor, &device, &product_id, &report));
+    CHECK_EQ(report.data[1], 7 ^ 0xff);
+    CHECK(!hid_replay_next_input(&cursor, &device, &product_id, &report));
+
+    hid_replay_close();
+    remove(CAPTURE_PATH);
+
+    return TEST_RESULT();
+}
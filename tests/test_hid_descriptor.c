@@ -0,0 +1,80 @@
+/**
+ * test_hid_descriptor.c - Feature reports found in report descriptors
+ */
+
+#include "test_util.h"
+#include "hid_descriptor.h"
+#include <string.h>
+
+int main(void)
+{
+    hid_feature_report_t reports[HID_DESCRIPTOR_MAX_REPORTS];
+
+    /* Two feature reports, an input report and a second feature item for report 0x02 */
+    {
+        static const unsigned char desc[] = {
+            0x05, 0x01, 0x09, 0x05, 0xa1, 0x01,     /* Usage page, usage, collection */
+            0x85, 0x01, 0x75, 0x08, 0x95, 0x3f,     /* Report 0x01, 8 bits x 63 */
+            0x81, 0x02,                             /* Input: not a feature report */
+            0x85, 0x02, 0x95, 0x24, 0xb1, 0x02,     /* Report 0x02, 36 bytes of data */
+            0x85, 0xa3, 0x96, 0x30, 0x00, 0xb1, 0x03,   /* Report 0xa3, 48 constant bytes, 2-byte count */
+            0x85, 0x02, 0x75, 0x01, 0x95, 0x04, 0xb1, 0x02,  /* Four more bits of report 0x02 */
+            0xc0
+        };
+        int count = hid_descriptor_feature_reports(desc, sizeof(desc), reports, HID_DESCRIPTOR_MAX_REPORTS);
+
+        CHECK_EQ(count, 2);
+        CHECK_EQ(reports[0].report_id, 0x02);
+        CHECK_EQ(reports[0].size, 37);
+        CHECK(reports[0].has_data);
+        CHECK_EQ(reports[1].report_id, 0xa3);
+        CHECK_EQ(reports[1].size, 48);
+        CHECK(!reports[1].has_data);
+
+        /* A short array keeps the first reports */
+        CHECK_EQ(hid_descriptor_feature_reports(desc, sizeof(desc), reports, 1), 1);
+        CHECK_EQ(reports[0].report_id, 0x02);
+    }
+
+    /* Push and pop restore the report size; long items are skipped */
+    {
+        static const unsigned char desc[] = {
+            0x85, 0x05, 0x75, 0x08, 0x95, 0x02,
+            0xa4,                                   /* Push */
+            0x75, 0x10, 0xb1, 0x02,                 /* 16 bits x 2 */
+            0xb4,                                   /* Pop */
+            0xfe, 0x02, 0x00, 0xaa, 0xbb,           /* Long item */
+            0xb1, 0x02                              /* 8 bits x 2 */
+        };
+        int count = hid_descriptor_feature_reports(desc, sizeof(desc), reports, HID_DESCRIPTOR_MAX_REPORTS);
+
+        CHECK_EQ(count, 1);
+        CHECK_EQ(reports[0].report_id, 0x05);
+        CHECK_EQ(reports[0].size, 6);
+    }
+
+    /* Without report IDs the feature report is report 0 */
+    {
+        static const unsigned char desc[] = { 0x75, 0x08, 0x95, 0x10, 0xb1, 0x02 };
+
+        CHECK_EQ(hid_descriptor_feature_reports(desc, sizeof(desc), reports, HID_DESCRIPTOR_MAX_REPORTS), 1);
+        CHECK_EQ(reports[0].report_id, 0);
+        CHECK_EQ(reports[0].size, 16);
+    }
+
+    /* Malformed descriptors */
+    {
+        static const unsigned char truncated[] = { 0x85, 0x01, 0x96, 0x10 };
+        static const unsigned char zero_id[] = { 0x85, 0x00 };
+        static const unsigned char pop_empty[] = { 0xb4 };
+        static const unsigned char long_truncated[] = { 0xfe, 0x08, 0x00, 0x01 };
+
+        CHECK_EQ(hid_descriptor_feature_reports(truncated, sizeof(truncated), reports, 8), -1);
+        CHECK_EQ(hid_descriptor_feature_reports(zero_id, sizeof(zero_id), reports, 8), -1);
+        CHECK_EQ(hid_descriptor_feature_reports(pop_empty, sizeof(pop_empty), reports, 8), -1);
+        CHECK_EQ(hid_descriptor_feature_reports(long_truncated, sizeof(long_truncated), reports, 8), -1);
+        CHECK_EQ(hid_descriptor_feature_reports(NULL, 0, reports, 8), 0);
+    }
+
+    TEST_RESULT();
+}
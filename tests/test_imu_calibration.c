@@ -0,0 +1,115 @@
+/**
+ * test_imu_calibration.c - DS4 report 0x02 parsing and the calibrated transform
+ */
+
+#include "test_util.h"
+#include "imu_calibration.h"
+#include <string.h>
+
+/**
+ * Writes a signed little-endian 16-bit value
+ */
+static void put_le16(unsigned char *p, int value)
+{
+    p[0] = (unsigned char)(value & 0xff);
+    p[1] = (unsigned char)((value >> 8) & 0xff);
+}
+
+/**
+ * Builds a USB calibration report with known biases and references
+ */
+static void build_report(unsigned char *report)
+{
+    memset(report, 0, DS4_CALIBRATION_LENGTH);
+    report[0] = DS4_CALIBRATION_REPORT_ID;
+
+    /* Gyro biases */
+    put_le16(report + 1, 10);
+    put_le16(report + 3, -5);
+    put_le16(report + 5, 0);
+
+    /* Gyro plus/minus references: X and Y span 16000 counts, Z is unusable */
+    put_le16(report + 7, 8000);
+    put_le16(report + 9, -8000);
+    put_le16(report + 11, 8100);
+    put_le16(report + 13, -7900);
+    put_le16(report + 15, 0);
+    put_le16(report + 17, 0);
+
+    /* Full-scale speed plus and minus: 540 deg/s each */
+    put_le16(report + 19, 540);
+    put_le16(report + 21, 540);
+
+    /* Accelerometer +1 g / -1 g readings */
+    put_le16(report + 23, 8200);
+    put_le16(report + 25, -8184);
+    put_le16(report + 27, 8192);
+    put_le16(report + 29, -8192);
+    put_le16(report + 31, -100);        /* Inverted references are ignored */
+    put_le16(report + 33, 100);
+}
+
+int main(void)
+{
+    unsigned char report[DS4_CALIBRATION_LENGTH];
+    imu_calibration_t cal, nominal;
+    decoded_reports_t batch;
+    imu_samples_t samples;
+    input_report_t input;
+
+    imu_calibration_nominal(REPORT_FAMILY_DS4, &nominal);
+    CHECK_NEAR(nominal.scale[IMU_ACCEL_X], 1.0 / 8192.0, 1e-9);
+    CHECK_NEAR(nominal.scale[IMU_GYRO_Z], 1.0 / 16.0, 1e-9);
+    CHECK_EQ(nominal.from_device, 0);
+
+    /* Wrong report ID or too short */
+    build_report(report);
+    CHECK(!imu_calibration_parse_ds4(report, DS4_CALIBRATION_LENGTH - 1, &cal));
+    report[0] = 0x05;
+    CHECK(!imu_calibration_parse_ds4(report, DS4_CALIBRATION_LENGTH, &cal));
+
+    build_report(report);
+    CHECK(imu_calibration_parse_ds4(report, DS4_CALIBRATION_LENGTH, &cal));
+    CHECK_EQ(cal.from_device, 1);
+
+    CHECK_NEAR(cal.scale[IMU_GYRO_X], 1080.0 / 16000.0, 1e-7);
+    CHECK_NEAR(cal.offset[IMU_GYRO_X], -10.0 * 1080.0 / 16000.0, 1e-6);
+    CHECK_NEAR(cal.scale[IMU_GYRO_Y], 1080.0 / 16000.0, 1e-7);
+    CHECK_NEAR(cal.offset[IMU_GYRO_Y], 5.0 * 1080.0 / 16000.0, 1e-6);
+    CHECK_NEAR(cal.scale[IMU_GYRO_Z], nominal.scale[IMU_GYRO_Z], 1e-9);
+    CHECK_NEAR(cal.offset[IMU_GYRO_Z], 0.0, 1e-9);
+
+    CHECK_NEAR(cal.scale[IMU_ACCEL_X], 2.0 / 16384.0, 1e-9);
+    CHECK_NEAR(cal.offset[IMU_ACCEL_X], -8.0 / 8192.0, 1e-7);
+    CHECK_NEAR(cal.offset[IMU_ACCEL_Y], 0.0, 1e-7);
+    CHECK_NEAR(cal.scale[IMU_ACCEL_Z], nominal.scale[IMU_ACCEL_Z], 1e-9);
+
+    /* Transform one decoded report: the bias reads as zero, +1 g as 1 g */
+    CHECK(decoded_reports_init(&batch, 4));
+    CHECK(imu_samples_init(&samples, 4));
+    memset(&input, 0, sizeof(input));
+    input.data[0] = 0x01;
+    input.length = 64;
+    input.data[5] = 0x08;
+    put_le16(input.data + 13, 10);          /* gyro X at its bias */
+    put_le16(input.data + 15, 3995);        /* gyro Y: 4000 counts above bias */
+    put_le16(input.data + 19, 8200);        /* accel X at +1 g */
+    put_le16(input.data + 21, -8192);       /* accel Y at -1 g */
+    decode_reports(REPORT_FAMILY_DS4, &input, 1, &batch);
+
+    CHECK_EQ(imu_calibration_apply(&cal, &batch, &samples), 1);
+    CHECK_EQ(samples.count, 1);
+    CHECK_NEAR(samples.gyro_x[0], 0.0, 1e-4);
+    CHECK_NEAR(samples.gyro_y[0], 270.0, 1e-3);
+    CHECK_NEAR(samples.accel_x[0], 1.0, 1e-4);
+    CHECK_NEAR(samples.accel_y[0], -1.0, 1e-4);
+
+    /* A full sample batch takes nothing more */
+    samples.count = samples.capacity;
+    CHECK_EQ(imu_calibration_apply(&cal, &batch, &samples), 0);
+
+    imu_samples_free(&samples);
+    decoded_reports_free(&batch);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,131 @@
+/**
+ * test_latency_stats.c - Histogram bucketing, merging and percentiles
+ */
+
+#include "test_util.h"
+#include "latency_stats.h"
+#include "controller_info.h"
+#include "thread_compat.h"
+
+#define THREAD_SAMPLES 1000
+
+/**
+ * Records THREAD_SAMPLES samples of 5 us from its own thread shard
+ */
+static void record_samples(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < THREAD_SAMPLES; i++)
+        latency_stats_record(LATENCY_OP_GET_FEATURE, PRODUCT_DS4, 5000);
+}
+
+/**
+ * Every sample lands in the one bucket whose bounds enclose it
+ */
+static void test_bucket_bounds(void)
+{
+    static const uint64_t SAMPLES[] = { 0, 1, 1023, 1024, 1279, 1280, 1535, 1536, 2047, 2048,
+                                        999999, 1000000, 123456789, (1ull << 42) - 1 };
+    latency_histogram_t hist = {0};
+
+    CHECK_EQ(latency_bucket_upper_ns(0), 1023);
+    CHECK_EQ(latency_bucket_upper_ns(1), 1279);
+    CHECK_EQ(latency_bucket_upper_ns(4), 2047);
+    CHECK_EQ(latency_bucket_upper_ns(5), 2559);
+
+    for (size_t i = 0; i < sizeof(SAMPLES) / sizeof(*SAMPLES); i++)
+    {
+        latency_histogram_t before;
+        int bucket = -1;
+
+        latency_stats_collect(LATENCY_OP_READ, latency_product_slot(PRODUCT_SIXAXIS), &before);
+        latency_stats_record(LATENCY_OP_READ, PRODUCT_SIXAXIS, SAMPLES[i]);
+        latency_stats_collect(LATENCY_OP_READ, latency_product_slot(PRODUCT_SIXAXIS), &hist);
+
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            if (hist.buckets[b] != before.buckets[b])
+            {
+                CHECK(bucket < 0);
+                bucket = b;
+            }
+        }
+
+        CHECK(bucket >= 0);
+        CHECK(SAMPLES[i] <= latency_bucket_upper_ns(bucket));
+        CHECK(bucket == 0 || SAMPLES[i] > latency_bucket_upper_ns(bucket - 1));
+    }
+    CHECK_EQ(hist.count, sizeof(SAMPLES) / sizeof(*SAMPLES));
+    CHECK_EQ(hist.max_ns, (1ull << 42) - 1);
+}
+
+/**
+ * Durations past the last octave are clamped into the last bucket
+ */
+static void test_overflow_bucket(void)
+{
+    latency_histogram_t hist;
+
+    latency_stats_record(LATENCY_OP_OPEN, PRODUCT_MOVE, UINT64_MAX / 2);
+    latency_stats_collect(LATENCY_OP_OPEN, latency_product_slot(PRODUCT_MOVE), &hist);
+    CHECK_EQ(hist.count, 1);
+    CHECK_EQ(hist.buckets[LATENCY_BUCKETS - 1], 1);
+}
+
+/**
+ * Shards of several threads merge into one histogram
+ */
+static void test_thread_merge(void)
+{
+    thread_t threads[3];
+    latency_histogram_t hist;
+
+    for (int i = 0; i < 3; i++)
+        CHECK(thread_create(&threads[i], record_samples, NULL));
+    for (int i = 0; i < 3; i++)
+        thread_join(threads[i]);
+
+    latency_stats_collect(LATENCY_OP_GET_FEATURE, latency_product_slot(PRODUCT_DS4), &hist);
+    CHECK_EQ(hist.count, 3 * THREAD_SAMPLES);
+    CHECK_EQ(hist.sum_ns, 3ull * THREAD_SAMPLES * 5000);
+    CHECK_EQ(hist.max_ns, 5000);
+
+    /* The percentile is the bucket bound, capped at the largest sample */
+    CHECK_EQ(latency_histogram_percentile(&hist, 50.0), 5000);
+}
+
+/**
+ * Percentiles pick the bucket that holds the ranked sample
+ */
+static void test_percentiles(void)
+{
+    latency_histogram_t hist;
+
+    for (int i = 0; i < 99; i++)
+        latency_stats_record(LATENCY_OP_SEND_FEATURE, 0, 100);
+    latency_stats_record(LATENCY_OP_SEND_FEATURE, 0, 1000000);
+    latency_stats_collect(LATENCY_OP_SEND_FEATURE, 0, &hist);
+
+    CHECK_EQ(latency_histogram_percentile(&hist, 50.0), latency_bucket_upper_ns(0));
+    CHECK_EQ(latency_histogram_percentile(&hist, 99.0), latency_bucket_upper_ns(0));
+    CHECK_EQ(latency_histogram_percentile(&hist, 100.0), 1000000);
+}
+
+int main(void)
+{
+    latency_stats_enabled = 1;
+
+    test_bucket_bounds();
+    test_overflow_bucket();
+    test_thread_merge();
+    test_percentiles();
+
+    /* Nothing is recorded while disabled */
+    latency_histogram_t hist;
+    latency_stats_enabled = 0;
+    latency_stats_record(LATENCY_OP_ENUMERATE, 0, 5000);
+    latency_stats_collect(LATENCY_OP_ENUMERATE, 0, &hist);
+    CHECK_EQ(hist.count, 0);
+
+    return TEST_RESULT();
+}
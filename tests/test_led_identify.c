@@ -0,0 +1,95 @@
+/**
+ * test_led_identify.c - Output report templates, slot patterns and colours
+ */
+
+#include "test_util.h"
+#include "led_identify.h"
+#include "controller_info.h"
+#include <string.h>
+
+int main(void)
+{
+    led_report_t report, copy;
+    led_state_t state = { 10, 20, 30, 0x05, 200 };
+    led_state_t lights_only = { 1, 2, 3, -1, -1 };
+
+    /* DualShock 4 over USB: lightbar and rumble fields */
+    CHECK(led_report_template(&report, PRODUCT_DS4, 0));
+    CHECK_EQ(report.length, DS4_OUTPUT_LENGTH);
+    CHECK_EQ(report.data[0], DS4_OUTPUT_REPORT_ID);
+    copy = report;
+    led_report_apply(&copy, &state);
+    CHECK_EQ(copy.data[1], 0x07);
+    CHECK(copy.data[4] == 200 && copy.data[5] == 200);
+    CHECK(copy.data[6] == 10 && copy.data[7] == 20 && copy.data[8] == 30);
+    copy = report;
+    led_report_apply(&copy, &lights_only);
+    CHECK_EQ(copy.data[1], 0x06);
+
+    /* Over Bluetooth the same fields sit two bytes on, under a valid CRC */
+    CHECK(led_report_template(&report, PRODUCT_DS4, 1));
+    CHECK_EQ(report.length, BT_OUTPUT_LENGTH);
+    CHECK_EQ(report.data[0], DS4_BT_OUTPUT_REPORT_ID);
+    led_report_apply(&report, &state);
+    CHECK_EQ(report.data[1], 0xc0);
+    CHECK_EQ(report.data[3], 0x07);
+    CHECK(report.data[8] == 10 && report.data[9] == 20 && report.data[10] == 30);
+    CHECK(bt_report_valid(BT_SEED_OUTPUT, report.data, report.length));
+
+    /* The template matches wrapping the USB report by hand */
+    {
+        led_report_t usb;
+        unsigned char bt[BT_OUTPUT_LENGTH];
+
+        CHECK(led_report_template(&usb, PRODUCT_DUALSENSE_EDGE, 0));
+        led_report_apply(&usb, &state);
+        CHECK(led_report_template(&report, PRODUCT_DUALSENSE_EDGE, 1));
+        led_report_apply(&report, &state);
+        CHECK_EQ(bt_wrap_output(PRODUCT_DUALSENSE_EDGE, usb.data, usb.length, bt), BT_OUTPUT_LENGTH);
+        CHECK(memcmp(bt, report.data, BT_OUTPUT_LENGTH) == 0);
+        CHECK_EQ(usb.data[1], 0x03);
+        CHECK_EQ(usb.data[2], 0x14);
+        CHECK_EQ(usb.data[44], 0x05);
+        CHECK(usb.data[45] == 10 && usb.data[46] == 20 && usb.data[47] == 30);
+    }
+
+    /* SixAxis: player LEDs in bits 1-4, no Bluetooth form, steady LED blocks */
+    CHECK(led_report_template(&report, PRODUCT_SIXAXIS, 1));
+    CHECK(!report.bluetooth);
+    CHECK_EQ(report.length, SIXAXIS_OUTPUT_LENGTH);
+    CHECK_EQ(report.data[0], SIXAXIS_OUTPUT_REPORT_ID);
+    led_report_apply(&report, &state);
+    CHECK_EQ(report.data[10], 0x0a);
+    CHECK(report.data[3] == 1 && report.data[5] == 200);
+    CHECK(report.data[11] == 0xff && report.data[26] == 0xff);
+
+    /* Move: sphere and rumble */
+    CHECK(led_report_template(&report, PRODUCT_MOVE, 0));
+    led_report_apply(&report, &state);
+    CHECK(report.data[0] == MOVE_OUTPUT_REPORT_ID && report.data[2] == 10 && report.data[6] == 200);
+
+    CHECK(!led_report_template(&report, 0x1234, 0));
+
+    /* Slots count like PS3 players, then start over */
+    CHECK_EQ(led_slot_pattern(1), 0x01);
+    CHECK_EQ(led_slot_pattern(4), 0x08);
+    CHECK_EQ(led_slot_pattern(5), 0x09);
+    CHECK_EQ(led_slot_pattern(7), 0x0c);
+    CHECK_EQ(led_slot_pattern(8), 0x0d);
+    CHECK_EQ(led_slot_pattern(10), 0x0f);
+    CHECK_EQ(led_slot_pattern(11), 0x01);
+
+    /* Neighbouring slots differ in colour, and none is the red of a failure */
+    for (int slot = 1; slot <= 30; slot++)
+    {
+        led_state_t a, b;
+
+        led_slot_color(slot, &a);
+        led_slot_color(slot + 1, &b);
+        CHECK(a.red != b.red || a.green != b.green || a.blue != b.blue);
+        CHECK(!(a.red == 255 && a.green == 0 && a.blue == 0));
+    }
+    CHECK(strcmp(led_slot_color(1, &state), "blue") == 0);
+
+    return TEST_RESULT();
+}
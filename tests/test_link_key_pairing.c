@@ -0,0 +1,147 @@
+/**
+ * test_link_key_pairing.c - Link key pairing layouts, reports and BlueZ storage entries
+ */
+
+#include "test_util.h"
+#include "link_key_pairing.h"
+#include "controller_info.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PLATFORM_WINDOWS
+    #include <unistd.h>
+    #include <sys/stat.h>
+#endif
+
+static const unsigned char HOST[6] = { 0x00, 0x1a, 0x7d, 0xda, 0x71, 0x13 };
+static const unsigned char DEVICE[6] = { 0xa4, 0x15, 0x66, 0x01, 0x02, 0x03 };
+
+int main(void)
+{
+    const link_key_layout_t *ds4 = link_key_layout(PRODUCT_DS4);
+    const link_key_layout_t *dualsense = link_key_layout(PRODUCT_DUALSENSE);
+    const link_key_layout_t *edge = link_key_layout(PRODUCT_DUALSENSE_EDGE);
+    unsigned char key[LINK_KEY_LENGTH], other[LINK_KEY_LENGTH];
+    unsigned char report[LINK_KEY_MAX_REPORT_LENGTH];
+    unsigned char pairing[LINK_KEY_MAX_PAIRING_LENGTH] = {
+        0x12, 0x03, 0x02, 0x01, 0x66, 0x15, 0xa4, 0x08, 0x25, 0x00, 0x13, 0x71, 0xda, 0x7d, 0x1a, 0x00
+    };
+    unsigned char device[6], host[6];
+    char info[512];
+
+    /* One layout per family; the SixAxis and Move are not paired with a key */
+    CHECK(ds4 != NULL && dualsense != NULL && edge != NULL);
+    CHECK(link_key_layout(PRODUCT_SIXAXIS) == NULL);
+    CHECK(link_key_layout(PRODUCT_MOVE) == NULL);
+    if (!ds4 || !dualsense || !edge)
+        return TEST_RESULT();
+    CHECK_EQ(ds4->pairing_report_id, 0x12);
+    CHECK_EQ(ds4->link_key_report_id, 0x13);
+    CHECK_EQ(ds4->address_report_id, MAC_REPORT_ID);
+    CHECK_EQ(dualsense->pairing_report_id, 0x09);
+    CHECK_EQ(dualsense->link_key_report_id, 0x0a);
+    CHECK_EQ(dualsense->address_report_id, 0);
+    CHECK_EQ(edge->pairing_length, 20);
+    CHECK_EQ(edge->link_key_length, 27);
+    CHECK(ds4->pairing_length <= LINK_KEY_MAX_PAIRING_LENGTH && ds4->link_key_length <= LINK_KEY_MAX_REPORT_LENGTH);
+
+    for (int i = 0; i < LINK_KEY_LENGTH; i++)
+        key[i] = (unsigned char)(0xf0 + i);
+
+    /* Report 0x13: host address little-endian, then the key as is */
+    memset(report, 0xee, sizeof(report));
+    link_key_build_report(ds4, HOST, key, report);
+    CHECK_EQ(report[0], 0x13);
+    CHECK_EQ(report[1], 0x13);
+    CHECK_EQ(report[6], 0x00);
+    CHECK_EQ(report[7], 0xf0);
+    CHECK_EQ(report[22], 0xff);
+
+    /* Report 0x0A: the same fields, zero-padded to 27 bytes */
+    memset(report, 0xee, sizeof(report));
+    link_key_build_report(dualsense, HOST, key, report);
+    CHECK_EQ(report[0], 0x0a);
+    CHECK_EQ(report[1], 0x13);
+    CHECK_EQ(report[22], 0xff);
+    CHECK_EQ(report[23], 0);
+    CHECK_EQ(report[26], 0);
+
+    /* Report 0x12: both addresses little-endian */
+    CHECK(link_key_parse_pairing(ds4, pairing, 16, device, host));
+    CHECK(memcmp(device, DEVICE, 6) == 0);
+    CHECK(memcmp(host, HOST, 6) == 0);
+    CHECK(!link_key_parse_pairing(ds4, pairing, 15, device, host));
+
+    /* Report 0x09 has the same offsets but is 20 bytes, and the IDs do not mix */
+    CHECK(!link_key_parse_pairing(dualsense, pairing, sizeof(pairing), device, host));
+    pairing[0] = 0x09;
+    CHECK(!link_key_parse_pairing(dualsense, pairing, 16, device, host));
+    memset(device, 0, 6);
+    CHECK(link_key_parse_pairing(dualsense, pairing, sizeof(pairing), device, host));
+    CHECK(memcmp(device, DEVICE, 6) == 0);
+    CHECK(memcmp(host, HOST, 6) == 0);
+    CHECK(!link_key_parse_pairing(ds4, pairing, sizeof(pairing), device, host));
+
+    /* The BlueZ entry carries the key in hex and the family's name and device ID */
+    CHECK(link_key_bluez_info(ds4, key, info, sizeof(info)) == strlen(info));
+    CHECK(strstr(info, "[LinkKey]\nKey=F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF\nType=4\nPINLength=0\n") != NULL);
+    CHECK(strstr(info, "Name=Wireless Controller\n") != NULL);
+    CHECK(strstr(info, "Class=0x002508\n") != NULL);
+    CHECK(strstr(info, "Vendor=1356\nProduct=2508\n") != NULL);
+    CHECK_EQ(link_key_bluez_info(ds4, key, info, 64), 0);
+    CHECK(link_key_bluez_info(edge, key, info, sizeof(info)) > 0);
+    CHECK(strstr(info, "Name=DualSense Edge Wireless Controller\n") != NULL);
+    CHECK(strstr(info, "Vendor=1356\nProduct=3570\n") != NULL);
+
+    /* Two keys from the CSPRNG differ */
+    CHECK(link_key_generate(key));
+    CHECK(link_key_generate(other));
+    CHECK(memcmp(key, other, sizeof(key)) != 0);
+
+#ifndef PLATFORM_WINDOWS
+    {
+        char dir[] = "/tmp/test_link_key_pairing.XXXXXX";
+        char path[256];
+        FILE *file;
+        struct stat st;
+
+        CHECK(mkdtemp(dir) != NULL);
+        link_key_set_storage(dir);
+        CHECK(strcmp(link_key_storage(), dir) == 0);
+
+        CHECK(!link_key_bluez_has_key(HOST, DEVICE));
+        CHECK(link_key_bluez_store(HOST, DEVICE, key, ds4));
+        CHECK(link_key_bluez_has_key(HOST, DEVICE));
+        CHECK(!link_key_bluez_has_key(DEVICE, HOST));
+
+        /* Named the way bluetoothd names its storage, readable only by the owner */
+        snprintf(path, sizeof(path), "%s/00:1A:7D:DA:71:13/A4:15:66:01:02:03/info", dir);
+        CHECK(stat(path, &st) == 0 && (st.st_mode & 0777) == 0600);
+        file = fopen(path, "r");
+        CHECK(file != NULL);
+        if (file)
+        {
+            size_t length = fread(info, 1, sizeof(info) - 1, file);
+            info[length] = '\0';
+            fclose(file);
+        }
+        CHECK(strstr(info, "Trusted=true\n") != NULL);
+
+        /* Pairing again replaces the entry, here as a DualSense */
+        CHECK(link_key_bluez_store(HOST, DEVICE, other, dualsense));
+        CHECK(link_key_bluez_has_key(HOST, DEVICE));
+
+        remove(path);
+        snprintf(path, sizeof(path), "%s/00:1A:7D:DA:71:13/A4:15:66:01:02:03", dir);
+        rmdir(path);
+        snprintf(path, sizeof(path), "%s/00:1A:7D:DA:71:13", dir);
+        rmdir(path);
+        rmdir(dir);
+        link_key_set_storage(NULL);
+        CHECK(strcmp(link_key_storage(), LINK_KEY_BLUEZ_DEFAULT_STORAGE) == 0);
+    }
+#endif
+
+    return TEST_RESULT();
+}
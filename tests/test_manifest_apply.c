@@ -0,0 +1,98 @@
+/**
+ * test_manifest_apply.c - Manifest parsing and the identity index
+ */
+
+#include "test_util.h"
+#include "manifest_apply.h"
+#include <string.h>
+
+static const char *MANIFEST =
+    "kind,identity,host\n"
+    "# bench 2\n"
+    "address,A4:53:85:0E:12:34,00:1a:7d:da:71:13\n"
+    "serial, \"0123456789ab\" ,001a7dda7114\r\n"
+    "\n"
+    "{\"address\": \"a453850e1235\", \"host\": \"00:1a:7d:da:71:13\"}\n"
+    "{\"path\":\"\\/dev\\/hidraw3\",\"host\":\"00:1a:7d:da:71:15\",\"note\":\"rack \\\"A\\\"\"}\n";
+
+/**
+ * Adds a line that must fail and checks the error names the line
+ */
+static int fails(manifest_t *manifest, const char *line, const char *message)
+{
+    char error[160];
+
+    return !manifest_add_line(manifest, line, 7, error, sizeof(error)) && strstr(error, "line 7") != NULL &&
+           strstr(error, message) != NULL;
+}
+
+int main(void)
+{
+    manifest_t manifest;
+    manifest_entry_t *entry;
+    char error[160], name[16];
+    FILE *file = tmpfile();
+
+    CHECK(file != NULL);
+    fputs(MANIFEST, file);
+    rewind(file);
+    manifest_init(&manifest);
+    CHECK(manifest_load(&manifest, file, error, sizeof(error)));
+    fclose(file);
+    CHECK_EQ(manifest.count, 4);
+    CHECK_EQ(manifest.kind_counts[MANIFEST_ADDRESS], 2);
+    CHECK_EQ(manifest.kind_counts[MANIFEST_SERIAL], 1);
+    CHECK_EQ(manifest.kind_counts[MANIFEST_PATH], 1);
+
+    /* Addresses are stored in lowercase with colons, whichever way they are written */
+    entry = manifest_find(&manifest, MANIFEST_ADDRESS, "a4:53:85:0e:12:34");
+    CHECK(entry != NULL && entry->line == 3 && entry->host_mac[5] == 0x13);
+    entry = manifest_find(&manifest, MANIFEST_ADDRESS, "a4:53:85:0e:12:35");
+    CHECK(entry != NULL && entry->line == 6);
+    entry = manifest_find(&manifest, MANIFEST_SERIAL, "0123456789ab");
+    CHECK(entry != NULL && entry->line == 4 && entry->host_mac[5] == 0x14);
+    entry = manifest_find(&manifest, MANIFEST_PATH, "/dev/hidraw3");
+    CHECK(entry != NULL && entry->host_mac[5] == 0x15);
+
+    /* Kinds are separate namespaces */
+    CHECK(manifest_find(&manifest, MANIFEST_PATH, "0123456789ab") == NULL);
+    CHECK(manifest_find(&manifest, MANIFEST_SERIAL, "") == NULL);
+
+    /* Errors name their line, and duplicates the line they repeat */
+    CHECK(fails(&manifest, "serial,0123456789ab,00:1a:7d:da:71:16", "line 4"));
+    CHECK(fails(&manifest, "address,a4:53:85:0e:12:34,00:1a:7d:da:71:16", "line 3"));
+    CHECK(fails(&manifest, "usb,1,00:1a:7d:da:71:16", "kind"));
+    CHECK(fails(&manifest, "serial,1", "expected"));
+    CHECK(fails(&manifest, "serial,1,2,3", "expected"));
+    CHECK(fails(&manifest, "serial,1,00:1a:7d", "host"));
+    CHECK(fails(&manifest, "address,00:11,00:1a:7d:da:71:16", "address"));
+    CHECK(fails(&manifest, "{\"serial\":\"1\"}", "host"));
+    CHECK(fails(&manifest, "{\"serial\":1,\"host\":\"00:1a:7d:da:71:16\"}", "strings"));
+    CHECK(fails(&manifest, "{\"serial\":\"1\",\"path\":\"2\",\"host\":\"00:1a:7d:da:71:16\"}", "identity"));
+    CHECK(fails(&manifest, "{\"serial\":\"1\",\"host\":\"00:1a:7d:da:71:16\"} x", "after"));
+    CHECK_EQ(manifest.count, 4);
+    manifest_free(&manifest);
+
+    /* The index keeps every entry reachable as it grows */
+    manifest_init(&manifest);
+    for (int i = 0; i < 1000; i++)
+    {
+        char line[64];
+
+        snprintf(line, sizeof(line), "serial,S%04d,00:1a:7d:da:71:13", i);
+        CHECK(manifest_add_line(&manifest, line, i + 1, error, sizeof(error)));
+    }
+    CHECK_EQ(manifest.count, 1000);
+    CHECK(manifest.slot_count >= 2000);
+    for (int i = 0; i < 1000; i += 37)
+    {
+        snprintf(name, sizeof(name), "S%04d", i);
+        entry = manifest_find(&manifest, MANIFEST_SERIAL, name);
+        CHECK(entry != NULL && entry->line == i + 1);
+    }
+    CHECK(manifest_find(&manifest, MANIFEST_SERIAL, "S1000") == NULL);
+    manifest_free(&manifest);
+
+    CHECK(strcmp(manifest_kind_name(MANIFEST_ADDRESS), "address") == 0);
+    return TEST_RESULT();
+}
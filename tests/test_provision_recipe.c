@@ -0,0 +1,104 @@
+/**
+ * test_provision_recipe.c - Recipe parsing and step conditions
+ */
+
+#include "test_util.h"
+#include "provision_recipe.h"
+#include "controller_info.h"
+#include <string.h>
+
+static const char *BENCH =
+    "# Bench recipe\n"
+    "host 00:1a:7d:da:71:13\n"
+    "timeout 1500\n"
+    "\n"
+    "identify\n"
+    "read_pairing   # current host\n"
+    "compare\n"
+    "write if mismatch timeout 5000\n"
+    "verify\n"
+    "lightbar 0 255 0\r\n"
+    "lightbar 255 0 0 if failed\n"
+    "ledger bench.jsonl if always\n"
+    "ledger bench.jsonl if !usb";
+
+/**
+ * Parses a recipe that must fail and checks the error names the line
+ */
+static int fails_on_line(const char *text, const char *line)
+{
+    recipe_t recipe;
+    char error[128];
+
+    return !recipe_parse(text, &recipe, error, sizeof(error)) && strstr(error, line) != NULL;
+}
+
+int main(void)
+{
+    static const unsigned char host[6] = { 0x00, 0x1a, 0x7d, 0xda, 0x71, 0x13 };
+    recipe_t recipe;
+    recipe_device_t device;
+    char error[128];
+
+    CHECK(recipe_parse(BENCH, &recipe, error, sizeof(error)));
+    CHECK_EQ(recipe.step_count, 9);
+    CHECK(recipe.have_host);
+    CHECK(memcmp(recipe.host_mac, host, 6) == 0);
+    CHECK(strcmp(recipe.ledger_path, "bench.jsonl") == 0);
+    CHECK(recipe_needs_host(&recipe));
+
+    CHECK_EQ(recipe.steps[0].action, RECIPE_IDENTIFY);
+    CHECK_EQ(recipe.steps[0].condition, RECIPE_IF_OK);
+    CHECK_EQ(recipe.steps[0].timeout_ms, 1500);
+    CHECK_EQ(recipe.steps[0].line, 5);
+    CHECK_EQ(recipe.steps[3].action, RECIPE_WRITE);
+    CHECK_EQ(recipe.steps[3].condition, RECIPE_IF_MISMATCH);
+    CHECK_EQ(recipe.steps[3].timeout_ms, 5000);
+    CHECK_EQ(recipe.steps[5].action, RECIPE_LIGHTBAR);
+    CHECK(recipe.steps[5].color[0] == 0 && recipe.steps[5].color[1] == 255 && recipe.steps[5].color[2] == 0);
+    CHECK_EQ(recipe.steps[6].condition, RECIPE_IF_FAILED);
+    CHECK_EQ(recipe.steps[8].condition, RECIPE_IF_USB);
+    CHECK(recipe.steps[8].negate);
+    CHECK(strcmp(recipe_action_name(RECIPE_READ_PAIRING), "read_pairing") == 0);
+    CHECK(strcmp(recipe_result_name(RECIPE_STEP_TIMED_OUT), "timed out") == 0);
+
+    /* The default timeout applies to the steps after it */
+    CHECK(recipe_parse("identify\ntimeout 50\nidentify\n", &recipe, error, sizeof(error)));
+    CHECK_EQ(recipe.steps[0].timeout_ms, RECIPE_DEFAULT_TIMEOUT_MS);
+    CHECK_EQ(recipe.steps[1].timeout_ms, 50);
+    CHECK(!recipe.have_host);
+    CHECK(!recipe_needs_host(&recipe));
+
+    /* Errors name their line */
+    CHECK(fails_on_line("identify\nflash\n", "line 2"));
+    CHECK(fails_on_line("lightbar 0 256 0\n", "line 1"));
+    CHECK(fails_on_line("lightbar 0 0\n", "line 1"));
+    CHECK(fails_on_line("identify\n\nwrite if maybe\n", "line 3"));
+    CHECK(fails_on_line("verify timeout 0\n", "line 1"));
+    CHECK(fails_on_line("verify extra\n", "line 1"));
+    CHECK(fails_on_line("host 00:11:22\n", "line 1"));
+    CHECK(fails_on_line("ledger\n", "line 1"));
+    CHECK(fails_on_line("ledger a.jsonl\nledger b.jsonl\n", "line 2"));
+    CHECK(fails_on_line("# nothing\n", "no steps"));
+
+    /* Conditions */
+    memset(&device, 0, sizeof(device));
+    device.product_id = PRODUCT_DUALSENSE_EDGE;
+    CHECK(recipe_parse("verify\nverify if failed\nverify if mismatch\nverify if !dualsense\n"
+                       "verify if bluetooth\nverify if always\n", &recipe, error, sizeof(error)));
+    CHECK(recipe_should_run(&recipe.steps[0], &device));
+    CHECK(!recipe_should_run(&recipe.steps[1], &device));
+    CHECK(recipe_should_run(&recipe.steps[2], &device));
+    CHECK(!recipe_should_run(&recipe.steps[3], &device));
+    CHECK(!recipe_should_run(&recipe.steps[4], &device));
+    device.failed = 1;
+    device.match = 1;
+    device.bluetooth = 1;
+    CHECK(!recipe_should_run(&recipe.steps[0], &device));
+    CHECK(recipe_should_run(&recipe.steps[1], &device));
+    CHECK(!recipe_should_run(&recipe.steps[2], &device));
+    CHECK(recipe_should_run(&recipe.steps[4], &device));
+    CHECK(recipe_should_run(&recipe.steps[5], &device));
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,234 @@
+/**
+ * test_recording.c - Recording round trip, compression ratio, index and damage
+ */
+
+#include "test_util.h"
+#include "recording.h"
+#include "controller_info.h"
+#include "thread_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define RECORDING_PATH "test_recording.rec"
+#define REPORTS 10000
+
+static input_report_t ds4[REPORTS], sixaxis[REPORTS];
+static input_report_t decoded[RECORDING_CHUNK_REPORTS];
+static uint32_t seed = 12345;
+static uint64_t retries = 0;
+
+/**
+ * Small deterministic noise in [-range, range]
+ */
+static int noise(int range)
+{
+    seed = seed * 1103515245u + 12345u;
+    return (int)((seed >> 16) % (uint32_t)(2 * range + 1)) - range;
+}
+
+static void put_le16(unsigned char *p, int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+/**
+ * DS4 reports of a hand-held controller: jittery timing, a running counter
+ * and sensor clock, sensor noise over slow motion, a stick that wobbles
+ */
+static void make_ds4(void)
+{
+    uint64_t us = 1000000;
+
+    for (int i = 0; i < REPORTS; i++)
+    {
+        input_report_t *r = &ds4[i];
+        double t = i * 0.004;
+
+        us += 4000 + noise(150);
+        memset(r, 0, sizeof(*r));
+        r->timestamp_ns = us * 1000u + 123;
+        r->length = 64;
+        r->data[0] = 0x01;
+        r->data[1] = (unsigned char)(128 + noise(1));
+        r->data[2] = r->data[3] = r->data[4] = 128;
+        r->data[5] = 0x08;
+        r->data[7] = (unsigned char)((i & 0x3f) << 2);
+        put_le16(r->data + 10, i * 188);
+        r->data[12] = 0x1b;
+        put_le16(r->data + 13, (int)(300 * sin(t)) + noise(6));
+        put_le16(r->data + 15, (int)(200 * cos(t * 0.7)) + noise(6));
+        put_le16(r->data + 17, noise(6));
+        put_le16(r->data + 19, (int)(1000 * sin(t * 0.3)) + noise(12));
+        put_le16(r->data + 21, 8192 + noise(12));
+        put_le16(r->data + 23, (int)(1000 * cos(t * 0.3)) + noise(12));
+        r->data[30] = 0x1b;
+        r->data[35] = 0x80;
+        r->data[39] = 0x80;
+    }
+}
+
+/**
+ * SixAxis reports whose length changes part way
+ */
+static void make_sixaxis(void)
+{
+    for (int i = 0; i < REPORTS; i++)
+    {
+        input_report_t *r = &sixaxis[i];
+
+        memset(r, 0, sizeof(*r));
+        r->timestamp_ns = (1002000 + (uint64_t)i * 5000) * 1000u;
+        r->length = i < REPORTS / 2 ? 49 : 48;
+        r->data[0] = 0x01;
+        r->data[6] = r->data[7] = r->data[8] = r->data[9] = 128;
+        r->data[30] = 0xee;
+        for (int axis = 0; axis < 4; axis++)
+        {
+            int v = 512 + noise(3);
+            r->data[41 + 2 * axis] = (unsigned char)(v >> 8);
+            r->data[42 + 2 * axis] = (unsigned char)v;
+        }
+    }
+}
+
+/**
+ * Adds a report, waiting for the writer thread while the queue is full
+ */
+static void add(recording_writer_t *writer, int device, const input_report_t *report)
+{
+    while (!recording_writer_add(writer, device, report))
+    {
+        retries++;
+        sleep_ms(1);
+    }
+}
+
+/**
+ * Checks that every chunk of a device decodes back to its reports
+ */
+static void check_device(recording_reader_t *reader, int device, const input_report_t *expected, int expected_count)
+{
+    const recording_chunk_t *chunks;
+    int chunk_count, next = 0;
+
+    chunks = recording_reader_chunks(reader, &chunk_count);
+    for (int c = 0; c < chunk_count; c++)
+    {
+        int count;
+
+        if (chunks[c].device != device)
+            continue;
+        count = recording_reader_read(reader, c, decoded);
+        CHECK_EQ(count, chunks[c].count);
+        for (int i = 0; i < count && next < expected_count; i++, next++)
+        {
+            const input_report_t *want = &expected[next];
+
+            CHECK_EQ(decoded[i].timestamp_ns, want->timestamp_ns / 1000u * 1000u);
+            CHECK_EQ(decoded[i].length, want->length);
+            CHECK(memcmp(decoded[i].data, want->data, want->length) == 0);
+        }
+    }
+    CHECK_EQ(next, expected_count);
+}
+
+int main(void)
+{
+    recording_writer_t *writer;
+    recording_reader_t *reader;
+    recording_stats_t stats;
+    const recording_chunk_t *chunks;
+    int chunk_count, chunk;
+    unsigned char *bytes;
+    long size;
+    FILE *file;
+
+    make_ds4();
+    make_sixaxis();
+
+    writer = recording_writer_open(RECORDING_PATH, 2);
+    CHECK(writer != NULL);
+    recording_writer_set_device(writer, 0, PRODUCT_DS4);
+    recording_writer_set_device(writer, 1, PRODUCT_SIXAXIS);
+    for (int i = 0; i < REPORTS; i++)
+    {
+        add(writer, 0, &ds4[i]);
+        add(writer, 1, &sixaxis[i]);
+    }
+    CHECK(recording_writer_close(writer, &stats));
+    CHECK_EQ(stats.reports, 2 * REPORTS);
+    CHECK_EQ(stats.dropped, retries);
+    CHECK_EQ(stats.chunks, 6);
+
+    /* At least 5x smaller than a capture of the same reports */
+    CHECK(stats.capture_bytes >= 5 * stats.bytes);
+
+    /* Every byte and every microsecond comes back */
+    reader = recording_reader_open(RECORDING_PATH);
+    CHECK(reader != NULL);
+    if (!reader)
+        return TEST_RESULT();
+    chunks = recording_reader_chunks(reader, &chunk_count);
+    CHECK_EQ(chunk_count, 6);
+    CHECK_EQ(chunks[0].first_us, ds4[0].timestamp_ns / 1000u);
+    check_device(reader, 0, ds4, REPORTS);
+    check_device(reader, 1, sixaxis, REPORTS);
+
+    /* Seeking finds the chunk holding a time */
+    chunk = recording_reader_seek(reader, 0, ds4[5000].timestamp_ns / 1000u);
+    CHECK(chunk >= 0 && chunks[chunk].device == 0);
+    CHECK(chunks[chunk].first_us <= ds4[5000].timestamp_ns / 1000u);
+    CHECK(chunks[chunk].last_us >= ds4[5000].timestamp_ns / 1000u);
+    CHECK_EQ(recording_reader_seek(reader, 1, UINT64_MAX), -1);
+    CHECK_EQ(recording_reader_seek(reader, 2, 0), -1);
+    recording_reader_close(reader);
+
+    /* A file cut off inside its last chunk is read up to the chunk before */
+    file = fopen(RECORDING_PATH, "rb");
+    CHECK(file != NULL);
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    bytes = (unsigned char*)malloc((size_t)size);
+    CHECK(bytes && fread(bytes, 1, (size_t)size, file) == (size_t)size);
+    fclose(file);
+
+    file = fopen(RECORDING_PATH, "wb");
+    fwrite(bytes, 1, (size_t)(size - RECORDING_FOOTER_SIZE - 6 * RECORDING_INDEX_ENTRY_SIZE - 10), file);
+    fclose(file);
+    reader = recording_reader_open(RECORDING_PATH);
+    CHECK(reader != NULL);
+    if (reader)
+    {
+        recording_reader_chunks(reader, &chunk_count);
+        CHECK_EQ(chunk_count, 5);
+        CHECK_EQ(recording_reader_read(reader, 0, decoded), RECORDING_CHUNK_REPORTS);
+        recording_reader_close(reader);
+    }
+
+    /* A damaged payload fails its CRC */
+    bytes[RECORDING_FILE_HEADER_SIZE + RECORDING_CHUNK_HEADER_SIZE + 100] ^= 0x40;
+    file = fopen(RECORDING_PATH, "wb");
+    fwrite(bytes, 1, (size_t)size, file);
+    fclose(file);
+    reader = recording_reader_open(RECORDING_PATH);
+    CHECK(reader != NULL);
+    if (reader)
+    {
+        CHECK_EQ(recording_reader_read(reader, 0, decoded), -1);
+        CHECK(recording_reader_read(reader, 1, decoded) > 0);
+        recording_reader_close(reader);
+    }
+
+    /* Not a recording */
+    CHECK(!recording_is_recording("test_recording.missing"));
+    CHECK(recording_reader_open("test_recording.missing") == NULL);
+
+    free(bytes);
+    remove(RECORDING_PATH);
+
+    return TEST_RESULT();
+}
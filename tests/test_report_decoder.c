@@ -0,0 +1,199 @@
+/**
+ * test_report_decoder.c - SoA decoders on hand-built reports of each family
+ */
+
+#include "test_util.h"
+#include "report_decoder.h"
+#include "controller_info.h"
+#include <string.h>
+
+/**
+ * Starts a report of the given length with the input report ID
+ */
+static void new_report(input_report_t *report, uint32_t length, uint64_t timestamp_ns)
+{
+    memset(report, 0, sizeof(*report));
+    report->data[0] = 0x01;
+    report->length = length;
+    report->timestamp_ns = timestamp_ns;
+}
+
+/**
+ * SixAxis: buttons, sticks, 10-bit big-endian sensors and the battery table
+ */
+static void test_sixaxis(decoded_reports_t *batch)
+{
+    input_report_t report;
+
+    new_report(&report, 49, 1234);
+    report.data[2] = 0x19;                  /* select, start, up */
+    report.data[3] = 0x41;                  /* L2, cross */
+    report.data[4] = 0x01;                  /* PS */
+    report.data[6] = 10;
+    report.data[7] = 20;
+    report.data[8] = 30;
+    report.data[9] = 40;
+    report.data[18] = 200;
+    report.data[19] = 255;
+    report.data[30] = 0x03;                 /* 50 % */
+    report.data[41] = 0x02; report.data[42] = 0x10;   /* 528 */
+    report.data[43] = 0x01; report.data[44] = 0xf0;   /* 496 */
+    report.data[45] = 0x02; report.data[46] = 0x00;   /* 512 */
+    report.data[47] = 0x03; report.data[48] = 0xff;   /* 1023 */
+
+    batch->count = 0;
+    CHECK_EQ(decode_reports(REPORT_FAMILY_SIXAXIS, &report, 1, batch), 1);
+    CHECK_EQ(batch->timestamp_ns[0], 1234);
+    CHECK_EQ(batch->buttons[0], BUTTON_SELECT | BUTTON_START | BUTTON_UP | BUTTON_L2 | BUTTON_CROSS | BUTTON_PS);
+    CHECK_EQ(batch->left_x[0], 10);
+    CHECK_EQ(batch->left_y[0], 20);
+    CHECK_EQ(batch->right_x[0], 30);
+    CHECK_EQ(batch->right_y[0], 40);
+    CHECK_EQ(batch->l2[0], 200);
+    CHECK_EQ(batch->r2[0], 255);
+    CHECK(batch->accel_x[0] == 16 && batch->accel_y[0] == -16 && batch->accel_z[0] == 0);
+    CHECK(batch->gyro_x[0] == 0 && batch->gyro_y[0] == 0 && batch->gyro_z[0] == 511);
+    CHECK_EQ(batch->touch_active[0], 0);
+    CHECK_EQ(batch->battery[0], 50);
+
+    report.data[30] = 0xee;
+    batch->count = 0;
+    decode_reports(REPORT_FAMILY_SIXAXIS, &report, 1, batch);
+    CHECK_EQ(batch->battery[0], BATTERY_CHARGING);
+}
+
+/**
+ * Move: buttons, T trigger and the second little-endian sensor frame
+ */
+static void test_move(decoded_reports_t *batch)
+{
+    input_report_t report;
+
+    new_report(&report, 49, 0);
+    report.data[1] = 0x08;                  /* start */
+    report.data[2] = 0x90;                  /* triangle, square */
+    report.data[4] = 0xc0;                  /* Move, T */
+    report.data[6] = 180;
+    report.data[12] = 0x05;                 /* 100 % */
+    report.data[19] = 0x00; report.data[20] = 0x90;   /* 0x9000 */
+    report.data[21] = 0xff; report.data[22] = 0x7f;   /* 0x7fff */
+    report.data[23] = 0x00; report.data[24] = 0x80;   /* 0x8000 */
+    report.data[31] = 0x01; report.data[32] = 0x80;
+    report.data[33] = 0x00; report.data[34] = 0x00;
+    report.data[35] = 0xff; report.data[36] = 0xff;
+
+    batch->count = 0;
+    CHECK_EQ(decode_reports(REPORT_FAMILY_MOVE, &report, 1, batch), 1);
+    CHECK_EQ(batch->buttons[0], BUTTON_START | BUTTON_TRIANGLE | BUTTON_SQUARE | BUTTON_MOVE | BUTTON_T);
+    CHECK(batch->left_x[0] == 128 && batch->right_y[0] == 128);
+    CHECK_EQ(batch->r2[0], 180);
+    CHECK(batch->accel_x[0] == 0x1000 && batch->accel_y[0] == -1 && batch->accel_z[0] == 0);
+    CHECK(batch->gyro_x[0] == 1 && batch->gyro_y[0] == -32768 && batch->gyro_z[0] == 32767);
+    CHECK_EQ(batch->battery[0], 100);
+}
+
+/**
+ * DS4: every hat position, face and shoulder buttons, sensors, touch and battery
+ */
+static void test_ds4(decoded_reports_t *batch)
+{
+    static const uint32_t HAT[9] = {
+        BUTTON_UP, BUTTON_UP | BUTTON_RIGHT, BUTTON_RIGHT, BUTTON_RIGHT | BUTTON_DOWN, BUTTON_DOWN,
+        BUTTON_DOWN | BUTTON_LEFT, BUTTON_LEFT, BUTTON_LEFT | BUTTON_UP, 0
+    };
+    input_report_t reports[9];
+
+    for (int i = 0; i < 9; i++)
+    {
+        new_report(&reports[i], 64, (uint64_t)i);
+        reports[i].data[5] = (unsigned char)(i | (i == 0 ? 0xf0 : 0x00));
+        reports[i].data[35] = 0x80;         /* not touching */
+    }
+
+    /* Report 0 also carries everything else */
+    reports[0].data[1] = 1;
+    reports[0].data[2] = 2;
+    reports[0].data[3] = 253;
+    reports[0].data[4] = 254;
+    reports[0].data[6] = 0xa5;              /* L1, L2, options, R3 */
+    reports[0].data[7] = 0x03;              /* PS, touchpad */
+    reports[0].data[8] = 77;
+    reports[0].data[9] = 88;
+    reports[0].data[13] = 0x34; reports[0].data[14] = 0x12;   /* gyro x 0x1234 */
+    reports[0].data[15] = 0xfe; reports[0].data[16] = 0xff;   /* gyro y -2 */
+    reports[0].data[23] = 0x00; reports[0].data[24] = 0x20;   /* accel z 8192 */
+    reports[0].data[30] = 0x1b;             /* cable, full: not charging */
+    reports[0].data[35] = 0x05;             /* touching */
+    reports[0].data[36] = 0x23;
+    reports[0].data[37] = 0x61;
+    reports[0].data[38] = 0x45;             /* x 0x123, y 0x456 */
+
+    reports[1].data[30] = 0x07;             /* 75 % */
+    reports[2].data[30] = 0x13;             /* charging at 35 % */
+
+    batch->count = 0;
+    CHECK_EQ(decode_reports(REPORT_FAMILY_DS4, reports, 9, batch), 9);
+
+    CHECK_EQ(batch->buttons[0], HAT[0] | BUTTON_SQUARE | BUTTON_CROSS | BUTTON_CIRCLE | BUTTON_TRIANGLE |
+                                BUTTON_L1 | BUTTON_L2 | BUTTON_START | BUTTON_R3 | BUTTON_PS | BUTTON_TOUCHPAD);
+    for (int i = 1; i < 9; i++)
+        CHECK_EQ(batch->buttons[i], HAT[i]);
+
+    CHECK(batch->left_x[0] == 1 && batch->left_y[0] == 2 && batch->right_x[0] == 253 && batch->right_y[0] == 254);
+    CHECK(batch->l2[0] == 77 && batch->r2[0] == 88);
+    CHECK(batch->gyro_x[0] == 0x1234 && batch->gyro_y[0] == -2 && batch->gyro_z[0] == 0);
+    CHECK(batch->accel_x[0] == 0 && batch->accel_z[0] == 8192);
+    CHECK(batch->touch_active[0] == 1 && batch->touch_x[0] == 0x123 && batch->touch_y[0] == 0x456);
+    CHECK_EQ(batch->touch_active[1], 0);
+    CHECK_EQ(batch->battery[0], 100);
+    CHECK_EQ(batch->battery[1], 75);
+    CHECK_EQ(batch->battery[2], BATTERY_CHARGING);
+    CHECK_EQ(batch->battery[3], 5);
+}
+
+/**
+ * Short or foreign reports decode as neutral input, and a full batch stops decoding
+ */
+static void test_neutral_and_capacity(decoded_reports_t *batch)
+{
+    static input_report_t reports[300];
+
+    for (int i = 0; i < 300; i++)
+    {
+        new_report(&reports[i], 64, (uint64_t)i);
+        reports[i].data[5] = 0x28;          /* cross, no hat */
+        reports[i].data[1] = (unsigned char)i;
+    }
+    reports[130].length = 10;
+    reports[131].data[0] = 0x11;
+
+    batch->count = 0;
+    CHECK_EQ(decode_reports(REPORT_FAMILY_DS4, reports, 300, batch), 256);
+    CHECK_EQ(batch->count, 256);
+    CHECK_EQ(decode_reports(REPORT_FAMILY_DS4, reports, 300, batch), 0);
+
+    /* Entries past the first 128-report chunk are decoded too */
+    CHECK_EQ(batch->left_x[200], 200);
+    CHECK_EQ(batch->buttons[255], BUTTON_CROSS);
+    CHECK(batch->buttons[130] == 0 && batch->left_x[130] == 128 && batch->timestamp_ns[130] == 130);
+    CHECK(batch->buttons[131] == 0 && batch->left_x[131] == 128);
+}
+
+int main(void)
+{
+    decoded_reports_t batch;
+
+    CHECK_EQ(report_family(PRODUCT_SIXAXIS), REPORT_FAMILY_SIXAXIS);
+    CHECK_EQ(report_family(PRODUCT_MOVE), REPORT_FAMILY_MOVE);
+    CHECK_EQ(report_family(PRODUCT_DS4), REPORT_FAMILY_DS4);
+    CHECK_EQ(report_family(0x1234), REPORT_FAMILY_UNKNOWN);
+
+    CHECK(decoded_reports_init(&batch, 256));
+    test_sixaxis(&batch);
+    test_move(&batch);
+    test_ds4(&batch);
+    test_neutral_and_capacity(&batch);
+    decoded_reports_free(&batch);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,170 @@
+/**
+ * test_report_ring.c - Ring wraparound, full/empty states and the watermark merge
+ */
+
+#include "test_util.h"
+#include "report_ring.h"
+#include "thread_compat.h"
+
+#define THREAD_REPORTS 100000
+
+/**
+ * Publishes one report stamped with the given time
+ */
+static int push(report_ring_t *ring, uint64_t timestamp_ns)
+{
+    input_report_t *slot = report_ring_claim(ring);
+
+    if (!slot)
+        return 0;
+    slot->timestamp_ns = timestamp_ns;
+    slot->length = 1;
+    slot->data[0] = (unsigned char)timestamp_ns;
+    report_ring_publish(ring);
+    return 1;
+}
+
+/**
+ * Fills and drains a small ring many times so the indices wrap the slots
+ */
+static void test_wraparound(void)
+{
+    report_ring_t ring;
+    uint64_t next_in = 0, next_out = 0;
+
+    CHECK(!report_ring_init(&ring, 6));
+    CHECK(report_ring_init(&ring, 4));
+    CHECK(report_ring_peek(&ring) == NULL);
+
+    for (int round = 0; round < 10; round++)
+    {
+        /* Exactly capacity reports fit */
+        while (push(&ring, next_in))
+            next_in++;
+        CHECK_EQ(next_in - next_out, 4);
+
+        /* Drain a varying number so the head and tail land on every slot */
+        for (int i = 0; i <= round % 4; i++)
+        {
+            const input_report_t *report = report_ring_peek(&ring);
+            CHECK(report != NULL);
+            if (!report)
+                break;
+            CHECK_EQ(report->timestamp_ns, next_out);
+            CHECK_EQ(report->data[0], (unsigned char)next_out);
+            report_ring_release(&ring);
+            next_out++;
+        }
+    }
+
+    while (report_ring_peek(&ring))
+    {
+        CHECK_EQ(report_ring_peek(&ring)->timestamp_ns, next_out);
+        report_ring_release(&ring);
+        next_out++;
+    }
+    CHECK_EQ(next_out, next_in);
+    report_ring_free(&ring);
+}
+
+/**
+ * Produces THREAD_REPORTS reports in order, yielding while the ring is full
+ */
+static void produce(void *arg)
+{
+    report_ring_t *ring = (report_ring_t*)arg;
+
+    for (uint64_t i = 0; i < THREAD_REPORTS; i++)
+    {
+        while (!push(ring, i))
+            sleep_ms(0);
+    }
+}
+
+/**
+ * A producer thread and the consumer never lose or reorder reports
+ */
+static void test_concurrent(void)
+{
+    report_ring_t ring;
+    thread_t thread;
+    uint64_t expected = 0;
+    int in_order = 1;
+
+    CHECK(report_ring_init(&ring, 16));
+    CHECK(thread_create(&thread, produce, &ring));
+    while (expected < THREAD_REPORTS)
+    {
+        const input_report_t *report = report_ring_peek(&ring);
+        if (!report)
+        {
+            sleep_ms(0);
+            continue;
+        }
+        in_order &= report->timestamp_ns == expected;
+        report_ring_release(&ring);
+        expected++;
+    }
+    thread_join(thread);
+    CHECK(in_order);
+    CHECK(report_ring_peek(&ring) == NULL);
+    report_ring_free(&ring);
+}
+
+/**
+ * Rings merge in timestamp order and nothing at or past the watermark is released
+ */
+static void test_merge(void)
+{
+    static const uint64_t STAMPS[3][4] = { { 10, 40, 70, 100 }, { 20, 30, 90, 95 }, { 5, 60, 80, 110 } };
+    report_ring_t storage[3];
+    report_ring_t *rings[3];
+    uint64_t last = 0;
+    int merged = 0, next;
+
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(report_ring_init(&storage[i], 4));
+        rings[i] = &storage[i];
+        for (int j = 0; j < 4; j++)
+            CHECK(push(rings[i], STAMPS[i][j]));
+    }
+
+    CHECK_EQ(report_ring_next_due(rings, 3, 5), -1);
+
+    /* Ring 1 could still publish anything from 90 on */
+    while ((next = report_ring_next_due(rings, 3, 90)) >= 0)
+    {
+        uint64_t stamp = report_ring_peek(rings[next])->timestamp_ns;
+        CHECK(stamp >= last && stamp < 90);
+        last = stamp;
+        report_ring_release(rings[next]);
+        merged++;
+    }
+    CHECK_EQ(merged, 8);
+    CHECK_EQ(report_ring_peek(rings[1])->timestamp_ns, 90);
+
+    /* Once every producer is done the rest drains in order */
+    while ((next = report_ring_next_due(rings, 3, UINT64_MAX)) >= 0)
+    {
+        uint64_t stamp = report_ring_peek(rings[next])->timestamp_ns;
+        CHECK(stamp >= last);
+        last = stamp;
+        report_ring_release(rings[next]);
+        merged++;
+    }
+    CHECK_EQ(merged, 12);
+    CHECK_EQ(last, 110);
+
+    for (int i = 0; i < 3; i++)
+        report_ring_free(&storage[i]);
+}
+
+int main(void)
+{
+    test_wraparound();
+    test_concurrent();
+    test_merge();
+
+    return TEST_RESULT();
+}
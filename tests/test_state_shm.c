@@ -0,0 +1,153 @@
+/**
+ * test_state_shm.c - Shared-memory state publication and seqlock reads
+ */
+
+#include "test_util.h"
+#include "state_shm.h"
+#include "thread_compat.h"
+#include "platform_compat.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef PLATFORM_WINDOWS
+
+#include <unistd.h>
+
+#define PUBLISHES 200000
+
+static decoded_reports_t decoded;
+static imu_samples_t samples;
+static _Atomic int reader_started = 0;
+static _Atomic int writer_done = 0;
+
+/**
+ * Fills the one-report batches with fields that all derive from n
+ */
+static void fill(uint32_t n)
+{
+    decoded.timestamp_ns[0] = n;
+    decoded.buttons[0] = n;
+    decoded.left_x[0] = decoded.right_y[0] = (uint8_t)n;
+    decoded.touch_x[0] = (uint16_t)n;
+    decoded.accel_x[0] = (int16_t)n;
+    samples.accel_x[0] = (float)n;
+    samples.gyro_z[0] = (float)n;
+}
+
+/**
+ * Publishes a new state to slot 1 as fast as possible once the reader runs
+ */
+static void writer_main(void *arg)
+{
+    (void)arg;
+    while (!atomic_load(&reader_started))
+        ;
+    for (uint32_t n = 1; n <= PUBLISHES; n++)
+    {
+        fill(n);
+        state_shm_publish(1, &decoded, &samples, 0);
+    }
+    atomic_store(&writer_done, 1);
+}
+
+int main(void)
+{
+    char name[64];
+    state_shm_map_t map;
+    state_shm_state_t state;
+    thread_t writer;
+    int torn = 0, reads = 0;
+
+    snprintf(name, sizeof(name), "/sixaxispairer-test-%d", (int)getpid());
+    CHECK(decoded_reports_init(&decoded, 1));
+    CHECK(imu_samples_init(&samples, 1));
+    decoded.count = samples.count = 1;
+
+    /* Nothing to attach to yet */
+    CHECK(!state_shm_attach(name, &map));
+
+    CHECK(state_shm_start(name, 2));
+    CHECK(state_shm_attach(name, &map));
+    CHECK_EQ(map.header->slot_count, 2);
+    CHECK_EQ(map.header->writer_pid, (unsigned long long)getpid());
+
+    /* Slots start disconnected and empty */
+    CHECK(state_shm_read(&map, 0, &state));
+    CHECK_EQ(state.connected, 0);
+    CHECK_EQ(state.reports, 0);
+    CHECK(!state_shm_read(&map, 2, &state));
+
+    /* A published report reads back field for field */
+    state_shm_set_slot(0, 0x09cc);
+    decoded.timestamp_ns[0] = 123456789;
+    decoded.buttons[0] = BUTTON_CROSS | BUTTON_PS;
+    decoded.left_x[0] = 1;
+    decoded.left_y[0] = 2;
+    decoded.right_x[0] = 3;
+    decoded.right_y[0] = 4;
+    decoded.l2[0] = 5;
+    decoded.r2[0] = 6;
+    decoded.accel_y[0] = -8192;
+    decoded.gyro_z[0] = 300;
+    decoded.touch_active[0] = 1;
+    decoded.touch_x[0] = 1000;
+    decoded.touch_y[0] = 500;
+    decoded.battery[0] = 70;
+    samples.accel_y[0] = -1.0f;
+    samples.gyro_z[0] = 18.75f;
+    state_shm_publish(0, &decoded, &samples, 0);
+
+    CHECK(state_shm_read(&map, 0, &state));
+    CHECK_EQ(state.connected, 1);
+    CHECK_EQ(state.product_id, 0x09cc);
+    CHECK_EQ(state.reports, 1);
+    CHECK_EQ(state.timestamp_ns, 123456789);
+    CHECK_EQ(state.buttons, BUTTON_CROSS | BUTTON_PS);
+    CHECK(state.left_x == 1 && state.left_y == 2 && state.right_x == 3 && state.right_y == 4);
+    CHECK(state.l2 == 5 && state.r2 == 6 && state.battery == 70);
+    CHECK(state.touch_active == 1 && state.touch_x == 1000 && state.touch_y == 500);
+    CHECK(state.accel_raw[1] == -8192 && state.gyro_raw[2] == 300);
+    CHECK(state.accel_g[1] == -1.0f && state.gyro_dps[2] == 18.75f);
+
+    /* Reads racing a writer never see a mix of two publishes */
+    CHECK(thread_create(&writer, writer_main, NULL));
+    atomic_store(&reader_started, 1);
+    do
+    {
+        if (!state_shm_read(&map, 1, &state))
+            continue;
+        reads++;
+        uint32_t n = state.buttons;
+        if (state.timestamp_ns != n || state.left_x != (uint8_t)n || state.right_y != (uint8_t)n ||
+            state.touch_x != (uint16_t)n || state.accel_raw[0] != (int16_t)n || state.accel_g[0] != (float)n ||
+            state.gyro_dps[2] != (float)n || state.reports != n)
+            torn++;
+    } while (!atomic_load(&writer_done));
+    thread_join(writer);
+    CHECK(reads > 0);
+    CHECK_EQ(torn, 0);
+    CHECK(state_shm_read(&map, 1, &state));
+    CHECK_EQ(state.reports, PUBLISHES);
+
+    /* Stopping disconnects every slot and removes the name */
+    state_shm_stop();
+    CHECK(state_shm_read(&map, 0, &state));
+    CHECK_EQ(state.connected, 0);
+    state_shm_detach(&map);
+    CHECK(!state_shm_attach(name, &map));
+
+    imu_samples_free(&samples);
+    decoded_reports_free(&decoded);
+
+    return TEST_RESULT();
+}
+
+#else /* PLATFORM_WINDOWS */
+
+int main(void)
+{
+    /* Shared-memory state is not built on Windows */
+    return 77;
+}
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * test_uring_reader.c - Batched io_uring reads from FIFOs standing in for hidraw devices
+ */
+
+#include "test_util.h"
+#include "uring_reader.h"
+#include "platform_compat.h"
+#include <string.h>
+
+#ifdef PLATFORM_LINUX
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define DEVICES 3
+
+static char paths[DEVICES][64];
+
+/**
+ * Harvests until a completion of the device arrives or a few waits time out
+ */
+static int wait_for(uring_reader_t *reader, int device, uring_completion_t *found)
+{
+    uring_completion_t completions[DEVICES];
+
+    for (int attempt = 0; attempt < 20; attempt++)
+    {
+        int count = uring_reader_wait(reader, completions, DEVICES, 50);
+        if (count < 0)
+            return 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (completions[i].device == device)
+            {
+                *found = completions[i];
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    uring_completion_t completions[DEVICES], found;
+    unsigned char report[64];
+    int writers[DEVICES];
+    uring_reader_t *reader = uring_reader_create(DEVICES);
+    int count;
+
+    /* io_uring may be disabled by the kernel or a seccomp filter */
+    if (!reader)
+        return 77;
+
+    for (int i = 0; i < DEVICES; i++)
+    {
+        snprintf(paths[i], sizeof(paths[i]), "test_uring_reader_%d.fifo", i);
+        unlink(paths[i]);
+        CHECK(mkfifo(paths[i], 0600) == 0);
+        CHECK_EQ(uring_reader_add(reader, paths[i]), i);
+        writers[i] = open(paths[i], O_WRONLY | O_NONBLOCK);
+        CHECK(writers[i] >= 0);
+    }
+    CHECK_EQ(uring_reader_add(reader, paths[0]), -1);  /* Full */
+    CHECK(uring_reader_start(reader));
+
+    /* Nothing written yet: the wait times out */
+    CHECK_EQ(uring_reader_wait(reader, completions, DEVICES, 20), 0);
+
+    /* One report on every device arrives as one batch */
+    for (int i = 0; i < DEVICES; i++)
+    {
+        memset(report, 0x10 + i, sizeof(report));
+        CHECK_EQ(write(writers[i], report, 10 + i), 10 + i);
+    }
+    usleep(20000);
+    count = uring_reader_wait(reader, completions, DEVICES, 200);
+    CHECK_EQ(count, DEVICES);
+    for (int i = 0; i < count; i++)
+    {
+        int device = completions[i].device;
+
+        CHECK_EQ(completions[i].result, 10 + device);
+        CHECK(completions[i].data[0] == 0x10 + device && completions[i].data[9 + device] == 0x10 + device);
+    }
+
+    /* Harvested reads are queued again by the next wait */
+    report[0] = 0xaa;
+    CHECK_EQ(write(writers[1], report, 5), 5);
+    CHECK(wait_for(reader, 1, &found));
+    CHECK_EQ(found.result, 5);
+    CHECK_EQ(found.data[0], 0xaa);
+
+    /* A closed writer ends the device once, the others keep reading */
+    close(writers[2]);
+    CHECK(wait_for(reader, 2, &found));
+    CHECK_EQ(found.result, 0);
+    report[0] = 0xbb;
+    CHECK_EQ(write(writers[0], report, 7), 7);
+    CHECK(wait_for(reader, 0, &found));
+    CHECK_EQ(found.data[0], 0xbb);
+    CHECK(!wait_for(reader, 2, &found));
+
+    uring_reader_destroy(reader);
+    for (int i = 0; i < DEVICES; i++)
+    {
+        if (i != 2)
+            close(writers[i]);
+        unlink(paths[i]);
+    }
+
+    return TEST_RESULT();
+}
+
+#else /* !PLATFORM_LINUX */
+
+int main(void)
+{
+    /* io_uring is Linux only */
+    return 77;
+}
+
+#endif
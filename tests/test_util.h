@@ -0,0 +1,49 @@
+/**
+ * test_util.h - Minimal checks shared by the unit tests
+ *
+ * A failed check prints its location and expression and the test keeps
+ * going; TEST_RESULT() turns the failure count into the exit status.
+ */
+
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdio.h>
+#include <math.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        unsigned long long a_ = (unsigned long long)(actual), e_ = (unsigned long long)(expected); \
+        if (a_ != e_) \
+        { \
+            fprintf(stderr, "%s:%d: %s is %llu (0x%llx), expected %llu (0x%llx)\n", __FILE__, __LINE__, \
+                    #actual, a_, a_, e_, e_); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        double a_ = (double)(actual), e_ = (double)(expected); \
+        if (!(fabs(a_ - e_) <= (tolerance))) \
+        { \
+            fprintf(stderr, "%s:%d: %s is %g, expected %g\n", __FILE__, __LINE__, #actual, a_, e_); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT() \
+    (test_failures ? (fprintf(stderr, "%d check(s) failed\n", test_failures), 1) : 0)
+
+#endif /* TEST_UTIL_H */
@@ -0,0 +1,219 @@
+/**
+ * thread_compat.h - Threading compatibility definitions
+ *
+ * Minimal threads, mutexes, condition variables and sleeping that map to
+ * Win32 on Windows and to POSIX threads everywhere else.
+ */
+
+#ifndef THREAD_COMPAT_H
+#define THREAD_COMPAT_H
+
+#include "platform_compat.h"
+#include <stdlib.h>
+
+#ifdef PLATFORM_WINDOWS
+    #include <windows.h>
+
+    typedef HANDLE thread_t;
+    typedef SRWLOCK mutex_t;
+    typedef CONDITION_VARIABLE cond_t;
+#else
+    #include <pthread.h>
+    #include <time.h>
+    #include <errno.h>
+
+    typedef pthread_t thread_t;
+    typedef pthread_mutex_t mutex_t;
+    typedef pthread_cond_t cond_t;
+#endif
+
+/* Signature of a thread entry point */
+typedef void (*thread_func_t)(void *arg);
+
+/**
+ * Start-up block handed to the platform thread entry point
+ */
+typedef struct {
+    thread_func_t func;
+    void *arg;
+} thread_start_t;
+
+/**
+ * Platform thread entry point that unpacks the start-up block
+ */
+#ifdef PLATFORM_WINDOWS
+static inline DWORD WINAPI thread_compat_entry(LPVOID param)
+#else
+static inline void* thread_compat_entry(void *param)
+#endif
+{
+    thread_start_t start = *(thread_start_t*)param;
+    free(param);
+    start.func(start.arg);
+#ifdef PLATFORM_WINDOWS
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Starts a new thread
+ *
+ * @param thread Output handle of the new thread
+ * @param func Entry point
+ * @param arg Argument passed to the entry point
+ * @return 1 on success, 0 on failure
+ */
+static inline int thread_create(thread_t *thread, thread_func_t func, void *arg)
+{
+    thread_start_t *start = (thread_start_t*)malloc(sizeof(thread_start_t));
+    if (!start)
+        return 0;
+    start->func = func;
+    start->arg = arg;
+
+#ifdef PLATFORM_WINDOWS
+    *thread = CreateThread(NULL, 0, thread_compat_entry, start, 0, NULL);
+    if (*thread == NULL)
+#else
+    if (pthread_create(thread, NULL, thread_compat_entry, start) != 0)
+#endif
+    {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Waits for a thread to finish
+ *
+ * @param thread The thread to wait for
+ */
+static inline void thread_join(thread_t thread)
+{
+#ifdef PLATFORM_WINDOWS
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static inline void mutex_init(mutex_t *mutex)
+{
+#ifdef PLATFORM_WINDOWS
+    InitializeSRWLock(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static inline void mutex_destroy(mutex_t *mutex)
+{
+#ifdef PLATFORM_WINDOWS
+    (void)mutex;
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+static inline void mutex_lock(mutex_t *mutex)
+{
+#ifdef PLATFORM_WINDOWS
+    AcquireSRWLockExclusive(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void mutex_unlock(mutex_t *mutex)
+{
+#ifdef PLATFORM_WINDOWS
+    ReleaseSRWLockExclusive(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+static inline void cond_init(cond_t *cond)
+{
+#ifdef PLATFORM_WINDOWS
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+static inline void cond_destroy(cond_t *cond)
+{
+#ifdef PLATFORM_WINDOWS
+    (void)cond;
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+static inline void cond_signal(cond_t *cond)
+{
+#ifdef PLATFORM_WINDOWS
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+static inline void cond_broadcast(cond_t *cond)
+{
+#ifdef PLATFORM_WINDOWS
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+/**
+ * Waits on a condition variable for at most the given time
+ *
+ * @param cond The condition variable
+ * @param mutex The mutex held by the caller
+ * @param timeout_ms Maximum time to wait in milliseconds
+ * @return 1 if signalled, 0 on timeout
+ */
+static inline int cond_timedwait(cond_t *cond, mutex_t *mutex, int timeout_ms)
+{
+#ifdef PLATFORM_WINDOWS
+    return SleepConditionVariableSRW(cond, mutex, (DWORD)timeout_ms, 0) ? 1 : 0;
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(cond, mutex, &deadline) != ETIMEDOUT;
+#endif
+}
+
+/**
+ * Suspends the calling thread
+ *
+ * @param ms Time to sleep in milliseconds
+ */
+static inline void sleep_ms(int ms)
+{
+#ifdef PLATFORM_WINDOWS
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+#endif /* THREAD_COMPAT_H */
@@ -0,0 +1,268 @@
+/**
+ * trace_events.c - Chrome trace-event export
+ *
+ * Implementation of the trace recorder. Events are appended to per-thread
+ * chunk lists without any locking and serialized to JSON once at exit.
+ */
+
+#include "trace_events.h"
+#include "latency_stats.h"
+#include "platform_compat.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifdef PLATFORM_WINDOWS
+    #include <windows.h>
+    #include <process.h>
+    #define getpid _getpid
+#else
+    #include <unistd.h>
+    #include <pthread.h>
+    #ifdef PLATFORM_LINUX
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+/* Number of events per buffer chunk */
+#define TRACE_CHUNK_EVENTS 1024
+
+/**
+ * A single complete ("X") trace event
+ */
+typedef struct {
+    const char *name;
+    const char *category;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    int report_id;
+    int result;
+    char path[TRACE_PATH_MAX];
+} trace_event_t;
+
+/**
+ * Fixed-size block of events; a thread's chunks are linked newest first
+ */
+typedef struct trace_chunk {
+    trace_event_t events[TRACE_CHUNK_EVENTS];
+    int count;
+    struct trace_chunk *prev;
+} trace_chunk_t;
+
+/**
+ * Per-thread event buffer, linked into a global list on first use
+ */
+typedef struct trace_buffer {
+    unsigned long thread_id;
+    trace_chunk_t *current;
+    struct trace_buffer *next;
+} trace_buffer_t;
+
+int trace_events_enabled = 0;
+
+static char *trace_path = NULL;
+static uint64_t trace_origin_ns = 0;
+static _Atomic(trace_buffer_t *) buffer_list = NULL;
+static THREAD_LOCAL trace_buffer_t *thread_buffer = NULL;
+
+/**
+ * Gets an operating system identifier for the calling thread
+ */
+static unsigned long current_thread_id(void)
+{
+#if defined(PLATFORM_WINDOWS)
+    return (unsigned long)GetCurrentThreadId();
+#elif defined(PLATFORM_LINUX)
+    return (unsigned long)syscall(SYS_gettid);
+#else
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    return (unsigned long)tid;
+#endif
+}
+
+/**
+ * Enables tracing and sets the file written by trace_events_write()
+ */
+int trace_events_open(const char *path)
+{
+    if (!path || !*path)
+        return 0;
+
+    trace_path = strdup(path);
+    if (!trace_path)
+        return 0;
+
+    trace_origin_ns = latency_now_ns();
+    trace_events_enabled = 1;
+    return 1;
+}
+
+/**
+ * Gets the start timestamp for an event
+ */
+uint64_t trace_events_begin(void)
+{
+    return trace_events_enabled ? latency_now_ns() : 0;
+}
+
+/**
+ * Gets the calling thread's buffer, creating and publishing it on first use
+ */
+static trace_buffer_t* get_thread_buffer(void)
+{
+    if (thread_buffer)
+        return thread_buffer;
+
+    trace_buffer_t *buffer = (trace_buffer_t*)calloc(1, sizeof(trace_buffer_t));
+    if (!buffer)
+        return NULL;
+
+    buffer->thread_id = current_thread_id();
+    buffer->next = atomic_load_explicit(&buffer_list, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&buffer_list, &buffer->next, buffer,
+                                                  memory_order_release, memory_order_relaxed))
+        ;
+
+    thread_buffer = buffer;
+    return buffer;
+}
+
+/**
+ * Records a complete event ending now into the calling thread's buffer
+ */
+void trace_events_record(const char *name, const char *category, uint64_t start_ns,
+                         const char *path, int report_id, int result)
+{
+    if (trace_events_enabled)
+        trace_events_record_span(name, category, start_ns, latency_now_ns(), path, report_id, result);
+}
+
+/**
+ * Records a complete event with an explicit end timestamp
+ */
+void trace_events_record_span(const char *name, const char *category, uint64_t start_ns, uint64_t end_ns,
+                              const char *path, int report_id, int result)
+{
+    trace_buffer_t *buffer;
+    trace_event_t *event;
+
+    if (!trace_events_enabled)
+        return;
+
+    buffer = get_thread_buffer();
+    if (!buffer)
+        return;
+
+    if (!buffer->current || buffer->current->count == TRACE_CHUNK_EVENTS)
+    {
+        trace_chunk_t *chunk = (trace_chunk_t*)malloc(sizeof(trace_chunk_t));
+        if (!chunk)
+            return;
+        chunk->count = 0;
+        chunk->prev = buffer->current;
+        buffer->current = chunk;
+    }
+
+    event = &buffer->current->events[buffer->current->count++];
+    event->name = name;
+    event->category = category;
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    event->report_id = report_id;
+    event->result = result;
+    if (path)
+    {
+        strncpy(event->path, path, sizeof(event->path) - 1);
+        event->path[sizeof(event->path) - 1] = '\0';
+    }
+    else
+    {
+        event->path[0] = '\0';
+    }
+}
+
+/**
+ * Writes a string as a JSON string literal
+ */
+static void write_json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char*)str; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fprintf(fp, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(fp, "\\u%04x", *p);
+        else
+            fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+/**
+ * Writes the events of one chunk list, oldest first
+ */
+static void write_chunks(FILE *fp, const trace_chunk_t *chunk, unsigned long thread_id,
+                         int pid, int *first)
+{
+    if (!chunk)
+        return;
+
+    write_chunks(fp, chunk->prev, thread_id, pid, first);
+
+    for (int i = 0; i < chunk->count; i++)
+    {
+        const trace_event_t *event = &chunk->events[i];
+        uint64_t start = event->start_ns > trace_origin_ns ? event->start_ns - trace_origin_ns : 0;
+        uint64_t duration = event->end_ns > event->start_ns ? event->end_ns - event->start_ns : 0;
+
+        fprintf(fp, "%s\n{\"name\":", *first ? "" : ",");
+        write_json_string(fp, event->name);
+        fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%lu,\"args\":{",
+                event->category, start / 1000.0, duration / 1000.0, pid, thread_id);
+        fprintf(fp, "\"result\":%d", event->result);
+        if (event->report_id >= 0)
+            fprintf(fp, ",\"report_id\":\"0x%02x\"", event->report_id);
+        if (event->path[0])
+        {
+            fprintf(fp, ",\"path\":");
+            write_json_string(fp, event->path);
+        }
+        fprintf(fp, "}}");
+        *first = 0;
+    }
+}
+
+/**
+ * Writes all buffered events to the trace file (called once at exit)
+ */
+void trace_events_write(void)
+{
+    FILE *fp;
+    int first = 1;
+    int pid = (int)getpid();
+
+    if (!trace_events_enabled || !trace_path)
+        return;
+
+    fp = fopen(trace_path, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to write trace file %s\n", COLOR_RED, COLOR_RESET, trace_path);
+        return;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (trace_buffer_t *buffer = atomic_load_explicit(&buffer_list, memory_order_acquire);
+         buffer; buffer = buffer->next)
+    {
+        write_chunks(fp, buffer->current, buffer->thread_id, pid, &first);
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    printf("%s[INFO]%s Trace written to %s\n", COLOR_BLUE, COLOR_RESET, trace_path);
+}
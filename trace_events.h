@@ -0,0 +1,72 @@
+/**
+ * trace_events.h - Chrome trace-event export
+ *
+ * Records the stages of a run (enumeration, opens, fallbacks, feature
+ * reports) as complete events in the Chrome trace-event JSON format, which
+ * can be loaded into Perfetto or chrome://tracing
+ */
+
+#ifndef TRACE_EVENTS_H
+#define TRACE_EVENTS_H
+
+#include <stdint.h>
+
+/* Category names used for trace events */
+#define TRACE_CAT_HID      "hid"       /* Individual HIDAPI calls */
+#define TRACE_CAT_STAGE    "stage"     /* High-level steps of a command */
+#define TRACE_CAT_FALLBACK "fallback"  /* Alternative methods tried after a failure */
+
+/* Maximum number of path characters stored per event */
+#define TRACE_PATH_MAX 128
+
+/* Non-zero when events should be recorded (set once at startup) */
+extern int trace_events_enabled;
+
+/**
+ * Enables tracing and sets the file written by trace_events_write()
+ *
+ * @param path Output file path for the JSON trace
+ * @return 1 on success, 0 on failure
+ */
+int trace_events_open(const char *path);
+
+/**
+ * Gets the start timestamp for an event
+ *
+ * @return Current time in nanoseconds, or 0 if tracing is disabled
+ */
+uint64_t trace_events_begin(void);
+
+/**
+ * Records a complete event ending now into the calling thread's buffer
+ *
+ * @param name Event name (must be a string literal or otherwise outlive the run)
+ * @param category Event category, one of the TRACE_CAT_* names
+ * @param start_ns Start timestamp from trace_events_begin()
+ * @param path Device path the event relates to, or NULL
+ * @param report_id Report ID the event relates to, or -1
+ * @param result Return value of the traced operation
+ */
+void trace_events_record(const char *name, const char *category, uint64_t start_ns,
+                         const char *path, int report_id, int result);
+
+/**
+ * Records a complete event with an explicit end timestamp
+ *
+ * @param name Event name (must be a string literal or otherwise outlive the run)
+ * @param category Event category, one of the TRACE_CAT_* names
+ * @param start_ns Start timestamp in nanoseconds
+ * @param end_ns End timestamp in nanoseconds
+ * @param path Device path the event relates to, or NULL
+ * @param report_id Report ID the event relates to, or -1
+ * @param result Return value of the traced operation
+ */
+void trace_events_record_span(const char *name, const char *category, uint64_t start_ns, uint64_t end_ns,
+                              const char *path, int report_id, int result);
+
+/**
+ * Writes all buffered events to the trace file (called once at exit)
+ */
+void trace_events_write(void);
+
+#endif /* TRACE_EVENTS_H */
@@ -6,6 +6,7 @@
 
 #include "ui.h"
 #include "controller_connection.h"
+#include "hid_io.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,6 +29,77 @@ void show_usage(const char *program_name)
            COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
     printf("%s\t%s %s-h%s      - Show this help message%s\n",
            COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %sdaemon <mac>%s [--metrics <socket>] [--workers <n>] [--interval <ms>] [--timeout <ms>]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Keep running and pair every controller that is plugged in%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %sstream%s [--duration <seconds>] [--output <file>] [--decoded] [--calibrated]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                [--orientation [--beta <gain>]] [--dsu | --dsu-bind <address>[:<port>]]%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                [--uinput] [--io-uring] [--shm | --shm-name <name>] [--record <file>]%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Stream input reports from all controllers in timestamp order (CSV)%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %sbench%s [--reports <n>] [--rounds <n>]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Measure input report decoder throughput on synthetic reports%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %sdecode <capture | recording>%s [--output <file>] [--from <seconds>]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Decode every input report of a capture or recording in batches (CSV)%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %sqa%s [--duration <seconds>] [--output <file>] [--min-rate <hz>] [--stick-drift <n>]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                [--stick-noise <n>] [--trigger-drift <n>] [--accel-noise <g>] [--gyro-noise <dps>]%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                [--gyro-bias <dps>] [--bounce-ms <ms>] [--max-bounces <n>] [--min-battery <percent>]%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Check every controller for drift, noise, bounce and battery in parallel%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %sprovision <recipe>%s [--host <mac>] [--journal <file> [--resume]]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Run a provisioning recipe on every controller in parallel%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %sapply <manifest>%s [--dry-run] [--journal <file> [--resume]]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Pair every controller listed in a CSV or JSON-lines manifest%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %sidentify%s [--host <mac> [--rumble <ms>]] [--off]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Light every controller by slot, or green/red by pairing with a host%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %ssnapshot <file>%s [--path <device path>]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Save every feature report of a USB controller to a snapshot file%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %srestore <file>%s [--dry-run]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Write a snapshot to every matching USB controller in parallel%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s %ssurvey%s [--product <id>] [--output <file>]%s\n",
+           COLOR_WHITE, program_name, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t                - Probe feature reports 0x00-0xff on every controller, sharing the IDs out%s\n",
+           COLOR_WHITE, COLOR_RESET);
+    printf("\n%sGlobal options (may be combined with any command):%s\n", COLOR_BOLD, COLOR_RESET);
+    printf("%s\t%s--stats%s       - Print HID latency statistics (p50/p99/max) at exit%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s--trace <file>%s - Write a Chrome trace-event JSON of the run (Perfetto, chrome://tracing)%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s--flight-dir <dir>%s - Directory for flight recorder dumps written on failure%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s--calibration-cache <file>%s - DS4 IMU calibration cache (default: per-user cache directory)%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s--capability-cache <file>%s - Feature reports each model answers (default: per-user cache directory)%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s--no-capability-cache%s - Send every feature report request, even ones known to fail%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s--bluez-dir <dir>%s - BlueZ storage that DS4 and DualSense link keys are written to (default: /var/lib/bluetooth)%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s--capture <file>%s - Record all HID traffic to a capture file%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
+    printf("%s\t%s--replay <file>%s - Serve HID traffic from a capture instead of hardware (%s--replay-fast%s: no delays)%s\n",
+           COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_CYAN, COLOR_WHITE, COLOR_RESET);
 }
 
 /**
@@ -41,12 +113,12 @@ int list_devices(int list_all)
     if (list_all)
     {
         printf("%s%s=== Listing all connected USB devices ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
-        devs = hid_enumerate(0, 0); /* Enumerate all USB HID devices */
+        devs = hid_io_enumerate(0, 0); /* Enumerate all USB HID devices */
     }
     else
     {
         printf("%s%s=== Listing all connected Sony USB devices ===%s\n", COLOR_BOLD, COLOR_YELLOW, COLOR_RESET);
-        devs = hid_enumerate(VENDOR_SONY, 0); /* Enumerate all devices with Sony vendor ID */
+        devs = hid_io_enumerate(VENDOR_SONY, 0); /* Enumerate all devices with Sony vendor ID */
     }
     cur_dev = devs;
 
@@ -108,7 +180,7 @@ int list_devices(int list_all)
         }
     }
 
-    hid_free_enumeration(devs);
+    hid_io_free_enumeration(devs);
     return 0;
 }
 
@@ -149,7 +221,7 @@ int dump_controller_info(void)
         dump_device_info(dev);
         
         /* Clean up */
-        hid_close(dev);
+        hid_io_close(dev);
     }
     else
     {
@@ -183,8 +255,7 @@ void display_controller_info(controller_info_t *controller, int index)
     printf("%s│  Product:         %ls\n", COLOR_MAGENTA,
            controller->product_string ? controller->product_string : L"(Unknown)");
     printf("%s│  Interface:       %d%s\n", COLOR_MAGENTA, controller->interface_number,
-           (controller->product_id == PRODUCT_DS4 && controller->interface_number == DS4_HID_INTERFACE) ? 
-           COLOR_GREEN " (Preferred)" COLOR_RESET : "");
+           controller->is_preferred ? COLOR_GREEN " (Preferred)" COLOR_RESET : "");
     printf("%s│  Path:            %s\n", COLOR_MAGENTA, controller->path);
     printf("%s└───────────────────────────────────────────────%s\n\n", COLOR_MAGENTA, COLOR_RESET);
 }
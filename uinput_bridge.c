@@ -0,0 +1,399 @@
+/**
+ * uinput_bridge.c - Virtual gamepads for streamed controllers
+ *
+ * Implementation of the uinput bridge. The mapping of every product in the
+ * supported product table is built once from a single control table, so the
+ * SixAxis, Move and DS4 expose the same codes for the same controls. Each
+ * gamepad is only written by the reader thread of its controller, which
+ * turns a report into events without going through the merge.
+ */
+
+#include "uinput_bridge.h"
+#include "controller_info.h"
+#include "latency_stats.h"
+#include "ui.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef PLATFORM_LINUX
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <errno.h>
+    #include <sys/ioctl.h>
+    #include <linux/uinput.h>
+#endif
+
+#ifdef PLATFORM_LINUX
+
+#define FAMILY_BIT(family) (1u << (family))
+#define PAD_FAMILIES (FAMILY_BIT(REPORT_FAMILY_SIXAXIS) | FAMILY_BIT(REPORT_FAMILY_DS4))
+#define ALL_FAMILIES (PAD_FAMILIES | FAMILY_BIT(REPORT_FAMILY_MOVE))
+
+/* Most buttons and axes of any mapping */
+#define MAX_MAPPED_BUTTONS 20
+#define MAX_MAPPED_AXES 8
+
+/* Every mapped control plus the hat and the SYN_REPORT */
+#define MAX_EVENTS (MAX_MAPPED_BUTTONS + MAX_MAPPED_AXES + 3)
+
+/* Entries of the supported product table that get a mapping */
+#define MAX_PRODUCTS 8
+
+/**
+ * Button bit to key code, with the families that have the button
+ */
+typedef struct {
+    uint32_t bit;
+    uint16_t code;
+    uint32_t families;
+} button_control_t;
+
+/**
+ * Decoded 0-255 field to absolute axis, with the families that have the axis
+ */
+typedef struct {
+    size_t field;  /* offsetof() the field's array in decoded_reports_t */
+    uint16_t code;
+    int32_t neutral;
+    uint32_t families;
+} axis_control_t;
+
+/* The layout; the Move's T trigger doubles as R2 so it lines up with the pads */
+static const button_control_t BUTTON_CONTROLS[] = {
+    { BUTTON_CROSS,    BTN_SOUTH,          ALL_FAMILIES },
+    { BUTTON_CIRCLE,   BTN_EAST,           ALL_FAMILIES },
+    { BUTTON_SQUARE,   BTN_WEST,           ALL_FAMILIES },
+    { BUTTON_TRIANGLE, BTN_NORTH,          ALL_FAMILIES },
+    { BUTTON_L1,       BTN_TL,             PAD_FAMILIES },
+    { BUTTON_R1,       BTN_TR,             PAD_FAMILIES },
+    { BUTTON_L2,       BTN_TL2,            PAD_FAMILIES },
+    { BUTTON_R2,       BTN_TR2,            PAD_FAMILIES },
+    { BUTTON_T,        BTN_TR2,            FAMILY_BIT(REPORT_FAMILY_MOVE) },
+    { BUTTON_SELECT,   BTN_SELECT,         ALL_FAMILIES },
+    { BUTTON_START,    BTN_START,          ALL_FAMILIES },
+    { BUTTON_L3,       BTN_THUMBL,         PAD_FAMILIES },
+    { BUTTON_R3,       BTN_THUMBR,         PAD_FAMILIES },
+    { BUTTON_PS,       BTN_MODE,           ALL_FAMILIES },
+    { BUTTON_TOUCHPAD, BTN_TRIGGER_HAPPY1, FAMILY_BIT(REPORT_FAMILY_DS4) },
+    { BUTTON_MOVE,     BTN_TRIGGER_HAPPY2, FAMILY_BIT(REPORT_FAMILY_MOVE) }
+};
+
+static const axis_control_t AXIS_CONTROLS[] = {
+    { offsetof(decoded_reports_t, left_x),  ABS_X,  128, PAD_FAMILIES },
+    { offsetof(decoded_reports_t, left_y),  ABS_Y,  128, PAD_FAMILIES },
+    { offsetof(decoded_reports_t, right_x), ABS_RX, 128, PAD_FAMILIES },
+    { offsetof(decoded_reports_t, right_y), ABS_RY, 128, PAD_FAMILIES },
+    { offsetof(decoded_reports_t, l2),      ABS_Z,  0,   PAD_FAMILIES },
+    { offsetof(decoded_reports_t, r2),      ABS_RZ, 0,   ALL_FAMILIES }
+};
+
+/* Families with a d-pad, reported as a hat like the kernel drivers do */
+#define HAT_FAMILIES PAD_FAMILIES
+
+/**
+ * Controls of one product
+ */
+typedef struct {
+    int buttons;
+    uint32_t button_bits[MAX_MAPPED_BUTTONS];
+    uint16_t button_codes[MAX_MAPPED_BUTTONS];
+    int axes;
+    size_t axis_fields[MAX_MAPPED_AXES];
+    uint16_t axis_codes[MAX_MAPPED_AXES];
+    int32_t axis_neutral[MAX_MAPPED_AXES];
+    int hat;
+} pad_mapping_t;
+
+/**
+ * One virtual gamepad and the state it last reported
+ */
+typedef struct {
+    int fd;
+    unsigned short product_id;
+    const pad_mapping_t *mapping;
+    uint32_t buttons;
+    int32_t axes[MAX_MAPPED_AXES];
+    int32_t hat_x, hat_y;
+    uint64_t events;
+    uint64_t writes;
+    uint64_t failed;
+} virtual_pad_t;
+
+static pad_mapping_t mappings[MAX_PRODUCTS];
+static virtual_pad_t pads[MAX_CONTROLLERS];
+static int bridge_started = 0;
+
+/**
+ * Collects the controls of one family from the control tables
+ */
+static void build_mapping(report_family_t family, pad_mapping_t *mapping)
+{
+    uint32_t bit = FAMILY_BIT(family);
+
+    memset(mapping, 0, sizeof(*mapping));
+    for (size_t i = 0; i < sizeof(BUTTON_CONTROLS) / sizeof(BUTTON_CONTROLS[0]); i++)
+    {
+        if (!(BUTTON_CONTROLS[i].families & bit))
+            continue;
+        mapping->button_bits[mapping->buttons] = BUTTON_CONTROLS[i].bit;
+        mapping->button_codes[mapping->buttons] = BUTTON_CONTROLS[i].code;
+        mapping->buttons++;
+    }
+    for (size_t i = 0; i < sizeof(AXIS_CONTROLS) / sizeof(AXIS_CONTROLS[0]); i++)
+    {
+        if (!(AXIS_CONTROLS[i].families & bit))
+            continue;
+        mapping->axis_fields[mapping->axes] = AXIS_CONTROLS[i].field;
+        mapping->axis_codes[mapping->axes] = AXIS_CONTROLS[i].code;
+        mapping->axis_neutral[mapping->axes] = AXIS_CONTROLS[i].neutral;
+        mapping->axes++;
+    }
+    mapping->hat = (HAT_FAMILIES & bit) != 0;
+}
+
+/**
+ * Sets up one absolute axis of a device being created
+ */
+static int setup_axis(int fd, uint16_t code, int32_t minimum, int32_t maximum, int32_t value)
+{
+    struct uinput_abs_setup abs;
+
+    memset(&abs, 0, sizeof(abs));
+    abs.code = code;
+    abs.absinfo.minimum = minimum;
+    abs.absinfo.maximum = maximum;
+    abs.absinfo.value = value;
+    return ioctl(fd, UI_SET_ABSBIT, code) == 0 && ioctl(fd, UI_ABS_SETUP, &abs) == 0;
+}
+
+/**
+ * Appends one event to a batch
+ */
+static inline void add_event(struct input_event *events, int *count, uint16_t type, uint16_t code, int32_t value)
+{
+    struct input_event *ev = &events[(*count)++];
+
+    /* The kernel stamps events written to uinput */
+    memset(&ev->time, 0, sizeof(ev->time));
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+}
+
+/**
+ * Builds the event mapping of every product in the supported product table
+ */
+int uinput_bridge_start(void)
+{
+    unsigned short product_id;
+
+    if (access("/dev/uinput", W_OK) != 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s Cannot write /dev/uinput: %s (load the uinput module or check permissions)\n",
+                COLOR_RED, COLOR_RESET, strerror(errno));
+        return 0;
+    }
+
+    for (int i = 0; i < MAX_PRODUCTS && (product_id = get_supported_product(i)) != 0; i++)
+        build_mapping(report_family(product_id), &mappings[i]);
+    for (int i = 0; i < MAX_CONTROLLERS; i++)
+    {
+        memset(&pads[i], 0, sizeof(pads[i]));
+        pads[i].fd = -1;
+    }
+    bridge_started = 1;
+    return 1;
+}
+
+/**
+ * Creates the virtual gamepad of one controller
+ */
+int uinput_bridge_open(int index, unsigned short product_id)
+{
+    struct uinput_setup setup;
+    const pad_mapping_t *mapping;
+    virtual_pad_t *pad;
+    int product_index = get_product_index(product_id);
+    int fd, ok;
+
+    if (!bridge_started || index < 0 || index >= MAX_CONTROLLERS || product_index < 0 ||
+        product_index >= MAX_PRODUCTS)
+        return 0;
+
+    mapping = &mappings[product_index];
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to open /dev/uinput: %s\n", COLOR_RED, COLOR_RESET, strerror(errno));
+        return 0;
+    }
+
+    ok = ioctl(fd, UI_SET_EVBIT, EV_KEY) == 0 && ioctl(fd, UI_SET_EVBIT, EV_ABS) == 0;
+    for (int i = 0; ok && i < mapping->buttons; i++)
+        ok = ioctl(fd, UI_SET_KEYBIT, mapping->button_codes[i]) == 0;
+    for (int i = 0; ok && i < mapping->axes; i++)
+        ok = setup_axis(fd, mapping->axis_codes[i], 0, 255, mapping->axis_neutral[i]);
+    if (ok && mapping->hat)
+        ok = setup_axis(fd, ABS_HAT0X, -1, 1, 0) && setup_axis(fd, ABS_HAT0Y, -1, 1, 0);
+
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = VENDOR_SONY;
+    setup.id.product = product_id;
+    snprintf(setup.name, sizeof(setup.name), "%s %s", UINPUT_DEVICE_PREFIX, get_controller_name(product_id));
+    if (!ok || ioctl(fd, UI_DEV_SETUP, &setup) != 0 || ioctl(fd, UI_DEV_CREATE) != 0)
+    {
+        fprintf(stderr, "%s[ERROR]%s Failed to create a virtual gamepad: %s\n", COLOR_RED, COLOR_RESET,
+                strerror(errno));
+        close(fd);
+        return 0;
+    }
+
+    pad = &pads[index];
+    memset(pad, 0, sizeof(*pad));
+    pad->fd = fd;
+    pad->product_id = product_id;
+    pad->mapping = mapping;
+    for (int i = 0; i < mapping->axes; i++)
+        pad->axes[i] = mapping->axis_neutral[i];
+
+    printf("%s[INFO]%s Mirroring controller %d as \"%s\"\n", COLOR_BLUE, COLOR_RESET, index, setup.name);
+    return 1;
+}
+
+/**
+ * Writes the changes of one decoded report as a single batch of events
+ */
+void uinput_bridge_write(int index, const decoded_reports_t *decoded, size_t entry, uint64_t timestamp_ns)
+{
+    struct input_event events[MAX_EVENTS];
+    virtual_pad_t *pad;
+    const pad_mapping_t *mapping;
+    uint32_t buttons, changed;
+    int count = 0;
+
+    if (index < 0 || index >= MAX_CONTROLLERS || pads[index].fd < 0 || !pads[index].mapping)
+        return;
+
+    pad = &pads[index];
+    mapping = pad->mapping;
+    buttons = decoded->buttons[entry];
+    changed = buttons ^ pad->buttons;
+
+    if (changed)
+    {
+        for (int i = 0; i < mapping->buttons; i++)
+        {
+            if (changed & mapping->button_bits[i])
+                add_event(events, &count, EV_KEY, mapping->button_codes[i], (buttons & mapping->button_bits[i]) != 0);
+        }
+        pad->buttons = buttons;
+    }
+
+    for (int i = 0; i < mapping->axes; i++)
+    {
+        const uint8_t *field = *(const uint8_t* const*)((const char*)decoded + mapping->axis_fields[i]);
+        int32_t value = field[entry];
+
+        if (value != pad->axes[i])
+        {
+            add_event(events, &count, EV_ABS, mapping->axis_codes[i], value);
+            pad->axes[i] = value;
+        }
+    }
+
+    if (mapping->hat)
+    {
+        int32_t x = ((buttons & BUTTON_RIGHT) != 0) - ((buttons & BUTTON_LEFT) != 0);
+        int32_t y = ((buttons & BUTTON_DOWN) != 0) - ((buttons & BUTTON_UP) != 0);
+
+        if (x != pad->hat_x)
+            add_event(events, &count, EV_ABS, ABS_HAT0X, x);
+        if (y != pad->hat_y)
+            add_event(events, &count, EV_ABS, ABS_HAT0Y, y);
+        pad->hat_x = x;
+        pad->hat_y = y;
+    }
+
+    if (count == 0)
+        return;
+
+    add_event(events, &count, EV_SYN, SYN_REPORT, 0);
+    if (write(pad->fd, events, (size_t)count * sizeof(events[0])) != (ssize_t)(count * sizeof(events[0])))
+    {
+        pad->failed++;
+        return;
+    }
+    pad->events += (uint64_t)count;
+    pad->writes++;
+
+    if (latency_stats_enabled)
+        latency_stats_record(LATENCY_OP_UINPUT, pad->product_id, latency_now_ns() - timestamp_ns);
+}
+
+/**
+ * Destroys every virtual gamepad and prints the event counts
+ */
+void uinput_bridge_stop(void)
+{
+    if (!bridge_started)
+        return;
+
+    for (int i = 0; i < MAX_CONTROLLERS; i++)
+    {
+        virtual_pad_t *pad = &pads[i];
+
+        if (pad->fd < 0)
+            continue;
+
+        ioctl(pad->fd, UI_DEV_DESTROY);
+        close(pad->fd);
+        pad->fd = -1;
+        printf("%s[INFO]%s Virtual gamepad %d: %llu events in %llu writes%s\n", COLOR_BLUE, COLOR_RESET, i,
+               (unsigned long long)pad->events, (unsigned long long)pad->writes,
+               pad->failed ? " (some writes failed)" : "");
+    }
+    bridge_started = 0;
+}
+
+#else /* !PLATFORM_LINUX */
+
+/**
+ * Builds the event mapping of every product in the supported product table
+ */
+int uinput_bridge_start(void)
+{
+    fprintf(stderr, "%s[ERROR]%s Virtual gamepads are only supported on Linux\n", COLOR_RED, COLOR_RESET);
+    return 0;
+}
+
+/**
+ * Creates the virtual gamepad of one controller
+ */
+int uinput_bridge_open(int index, unsigned short product_id)
+{
+    (void)index;
+    (void)product_id;
+    return 0;
+}
+
+/**
+ * Writes the changes of one decoded report as a single batch of events
+ */
+void uinput_bridge_write(int index, const decoded_reports_t *decoded, size_t entry, uint64_t timestamp_ns)
+{
+    (void)index;
+    (void)decoded;
+    (void)entry;
+    (void)timestamp_ns;
+}
+
+/**
+ * Destroys every virtual gamepad and prints the event counts
+ */
+void uinput_bridge_stop(void)
+{
+}
+
+#endif /* PLATFORM_LINUX */
@@ -0,0 +1,52 @@
+/**
+ * uinput_bridge.h - Virtual gamepads for streamed controllers
+ *
+ * Mirrors each streamed controller as a Linux uinput gamepad with the same
+ * layout for every product family, independent of the kernel's own drivers.
+ * Each decoded report becomes one batch of input events written with a
+ * single write().
+ */
+
+#ifndef UINPUT_BRIDGE_H
+#define UINPUT_BRIDGE_H
+
+#include "report_decoder.h"
+
+/* Name prefix of the virtual devices */
+#define UINPUT_DEVICE_PREFIX "sixaxispairer"
+
+/**
+ * Builds the event mapping of every product in the supported product table
+ *
+ * @return 1 on success, 0 if uinput is not available
+ */
+int uinput_bridge_start(void);
+
+/**
+ * Creates the virtual gamepad of one controller
+ *
+ * @param index Controller index (0 to MAX_CONTROLLERS - 1)
+ * @param product_id Product ID of the controller, which selects the mapping
+ * @return 1 on success, 0 on failure
+ */
+int uinput_bridge_open(int index, unsigned short product_id);
+
+/**
+ * Writes the changes of one decoded report as a single batch of events
+ *
+ * Must only be called from the thread that reads the controller. The time
+ * from timestamp_ns to the completed write is recorded under --stats.
+ *
+ * @param index Controller index
+ * @param decoded Decoded reports
+ * @param entry Index of the report in the batch
+ * @param timestamp_ns latency_now_ns() when the report was read
+ */
+void uinput_bridge_write(int index, const decoded_reports_t *decoded, size_t entry, uint64_t timestamp_ns);
+
+/**
+ * Destroys every virtual gamepad and prints the event counts
+ */
+void uinput_bridge_stop(void);
+
+#endif /* UINPUT_BRIDGE_H */
@@ -0,0 +1,422 @@
+/**
+ * uring_reader.c - io_uring input report reader
+ *
+ * Implementation on the raw io_uring system calls, without liburing. The
+ * submission and completion rings are shared with the kernel through mmap;
+ * this side only advances the submission tail and the completion head, with
+ * release stores so the kernel never sees an entry before its contents.
+ *
+ * Character devices such as hidraw do not support non-blocking reads from
+ * io_uring, which would park a kernel worker in every outstanding read. So
+ * each read is linked behind a poll on its non-blocking descriptor: the
+ * kernel waits for readiness without a thread and the read then completes
+ * inline.
+ */
+
+#include "uring_reader.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PLATFORM_LINUX
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <errno.h>
+    #include <poll.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <linux/io_uring.h>
+#endif
+
+#ifdef PLATFORM_LINUX
+
+/* Tags the user data of poll entries, which are not reported */
+#define POLL_TAG (1ull << 32)
+
+/* Submission entries per read: the poll and the linked read */
+#define ENTRIES_PER_READ 2
+
+/**
+ * Per-device state
+ */
+typedef struct {
+    int fd;
+    int rearm;                  /* Harvested, to be queued again by the next wait; failed devices never are */
+} uring_device_t;
+
+struct uring_reader {
+    int ring_fd;
+    int max_devices;
+    int device_count;
+    int fixed_buffers;          /* Buffers are registered; READ_FIXED is used */
+    uring_device_t *devices;
+    unsigned char *buffers;     /* URING_READER_REPORT_SIZE bytes per device */
+
+    /* Submission ring */
+    void *sq_map;
+    size_t sq_map_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned sq_pending;        /* Entries queued but not yet submitted */
+
+    /* Completion ring */
+    void *cq_map;
+    size_t cq_map_size;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+/**
+ * Creates a reader with its own io_uring
+ */
+uring_reader_t* uring_reader_create(int max_devices)
+{
+    struct io_uring_params params;
+    uring_reader_t *reader;
+    unsigned entries = 1;
+
+    if (max_devices <= 0)
+        return NULL;
+    while (entries < (unsigned)max_devices * ENTRIES_PER_READ)
+        entries <<= 1;
+
+    reader = (uring_reader_t*)calloc(1, sizeof(*reader));
+    if (!reader)
+        return NULL;
+    reader->ring_fd = -1;
+    reader->max_devices = max_devices;
+    reader->devices = (uring_device_t*)calloc((size_t)max_devices, sizeof(uring_device_t));
+    reader->buffers = (unsigned char*)calloc((size_t)max_devices, URING_READER_REPORT_SIZE);
+    if (!reader->devices || !reader->buffers)
+    {
+        uring_reader_destroy(reader);
+        return NULL;
+    }
+
+    /* Fails with ENOSYS on old kernels and EPERM where io_uring is disabled */
+    memset(&params, 0, sizeof(params));
+    reader->ring_fd = sys_io_uring_setup(entries, &params);
+    if (reader->ring_fd < 0)
+    {
+        uring_reader_destroy(reader);
+        return NULL;
+    }
+
+    reader->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    reader->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (reader->cq_map_size > reader->sq_map_size)
+            reader->sq_map_size = reader->cq_map_size;
+        reader->cq_map_size = 0;
+    }
+
+    reader->sq_map = mmap(NULL, reader->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          reader->ring_fd, IORING_OFF_SQ_RING);
+    if (reader->sq_map == MAP_FAILED)
+    {
+        reader->sq_map = NULL;
+        uring_reader_destroy(reader);
+        return NULL;
+    }
+    if (reader->cq_map_size)
+    {
+        reader->cq_map = mmap(NULL, reader->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              reader->ring_fd, IORING_OFF_CQ_RING);
+        if (reader->cq_map == MAP_FAILED)
+        {
+            reader->cq_map = NULL;
+            uring_reader_destroy(reader);
+            return NULL;
+        }
+    }
+    else
+    {
+        reader->cq_map = reader->sq_map;
+    }
+
+    reader->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    reader->sqes = (struct io_uring_sqe*)mmap(NULL, reader->sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, reader->ring_fd, IORING_OFF_SQES);
+    if (reader->sqes == MAP_FAILED)
+    {
+        reader->sqes = NULL;
+        uring_reader_destroy(reader);
+        return NULL;
+    }
+
+    reader->sq_head = (unsigned*)((char*)reader->sq_map + params.sq_off.head);
+    reader->sq_tail = (unsigned*)((char*)reader->sq_map + params.sq_off.tail);
+    reader->sq_mask = (unsigned*)((char*)reader->sq_map + params.sq_off.ring_mask);
+    reader->sq_array = (unsigned*)((char*)reader->sq_map + params.sq_off.array);
+    reader->cq_head = (unsigned*)((char*)reader->cq_map + params.cq_off.head);
+    reader->cq_tail = (unsigned*)((char*)reader->cq_map + params.cq_off.tail);
+    reader->cq_mask = (unsigned*)((char*)reader->cq_map + params.cq_off.ring_mask);
+    reader->cqes = (struct io_uring_cqe*)((char*)reader->cq_map + params.cq_off.cqes);
+
+    return reader;
+}
+
+/**
+ * Opens a device for non-blocking reads through the ring
+ */
+int uring_reader_add(uring_reader_t *reader, const char *path)
+{
+    int fd;
+
+    if (!reader || reader->device_count >= reader->max_devices)
+        return -1;
+
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    reader->devices[reader->device_count].fd = fd;
+    return reader->device_count++;
+}
+
+/**
+ * Claims the next submission entry; published by queue_read()
+ */
+static struct io_uring_sqe* next_sqe(uring_reader_t *reader, unsigned tail)
+{
+    unsigned index = tail & *reader->sq_mask;
+    struct io_uring_sqe *sqe = &reader->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    reader->sq_array[index] = index;
+    return sqe;
+}
+
+/**
+ * Queues a poll and the read linked behind it; submitted by the next
+ * io_uring_enter()
+ */
+static void queue_read(uring_reader_t *reader, int device)
+{
+    unsigned tail = *reader->sq_tail;
+    struct io_uring_sqe *poll = next_sqe(reader, tail);
+    struct io_uring_sqe *read = next_sqe(reader, tail + 1);
+    int fd = reader->devices[device].fd;
+
+    poll->opcode = IORING_OP_POLL_ADD;
+    poll->fd = fd;
+    poll->flags = IOSQE_IO_LINK;
+    poll->poll32_events = POLLIN;
+    poll->user_data = POLL_TAG | (unsigned long long)device;
+
+    read->opcode = reader->fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    read->fd = fd;
+    read->addr = (unsigned long long)(uintptr_t)(reader->buffers + (size_t)device * URING_READER_REPORT_SIZE);
+    read->len = URING_READER_REPORT_SIZE;
+    read->off = (unsigned long long)-1;   /* Current position; devices are not seekable */
+    read->buf_index = (unsigned short)(reader->fixed_buffers ? device : 0);
+    read->user_data = (unsigned long long)device;
+
+    __atomic_store_n(reader->sq_tail, tail + ENTRIES_PER_READ, __ATOMIC_RELEASE);
+    reader->sq_pending += ENTRIES_PER_READ;
+}
+
+/**
+ * Hands every queued read to the kernel in one call
+ */
+static int submit_pending(uring_reader_t *reader)
+{
+    while (reader->sq_pending > 0)
+    {
+        int ret = sys_io_uring_enter(reader->ring_fd, reader->sq_pending, 0, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        reader->sq_pending -= (unsigned)ret;
+    }
+    return 1;
+}
+
+/**
+ * Registers the report buffers and queues the first read on every device
+ */
+int uring_reader_start(uring_reader_t *reader)
+{
+    struct iovec *iovecs;
+
+    if (!reader || reader->device_count == 0)
+        return 0;
+
+    /* Registered buffers are mapped into the kernel once instead of per read;
+       without them (e.g. under a tight RLIMIT_MEMLOCK) plain reads still work */
+    iovecs = (struct iovec*)calloc((size_t)reader->device_count, sizeof(*iovecs));
+    if (iovecs)
+    {
+        for (int i = 0; i < reader->device_count; i++)
+        {
+            iovecs[i].iov_base = reader->buffers + (size_t)i * URING_READER_REPORT_SIZE;
+            iovecs[i].iov_len = URING_READER_REPORT_SIZE;
+        }
+        reader->fixed_buffers = sys_io_uring_register(reader->ring_fd, IORING_REGISTER_BUFFERS, iovecs,
+                                                      (unsigned)reader->device_count) == 0;
+        free(iovecs);
+    }
+
+    for (int i = 0; i < reader->device_count; i++)
+        queue_read(reader, i);
+    return submit_pending(reader);
+}
+
+/**
+ * Waits for reads to complete and harvests every completed one
+ */
+int uring_reader_wait(uring_reader_t *reader, uring_completion_t *completions, int max, int timeout_ms)
+{
+    unsigned head, tail;
+    int count = 0;
+
+    for (int i = 0; i < reader->device_count; i++)
+    {
+        if (reader->devices[i].rearm)
+        {
+            reader->devices[i].rearm = 0;
+            queue_read(reader, i);
+        }
+    }
+    if (!submit_pending(reader))
+        return -1;
+
+    /* The ring descriptor polls readable while completions are waiting */
+    head = *reader->cq_head;
+    tail = __atomic_load_n(reader->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+    {
+        struct pollfd pfd = { reader->ring_fd, POLLIN, 0 };
+        int ret = poll(&pfd, 1, timeout_ms);
+
+        if (ret < 0)
+            return errno == EINTR ? 0 : -1;
+        tail = __atomic_load_n(reader->cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    while (head != tail && count < max)
+    {
+        const struct io_uring_cqe *cqe = &reader->cqes[head & *reader->cq_mask];
+        int device = (int)(cqe->user_data & 0xffffffffu);
+
+        head++;
+        if ((cqe->user_data & POLL_TAG) || device < 0 || device >= reader->device_count)
+            continue;
+
+        /* Another reader of the device may have taken the report first */
+        if (cqe->res == -EAGAIN || cqe->res == -EINTR)
+        {
+            reader->devices[device].rearm = 1;
+            continue;
+        }
+
+        completions[count].device = device;
+        completions[count].result = cqe->res;
+        completions[count].data = reader->buffers + (size_t)device * URING_READER_REPORT_SIZE;
+        count++;
+
+        /* A failed poll cancels its read (-ECANCELED), which also counts as failed */
+        reader->devices[device].rearm = cqe->res > 0;
+    }
+    __atomic_store_n(reader->cq_head, head, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+/**
+ * Closes every device and the ring, cancelling outstanding reads
+ */
+void uring_reader_destroy(uring_reader_t *reader)
+{
+    if (!reader)
+        return;
+
+    /* Closing the ring cancels the outstanding reads */
+    if (reader->sqes)
+        munmap(reader->sqes, reader->sqes_size);
+    if (reader->cq_map && reader->cq_map != reader->sq_map)
+        munmap(reader->cq_map, reader->cq_map_size);
+    if (reader->sq_map)
+        munmap(reader->sq_map, reader->sq_map_size);
+    if (reader->ring_fd >= 0)
+        close(reader->ring_fd);
+    for (int i = 0; i < reader->device_count; i++)
+        close(reader->devices[i].fd);
+
+    free(reader->devices);
+    free(reader->buffers);
+    free(reader);
+}
+
+#else /* !PLATFORM_LINUX */
+
+/**
+ * Creates a reader with its own io_uring
+ */
+uring_reader_t* uring_reader_create(int max_devices)
+{
+    (void)max_devices;
+    return NULL;
+}
+
+/**
+ * Opens a device for non-blocking reads through the ring
+ */
+int uring_reader_add(uring_reader_t *reader, const char *path)
+{
+    (void)reader;
+    (void)path;
+    return -1;
+}
+
+/**
+ * Registers the report buffers and queues the first read on every device
+ */
+int uring_reader_start(uring_reader_t *reader)
+{
+    (void)reader;
+    return 0;
+}
+
+/**
+ * Waits for reads to complete and harvests every completed one
+ */
+int uring_reader_wait(uring_reader_t *reader, uring_completion_t *completions, int max, int timeout_ms)
+{
+    (void)reader;
+    (void)completions;
+    (void)max;
+    (void)timeout_ms;
+    return -1;
+}
+
+/**
+ * Closes every device and the ring, cancelling outstanding reads
+ */
+void uring_reader_destroy(uring_reader_t *reader)
+{
+    (void)reader;
+}
+
+#endif /* PLATFORM_LINUX */
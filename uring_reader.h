@@ -0,0 +1,81 @@
+/**
+ * uring_reader.h - io_uring input report reader
+ *
+ * Reads input reports from many hidraw devices on a single thread. One read
+ * into a buffer registered with the kernel is kept outstanding on every
+ * device, and completions are harvested in batches, so the aggregate report
+ * rate of dozens of controllers costs one thread and one syscall per batch
+ * instead of one blocked thread per controller. Linux only; everywhere else
+ * uring_reader_create() fails and callers keep their reader threads.
+ */
+
+#ifndef URING_READER_H
+#define URING_READER_H
+
+#include <stddef.h>
+
+/* Bytes read per report; matches INPUT_REPORT_MAX of report_ring.h */
+#define URING_READER_REPORT_SIZE 128
+
+/**
+ * One harvested read
+ */
+typedef struct {
+    int device;                 /* Index returned by uring_reader_add() */
+    int result;                 /* Bytes read, or a negative errno */
+    const unsigned char *data;  /* The report; valid until the next uring_reader_wait() */
+} uring_completion_t;
+
+typedef struct uring_reader uring_reader_t;
+
+/**
+ * Creates a reader with its own io_uring
+ *
+ * @param max_devices Most devices that will be added
+ * @return The reader, or NULL if io_uring is not available
+ */
+uring_reader_t* uring_reader_create(int max_devices);
+
+/**
+ * Opens a device for non-blocking reads through the ring
+ *
+ * Non-blocking descriptors let the kernel wait for readiness itself
+ * instead of parking a worker thread in every read.
+ *
+ * @param reader The reader
+ * @param path Device path, e.g. /dev/hidraw0
+ * @return Device index (0, 1, ... in the order added), or -1 on failure
+ */
+int uring_reader_add(uring_reader_t *reader, const char *path);
+
+/**
+ * Registers the report buffers and queues the first read on every device
+ *
+ * @param reader The reader
+ * @return 1 on success, 0 on failure
+ */
+int uring_reader_start(uring_reader_t *reader);
+
+/**
+ * Waits for reads to complete and harvests every completed one
+ *
+ * The reads harvested by the previous call are queued again first, in one
+ * submission. A device whose read fails or reaches end of file is reported
+ * once and not read again.
+ *
+ * @param reader The reader
+ * @param completions Receives the harvested reads
+ * @param max Capacity of completions
+ * @param timeout_ms Longest wait for the first completion
+ * @return Number of completions (0 on timeout), or -1 on error
+ */
+int uring_reader_wait(uring_reader_t *reader, uring_completion_t *completions, int max, int timeout_ms);
+
+/**
+ * Closes every device and the ring, cancelling outstanding reads
+ *
+ * @param reader The reader, or NULL
+ */
+void uring_reader_destroy(uring_reader_t *reader);
+
+#endif /* URING_READER_H */